@@ -0,0 +1,203 @@
+#define _POSIX_C_SOURCE 200112L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <float.h>
+#include "batch_eval.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#define BATCH_HAVE_X86 1
+#include <immintrin.h>
+#endif
+
+// Every stack slot is padded to a multiple of the widest vector
+#define BATCH_LANES 4
+
+typedef void (*BinaryKernel)(double *dst, const double *a, const double *b, size_t n);
+typedef void (*UnaryKernel)(double *dst, const double *a, size_t n);
+
+typedef struct {
+    BinaryKernel add, sub, mul, div, pow;
+    UnaryKernel neg, sqrt, sin, cos, tan, log10, ln;
+} BatchKernels;
+
+// Constants shared by all kernel instantiations
+#define ROUND_SHIFT 6755399441055744.0          // 1.5 * 2^52: x + shift rounds x to an integer
+#define TWO_OVER_PI 6.36619772367581382433e-01
+#define PIO2_1      1.57079632673412561417e+00  // first 33 bits of pi/2
+#define PIO2_1T     6.07710050650619224932e-11  // pi/2 - PIO2_1
+#define TRIG_LIMIT  1.0e6
+#define S1 -1.66666666666666324348e-01
+#define S2  8.33333333332248946124e-03
+#define S3 -1.98412698298579493134e-04
+#define S4  2.75573137070700676789e-06
+#define S5 -2.50507602534068634195e-08
+#define S6  1.58969099521155010221e-10
+#define C1  4.16666666666666019037e-02
+#define C2 -1.38888888888741095749e-03
+#define C3  2.48015872894767294178e-05
+#define C4 -2.75573143513906633035e-07
+#define C5  2.08757232129817482790e-09
+#define C6 -1.13596475577881948265e-11
+#define SQRT2       1.41421356237309504880
+#define LN2_HI      6.93147180369123816490e-01
+#define LN2_LO      1.90821492927058770002e-10
+#define INV_LN2     1.44269504088896338700e+00
+#define INV_LN10    4.34294481903251827651e-01
+#define EXP_LIMIT   708.0
+#define LG1 6.666666666666735130e-01
+#define LG2 3.999999999940941908e-01
+#define LG3 2.857142874366239149e-01
+#define LG4 2.222219843214978396e-01
+#define LG5 1.818357216161805012e-01
+#define LG6 1.531383769920937332e-01
+#define LG7 1.479819860511658591e-01
+
+// Scalar fallback, one double per "vector"
+#define VEC_WIDTH 1
+#define VEC_TARGET
+#define VEC(name) name##_scalar
+#define VEC_SQRT(x) ((VEC(vdouble)){ sqrt((x)[0]) })
+#include "batch_kernels.h"
+#undef VEC_WIDTH
+#undef VEC_TARGET
+#undef VEC
+#undef VEC_SQRT
+
+#ifdef BATCH_HAVE_X86
+#define VEC_WIDTH 2
+#define VEC_TARGET __attribute__((target("sse2")))
+#define VEC(name) name##_sse2
+#define VEC_SQRT(x) _mm_sqrt_pd(x)
+#include "batch_kernels.h"
+#undef VEC_WIDTH
+#undef VEC_TARGET
+#undef VEC
+#undef VEC_SQRT
+
+#define VEC_WIDTH 4
+#define VEC_TARGET __attribute__((target("avx2")))
+#define VEC(name) name##_avx2
+#define VEC_SQRT(x) _mm256_sqrt_pd(x)
+#include "batch_kernels.h"
+#undef VEC_WIDTH
+#undef VEC_TARGET
+#undef VEC
+#undef VEC_SQRT
+#endif
+
+BatchIsa batch_detect_isa() {
+    static int detected = -1;
+
+    if (detected < 0) {
+        detected = BATCH_SCALAR;
+#ifdef BATCH_HAVE_X86
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx2")) {
+            detected = BATCH_AVX2;
+        } else if (__builtin_cpu_supports("sse2")) {
+            detected = BATCH_SSE2;
+        }
+#endif
+    }
+    return (BatchIsa)detected;
+}
+
+const char* batch_isa_name(BatchIsa isa) {
+    switch (isa) {
+        case BATCH_AVX2: return "avx2";
+        case BATCH_SSE2: return "sse2";
+        default:         return "scalar";
+    }
+}
+
+static const BatchKernels* kernels_for(BatchIsa isa) {
+#ifdef BATCH_HAVE_X86
+    if (isa == BATCH_AVX2) return &kernels_avx2;
+    if (isa == BATCH_SSE2) return &kernels_sse2;
+#endif
+    (void)isa;
+    return &kernels_scalar;
+}
+
+static void fill(double *dst, double value, size_t n) {
+    for (size_t i = 0; i < n; i++) dst[i] = value;
+}
+
+int evaluate_batch_isa(const Program *program, const double *const *columns,
+                       double memory, size_t rows, double *out, BatchIsa isa) {
+    if (isa > batch_detect_isa()) {
+        isa = batch_detect_isa();
+    }
+    const BatchKernels *k = kernels_for(isa);
+
+    // One BATCH_BLOCK-sized vector per stack slot and per local
+    void *memory_block;
+    size_t slots = (size_t)program->max_stack + program->local_count;
+    size_t stack_size = slots * BATCH_BLOCK * sizeof(double);
+    if (posix_memalign(&memory_block, 32, stack_size) != 0) {
+        printf("Memory allocation failed!\n");
+        return -1;
+    }
+    double *stack = memory_block;
+    double *locals = stack + (size_t)program->max_stack * BATCH_BLOCK;
+    memset(stack, 0, stack_size);
+
+    for (size_t start = 0; start < rows; start += BATCH_BLOCK) {
+        size_t count = rows - start < BATCH_BLOCK ? rows - start : BATCH_BLOCK;
+        size_t n = (count + BATCH_LANES - 1) / BATCH_LANES * BATCH_LANES;
+        int depth = 0;
+
+        for (int pc = 0; pc < program->code_length; pc++) {
+            const Instruction *in = &program->code[pc];
+            double *top = stack + (size_t)(depth - 1) * BATCH_BLOCK;
+            double *next = top + BATCH_BLOCK;
+            double *under = top - BATCH_BLOCK;
+
+            switch (in->op) {
+                case OP_CONST:
+                    fill(next, program->constants[in->arg], n);
+                    depth++;
+                    break;
+                case OP_MEMORY:
+                    fill(next, memory, n);
+                    depth++;
+                    break;
+                case OP_VARIABLE:
+                    memcpy(next, columns[in->arg] + start, count * sizeof(double));
+                    depth++;
+                    break;
+                case OP_NEG:  k->neg(top, top, n); break;
+                case OP_SIN:  k->sin(top, top, n); break;
+                case OP_COS:  k->cos(top, top, n); break;
+                case OP_TAN:  k->tan(top, top, n); break;
+                case OP_LOG:  k->log10(top, top, n); break;
+                case OP_LN:   k->ln(top, top, n); break;
+                case OP_SQRT: k->sqrt(top, top, n); break;
+                case OP_ADD:  k->add(under, under, top, n); depth--; break;
+                case OP_SUB:  k->sub(under, under, top, n); depth--; break;
+                case OP_MUL:  k->mul(under, under, top, n); depth--; break;
+                case OP_DIV:  k->div(under, under, top, n); depth--; break;
+                case OP_POW:  k->pow(under, under, top, n); depth--; break;
+                case OP_STORE:
+                    memcpy(locals + (size_t)in->arg * BATCH_BLOCK, top, n * sizeof(double));
+                    break;
+                case OP_LOAD:
+                    memcpy(next, locals + (size_t)in->arg * BATCH_BLOCK, n * sizeof(double));
+                    depth++;
+                    break;
+            }
+        }
+
+        memcpy(out + start, stack, count * sizeof(double));
+    }
+
+    free(stack);
+    return 0;
+}
+
+int evaluate_batch(const Program *program, const double *const *columns,
+                   double memory, size_t rows, double *out) {
+    return evaluate_batch_isa(program, columns, memory, rows, out, batch_detect_isa());
+}
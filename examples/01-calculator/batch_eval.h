@@ -0,0 +1,30 @@
+#ifndef BATCH_EVAL_H
+#define BATCH_EVAL_H
+
+#include <stddef.h>
+#include "expression_parser.h"
+
+// Vectorized evaluation of one compiled program over column arrays.
+// The bytecode is interpreted once per block of rows, and each instruction
+// runs a SIMD kernel over the whole block.
+
+#define BATCH_BLOCK 256
+
+typedef enum {
+    BATCH_SCALAR,
+    BATCH_SSE2,
+    BATCH_AVX2
+} BatchIsa;
+
+BatchIsa batch_detect_isa();
+const char* batch_isa_name(BatchIsa isa);
+
+// columns[i] holds the rows for program->variable_names[i].
+// Division by zero follows IEEE rules (inf/nan) instead of stopping the batch.
+// Returns 0 on success, -1 if memory could not be allocated.
+int evaluate_batch(const Program *program, const double *const *columns,
+                   double memory, size_t rows, double *out);
+int evaluate_batch_isa(const Program *program, const double *const *columns,
+                       double memory, size_t rows, double *out, BatchIsa isa);
+
+#endif
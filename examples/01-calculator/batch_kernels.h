@@ -0,0 +1,258 @@
+// Batch kernels, instantiated once per instruction set by batch_eval.c.
+// No include guard on purpose. The including file defines:
+//   VEC_WIDTH      - doubles per vector (1, 2 or 4)
+//   VEC_TARGET     - function attribute enabling the instruction set
+//   VEC(name)      - appends the instruction set suffix to name
+//   VEC_SQRT(x)    - vector square root
+//
+// Every kernel takes arrays aligned to 32 bytes whose length n is a
+// multiple of 4. The transcendental functions use polynomial approximations
+// (fdlibm coefficients) evaluated lane by lane; lanes outside the range the
+// approximation handles are recomputed with libm. The same operations run at
+// every width, so results do not depend on the instruction set chosen.
+
+typedef double VEC(vdouble) __attribute__((vector_size(VEC_WIDTH * 8), may_alias));
+typedef long long VEC(vlong) __attribute__((vector_size(VEC_WIDTH * 8), may_alias));
+
+#define vdouble VEC(vdouble)
+#define vlong VEC(vlong)
+#define LOAD(p) (*(const vdouble *)(p))
+#define STORE(p, v) (*(vdouble *)(p) = (v))
+#define SPLAT(c) ((vdouble){0} + (c))
+
+static inline VEC_TARGET vdouble VEC(select)(vlong mask, vdouble a, vdouble b) {
+    return (vdouble)((mask & (vlong)a) | (~mask & (vlong)b));
+}
+
+static inline VEC_TARGET vdouble VEC(vabs)(vdouble x) {
+    return (vdouble)((vlong)x & 0x7fffffffffffffffLL);
+}
+
+static inline VEC_TARGET int VEC(any)(vlong mask) {
+    for (int i = 0; i < VEC_WIDTH; i++) {
+        if (mask[i]) return 1;
+    }
+    return 0;
+}
+
+// Arithmetic
+
+static VEC_TARGET void VEC(kernel_add)(double *dst, const double *a, const double *b, size_t n) {
+    for (size_t i = 0; i < n; i += VEC_WIDTH) STORE(dst + i, LOAD(a + i) + LOAD(b + i));
+}
+
+static VEC_TARGET void VEC(kernel_sub)(double *dst, const double *a, const double *b, size_t n) {
+    for (size_t i = 0; i < n; i += VEC_WIDTH) STORE(dst + i, LOAD(a + i) - LOAD(b + i));
+}
+
+static VEC_TARGET void VEC(kernel_mul)(double *dst, const double *a, const double *b, size_t n) {
+    for (size_t i = 0; i < n; i += VEC_WIDTH) STORE(dst + i, LOAD(a + i) * LOAD(b + i));
+}
+
+static VEC_TARGET void VEC(kernel_div)(double *dst, const double *a, const double *b, size_t n) {
+    for (size_t i = 0; i < n; i += VEC_WIDTH) STORE(dst + i, LOAD(a + i) / LOAD(b + i));
+}
+
+static VEC_TARGET void VEC(kernel_neg)(double *dst, const double *a, size_t n) {
+    for (size_t i = 0; i < n; i += VEC_WIDTH) STORE(dst + i, -LOAD(a + i));
+}
+
+static VEC_TARGET void VEC(kernel_sqrt)(double *dst, const double *a, size_t n) {
+    for (size_t i = 0; i < n; i += VEC_WIDTH) STORE(dst + i, VEC_SQRT(LOAD(a + i)));
+}
+
+// Trigonometry: x = q * pi/2 + r with |r| <= pi/4
+
+static inline VEC_TARGET vdouble VEC(reduce)(vdouble x, vlong *quadrant) {
+    vdouble t = x * TWO_OVER_PI + ROUND_SHIFT;
+    vdouble q = t - ROUND_SHIFT;
+    *quadrant = (vlong)t - (vlong)SPLAT(ROUND_SHIFT);
+    vdouble r = x - q * PIO2_1;
+    return r - q * PIO2_1T;
+}
+
+static inline VEC_TARGET vdouble VEC(sin_poly)(vdouble r) {
+    vdouble z = r * r;
+    vdouble p = z * S6 + S5;
+    p = p * z + S4;
+    p = p * z + S3;
+    p = p * z + S2;
+    p = p * z + S1;
+    return r + r * z * p;
+}
+
+static inline VEC_TARGET vdouble VEC(cos_poly)(vdouble r) {
+    vdouble z = r * r;
+    vdouble p = z * C6 + C5;
+    p = p * z + C4;
+    p = p * z + C3;
+    p = p * z + C2;
+    p = p * z + C1;
+    return 1.0 - 0.5 * z + z * z * p;
+}
+
+// Lanes where |x| is too large to reduce accurately (or not finite)
+static inline VEC_TARGET vlong VEC(trig_fallback)(vdouble x) {
+    return ~(VEC(vabs)(x) <= TRIG_LIMIT);
+}
+
+static VEC_TARGET void VEC(kernel_sin)(double *dst, const double *a, size_t n) {
+    for (size_t i = 0; i < n; i += VEC_WIDTH) {
+        vdouble x = LOAD(a + i);
+        vlong q;
+        vdouble r = VEC(reduce)(x, &q);
+        vdouble result = VEC(select)((q & 1) != 0, VEC(cos_poly)(r), VEC(sin_poly)(r));
+        result = (vdouble)((vlong)result ^ ((q & 2) << 62));
+
+        vlong fallback = VEC(trig_fallback)(x);
+        STORE(dst + i, result);
+        if (VEC(any)(fallback)) {
+            for (int k = 0; k < VEC_WIDTH; k++) {
+                if (fallback[k]) dst[i + k] = sin(x[k]);
+            }
+        }
+    }
+}
+
+static VEC_TARGET void VEC(kernel_cos)(double *dst, const double *a, size_t n) {
+    for (size_t i = 0; i < n; i += VEC_WIDTH) {
+        vdouble x = LOAD(a + i);
+        vlong q;
+        vdouble r = VEC(reduce)(x, &q);
+        q = q + 1;
+        vdouble result = VEC(select)((q & 1) != 0, VEC(cos_poly)(r), VEC(sin_poly)(r));
+        result = (vdouble)((vlong)result ^ ((q & 2) << 62));
+
+        vlong fallback = VEC(trig_fallback)(x);
+        STORE(dst + i, result);
+        if (VEC(any)(fallback)) {
+            for (int k = 0; k < VEC_WIDTH; k++) {
+                if (fallback[k]) dst[i + k] = cos(x[k]);
+            }
+        }
+    }
+}
+
+static VEC_TARGET void VEC(kernel_tan)(double *dst, const double *a, size_t n) {
+    for (size_t i = 0; i < n; i += VEC_WIDTH) {
+        vdouble x = LOAD(a + i);
+        vlong q;
+        vdouble r = VEC(reduce)(x, &q);
+        vdouble s = VEC(sin_poly)(r);
+        vdouble c = VEC(cos_poly)(r);
+        vdouble result = VEC(select)((q & 1) != 0, -c / s, s / c);
+
+        vlong fallback = VEC(trig_fallback)(x);
+        STORE(dst + i, result);
+        if (VEC(any)(fallback)) {
+            for (int k = 0; k < VEC_WIDTH; k++) {
+                if (fallback[k]) dst[i + k] = tan(x[k]);
+            }
+        }
+    }
+}
+
+// Logarithm: x = 2^k * m with m in [sqrt(2)/2, sqrt(2)), valid for normal x > 0
+
+static inline VEC_TARGET vdouble VEC(log_core)(vdouble x) {
+    vlong bits = (vlong)x;
+    vlong k = ((bits >> 52) & 0x7ff) - 1023;
+    vdouble m = (vdouble)((bits & 0x000fffffffffffffLL) | 0x3ff0000000000000LL);
+    vlong high = m > SQRT2;
+    m = VEC(select)(high, m * 0.5, m);
+    k = k - high;
+    vdouble kd = (vdouble)(k + (vlong)SPLAT(ROUND_SHIFT)) - ROUND_SHIFT;
+
+    vdouble f = m - 1.0;
+    vdouble s = f / (2.0 + f);
+    vdouble z = s * s;
+    vdouble w = z * z;
+    vdouble t1 = w * (LG2 + w * (LG4 + w * LG6));
+    vdouble t2 = z * (LG1 + w * (LG3 + w * (LG5 + w * LG7)));
+    vdouble hfsq = 0.5 * f * f;
+    return kd * LN2_HI - ((hfsq - (s * (hfsq + t2 + t1) + kd * LN2_LO)) - f);
+}
+
+static inline VEC_TARGET vlong VEC(log_fallback)(vdouble x) {
+    return ~((x >= DBL_MIN) & (x <= DBL_MAX));
+}
+
+static VEC_TARGET void VEC(kernel_ln)(double *dst, const double *a, size_t n) {
+    for (size_t i = 0; i < n; i += VEC_WIDTH) {
+        vdouble x = LOAD(a + i);
+        vlong fallback = VEC(log_fallback)(x);
+        STORE(dst + i, VEC(log_core)(x));
+        if (VEC(any)(fallback)) {
+            for (int k = 0; k < VEC_WIDTH; k++) {
+                if (fallback[k]) dst[i + k] = log(x[k]);
+            }
+        }
+    }
+}
+
+static VEC_TARGET void VEC(kernel_log10)(double *dst, const double *a, size_t n) {
+    for (size_t i = 0; i < n; i += VEC_WIDTH) {
+        vdouble x = LOAD(a + i);
+        vlong fallback = VEC(log_fallback)(x);
+        STORE(dst + i, VEC(log_core)(x) * INV_LN10);
+        if (VEC(any)(fallback)) {
+            for (int k = 0; k < VEC_WIDTH; k++) {
+                if (fallback[k]) dst[i + k] = log10(x[k]);
+            }
+        }
+    }
+}
+
+// Power: pow(x, y) = exp(y * ln(x)), valid for normal x > 0 and |y * ln(x)| < 708
+
+static inline VEC_TARGET vdouble VEC(exp_core)(vdouble x) {
+    vdouble t = x * INV_LN2 + ROUND_SHIFT;
+    vdouble n = t - ROUND_SHIFT;
+    vlong ni = (vlong)t - (vlong)SPLAT(ROUND_SHIFT);
+    vdouble r = x - n * LN2_HI - n * LN2_LO;
+
+    // Taylor series of exp(r) for |r| <= ln(2)/2
+    vdouble p = r * (1.0 / 6227020800.0) + 1.0 / 479001600.0;
+    p = p * r + 1.0 / 39916800.0;
+    p = p * r + 1.0 / 3628800.0;
+    p = p * r + 1.0 / 362880.0;
+    p = p * r + 1.0 / 40320.0;
+    p = p * r + 1.0 / 5040.0;
+    p = p * r + 1.0 / 720.0;
+    p = p * r + 1.0 / 120.0;
+    p = p * r + 1.0 / 24.0;
+    p = p * r + 1.0 / 6.0;
+    p = p * r + 0.5;
+    p = p * r + 1.0;
+    p = p * r + 1.0;
+
+    vdouble scale = (vdouble)((ni + 1023) << 52);
+    return p * scale;
+}
+
+static VEC_TARGET void VEC(kernel_pow)(double *dst, const double *a, const double *b, size_t n) {
+    for (size_t i = 0; i < n; i += VEC_WIDTH) {
+        vdouble x = LOAD(a + i);
+        vdouble y = LOAD(b + i);
+        vdouble t = y * VEC(log_core)(x);
+        vlong fallback = VEC(log_fallback)(x) | ~(VEC(vabs)(t) < EXP_LIMIT);
+        STORE(dst + i, VEC(exp_core)(VEC(select)(fallback, SPLAT(0.0), t)));
+        if (VEC(any)(fallback)) {
+            for (int k = 0; k < VEC_WIDTH; k++) {
+                if (fallback[k]) dst[i + k] = pow(x[k], y[k]);
+            }
+        }
+    }
+}
+
+static const BatchKernels VEC(kernels) = {
+    VEC(kernel_add), VEC(kernel_sub), VEC(kernel_mul), VEC(kernel_div), VEC(kernel_pow),
+    VEC(kernel_neg), VEC(kernel_sqrt), VEC(kernel_sin), VEC(kernel_cos), VEC(kernel_tan),
+    VEC(kernel_log10), VEC(kernel_ln)
+};
+
+#undef vdouble
+#undef vlong
+#undef LOAD
+#undef STORE
+#undef SPLAT
@@ -0,0 +1,334 @@
+#define _DEFAULT_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <pthread.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "expression_parser.h"
+#include "batch_runner.h"
+#include "result_cache.h"
+#include "jit.h"
+
+// Chunks allowed in flight per worker before workers wait for the writer
+#define CHUNKS_PER_WORKER 4
+
+typedef struct {
+    const char *start;
+    size_t length;
+    char *output;
+    size_t output_length;
+    size_t output_capacity;
+    int failed;             // out of memory: output stops short
+    int done;
+} Chunk;
+
+typedef struct {
+    Chunk *chunks;
+    int chunk_count;
+    int next_chunk;         // next chunk handed to a worker
+    int next_write;         // next chunk the writer is waiting for
+    int window;             // maximum chunks between next_write and next_chunk
+    size_t cache_budget;    // result cache bytes per worker (0: no cache)
+    pthread_mutex_t lock;
+    pthread_cond_t chunk_done;
+    pthread_cond_t slot_free;
+} BatchJob;
+
+// Input buffer: either a mapping of the file or a copy of stdin
+typedef struct {
+    char *data;
+    size_t size;
+    int mapped;
+} InputBuffer;
+
+static int load_input(const char *path, InputBuffer *input) {
+    input->data = NULL;
+    input->size = 0;
+    input->mapped = 0;
+
+    if (strcmp(path, "-") != 0) {
+        int fd = open(path, O_RDONLY);
+        if (fd < 0) return -1;
+
+        struct stat file_stat;
+        if (fstat(fd, &file_stat) == 0 && S_ISREG(file_stat.st_mode)) {
+            input->size = file_stat.st_size;
+            if (input->size == 0) {
+                close(fd);
+                return 0;
+            }
+            void *data = mmap(NULL, input->size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (data != MAP_FAILED) {
+                madvise(data, input->size, MADV_SEQUENTIAL);
+                input->data = data;
+                input->mapped = 1;
+                close(fd);
+                return 0;
+            }
+        }
+        close(fd);
+    }
+
+    // Stream the input (stdin, pipes, or files that cannot be mapped)
+    FILE *file = strcmp(path, "-") == 0 ? stdin : fopen(path, "rb");
+    if (file == NULL) return -1;
+
+    size_t capacity = 0;
+    size_t bytes_read;
+    do {
+        if (input->size == capacity) {
+            capacity = capacity ? capacity * 2 : BATCH_CHUNK_SIZE;
+            char *data = realloc(input->data, capacity);
+            if (data == NULL) {
+                if (file != stdin) fclose(file);
+                return -1;
+            }
+            input->data = data;
+        }
+        bytes_read = fread(input->data + input->size, 1, capacity - input->size, file);
+        input->size += bytes_read;
+    } while (bytes_read > 0);
+
+    if (file != stdin) fclose(file);
+    return 0;
+}
+
+static void release_input(InputBuffer *input) {
+    if (input->mapped) {
+        munmap(input->data, input->size);
+    } else {
+        free(input->data);
+    }
+}
+
+// Splits the input into chunks of about BATCH_CHUNK_SIZE bytes, each ending
+// at a line boundary
+static int split_chunks(const InputBuffer *input, Chunk **chunks) {
+    int capacity = (int)(input->size / BATCH_CHUNK_SIZE) + 1;
+    int count = 0;
+    size_t pos = 0;
+
+    *chunks = calloc(capacity, sizeof(Chunk));
+    if (*chunks == NULL) return -1;
+
+    while (pos < input->size) {
+        size_t end = pos + BATCH_CHUNK_SIZE;
+        if (end >= input->size) {
+            end = input->size;
+        } else {
+            const char *newline = memchr(input->data + end, '\n', input->size - end);
+            end = newline ? (size_t)(newline - input->data) + 1 : input->size;
+        }
+
+        if (count == capacity) {
+            capacity *= 2;
+            Chunk *grown = realloc(*chunks, capacity * sizeof(Chunk));
+            if (grown == NULL) return -1;
+            *chunks = grown;
+        }
+        memset(&(*chunks)[count], 0, sizeof(Chunk));
+        (*chunks)[count].start = input->data + pos;
+        (*chunks)[count].length = end - pos;
+        count++;
+        pos = end;
+    }
+    return count;
+}
+
+// Formats straight into the chunk's output, growing it to fit. Returns -1
+// and marks the chunk failed if it cannot grow.
+static int append_output(Chunk *chunk, const char *format, ...) {
+    va_list args;
+    va_start(args, format);
+    size_t space = chunk->output_capacity - chunk->output_length;
+    int length = vsnprintf(chunk->output ? chunk->output + chunk->output_length : NULL, space, format, args);
+    va_end(args);
+    if (length < 0) return 0;
+    if ((size_t)length < space) {
+        chunk->output_length += length;
+        return 0;
+    }
+
+    size_t capacity = chunk->output_capacity ? chunk->output_capacity * 2 : 64 * 1024;
+    while (capacity <= chunk->output_length + length) capacity *= 2;
+    char *output = realloc(chunk->output, capacity);
+    if (output == NULL) {
+        chunk->failed = 1;
+        return -1;
+    }
+    chunk->output = output;
+    chunk->output_capacity = capacity;
+
+    va_start(args, format);
+    vsnprintf(chunk->output + chunk->output_length, capacity - chunk->output_length, format, args);
+    va_end(args);
+    chunk->output_length += length;
+    return 0;
+}
+
+// Evaluates every line of a chunk into the chunk's own output buffer
+static void process_chunk(Chunk *chunk, CalcContext *context, char **line, size_t *line_capacity) {
+    const char *pos = chunk->start;
+    const char *end = chunk->start + chunk->length;
+
+    while (pos < end) {
+        const char *newline = memchr(pos, '\n', end - pos);
+        const char *line_end = newline ? newline : end;
+        size_t length = line_end - pos;
+        if (length > 0 && pos[length - 1] == '\r') length--;
+
+        if (length + 1 > *line_capacity) {
+            size_t capacity = (length + 1) * 2;
+            char *grown = realloc(*line, capacity);
+            if (grown == NULL) {
+                chunk->failed = 1;
+                return;
+            }
+            *line = grown;
+            *line_capacity = capacity;
+        }
+        memcpy(*line, pos, length);
+        (*line)[length] = '\0';
+
+        double result;
+        int status;
+        if (length == 0) {
+            status = append_output(chunk, "\n");
+        } else if (calculate(context, *line, &result) == 0) {
+            status = append_output(chunk, "%.6f\n", result);
+        } else {
+            status = append_output(chunk, "Error: %s\n", context->error);
+        }
+        if (status != 0) return;
+
+        pos = line_end + 1;
+    }
+}
+
+static void* batch_worker(void *arg) {
+    BatchJob *job = arg;
+    CalcContext context;
+    char *line = NULL;
+    size_t line_capacity = 0;
+
+    init_context(&context);
+    if (job->cache_budget > 0) {
+        context.cache = create_result_cache(job->cache_budget);
+    }
+    context.programs = create_tiered_table();
+
+    while (1) {
+        pthread_mutex_lock(&job->lock);
+        while (job->next_chunk < job->chunk_count &&
+               job->next_chunk >= job->next_write + job->window) {
+            pthread_cond_wait(&job->slot_free, &job->lock);
+        }
+        if (job->next_chunk >= job->chunk_count) {
+            pthread_mutex_unlock(&job->lock);
+            break;
+        }
+        Chunk *chunk = &job->chunks[job->next_chunk++];
+        pthread_mutex_unlock(&job->lock);
+
+        process_chunk(chunk, &context, &line, &line_capacity);
+
+        pthread_mutex_lock(&job->lock);
+        chunk->done = 1;
+        pthread_cond_broadcast(&job->chunk_done);
+        pthread_mutex_unlock(&job->lock);
+    }
+
+    free_result_cache(context.cache);
+    free_tiered_table(context.programs);
+    free(line);
+    return NULL;
+}
+
+int run_batch_file(const char *path, int threads, size_t cache_budget) {
+    InputBuffer input;
+    if (load_input(path, &input) != 0) {
+        fprintf(stderr, "Error: Cannot read file '%s'\n", path);
+        return 1;
+    }
+
+    BatchJob job;
+    job.chunk_count = split_chunks(&input, &job.chunks);
+    if (job.chunk_count < 0) {
+        fprintf(stderr, "Memory allocation failed!\n");
+        free(job.chunks);
+        release_input(&input);
+        return 1;
+    }
+
+    if (threads <= 0) {
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        threads = cpus > 0 ? (int)cpus : 1;
+    }
+    job.next_chunk = 0;
+    job.next_write = 0;
+    job.window = threads * CHUNKS_PER_WORKER;
+    job.cache_budget = cache_budget / threads;
+    pthread_mutex_init(&job.lock, NULL);
+    pthread_cond_init(&job.chunk_done, NULL);
+    pthread_cond_init(&job.slot_free, NULL);
+
+    pthread_t *workers = malloc(threads * sizeof(pthread_t));
+    int started = 0;
+    if (workers != NULL) {
+        while (started < threads &&
+               pthread_create(&workers[started], NULL, batch_worker, &job) == 0) {
+            started++;
+        }
+    }
+    if (started == 0) {
+        // No threads available: evaluate everything on this thread
+        job.window = job.chunk_count;
+        batch_worker(&job);
+    }
+
+    // Reordering writer: emit chunks strictly in input order
+    int status = 0;
+    static char output_buffer[1 << 20];
+    setvbuf(stdout, output_buffer, _IOFBF, sizeof(output_buffer));
+
+    for (int i = 0; i < job.chunk_count; i++) {
+        Chunk *chunk = &job.chunks[i];
+
+        pthread_mutex_lock(&job.lock);
+        while (!chunk->done) {
+            pthread_cond_wait(&job.chunk_done, &job.lock);
+        }
+        pthread_mutex_unlock(&job.lock);
+
+        fwrite(chunk->output, 1, chunk->output_length, stdout);
+        if (chunk->failed && status == 0) {
+            fflush(stdout);
+            fprintf(stderr, "Memory allocation failed!\n");
+            status = 1;
+        }
+        free(chunk->output);
+        chunk->output = NULL;
+
+        pthread_mutex_lock(&job.lock);
+        job.next_write = i + 1;
+        pthread_cond_broadcast(&job.slot_free);
+        pthread_mutex_unlock(&job.lock);
+    }
+    fflush(stdout);
+
+    for (int i = 0; i < started; i++) {
+        pthread_join(workers[i], NULL);
+    }
+
+    free(workers);
+    pthread_mutex_destroy(&job.lock);
+    pthread_cond_destroy(&job.chunk_done);
+    pthread_cond_destroy(&job.slot_free);
+    free(job.chunks);
+    release_input(&input);
+    return status;
+}
@@ -0,0 +1,18 @@
+#ifndef BATCH_RUNNER_H
+#define BATCH_RUNNER_H
+
+// Non-interactive evaluation of a file with one expression per line.
+// The file is memory-mapped ("-" streams stdin instead), split into chunks
+// at line boundaries and evaluated by a pool of worker threads, each with
+// its own CalcContext. Results are written to stdout in input order.
+
+#include <stddef.h>
+
+#define BATCH_CHUNK_SIZE (256 * 1024)
+
+// threads <= 0 uses one thread per online CPU. cache_budget bytes of
+// result cache are split between the workers (0 disables caching).
+// Returns 0 on success, 1 if the input could not be read or memory ran out.
+int run_batch_file(const char *path, int threads, size_t cache_budget);
+
+#endif
@@ -0,0 +1,96 @@
+#define _POSIX_C_SOURCE 199309L
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <time.h>
+#include "expression_parser.h"
+#include "batch_eval.h"
+
+// Compares row-by-row bytecode evaluation with the batch kernels for every
+// instruction set available, and reports the largest relative difference.
+
+#define ROWS 1000000
+
+static const char *formulas[] = {
+    "sqrt(x*x + y*y)",
+    "x * 1.5 - y / 3 + 2",
+    "sin(x) * cos(y) + tan(x / 4)",
+    "ln(y + 1) + log(x + 2)",
+    "pow(y + 1, 2.5) - pow(x + 3, 0.5)"
+};
+
+static double now_seconds() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+int main() {
+    int formula_count = sizeof(formulas) / sizeof(formulas[0]);
+    double *x = malloc(ROWS * sizeof(double));
+    double *y = malloc(ROWS * sizeof(double));
+    double *expected = malloc(ROWS * sizeof(double));
+    double *actual = malloc(ROWS * sizeof(double));
+    if (x == NULL || y == NULL || expected == NULL || actual == NULL) {
+        printf("Memory allocation failed!\n");
+        return 1;
+    }
+
+    srand(42);
+    for (int i = 0; i < ROWS; i++) {
+        x[i] = (rand() / (double)RAND_MAX) * 200.0 - 100.0;
+        y[i] = (rand() / (double)RAND_MAX) * 50.0;
+    }
+
+    printf("Batch evaluation over %d rows (detected: %s)\n", ROWS, batch_isa_name(batch_detect_isa()));
+    printf("%-36s %-8s %12s %12s\n", "Expression", "Mode", "Rows/s", "Max rel err");
+
+    for (int f = 0; f < formula_count; f++) {
+        Program *program = compile_expression(formulas[f], NULL);
+        if (program == NULL) {
+            printf("Error: Cannot compile '%s'\n", formulas[f]);
+            return 1;
+        }
+
+        // Columns in the order the compiler assigned variable slots
+        const double *columns[2];
+        for (int v = 0; v < program->variable_count; v++) {
+            columns[v] = program->variable_names[v][0] == 'x' ? x : y;
+        }
+
+        double variables[2];
+        EvalEnv env = { 0.0, variables, EVAL_OK };
+        double start = now_seconds();
+        for (int i = 0; i < ROWS; i++) {
+            for (int v = 0; v < program->variable_count; v++) {
+                variables[v] = columns[v][i];
+            }
+            expected[i] = evaluate_program(program, &env);
+        }
+        double row_time = now_seconds() - start;
+        printf("%-36s %-8s %12.0f %12s\n", formulas[f], "row", ROWS / row_time, "-");
+
+        for (int isa = BATCH_SCALAR; isa <= (int)batch_detect_isa(); isa++) {
+            start = now_seconds();
+            evaluate_batch_isa(program, columns, 0.0, ROWS, actual, (BatchIsa)isa);
+            double batch_time = now_seconds() - start;
+
+            double max_error = 0.0;
+            for (int i = 0; i < ROWS; i++) {
+                double scale = fabs(expected[i]) > 1.0 ? fabs(expected[i]) : 1.0;
+                double error = fabs(actual[i] - expected[i]) / scale;
+                if (error > max_error) max_error = error;
+            }
+            printf("%-36s %-8s %12.0f %12.2e\n", "", batch_isa_name((BatchIsa)isa),
+                   ROWS / batch_time, max_error);
+        }
+
+        free_program(program);
+    }
+
+    free(x);
+    free(y);
+    free(expected);
+    free(actual);
+    return 0;
+}
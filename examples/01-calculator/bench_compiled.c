@@ -0,0 +1,77 @@
+#define _POSIX_C_SOURCE 199309L
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include "expression_parser.h"
+#include "jit.h"
+
+// Compares re-parsing every evaluation against compiling once and
+// evaluating the bytecode (or tiered bytecode + JIT) many times with
+// different MR values.
+
+#define ITERATIONS 1000000
+
+static const char *formulas[] = {
+    "2 + 3 * 4",
+    "sqrt(16) + pow(2, 3)",
+    "sin(pi/2) * MR + cos(MR / 3)",
+    "(MR * 1.05 - 12.5) / (1 + ln(MR + 1))",
+    "pow(MR, 2) + 3 * MR - log(MR + 10) + tan(0.25)",
+    "sin(MR) * sin(MR) + cos(MR) * cos(MR) + sin(MR) / cos(MR)"
+};
+
+static double now_seconds() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+int main() {
+    int formula_count = sizeof(formulas) / sizeof(formulas[0]);
+
+    printf("Re-parse vs compiled evaluation (%d iterations each)\n", ITERATIONS);
+    printf("%-58s %12s %12s %12s %8s\n", "Expression", "Re-parse/s", "Compiled/s", "Tiered/s", "Speedup");
+
+    for (int f = 0; f < formula_count; f++) {
+        EvalEnv env = { 0.0, NULL, EVAL_OK };
+        volatile double sink = 0.0;
+
+        double start = now_seconds();
+        for (int i = 0; i < ITERATIONS; i++) {
+            env.memory = i * 0.001;
+            sink += evaluate_expression(formulas[f], &env);
+        }
+        double reparse_time = now_seconds() - start;
+
+        Program *program = compile_expression(formulas[f], NULL);
+        if (program == NULL) {
+            printf("Error: Cannot compile '%s'\n", formulas[f]);
+            return 1;
+        }
+
+        start = now_seconds();
+        for (int i = 0; i < ITERATIONS; i++) {
+            env.memory = i * 0.001;
+            sink += evaluate_program(program, &env);
+        }
+        double compiled_time = now_seconds() - start;
+
+        TieredProgram tiered;
+        init_tiered(&tiered, program, JIT_DEFAULT_THRESHOLD);
+        start = now_seconds();
+        for (int i = 0; i < ITERATIONS; i++) {
+            env.memory = i * 0.001;
+            sink += evaluate_tiered(&tiered, &env);
+        }
+        double tiered_time = now_seconds() - start;
+        free_tiered(&tiered);
+        free_program(program);
+
+        printf("%-58s %12.0f %12.0f %12.0f %7.1fx\n", formulas[f],
+               ITERATIONS / reparse_time, ITERATIONS / compiled_time,
+               ITERATIONS / tiered_time, reparse_time / tiered_time);
+        (void)sink;
+    }
+
+    return 0;
+}
@@ -0,0 +1,155 @@
+#define _POSIX_C_SOURCE 199309L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <math.h>
+#include <float.h>
+#include "expression_parser.h"
+#include "derivative.h"
+
+// Gradients three ways: central finite differences (2n + 1 evaluations
+// of the program), forward mode (one pass of evaluate_gradient) and
+// symbolic (the value program plus one diff() program per variable).
+// Errors are relative to the symbolic derivatives.
+
+#define POINTS 1000
+#define ROUNDS 200
+#define MAX_VARIABLES 3
+
+static const char *formulas[] = {
+    "pow(1 - x, 2) + 100 * pow(y - x * x, 2)",
+    "x * sin(y) + pow(x, 2) / sqrt(y) - ln(x * y)",
+    "sin(x) * cos(y) * 0.5 + pow(z, 3) / (1 + x * x + y * y)",
+    "(x * y + y * z + z * x) / sqrt(x * x + y * y + z * z) + tan(z / 10)",
+};
+
+static unsigned int random_state = 12345;
+
+static double next_random() {
+    random_state = random_state * 1103515245u + 12345u;
+    return (random_state >> 8) / 16777216.0;
+}
+
+static double now_seconds() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static double relative_error(double actual, double expected) {
+    return fabs(actual - expected) / fmax(1.0, fabs(expected));
+}
+
+static void finite_differences(const Program *program, double *variables, double *gradient) {
+    EvalEnv env = { 0.0, variables, EVAL_OK };
+    for (int v = 0; v < program->variable_count; v++) {
+        double x = variables[v];
+        double h = cbrt(DBL_EPSILON) * fmax(1.0, fabs(x));
+        variables[v] = x + h;
+        double above = evaluate_program(program, &env);
+        variables[v] = x - h;
+        double below = evaluate_program(program, &env);
+        variables[v] = x;
+        gradient[v] = (above - below) / (2 * h);
+    }
+}
+
+int main() {
+    printf("Gradient throughput, %d points x %d rounds per formula\n", POINTS, ROUNDS);
+    printf("%-7s %4s %14s %14s %14s %12s %12s\n", "Formula", "Vars", "FD grad/s", "Forward grad/s",
+           "Symbolic g/s", "FD error", "AD error");
+
+    for (size_t f = 0; f < sizeof(formulas) / sizeof(formulas[0]); f++) {
+        Program *program = compile_expression(formulas[f], NULL);
+        if (program == NULL) {
+            printf("Error: Cannot compile '%s'\n", formulas[f]);
+            return 1;
+        }
+        int count = program->variable_count;
+        Program *derivatives[MAX_VARIABLES];
+        double (*points)[MAX_VARIABLES] = malloc(POINTS * sizeof(*points));
+        if (points == NULL) {
+            printf("Memory allocation failed!\n");
+            return 1;
+        }
+
+        // Derivative programs read their variables from the same slots
+        int slots[MAX_VARIABLES][MAX_VARIABLES];
+        for (int v = 0; v < count; v++) {
+            char text[512];
+            snprintf(text, sizeof(text), "diff(%s, %s)", formulas[f], program->variable_names[v]);
+            derivatives[v] = compile_expression(text, NULL);
+            if (derivatives[v] == NULL) {
+                printf("Error: Cannot compile '%s'\n", text);
+                return 1;
+            }
+            for (int i = 0; i < derivatives[v]->variable_count; i++) {
+                slots[v][i] = program_variable_index(program, derivatives[v]->variable_names[i]);
+            }
+        }
+        for (int p = 0; p < POINTS; p++) {
+            for (int v = 0; v < count; v++) points[p][v] = 0.5 + 2.0 * next_random();
+        }
+
+        double gradient[MAX_VARIABLES], expected[MAX_VARIABLES], values[MAX_VARIABLES];
+        double fd_error = 0, ad_error = 0;
+        volatile double sink = 0.0;
+        for (int p = 0; p < POINTS; p++) {
+            EvalEnv env = { 0.0, points[p], EVAL_OK };
+            for (int v = 0; v < count; v++) {
+                for (int i = 0; i < derivatives[v]->variable_count; i++) values[i] = points[p][slots[v][i]];
+                EvalEnv derivative_env = { 0.0, values, EVAL_OK };
+                expected[v] = evaluate_program(derivatives[v], &derivative_env);
+            }
+            finite_differences(program, points[p], gradient);
+            for (int v = 0; v < count; v++) fd_error = fmax(fd_error, relative_error(gradient[v], expected[v]));
+            evaluate_gradient(program, &env, gradient);
+            for (int v = 0; v < count; v++) ad_error = fmax(ad_error, relative_error(gradient[v], expected[v]));
+        }
+
+        double start = now_seconds();
+        for (int r = 0; r < ROUNDS; r++) {
+            for (int p = 0; p < POINTS; p++) {
+                EvalEnv env = { 0.0, points[p], EVAL_OK };
+                sink += evaluate_program(program, &env);
+                finite_differences(program, points[p], gradient);
+                sink += gradient[0];
+            }
+        }
+        double fd_rate = (double)ROUNDS * POINTS / (now_seconds() - start);
+
+        start = now_seconds();
+        for (int r = 0; r < ROUNDS; r++) {
+            for (int p = 0; p < POINTS; p++) {
+                EvalEnv env = { 0.0, points[p], EVAL_OK };
+                sink += evaluate_gradient(program, &env, gradient);
+                sink += gradient[0];
+            }
+        }
+        double ad_rate = (double)ROUNDS * POINTS / (now_seconds() - start);
+
+        start = now_seconds();
+        for (int r = 0; r < ROUNDS; r++) {
+            for (int p = 0; p < POINTS; p++) {
+                EvalEnv env = { 0.0, points[p], EVAL_OK };
+                sink += evaluate_program(program, &env);
+                for (int v = 0; v < count; v++) {
+                    for (int i = 0; i < derivatives[v]->variable_count; i++) values[i] = points[p][slots[v][i]];
+                    EvalEnv derivative_env = { 0.0, values, EVAL_OK };
+                    sink += evaluate_program(derivatives[v], &derivative_env);
+                }
+            }
+        }
+        double symbolic_rate = (double)ROUNDS * POINTS / (now_seconds() - start);
+
+        printf("%-7zu %4d %14.0f %14.0f %14.0f %12.2e %12.2e\n", f + 1, count, fd_rate, ad_rate,
+               symbolic_rate, fd_error, ad_error);
+        (void)sink;
+
+        for (int v = 0; v < count; v++) free_program(derivatives[v]);
+        free(points);
+        free_program(program);
+    }
+    return 0;
+}
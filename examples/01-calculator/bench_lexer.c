@@ -0,0 +1,115 @@
+#define _POSIX_C_SOURCE 199309L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "lexer.h"
+
+// Parses 100M numeric literals with scan_number and with strtod, per kind
+// of literal, and runs the whole tokenizer over the same text.
+
+#define LITERALS 1000000
+#define PASSES 100
+#define MAX_LITERAL 32
+
+typedef struct {
+    const char *name;
+    char *text;                 // literals separated by spaces
+    const char **starts;
+} Corpus;
+
+static double now_seconds() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static double random_double() {
+    return (double)rand() / RAND_MAX * (rand() % 2 ? 1e6 : 1.0);
+}
+
+static void generate(char *buffer, int kind) {
+    switch (kind) {
+        case 0: snprintf(buffer, MAX_LITERAL, "%d", rand() % 100000); break;
+        case 1: snprintf(buffer, MAX_LITERAL, "%d.%02d", rand() % 10000, rand() % 100); break;
+        case 2: snprintf(buffer, MAX_LITERAL, "%.17g", random_double()); break;
+        case 3: snprintf(buffer, MAX_LITERAL, "%.6e", random_double() * 1e-9); break;
+        default: snprintf(buffer, MAX_LITERAL, "%.16e", random_double() * 1e200); break;
+    }
+}
+
+static const char *kind_names[] = {
+    "integers (42817)", "money (1234.56)", "17 digits", "exponent (1.5e-9)", "long exponent"
+};
+
+#define KINDS ((int)(sizeof(kind_names) / sizeof(kind_names[0])))
+
+static int build_corpus(Corpus *corpus, int kind) {
+    corpus->name = kind_names[kind];
+    corpus->text = malloc((size_t)LITERALS * MAX_LITERAL + 1);
+    corpus->starts = malloc(LITERALS * sizeof(char *));
+    if (corpus->text == NULL || corpus->starts == NULL) {
+        printf("Memory allocation failed!\n");
+        return 0;
+    }
+
+    char *write = corpus->text;
+    for (int i = 0; i < LITERALS; i++) {
+        corpus->starts[i] = write;
+        generate(write, kind);
+        write += strlen(write);
+        *write++ = ' ';
+    }
+    *write = '\0';
+    return 1;
+}
+
+int main() {
+    srand(42);
+    printf("Number literal parsing (%d literals per row)\n", LITERALS * PASSES);
+    printf("%-20s %14s %14s %14s %8s\n", "Literals", "scan_number", "strtod", "next_token", "Speedup");
+    printf("%-20s %14s %14s %14s\n", "", "ns/literal", "ns/literal", "ns/token");
+
+    for (int kind = 0; kind < KINDS; kind++) {
+        Corpus corpus;
+        if (!build_corpus(&corpus, kind)) return 1;
+
+        volatile double sink = 0.0;
+        double start = now_seconds();
+        for (int pass = 0; pass < PASSES; pass++) {
+            for (int i = 0; i < LITERALS; i++) {
+                double value;
+                scan_number(corpus.starts[i], &value);
+                sink += value;
+            }
+        }
+        double lexer_time = now_seconds() - start;
+
+        start = now_seconds();
+        for (int pass = 0; pass < PASSES; pass++) {
+            for (int i = 0; i < LITERALS; i++) {
+                sink += strtod(corpus.starts[i], NULL);
+            }
+        }
+        double strtod_time = now_seconds() - start;
+
+        start = now_seconds();
+        for (int pass = 0; pass < PASSES; pass++) {
+            Lexer lexer;
+            init_lexer(&lexer, corpus.text);
+            for (Token token = next_token(&lexer); token.type != TOKEN_END; token = next_token(&lexer)) {
+                sink += token.value;
+            }
+        }
+        double token_time = now_seconds() - start;
+        (void)sink;
+
+        double count = (double)LITERALS * PASSES;
+        printf("%-20s %14.2f %14.2f %14.2f %7.1fx\n", corpus.name, lexer_time * 1e9 / count,
+               strtod_time * 1e9 / count, token_time * 1e9 / count, strtod_time / lexer_time);
+
+        free(corpus.text);
+        free(corpus.starts);
+    }
+    return 0;
+}
@@ -0,0 +1,106 @@
+#define _POSIX_C_SOURCE 199309L
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include "expression_parser.h"
+#include "numeric.h"
+
+// Compares the double, fixed-point and big-decimal backends on the same
+// parsed expression trees, with the compiled bytecode as a reference.
+
+#define ITERATIONS 200000
+
+static const char *corpus[] = {
+    "19.99 * 3 + 4.50",
+    "(1250.00 - 100) / 12",
+    "0.1 + 0.2 + 0.3 + 0.4",
+    "pow(1.05, 10) * 1000",
+    "1234.5678 * 8765.4321 - 99.99",
+    "sqrt(2) * 100",
+    "(MR * 1.07 - 12.5) / 3",
+    "2 + 3 * 4 - 5 / 8"
+};
+
+#define CORPUS_SIZE ((int)(sizeof(corpus) / sizeof(corpus[0])))
+
+static double now_seconds() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+int main() {
+    Node *trees[CORPUS_SIZE];
+    Program *programs[CORPUS_SIZE];
+
+    for (int i = 0; i < CORPUS_SIZE; i++) {
+        Parser parser;
+        init_parser(&parser, corpus[i]);
+        trees[i] = parse_formula(&parser);
+        programs[i] = compile_expression(corpus[i], NULL);
+        if (trees[i] == NULL || programs[i] == NULL) {
+            printf("Error: Cannot parse '%s'\n", corpus[i]);
+            return 1;
+        }
+    }
+
+    printf("Results (MR = 42.5)\n");
+    printf("%-32s %-22s %-16s %s\n", "Expression", "double", "fixed", "decimal");
+    for (int i = 0; i < CORPUS_SIZE; i++) {
+        printf("%-32s", corpus[i]);
+        for (int mode = NUMERIC_DOUBLE; mode <= NUMERIC_DECIMAL; mode++) {
+            const NumericBackend *backend = numeric_backend(mode);
+            NumValue value;
+            if (evaluate_numeric(backend, trees[i], 42.5, &value) != EVAL_OK) {
+                printf(" %-21s", "error");
+                continue;
+            }
+            char *text = backend->format(&value);
+            printf(mode == NUMERIC_DECIMAL ? " %s" : mode == NUMERIC_FIXED ? " %-16s" : " %-22s",
+                   text ? text : "?");
+            free(text);
+            backend->release(&value);
+        }
+        printf("\n");
+    }
+
+    printf("\nThroughput over the corpus (%d passes)\n", ITERATIONS);
+    printf("%-20s %14s %10s\n", "Backend", "Evaluations/s", "ns/eval");
+
+    volatile double sink = 0.0;
+    double start = now_seconds();
+    for (int n = 0; n < ITERATIONS; n++) {
+        for (int i = 0; i < CORPUS_SIZE; i++) {
+            EvalEnv env = { 42.5, NULL, EVAL_OK };
+            sink += evaluate_program(programs[i], &env);
+        }
+    }
+    double elapsed = now_seconds() - start;
+    double evaluations = (double)ITERATIONS * CORPUS_SIZE;
+    printf("%-20s %14.0f %10.1f\n", "bytecode (double)", evaluations / elapsed, elapsed * 1e9 / evaluations);
+
+    for (int mode = NUMERIC_DOUBLE; mode <= NUMERIC_DECIMAL; mode++) {
+        const NumericBackend *backend = numeric_backend(mode);
+        int passes = mode == NUMERIC_DECIMAL ? ITERATIONS / 10 : ITERATIONS;
+
+        start = now_seconds();
+        for (int n = 0; n < passes; n++) {
+            for (int i = 0; i < CORPUS_SIZE; i++) {
+                NumValue value;
+                if (evaluate_numeric(backend, trees[i], 42.5, &value) == EVAL_OK) {
+                    backend->release(&value);
+                }
+            }
+        }
+        elapsed = now_seconds() - start;
+        evaluations = (double)passes * CORPUS_SIZE;
+        printf("%-20s %14.0f %10.1f\n", backend->name, evaluations / elapsed, elapsed * 1e9 / evaluations);
+    }
+    (void)sink;
+
+    for (int i = 0; i < CORPUS_SIZE; i++) {
+        free_node(trees[i]);
+        free_program(programs[i]);
+    }
+    return 0;
+}
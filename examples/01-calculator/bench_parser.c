@@ -0,0 +1,147 @@
+#define _POSIX_C_SOURCE 199309L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "expression_parser.h"
+
+// Parser and compiler throughput over three corpora: short everyday
+// expressions, deeply nested ones and function-heavy ones. Each corpus is
+// run once to warm up, then REPETITIONS times; the table shows the median
+// and the 10th / 90th percentile of expressions per second over those runs.
+
+#define CORPUS_SIZE 2000
+#define REPETITIONS 21
+#define MAX_TEXT 2048
+
+typedef struct {
+    const char *name;
+    char (*texts)[MAX_TEXT];
+    size_t bytes;
+} Corpus;
+
+static unsigned int random_state = 12345;
+
+static unsigned int next_random() {
+    random_state = random_state * 1103515245u + 12345u;
+    return random_state >> 8;
+}
+
+static double now_seconds() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void build_short(char *text, int i) {
+    static const char *templates[] = {
+        "%d + %d * %d", "(%d + %d) / %d", "%d.5 - %d * 0.%d", "%de3 / (%d + %d)",
+        "x * %d + y / %d - %d", "MR + %d * (%d - %d)"
+    };
+    snprintf(text, MAX_TEXT, templates[i % 6], next_random() % 1000, next_random() % 100 + 1,
+             next_random() % 100 + 1);
+}
+
+// Right-leaning chains that nest 60 to 200 levels deep
+static void build_deep(char *text, int i) {
+    static const char operators[] = "+-*/";
+    int depth = 60 + i % 141;
+    size_t length = 0;
+    for (int d = 0; d < depth; d++) {
+        length += snprintf(text + length, MAX_TEXT - length, "%u%c(", next_random() % 10 + 1, operators[d % 4]);
+    }
+    length += snprintf(text + length, MAX_TEXT - length, "x");
+    memset(text + length, ')', depth);
+    text[length + depth] = '\0';
+}
+
+static void build_function(char *text, size_t size, int depth) {
+    static const char *functions[] = { "sin", "cos", "tan", "log", "ln", "sqrt" };
+    if (depth == 0) {
+        snprintf(text, size, next_random() % 2 ? "x" : "%u.25", next_random() % 50 + 1);
+        return;
+    }
+    char left[MAX_TEXT / 2], right[MAX_TEXT / 4];
+    build_function(left, sizeof(left), depth - 1);
+    build_function(right, sizeof(right), depth - 1);
+    switch (next_random() % 3) {
+        case 0: snprintf(text, size, "%s(%s)", functions[next_random() % 6], left); break;
+        case 1: snprintf(text, size, "pow(%s, %s)", left, right); break;
+        default: snprintf(text, size, "%s(%s) + %s(%s)", functions[next_random() % 6], left,
+                          functions[next_random() % 6], right); break;
+    }
+}
+
+static int compare_doubles(const void *a, const void *b) {
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+// One pass over the corpus; returns expressions per second
+static double run_pass(const Corpus *corpus, int compile) {
+    double start = now_seconds();
+    for (int i = 0; i < CORPUS_SIZE; i++) {
+        if (compile) {
+            Program *program = compile_expression(corpus->texts[i], NULL);
+            if (program == NULL) {
+                printf("Error: Cannot compile '%.60s'\n", corpus->texts[i]);
+                exit(1);
+            }
+            free_program(program);
+        } else {
+            Parser parser;
+            init_parser(&parser, corpus->texts[i]);
+            Node *root = parse_formula(&parser);
+            if (root == NULL) {
+                printf("Error: Cannot parse '%.60s': %s\n", corpus->texts[i], parser.error.message);
+                exit(1);
+            }
+            free_node(root);
+        }
+    }
+    return CORPUS_SIZE / (now_seconds() - start);
+}
+
+int main() {
+    Corpus corpora[3] = { { "short", NULL, 0 }, { "deep", NULL, 0 }, { "functions", NULL, 0 } };
+    for (int c = 0; c < 3; c++) {
+        corpora[c].texts = malloc(CORPUS_SIZE * sizeof(*corpora[c].texts));
+        if (corpora[c].texts == NULL) {
+            printf("Memory allocation failed!\n");
+            return 1;
+        }
+        for (int i = 0; i < CORPUS_SIZE; i++) {
+            char *text = corpora[c].texts[i];
+            if (c == 0) build_short(text, i);
+            else if (c == 1) build_deep(text, i);
+            else build_function(text, MAX_TEXT, 3 + i % 3);
+            corpora[c].bytes += strlen(text);
+        }
+    }
+
+    printf("Parser throughput, %d expressions per corpus, median of %d runs\n", CORPUS_SIZE, REPETITIONS);
+    printf("%-10s %-8s %8s %12s %12s %12s %9s\n", "Corpus", "Stage", "Avg len", "p10 expr/s",
+           "Median", "p90 expr/s", "MB/s");
+
+    for (int c = 0; c < 3; c++) {
+        for (int compile = 0; compile < 2; compile++) {
+            double rates[REPETITIONS];
+            run_pass(&corpora[c], compile);
+            for (int r = 0; r < REPETITIONS; r++) {
+                rates[r] = run_pass(&corpora[c], compile);
+            }
+            qsort(rates, REPETITIONS, sizeof(double), compare_doubles);
+
+            double average_length = (double)corpora[c].bytes / CORPUS_SIZE;
+            double median = rates[REPETITIONS / 2];
+            printf("%-10s %-8s %8.0f %12.0f %12.0f %12.0f %9.1f\n", corpora[c].name,
+                   compile ? "compile" : "parse", average_length, rates[REPETITIONS / 10], median,
+                   rates[REPETITIONS - 1 - REPETITIONS / 10], median * average_length / 1e6);
+        }
+    }
+
+    for (int c = 0; c < 3; c++) {
+        free(corpora[c].texts);
+    }
+    return 0;
+}
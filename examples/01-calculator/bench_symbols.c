@@ -0,0 +1,125 @@
+#define _POSIX_C_SOURCE 199309L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "expression_parser.h"
+#include "symbols.h"
+
+// Name lookup and parsing cost as the number of user symbols grows: the
+// built-in perfect hash and the open-addressing table should stay flat,
+// unlike a linear scan over the same names.
+
+#define LOOKUPS 2000000
+#define PARSES 200000
+#define LINEAR_LOOKUPS 2000
+#define NAME_LENGTH 16
+
+static const char *formula = "sin(v1) + f(v2, 3) * pi - sqrt(v3) / MR + ln(e)";
+
+static double now_seconds() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static Node* parse_text(const char *text) {
+    Parser parser;
+    init_parser(&parser, text);
+    return parse_formula(&parser);
+}
+
+int main() {
+    static const char *builtin_names[] = { "sin", "cos", "tan", "log", "ln", "sqrt", "pow", "MR", "pi", "e" };
+    static const int sizes[] = { 10, 100, 1000, 10000, 100000, 1000000 };
+
+    printf("Symbol lookup and parse cost (ns per operation)\n");
+    printf("%10s %10s %10s %10s %10s %12s\n", "Symbols", "Built-in", "User hit", "User miss", "Parse", "Linear scan");
+
+    for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+        int count = sizes[s];
+        SymbolTable *table = create_symbol_table();
+        char (*names)[NAME_LENGTH] = malloc((size_t)count * NAME_LENGTH);
+        char (*missing)[NAME_LENGTH] = malloc((size_t)count * NAME_LENGTH);
+        if (table == NULL || names == NULL || missing == NULL) {
+            printf("Memory allocation failed!\n");
+            return 1;
+        }
+
+        for (int i = 0; i < count; i++) {
+            snprintf(names[i], NAME_LENGTH, "v%d", i);
+            snprintf(missing[i], NAME_LENGTH, "w%d", i);
+            set_variable(table, names[i], i);
+        }
+        Node *body = parse_text("a * a + b");
+        char **parameters = malloc(2 * sizeof(char *));
+        parameters[0] = malloc(2);
+        parameters[1] = malloc(2);
+        strcpy(parameters[0], "a");
+        strcpy(parameters[1], "b");
+        set_function(table, "f", parameters, 2, body);
+
+        volatile long found = 0;
+        double start = now_seconds();
+        for (int i = 0; i < LOOKUPS; i++) {
+            const char *name = builtin_names[i % 10];
+            found += find_builtin(name, (int)strlen(name)) != NULL;
+        }
+        double builtin_time = (now_seconds() - start) * 1e9 / LOOKUPS;
+
+        srand(7);
+        start = now_seconds();
+        for (int i = 0; i < LOOKUPS; i++) {
+            const char *name = names[rand() % count];
+            found += find_symbol(table, name, (int)strlen(name)) != NULL;
+        }
+        double hit_time = (now_seconds() - start) * 1e9 / LOOKUPS;
+
+        start = now_seconds();
+        for (int i = 0; i < LOOKUPS; i++) {
+            const char *name = missing[rand() % count];
+            found += find_symbol(table, name, (int)strlen(name)) != NULL;
+        }
+        double miss_time = (now_seconds() - start) * 1e9 / LOOKUPS;
+
+        CalcContext context;
+        init_context(&context);
+        context.memory = 2.0;
+        context.symbols = table;
+        start = now_seconds();
+        for (int i = 0; i < PARSES; i++) {
+            Parser parser;
+            init_parser(&parser, formula);
+            parser.symbols = table;
+            free_node(parse_formula(&parser));
+        }
+        double parse_time = (now_seconds() - start) * 1e9 / PARSES;
+
+        // What every lookup would cost with a list of names instead
+        start = now_seconds();
+        for (int i = 0; i < LINEAR_LOOKUPS; i++) {
+            const char *name = names[rand() % count];
+            for (int j = 0; j < count; j++) {
+                if (strcmp(names[j], name) == 0) {
+                    found++;
+                    break;
+                }
+            }
+        }
+        double linear_time = (now_seconds() - start) * 1e9 / LINEAR_LOOKUPS;
+
+        double check;
+        if (calculate(&context, formula, &check) != 0) {
+            printf("Error: %s\n", context.error);
+            return 1;
+        }
+
+        printf("%10d %10.1f %10.1f %10.1f %10.1f %12.1f\n", count, builtin_time, hit_time,
+               miss_time, parse_time, linear_time);
+        (void)found;
+        free_symbol_table(table);
+        free(names);
+        free(missing);
+    }
+    return 0;
+}
@@ -0,0 +1,597 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <limits.h>
+#include <math.h>
+#include "big_decimal.h"
+
+#define LIMB_BASE 4294967296ULL
+#define MAX_EXPONENT 100000
+
+static const unsigned int powers_of_ten[10] = {
+    1u, 10u, 100u, 1000u, 10000u, 100000u, 1000000u, 10000000u, 100000000u, 1000000000u
+};
+
+static BigDecimal* alloc_decimal(int capacity) {
+    if (capacity < 1) capacity = 1;
+    BigDecimal *d = malloc(sizeof(BigDecimal) + capacity * sizeof(unsigned int));
+    if (d == NULL) return NULL;
+    d->sign = 1;
+    d->scale = 0;
+    d->length = 0;
+    d->capacity = capacity;
+    memset(d->limbs, 0, capacity * sizeof(unsigned int));
+    return d;
+}
+
+static void trim(BigDecimal *d) {
+    while (d->length > 0 && d->limbs[d->length - 1] == 0) d->length--;
+    if (d->length == 0) d->sign = 1;
+}
+
+// Copy of a with room for extra more limbs
+static BigDecimal* copy_decimal(const BigDecimal *a, int extra) {
+    BigDecimal *r = alloc_decimal(a->length + extra);
+    if (r == NULL) return NULL;
+    memcpy(r->limbs, a->limbs, a->length * sizeof(unsigned int));
+    r->length = a->length;
+    r->sign = a->sign;
+    r->scale = a->scale;
+    return r;
+}
+
+// magnitude = magnitude * factor + add; needs one spare limb
+static void multiply_small(BigDecimal *d, unsigned int factor, unsigned int add) {
+    unsigned long long carry = add;
+    for (int i = 0; i < d->length; i++) {
+        carry += (unsigned long long)d->limbs[i] * factor;
+        d->limbs[i] = (unsigned int)carry;
+        carry >>= 32;
+    }
+    if (carry) d->limbs[d->length++] = (unsigned int)carry;
+}
+
+// magnitude = magnitude / divisor; returns the remainder
+static unsigned int divide_small(BigDecimal *d, unsigned int divisor) {
+    unsigned long long remainder = 0;
+    for (int i = d->length - 1; i >= 0; i--) {
+        unsigned long long current = (remainder << 32) | d->limbs[i];
+        d->limbs[i] = (unsigned int)(current / divisor);
+        remainder = current % divisor;
+    }
+    trim(d);
+    return (unsigned int)remainder;
+}
+
+static unsigned int remainder_small(const BigDecimal *d, unsigned int divisor) {
+    unsigned long long remainder = 0;
+    for (int i = d->length - 1; i >= 0; i--) {
+        remainder = ((remainder << 32) | d->limbs[i]) % divisor;
+    }
+    return (unsigned int)remainder;
+}
+
+// Copy of a with places more decimal places (the same value)
+static BigDecimal* shift_decimal(const BigDecimal *a, int places) {
+    BigDecimal *r = copy_decimal(a, places / 9 + 1);
+    if (r == NULL) return NULL;
+    r->scale += places;
+    while (places > 0) {
+        int step = places > 9 ? 9 : places;
+        multiply_small(r, powers_of_ten[step], 0);
+        places -= step;
+    }
+    return r;
+}
+
+// Drops decimal places down to scale, rounding half away from zero
+static void round_to_scale(BigDecimal *d, int scale) {
+    int sign = d->sign;
+    unsigned int dropped = 0;
+    while (d->scale > scale) {
+        dropped = divide_small(d, 10);
+        d->scale--;
+    }
+    if (dropped >= 5) {
+        // The value shrank at least tenfold, so the carry always fits
+        multiply_small(d, 1, 1);
+        d->sign = sign;
+    }
+}
+
+static void strip_trailing_zeros(BigDecimal *d) {
+    while (d->scale > 0 && d->length > 0 && remainder_small(d, 10) == 0) {
+        divide_small(d, 10);
+        d->scale--;
+    }
+    if (d->length == 0) d->scale = 0;
+}
+
+static int compare_magnitude(const BigDecimal *a, const BigDecimal *b) {
+    if (a->length != b->length) return a->length < b->length ? -1 : 1;
+    for (int i = a->length - 1; i >= 0; i--) {
+        if (a->limbs[i] != b->limbs[i]) return a->limbs[i] < b->limbs[i] ? -1 : 1;
+    }
+    return 0;
+}
+
+// r = |a| + |b|; r needs max(length) + 1 limbs
+static void add_magnitudes(BigDecimal *r, const BigDecimal *a, const BigDecimal *b) {
+    int length = a->length > b->length ? a->length : b->length;
+    unsigned long long carry = 0;
+    for (int i = 0; i < length; i++) {
+        carry += (unsigned long long)(i < a->length ? a->limbs[i] : 0) +
+                 (i < b->length ? b->limbs[i] : 0);
+        r->limbs[i] = (unsigned int)carry;
+        carry >>= 32;
+    }
+    r->limbs[length] = (unsigned int)carry;
+    r->length = length + 1;
+}
+
+// r = |a| - |b| with |a| >= |b|
+static void subtract_magnitudes(BigDecimal *r, const BigDecimal *a, const BigDecimal *b) {
+    long long borrow = 0;
+    for (int i = 0; i < a->length; i++) {
+        long long difference = (long long)a->limbs[i] - (i < b->length ? b->limbs[i] : 0) - borrow;
+        borrow = difference < 0;
+        r->limbs[i] = (unsigned int)(difference + (borrow ? (long long)LIMB_BASE : 0));
+    }
+    r->length = a->length;
+}
+
+// Long division of magnitudes (Knuth, algorithm D). quotient needs
+// u->length - v->length + 1 limbs, remainder (optional) v->length limbs.
+static int divide_magnitudes(const BigDecimal *u, const BigDecimal *v,
+                             BigDecimal *quotient, BigDecimal *remainder) {
+    int m = u->length;
+    int n = v->length;
+    quotient->length = 0;
+
+    if (m < n) {
+        if (remainder != NULL) {
+            memcpy(remainder->limbs, u->limbs, m * sizeof(unsigned int));
+            remainder->length = m;
+        }
+        return 0;
+    }
+    if (n == 1) {
+        unsigned long long rest = 0;
+        for (int j = m - 1; j >= 0; j--) {
+            unsigned long long current = (rest << 32) | u->limbs[j];
+            quotient->limbs[j] = (unsigned int)(current / v->limbs[0]);
+            rest = current % v->limbs[0];
+        }
+        quotient->length = m;
+        trim(quotient);
+        if (remainder != NULL) {
+            remainder->limbs[0] = (unsigned int)rest;
+            remainder->length = 1;
+            trim(remainder);
+        }
+        return 0;
+    }
+
+    unsigned int *un = malloc((m + 1) * sizeof(unsigned int));
+    unsigned int *vn = malloc(n * sizeof(unsigned int));
+    if (un == NULL || vn == NULL) {
+        free(un);
+        free(vn);
+        return -1;
+    }
+
+    // Normalize so the divisor's top limb has its high bit set
+    int s = __builtin_clz(v->limbs[n - 1]);
+    for (int i = n - 1; i > 0; i--) {
+        vn[i] = (v->limbs[i] << s) | (unsigned int)((unsigned long long)v->limbs[i - 1] >> (32 - s));
+    }
+    vn[0] = v->limbs[0] << s;
+    un[m] = (unsigned int)((unsigned long long)u->limbs[m - 1] >> (32 - s));
+    for (int i = m - 1; i > 0; i--) {
+        un[i] = (u->limbs[i] << s) | (unsigned int)((unsigned long long)u->limbs[i - 1] >> (32 - s));
+    }
+    un[0] = u->limbs[0] << s;
+
+    for (int j = m - n; j >= 0; j--) {
+        // Estimate the quotient limb from the top two limbs, then correct it
+        unsigned long long numerator = ((unsigned long long)un[j + n] << 32) | un[j + n - 1];
+        unsigned long long qhat = numerator / vn[n - 1];
+        unsigned long long rhat = numerator % vn[n - 1];
+        while (qhat >= LIMB_BASE || qhat * vn[n - 2] > ((rhat << 32) | un[j + n - 2])) {
+            qhat--;
+            rhat += vn[n - 1];
+            if (rhat >= LIMB_BASE) break;
+        }
+
+        long long borrow = 0;
+        long long t;
+        for (int i = 0; i < n; i++) {
+            unsigned long long product = qhat * vn[i];
+            t = (long long)un[i + j] - borrow - (long long)(product & 0xffffffffULL);
+            un[i + j] = (unsigned int)t;
+            borrow = (long long)(product >> 32) - (t >> 32);
+        }
+        t = (long long)un[j + n] - borrow;
+        un[j + n] = (unsigned int)t;
+
+        quotient->limbs[j] = (unsigned int)qhat;
+        if (t < 0) {
+            // Estimate was one too large: add the divisor back
+            quotient->limbs[j]--;
+            unsigned long long carry = 0;
+            for (int i = 0; i < n; i++) {
+                unsigned long long sum = (unsigned long long)un[i + j] + vn[i] + carry;
+                un[i + j] = (unsigned int)sum;
+                carry = sum >> 32;
+            }
+            un[j + n] += (unsigned int)carry;
+        }
+    }
+    quotient->length = m - n + 1;
+    trim(quotient);
+
+    if (remainder != NULL) {
+        for (int i = 0; i < n - 1; i++) {
+            remainder->limbs[i] = (un[i] >> s) | (unsigned int)((unsigned long long)un[i + 1] << (32 - s));
+        }
+        remainder->limbs[n - 1] = un[n - 1] >> s;
+        remainder->length = n;
+        trim(remainder);
+    }
+    free(un);
+    free(vn);
+    return 0;
+}
+
+// Parses [+-]digits[.digits][e[+-]digits]
+BigDecimal* decimal_parse(const char *text) {
+    const char *p = text;
+    int sign = 1;
+    if (*p == '+' || *p == '-') {
+        if (*p == '-') sign = -1;
+        p++;
+    }
+
+    int digits = 0;
+    for (const char *q = p; *q; q++) {
+        if (isdigit((unsigned char)*q)) digits++;
+    }
+    BigDecimal *d = alloc_decimal(digits / 9 + 2);
+    if (d == NULL) return NULL;
+
+    unsigned int chunk = 0;
+    int chunk_digits = 0;
+    int seen_digit = 0;
+    int seen_point = 0;
+    for (; *p; p++) {
+        if (isdigit((unsigned char)*p)) {
+            chunk = chunk * 10 + (*p - '0');
+            seen_digit = 1;
+            if (seen_point) d->scale++;
+            if (++chunk_digits == 9) {
+                multiply_small(d, powers_of_ten[9], chunk);
+                chunk = 0;
+                chunk_digits = 0;
+            }
+        } else if (*p == '.' && !seen_point) {
+            seen_point = 1;
+        } else {
+            break;
+        }
+    }
+    if (chunk_digits > 0) multiply_small(d, powers_of_ten[chunk_digits], chunk);
+
+    long exponent = 0;
+    if (seen_digit && (*p == 'e' || *p == 'E')) {
+        char *end;
+        exponent = strtol(p + 1, &end, 10);
+        if (end != p + 1) p = end;
+    }
+    if (!seen_digit || *p != '\0' || exponent > MAX_EXPONENT || exponent < -MAX_EXPONENT) {
+        decimal_free(d);
+        return NULL;
+    }
+
+    d->sign = sign;
+    trim(d);
+    long scale = d->scale - exponent;
+    if (scale < 0) {
+        BigDecimal *shifted = shift_decimal(d, (int)-scale);
+        decimal_free(d);
+        if (shifted == NULL) return NULL;
+        shifted->scale = 0;
+        return shifted;
+    }
+    d->scale = (int)scale;
+    return d;
+}
+
+// Uses the shortest decimal that converts back to the same double, so
+// 0.1 becomes exactly 0.1 rather than its binary expansion
+BigDecimal* decimal_from_double(double value) {
+    if (!isfinite(value)) return NULL;
+
+    char buffer[40];
+    for (int precision = 15; precision <= 17; precision++) {
+        snprintf(buffer, sizeof(buffer), "%.*g", precision, value);
+        if (strtod(buffer, NULL) == value) break;
+    }
+    return decimal_parse(buffer);
+}
+
+static BigDecimal* add_signed(const BigDecimal *a, const BigDecimal *b, int b_sign) {
+    int scale = a->scale > b->scale ? a->scale : b->scale;
+    BigDecimal *x = shift_decimal(a, scale - a->scale);
+    BigDecimal *y = shift_decimal(b, scale - b->scale);
+    BigDecimal *r = NULL;
+
+    if (x != NULL && y != NULL) {
+        r = alloc_decimal((x->length > y->length ? x->length : y->length) + 1);
+    }
+    if (r != NULL) {
+        r->scale = scale;
+        if (x->sign == b_sign) {
+            add_magnitudes(r, x, y);
+            r->sign = x->sign;
+        } else if (compare_magnitude(x, y) >= 0) {
+            subtract_magnitudes(r, x, y);
+            r->sign = x->sign;
+        } else {
+            subtract_magnitudes(r, y, x);
+            r->sign = b_sign;
+        }
+        trim(r);
+    }
+    decimal_free(x);
+    decimal_free(y);
+    return r;
+}
+
+BigDecimal* decimal_add(const BigDecimal *a, const BigDecimal *b) {
+    return add_signed(a, b, b->sign);
+}
+
+BigDecimal* decimal_sub(const BigDecimal *a, const BigDecimal *b) {
+    return add_signed(a, b, -b->sign);
+}
+
+BigDecimal* decimal_mul(const BigDecimal *a, const BigDecimal *b) {
+    BigDecimal *r = alloc_decimal(a->length + b->length);
+    if (r == NULL) return NULL;
+
+    for (int i = 0; i < a->length; i++) {
+        unsigned long long carry = 0;
+        for (int j = 0; j < b->length; j++) {
+            carry += (unsigned long long)a->limbs[i] * b->limbs[j] + r->limbs[i + j];
+            r->limbs[i + j] = (unsigned int)carry;
+            carry >>= 32;
+        }
+        r->limbs[i + b->length] = (unsigned int)carry;
+    }
+    r->length = a->length + b->length;
+    r->scale = a->scale + b->scale;
+    r->sign = a->sign * b->sign;
+    trim(r);
+    return r;
+}
+
+// Returns a / b rounded to scale decimal places (NULL if b is zero)
+BigDecimal* decimal_div(const BigDecimal *a, const BigDecimal *b, int scale) {
+    if (decimal_is_zero(b)) return NULL;
+
+    // Compute one extra digit for rounding: a * 10^exponent / b
+    int exponent = scale + 1 + b->scale - a->scale;
+    BigDecimal *numerator = shift_decimal(a, exponent > 0 ? exponent : 0);
+    BigDecimal *denominator = shift_decimal(b, exponent < 0 ? -exponent : 0);
+    BigDecimal *quotient = NULL;
+
+    if (numerator != NULL && denominator != NULL) {
+        quotient = alloc_decimal(numerator->length - denominator->length + 2);
+    }
+    if (quotient != NULL && divide_magnitudes(numerator, denominator, quotient, NULL) != 0) {
+        decimal_free(quotient);
+        quotient = NULL;
+    }
+    decimal_free(numerator);
+    decimal_free(denominator);
+    if (quotient == NULL) return NULL;
+
+    quotient->sign = a->sign * b->sign;
+    quotient->scale = scale + 1;
+    round_to_scale(quotient, scale);
+    trim(quotient);
+    strip_trailing_zeros(quotient);
+    return quotient;
+}
+
+// floor(sqrt(n)) of a magnitude, by Newton's iteration from above
+static BigDecimal* integer_sqrt(const BigDecimal *n) {
+    if (n->length == 0) return alloc_decimal(1);
+
+    int bits = (n->length - 1) * 32 + (32 - __builtin_clz(n->limbs[n->length - 1]));
+    int start = (bits + 1) / 2;
+    BigDecimal *x = alloc_decimal(n->length / 2 + 2);
+    if (x == NULL) return NULL;
+    x->limbs[start / 32] = 1u << (start % 32);
+    x->length = start / 32 + 1;
+
+    while (1) {
+        BigDecimal *quotient = alloc_decimal(n->length - x->length + 1);
+        BigDecimal *sum = NULL;
+        if (quotient != NULL && divide_magnitudes(n, x, quotient, NULL) == 0) {
+            sum = alloc_decimal((x->length > quotient->length ? x->length : quotient->length) + 1);
+        }
+        if (sum == NULL) {
+            decimal_free(quotient);
+            decimal_free(x);
+            return NULL;
+        }
+        add_magnitudes(sum, x, quotient);
+        decimal_free(quotient);
+        trim(sum);
+        divide_small(sum, 2);
+
+        if (compare_magnitude(sum, x) >= 0) {
+            decimal_free(sum);
+            return x;
+        }
+        decimal_free(x);
+        x = sum;
+    }
+}
+
+// Returns sqrt(a) rounded to scale decimal places (NULL if a < 0)
+BigDecimal* decimal_sqrt(const BigDecimal *a, int scale) {
+    if (a->sign < 0 && a->length > 0) return NULL;
+
+    // sqrt(m / 10^s) = sqrt(m * 10^(2k - s)) / 10^k
+    int places = scale + 1;
+    if (2 * places < a->scale) places = (a->scale + 1) / 2;
+    BigDecimal *widened = shift_decimal(a, 2 * places - a->scale);
+    if (widened == NULL) return NULL;
+
+    BigDecimal *root = integer_sqrt(widened);
+    decimal_free(widened);
+    if (root == NULL) return NULL;
+
+    root->scale = places;
+    round_to_scale(root, scale);
+    trim(root);
+    strip_trailing_zeros(root);
+    return root;
+}
+
+// Exact for non-negative exponents; negative ones divide to scale places
+BigDecimal* decimal_pow_int(const BigDecimal *a, long exponent, int scale) {
+    unsigned long remaining = exponent < 0 ? -(unsigned long)exponent : (unsigned long)exponent;
+    BigDecimal *result = decimal_parse("1");
+    BigDecimal *base = copy_decimal(a, 0);
+
+    while (remaining > 0 && result != NULL && base != NULL) {
+        if (remaining & 1) {
+            BigDecimal *product = decimal_mul(result, base);
+            decimal_free(result);
+            result = product;
+        }
+        remaining >>= 1;
+        if (remaining > 0) {
+            BigDecimal *square = decimal_mul(base, base);
+            decimal_free(base);
+            base = square;
+        }
+    }
+    decimal_free(base);
+
+    if (exponent < 0 && result != NULL) {
+        BigDecimal *one = decimal_parse("1");
+        BigDecimal *inverse = one ? decimal_div(one, result, scale) : NULL;
+        decimal_free(one);
+        decimal_free(result);
+        result = inverse;
+    }
+    return result;
+}
+
+BigDecimal* decimal_negate(const BigDecimal *a) {
+    BigDecimal *r = copy_decimal(a, 0);
+    if (r != NULL && r->length > 0) r->sign = -r->sign;
+    return r;
+}
+
+int decimal_is_zero(const BigDecimal *a) {
+    return a->length == 0;
+}
+
+// Returns 1 and stores the value if a is an integer that fits in a long
+int decimal_to_long(const BigDecimal *a, long *value) {
+    BigDecimal *copy = copy_decimal(a, 0);
+    if (copy == NULL) return 0;
+    strip_trailing_zeros(copy);
+
+    int fits = copy->scale == 0 && copy->length <= 2;
+    unsigned long long magnitude = 0;
+    if (fits) {
+        for (int i = copy->length - 1; i >= 0; i--) {
+            magnitude = (magnitude << 32) | copy->limbs[i];
+        }
+        fits = magnitude <= (unsigned long long)LONG_MAX;
+    }
+    if (fits) *value = copy->sign * (long)magnitude;
+    decimal_free(copy);
+    return fits;
+}
+
+double decimal_to_double(const BigDecimal *a) {
+    char *text = decimal_format(a);
+    if (text == NULL) return NAN;
+    double value = strtod(text, NULL);
+    free(text);
+    return value;
+}
+
+// Formats a as plain decimal text without trailing zeros; caller frees
+char* decimal_format(const BigDecimal *a) {
+    BigDecimal *copy = copy_decimal(a, 0);
+    int chunk_capacity = a->length * 10 / 9 + 2;
+    unsigned int *chunks = malloc(chunk_capacity * sizeof(unsigned int));
+    char *digits = malloc(chunk_capacity * 9 + 1);
+    if (copy == NULL || chunks == NULL || digits == NULL) {
+        decimal_free(copy);
+        free(chunks);
+        free(digits);
+        return NULL;
+    }
+
+    // Peel off nine decimal digits at a time, least significant first
+    int chunk_count = 0;
+    do {
+        chunks[chunk_count++] = divide_small(copy, powers_of_ten[9]);
+    } while (copy->length > 0);
+    decimal_free(copy);
+
+    int length = sprintf(digits, "%u", chunks[chunk_count - 1]);
+    for (int i = chunk_count - 2; i >= 0; i--) {
+        length += sprintf(digits + length, "%09u", chunks[i]);
+    }
+    free(chunks);
+
+    int scale = a->scale;
+    char *text = malloc(length + scale + 4);
+    if (text == NULL) {
+        free(digits);
+        return NULL;
+    }
+
+    char *out = text;
+    if (a->sign < 0 && a->length > 0) *out++ = '-';
+    if (length <= scale) {
+        // Pure fraction: 0.000ddd
+        *out++ = '0';
+        *out++ = '.';
+        memset(out, '0', scale - length);
+        out += scale - length;
+        memcpy(out, digits, length);
+        out += length;
+    } else {
+        memcpy(out, digits, length - scale);
+        out += length - scale;
+        if (scale > 0) {
+            *out++ = '.';
+            memcpy(out, digits + length - scale, scale);
+            out += scale;
+        }
+    }
+    free(digits);
+
+    if (scale > 0) {
+        while (out[-1] == '0') out--;
+        if (out[-1] == '.') out--;
+    }
+    *out = '\0';
+    return text;
+}
+
+void decimal_free(BigDecimal *a) {
+    free(a);
+}
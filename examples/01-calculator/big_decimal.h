@@ -0,0 +1,33 @@
+#ifndef BIG_DECIMAL_H
+#define BIG_DECIMAL_H
+
+// Arbitrary-precision decimal numbers: a binary magnitude of 32-bit limbs
+// and a decimal scale, value = sign * magnitude / 10^scale. Addition,
+// subtraction and multiplication are exact; division and square roots are
+// rounded (half away from zero) to a requested number of decimal places.
+// Every operation returns a new number (NULL if out of memory).
+
+typedef struct {
+    int sign;               // 1 or -1; zero is always positive
+    int scale;              // decimal places, >= 0
+    int length;             // limbs in use, 0 for zero
+    int capacity;
+    unsigned int limbs[];   // magnitude, least significant limb first
+} BigDecimal;
+
+BigDecimal* decimal_parse(const char *text);
+BigDecimal* decimal_from_double(double value);
+BigDecimal* decimal_add(const BigDecimal *a, const BigDecimal *b);
+BigDecimal* decimal_sub(const BigDecimal *a, const BigDecimal *b);
+BigDecimal* decimal_mul(const BigDecimal *a, const BigDecimal *b);
+BigDecimal* decimal_div(const BigDecimal *a, const BigDecimal *b, int scale);
+BigDecimal* decimal_sqrt(const BigDecimal *a, int scale);
+BigDecimal* decimal_pow_int(const BigDecimal *a, long exponent, int scale);
+BigDecimal* decimal_negate(const BigDecimal *a);
+int decimal_is_zero(const BigDecimal *a);
+int decimal_to_long(const BigDecimal *a, long *value);
+double decimal_to_double(const BigDecimal *a);
+char* decimal_format(const BigDecimal *a);
+void decimal_free(BigDecimal *a);
+
+#endif
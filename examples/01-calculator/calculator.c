@@ -1,292 +1,393 @@
+#define _POSIX_C_SOURCE 200809L
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <math.h>
-#include <ctype.h>
+#include "expression_parser.h"
+#include "derivative.h"
+#include "batch_eval.h"
+#include "batch_runner.h"
+#include "history.h"
+#include "history_log.h"
+#include "result_cache.h"
+#include "numeric.h"
+#include "symbols.h"
+#include "server.h"
+#include "profile.h"
 
-#ifndef M_PI
-#define M_PI 3.14159265358979323846
-#endif
+#define MAX_EXPRESSION 1000
+#define VECTOR_CHUNK_ROWS 65536
+#define MAX_COLUMNS 64
 
-#ifndef M_E
-#define M_E 2.71828182845904523536
-#endif
+void show_memory(CalcContext *context) {
+    printf("Memory: %.6f\n", context->memory);
+}
 
-#define MAX_EXPRESSION 1000
-#define MAX_HISTORY 100
-
-typedef struct HistoryEntry {
-    char expression[MAX_EXPRESSION];
-    double result;
-    struct HistoryEntry *next;
-} HistoryEntry;
-
-typedef struct {
-    HistoryEntry *head;
-    int count;
-} HistoryManager;
-
-HistoryManager* create_history_manager() {
-    HistoryManager *manager = malloc(sizeof(HistoryManager));
-    manager->head = NULL;
-    manager->count = 0;
-    return manager;
+void memory_clear(CalcContext *context) {
+    context->memory = 0.0;
+    printf("Memory cleared.\n");
 }
 
-void add_to_history(HistoryManager *manager, const char *expression, double result) {
-    HistoryEntry *entry = malloc(sizeof(HistoryEntry));
-    strcpy(entry->expression, expression);
-    entry->result = result;
-    entry->next = manager->head;
-    manager->head = entry;
-    
-    manager->count++;
-    if (manager->count > MAX_HISTORY) {
-        // Remove oldest entry
-        HistoryEntry *current = manager->head;
-        while (current->next->next != NULL) {
-            current = current->next;
-        }
-        free(current->next);
-        current->next = NULL;
-        manager->count--;
-    }
+void memory_add(CalcContext *context, double value) {
+    context->memory += value;
+    printf("Memory: %.6f\n", context->memory);
 }
 
-void show_history(HistoryManager *manager) {
-    if (manager->count == 0) {
-        printf("No history available.\n");
-        return;
-    }
-    
-    printf("\nCalculation History:\n");
-    printf("%-3s %-30s %-15s\n", "#", "Expression", "Result");
-    printf("%-3s %-30s %-15s\n", "---", "----------", "------");
-    
-    HistoryEntry *current = manager->head;
-    int index = 1;
-    while (current != NULL) {
-        printf("%-3d %-30s %-15.6f\n", index, current->expression, current->result);
-        current = current->next;
-        index++;
-    }
+void memory_subtract(CalcContext *context, double value) {
+    context->memory -= value;
+    printf("Memory: %.6f\n", context->memory);
+}
+
+void memory_recall(CalcContext *context) {
+    printf("Memory recall: %.6f\n", context->memory);
+}
+
+void show_help() {
+    printf("\nCalculator Help:\n");
+    printf("===============\n");
+    printf("Basic operations: +, -, *, /\n");
+    printf("Scientific functions: sin(), cos(), tan(), log(), ln(), sqrt(), pow()\n");
+    printf("Constants: pi, e\n");
+    printf("Numbers: 42, 1.5, .5, 1e-9, 2.5E+3, 0xFF\n");
+    printf("Memory operations: MR (memory recall)\n");
+    printf("Definitions: let NAME = EXPR, def NAME(A, B) = EXPR\n");
+    printf("Commands:\n");
+    printf("  help          - Show this help\n");
+    printf("  history       - Show calculation history\n");
+    printf("  history search PREFIX - Show past expressions starting with PREFIX\n");
+    printf("  export [FILE] - Write the saved history as CSV (default: stdout)\n");
+    printf("  stats         - Show result cache hit/miss counters\n");
+    printf("  clear         - Clear screen\n");
+    printf("  memory        - Show memory value\n");
+    printf("  memory_clear  - Clear memory\n");
+    printf("  explain EXPR  - Show how an expression was optimized\n");
+    printf("  diff(EXPR, x) - Show the derivative of EXPR with respect to x\n");
+    printf("  profile [reset] - Show (or clear) evaluator counters (make PROFILE=1)\n");
+    printf("  quit          - Exit calculator\n");
+    printf("\nExamples:\n");
+    printf("  2 + 3 * 4\n");
+    printf("  sqrt(16) + pow(2, 3)\n");
+    printf("  sin(pi/2)\n");
+    printf("  let rate = 0.05\n");
+    printf("  def interest(p, years) = p * pow(1 + rate, years) - p\n");
+    printf("  (10 + 5) / 3\n");
+    printf("  diff(x * sin(x), x)\n");
     printf("\n");
 }
 
-double memory_value = 0.0;
+static const char *profile_json_path;
 
-void show_memory() {
-    printf("Memory: %.6f\n", memory_value);
+static void write_profile_at_exit() {
+    profile_write_json(profile_json_path);
 }
 
-void memory_clear() {
-    memory_value = 0.0;
-    printf("Memory cleared.\n");
+void explain_expression(const char *expression) {
+    ParseError error;
+    Program *program = compile_expression(expression, &error);
+    if (program == NULL) {
+        printf("Error: %s\n", error.position >= 0 ? error.message : "Invalid expression");
+        return;
+    }
+
+    printf("Tree nodes:    %d\n", program->stats.tree_nodes);
+    printf("DAG nodes:     %d\n", program->stats.dag_nodes);
+    printf("Folded:        %d\n", program->stats.folded_nodes);
+    printf("Shared:        %d\n", program->stats.shared_nodes);
+    printf("Instructions:  %d\n", program->code_length);
+    printf("Constants:     %d\n", program->constant_count);
+    printf("Locals:        %d\n", program->local_count);
+    free_program(program);
 }
 
-void memory_add(double value) {
-    memory_value += value;
-    printf("Memory: %.6f\n", memory_value);
+// True for a diff(...) call with nothing around it; inside a larger
+// expression diff evaluates to a number like any function
+static int is_derivative_call(const char *text) {
+    text += strspn(text, " \t");
+    if (strncmp(text, "diff", 4) != 0) return 0;
+    text += 4 + strspn(text + 4, " \t");
+    if (*text != '(') return 0;
+
+    int open = 0;
+    for (; *text; text++) {
+        if (*text == '(') open++;
+        if (*text == ')' && --open == 0) break;
+    }
+    return *text == ')' && text[1 + strspn(text + 1, " \t")] == '\0';
 }
 
-void memory_subtract(double value) {
-    memory_value -= value;
-    printf("Memory: %.6f\n", memory_value);
+void show_derivative(CalcContext *context, const char *expression) {
+    Parser parser;
+    init_parser(&parser, expression);
+    parser.symbols = context->symbols;
+    Node *root = parse_formula(&parser);
+    if (root == NULL) {
+        printf("Error: %s\n", parser.error.position >= 0 ? parser.error.message : "Invalid expression");
+        return;
+    }
+    char *text = format_node(root);
+    if (text == NULL) {
+        printf("Memory allocation failed!\n");
+    } else {
+        printf("%s\n", text);
+        free(text);
+    }
+    free_node(root);
 }
 
-void memory_recall() {
-    printf("Memory recall: %.6f\n", memory_value);
+void clear_screen() {
+    system("clear");  // Unix/Linux
+    // system("cls");  // Windows
 }
 
-// Simple expression evaluator using recursive descent
-double parse_expression(const char **expr);
-double parse_term(const char **expr);
-double parse_factor(const char **expr);
+// Vector mode: evaluate one expression over every row of a column file.
+// The first line names the columns; fields are separated by commas or spaces.
 
-double parse_factor(const char **expr) {
-    while (isspace(**expr)) (*expr)++;
-    
-    if (**expr == '(') {
-        (*expr)++; // skip '('
-        double result = parse_expression(expr);
-        if (**expr == ')') {
-            (*expr)++; // skip ')'
-        }
-        return result;
-    }
-    
-    if (strncmp(*expr, "sin(", 4) == 0) {
-        *expr += 4;
-        double result = parse_expression(expr);
-        if (**expr == ')') (*expr)++;
-        return sin(result);
+static int split_fields(char *line, char **fields, int max_fields) {
+    int count = 0;
+    char *token = strtok(line, " ,\t\r\n");
+    while (token != NULL && count < max_fields) {
+        fields[count++] = token;
+        token = strtok(NULL, " ,\t\r\n");
     }
-    
-    if (strncmp(*expr, "cos(", 4) == 0) {
-        *expr += 4;
-        double result = parse_expression(expr);
-        if (**expr == ')') (*expr)++;
-        return cos(result);
+    return count;
+}
+
+static void write_results(const double *results, size_t rows) {
+    for (size_t i = 0; i < rows; i++) {
+        printf("%.6f\n", results[i]);
     }
-    
-    if (strncmp(*expr, "tan(", 4) == 0) {
-        *expr += 4;
-        double result = parse_expression(expr);
-        if (**expr == ')') (*expr)++;
-        return tan(result);
+}
+
+int run_vector_mode(const char *expression, const char *path) {
+    Program *program = compile_expression(expression, NULL);
+    if (program == NULL) {
+        fprintf(stderr, "Error: Invalid expression\n");
+        return 1;
     }
-    
-    if (strncmp(*expr, "log(", 4) == 0) {
-        *expr += 4;
-        double result = parse_expression(expr);
-        if (**expr == ')') (*expr)++;
-        return log10(result);
+
+    FILE *input = path ? fopen(path, "r") : stdin;
+    if (input == NULL) {
+        fprintf(stderr, "Error: Cannot open file '%s'\n", path);
+        free_program(program);
+        return 1;
     }
-    
-    if (strncmp(*expr, "ln(", 3) == 0) {
-        *expr += 3;
-        double result = parse_expression(expr);
-        if (**expr == ')') (*expr)++;
-        return log(result);
+
+    char *line = NULL;
+    size_t line_capacity = 0;
+    char *fields[MAX_COLUMNS];
+    int column_of[MAX_COLUMNS];
+    double *columns[MAX_COLUMNS];
+    double *results = malloc(VECTOR_CHUNK_ROWS * sizeof(double));
+    int status = 1;
+    int variable_count = program->variable_count;
+    int loaded = 0;
+
+    if (variable_count > MAX_COLUMNS) {
+        fprintf(stderr, "Error: Too many variables\n");
+        goto done;
     }
-    
-    if (strncmp(*expr, "sqrt(", 5) == 0) {
-        *expr += 5;
-        double result = parse_expression(expr);
-        if (**expr == ')') (*expr)++;
-        return sqrt(result);
+
+    // Map every free variable to a column of the header
+    if (getline(&line, &line_capacity, input) < 0) {
+        fprintf(stderr, "Error: Missing header line\n");
+        goto done;
     }
-    
-    if (strncmp(*expr, "pow(", 4) == 0) {
-        *expr += 4;
-        double base = parse_expression(expr);
-        if (**expr == ',') (*expr)++;
-        double exp = parse_expression(expr);
-        if (**expr == ')') (*expr)++;
-        return pow(base, exp);
+    int field_count = split_fields(line, fields, MAX_COLUMNS);
+    for (int v = 0; v < variable_count; v++) {
+        column_of[v] = -1;
+        for (int c = 0; c < field_count; c++) {
+            if (strcmp(fields[c], program->variable_names[v]) == 0) {
+                column_of[v] = c;
+            }
+        }
+        if (column_of[v] < 0) {
+            fprintf(stderr, "Error: Column '%s' not found in header\n", program->variable_names[v]);
+            goto done;
+        }
     }
-    
-    if (strncmp(*expr, "MR", 2) == 0) {
-        *expr += 2;
-        return memory_value;
+
+    for (loaded = 0; loaded < variable_count; loaded++) {
+        columns[loaded] = malloc(VECTOR_CHUNK_ROWS * sizeof(double));
+        if (columns[loaded] == NULL) break;
     }
-    
-    if (strncmp(*expr, "pi", 2) == 0) {
-        *expr += 2;
-        return M_PI;
+    if (results == NULL || loaded < variable_count) {
+        fprintf(stderr, "Memory allocation failed!\n");
+        goto done;
     }
-    
-    if (strncmp(*expr, "e", 1) == 0) {
-        *expr += 1;
-        return M_E;
+
+    static char output_buffer[1 << 20];
+    setvbuf(stdout, output_buffer, _IOFBF, sizeof(output_buffer));
+
+    size_t rows = 0;
+    long line_number = 1;
+    while (getline(&line, &line_capacity, input) >= 0) {
+        line_number++;
+        field_count = split_fields(line, fields, MAX_COLUMNS);
+        if (field_count == 0) continue;
+
+        for (int v = 0; v < variable_count; v++) {
+            if (column_of[v] >= field_count) {
+                fprintf(stderr, "Error: Line %ld has only %d fields\n", line_number, field_count);
+                goto done;
+            }
+            columns[v][rows] = strtod(fields[column_of[v]], NULL);
+        }
+
+        if (++rows == VECTOR_CHUNK_ROWS) {
+            if (evaluate_batch(program, (const double *const *)columns, 0.0, rows, results) != 0) goto done;
+            write_results(results, rows);
+            rows = 0;
+        }
     }
-    
-    // Parse number
-    double result = 0.0;
-    int sign = 1;
-    
-    if (**expr == '-') {
-        sign = -1;
-        (*expr)++;
+
+    if (rows > 0) {
+        if (evaluate_batch(program, (const double *const *)columns, 0.0, rows, results) != 0) goto done;
+        write_results(results, rows);
     }
-    
-    while (isdigit(**expr)) {
-        result = result * 10.0 + (**expr - '0');
-        (*expr)++;
+    status = 0;
+
+done:
+    fflush(stdout);
+    for (int v = 0; v < loaded; v++) {
+        free(columns[v]);
     }
-    
-    if (**expr == '.') {
-        (*expr)++;
-        double factor = 0.1;
-        while (isdigit(**expr)) {
-            result += (**expr - '0') * factor;
-            factor *= 0.1;
-            (*expr)++;
-        }
+    free(results);
+    free(line);
+    if (input != stdin) fclose(input);
+    free_program(program);
+    return status;
+}
+
+// Opens the history log at path, or in the home directory if path is NULL
+static HistoryLog* open_default_history_log(const char *path) {
+    if (path != NULL) {
+        return open_history_log(path);
     }
-    
-    return sign * result;
+
+    const char *home = getenv("HOME");
+    if (home == NULL) return NULL;
+
+    char default_path[MAX_EXPRESSION];
+    snprintf(default_path, sizeof(default_path), "%s/%s", home, HISTORY_LOG_DEFAULT_NAME);
+    return open_history_log(default_path);
 }
 
-double parse_term(const char **expr) {
-    double left = parse_factor(expr);
-    
-    while (1) {
-        while (isspace(**expr)) (*expr)++;
-        
-        if (**expr == '*') {
-            (*expr)++;
-            left *= parse_factor(expr);
-        } else if (**expr == '/') {
-            (*expr)++;
-            double right = parse_factor(expr);
-            if (right == 0) {
-                printf("Error: Division by zero!\n");
-                return 0;
-            }
-            left /= right;
-        } else {
-            break;
-        }
+// Exports the full saved history, or the in-memory history without a log
+static void export_command(HistoryManager *history, HistoryLog *log, const char *path) {
+    FILE *output = path ? fopen(path, "w") : stdout;
+    if (output == NULL) {
+        printf("Error: Cannot open file '%s'\n", path);
+        return;
     }
-    
-    return left;
+
+    int status = log ? export_history_log(log, output) : export_history(history, output);
+    if (status != 0) {
+        printf("Error: Export failed\n");
+    } else if (path != NULL) {
+        printf("History exported to %s\n", path);
+    }
+    if (output != stdout) fclose(output);
 }
 
-double parse_expression(const char **expr) {
-    double left = parse_term(expr);
-    
-    while (1) {
-        while (isspace(**expr)) (*expr)++;
-        
-        if (**expr == '+') {
-            (*expr)++;
-            left += parse_term(expr);
-        } else if (**expr == '-') {
-            (*expr)++;
-            left -= parse_term(expr);
+static void show_usage(const char *program_name) {
+    fprintf(stderr, "Usage: %s                          interactive calculator\n", program_name);
+    fprintf(stderr, "       %s --vector EXPR [FILE]     evaluate EXPR over column data\n", program_name);
+    fprintf(stderr, "       %s --batch FILE [--threads N]  evaluate one expression per line\n", program_name);
+    fprintf(stderr, "       %s --serve PATH [--threads N]  answer expressions on a Unix socket\n", program_name);
+    fprintf(stderr, "       %s --profile-json PATH      write evaluator counters on exit (make PROFILE=1)\n",
+            program_name);
+    fprintf(stderr, "       %s --history-size N         keep the last N calculations (default %d)\n",
+            program_name, HISTORY_DEFAULT_CAPACITY);
+    fprintf(stderr, "       %s --history-file PATH      save history to PATH (default ~/%s)\n",
+            program_name, HISTORY_LOG_DEFAULT_NAME);
+    fprintf(stderr, "       %s --no-history-file        do not save history\n", program_name);
+    fprintf(stderr, "       %s --cache-mb N             result cache budget in MB (default %d, 0 disables)\n",
+            program_name, CACHE_DEFAULT_BUDGET >> 20);
+    fprintf(stderr, "       %s --numeric MODE           double (default), fixed or decimal arithmetic\n",
+            program_name);
+}
+
+int main(int argc, char *argv[]) {
+    const char *vector_expression = NULL;
+    const char *vector_file = NULL;
+    const char *batch_file = NULL;
+    const char *socket_path = NULL;
+    int threads = 0;
+    long history_size = HISTORY_DEFAULT_CAPACITY;
+    const char *history_file = NULL;
+    int save_history = 1;
+    long cache_mb = CACHE_DEFAULT_BUDGET >> 20;
+    const NumericBackend *numeric = NULL;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--vector") == 0 && i + 1 < argc) {
+            vector_expression = argv[++i];
+            if (i + 1 < argc && strncmp(argv[i + 1], "--", 2) != 0) {
+                vector_file = argv[++i];
+            }
+        } else if (strcmp(argv[i], "--batch") == 0 && i + 1 < argc) {
+            batch_file = argv[++i];
+        } else if (strcmp(argv[i], "--serve") == 0 && i + 1 < argc) {
+            socket_path = argv[++i];
+        } else if (strcmp(argv[i], "--profile-json") == 0 && i + 1 < argc) {
+            profile_json_path = argv[++i];
+        } else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+            threads = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--history-size") == 0 && i + 1 < argc) {
+            history_size = atol(argv[++i]);
+        } else if (strcmp(argv[i], "--history-file") == 0 && i + 1 < argc) {
+            history_file = argv[++i];
+        } else if (strcmp(argv[i], "--no-history-file") == 0) {
+            save_history = 0;
+        } else if (strcmp(argv[i], "--cache-mb") == 0 && i + 1 < argc) {
+            cache_mb = atol(argv[++i]);
+        } else if (strcmp(argv[i], "--numeric") == 0 && i + 1 < argc) {
+            numeric = numeric_backend_by_name(argv[++i]);
+            if (numeric == NULL) {
+                show_usage(argv[0]);
+                return 1;
+            }
+            // The compiled evaluator already is the double backend
+            if (numeric == numeric_backend(NUMERIC_DOUBLE)) numeric = NULL;
         } else {
-            break;
+            show_usage(argv[0]);
+            return 1;
         }
     }
-    
-    return left;
-}
 
-double evaluate_expression(const char *expression) {
-    const char *expr = expression;
-    return parse_expression(&expr);
-}
+    size_t cache_budget = cache_mb > 0 ? (size_t)cache_mb << 20 : 0;
 
-void show_help() {
-    printf("\nCalculator Help:\n");
-    printf("===============\n");
-    printf("Basic operations: +, -, *, /\n");
-    printf("Scientific functions: sin(), cos(), tan(), log(), ln(), sqrt(), pow()\n");
-    printf("Constants: pi, e\n");
-    printf("Memory operations: MR (memory recall)\n");
-    printf("Commands:\n");
-    printf("  help          - Show this help\n");
-    printf("  history       - Show calculation history\n");
-    printf("  clear         - Clear screen\n");
-    printf("  memory        - Show memory value\n");
-    printf("  memory_clear  - Clear memory\n");
-    printf("  quit          - Exit calculator\n");
-    printf("\nExamples:\n");
-    printf("  2 + 3 * 4\n");
-    printf("  sqrt(16) + pow(2, 3)\n");
-    printf("  sin(pi/2)\n");
-    printf("  (10 + 5) / 3\n");
-    printf("\n");
-}
+    if (profile_json_path != NULL) {
+        if (!profile_enabled()) {
+            fprintf(stderr, "Error: Profiling is not compiled in; rebuild with 'make PROFILE=1'\n");
+            return 1;
+        }
+        atexit(write_profile_at_exit);
+    }
 
-void clear_screen() {
-    system("clear");  // Unix/Linux
-    // system("cls");  // Windows
-}
+    if (vector_expression != NULL) {
+        return run_vector_mode(vector_expression, vector_file);
+    }
+    if (batch_file != NULL) {
+        return run_batch_file(batch_file, threads, cache_budget);
+    }
+    if (socket_path != NULL) {
+        return run_server(socket_path, threads);
+    }
 
-int main() {
-    HistoryManager *history = create_history_manager();
+    HistoryManager *history = create_history_manager(history_size > 0 ? (size_t)history_size : 0);
+    if (history == NULL) {
+        return 1;
+    }
+    HistoryLog *history_log = save_history ? open_default_history_log(history_file) : NULL;
+    if (history_log != NULL) {
+        history_log_load(history_log, history);
+    }
+    CalcContext context;
+    init_context(&context);
+    if (cache_budget > 0) {
+        context.cache = create_result_cache(cache_budget);
+    }
+    context.symbols = create_symbol_table();
     char input[MAX_EXPRESSION];
     
     printf("Advanced Calculator\n");
@@ -318,6 +419,19 @@ int main() {
         else if (strcmp(input, "history") == 0) {
             show_history(history);
         }
+        else if (strncmp(input, "history search ", 15) == 0) {
+            search_history(history, input + 15);
+        }
+        else if (strcmp(input, "export") == 0 || strncmp(input, "export ", 7) == 0) {
+            export_command(history, history_log, input[6] ? input + 7 : NULL);
+        }
+        else if (strcmp(input, "stats") == 0) {
+            if (context.cache != NULL) {
+                show_cache_stats(context.cache);
+            } else {
+                printf("Result cache disabled.\n");
+            }
+        }
         else if (strcmp(input, "clear") == 0) {
             clear_screen();
             printf("Advanced Calculator\n");
@@ -325,47 +439,69 @@ int main() {
             printf("==========================================\n\n");
         }
         else if (strcmp(input, "memory") == 0) {
-            show_memory();
+            show_memory(&context);
         }
         else if (strcmp(input, "memory_clear") == 0) {
-            memory_clear();
+            memory_clear(&context);
+        }
+        else if (strcmp(input, "profile") == 0) {
+            profile_report(stdout);
+        }
+        else if (strcmp(input, "profile reset") == 0) {
+            profile_reset();
+        }
+        else if (strncmp(input, "explain ", 8) == 0) {
+            explain_expression(input + 8);
+        }
+        else if (is_derivative_call(input)) {
+            show_derivative(&context, input);
+        }
+        else if (is_definition(input)) {
+            double value;
+            if (define_symbol(&context, input, &value) != 0) {
+                printf("Error: %s\n", context.error);
+            } else if (strncmp(input + strspn(input, " \t"), "let", 3) == 0) {
+                printf("%.6f\n", value);
+            }
         }
         else if (strncmp(input, "memory + ", 9) == 0) {
             double value = atof(input + 9);
-            memory_add(value);
+            memory_add(&context, value);
         }
         else if (strncmp(input, "memory - ", 9) == 0) {
             double value = atof(input + 9);
-            memory_subtract(value);
+            memory_subtract(&context, value);
         }
         else {
-            // Try to evaluate as expression
-            double result = evaluate_expression(input);
-            
-            // Check if we reached the end of the expression
-            const char *remaining = input;
-            parse_expression(&remaining);
-            while (isspace(*remaining)) remaining++;
-            
-            if (*remaining == '\0') {
-                printf("%.6f\n", result);
+            double result;
+            char *formatted = NULL;
+            int status = numeric == NULL ? calculate(&context, input, &result)
+                                         : calculate_numeric(&context, numeric, input, &formatted, &result);
+            if (status == 0) {
+                if (formatted != NULL) {
+                    printf("%s\n", formatted);
+                    free(formatted);
+                } else {
+                    printf("%.6f\n", result);
+                }
                 add_to_history(history, input, result);
+                if (history_log != NULL && history_log_append(history_log, input, result) != 0) {
+                    printf("Error: Cannot save history, continuing without it\n");
+                    close_history_log(history_log);
+                    history_log = NULL;
+                }
             } else {
-                printf("Error: Invalid expression\n");
+                printf("Error: %s\n", context.error);
             }
         }
     }
     
     printf("Goodbye!\n");
     
-    // Clean up history
-    HistoryEntry *current = history->head;
-    while (current != NULL) {
-        HistoryEntry *next = current->next;
-        free(current);
-        current = next;
-    }
-    free(history);
+    close_history_log(history_log);
+    free_result_cache(context.cache);
+    free_symbol_table(context.symbols);
+    free_history_manager(history);
     
     return 0;
 }
@@ -0,0 +1,480 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "derivative.h"
+#include "expression_optimizer.h"
+#include "lexer.h"
+
+#define GRADIENT_BUFFER 4096        // doubles on the C stack before falling back to malloc
+
+// Simplifying constructors. Each takes ownership of its operands, frees
+// them if it does not use them, and returns NULL (freeing everything) if
+// an operand is NULL or memory runs out.
+
+static int is_number(const Node *node, double value) {
+    return node->type == NODE_NUMBER && node->value == value;
+}
+
+static int same_tree(const Node *a, const Node *b) {
+    if (a == NULL || b == NULL) return a == b;
+    if (a->type != b->type) return 0;
+    if (a->type == NODE_NUMBER && memcmp(&a->value, &b->value, sizeof(double)) != 0) return 0;
+    if (a->type == NODE_VARIABLE && strcmp(a->name, b->name) != 0) return 0;
+    return same_tree(a->left, b->left) && same_tree(a->right, b->right);
+}
+
+static Node* number(double value) {
+    return create_number_node(value);
+}
+
+// Folds operations on constants with the same functions the optimizer uses
+static Node* operation(NodeType type, Node *left, Node *right) {
+    if (left == NULL || (node_arity(type) == 2 && right == NULL)) {
+        free_node(left);
+        free_node(right);
+        return NULL;
+    }
+    double folded;
+    if (left->type == NODE_NUMBER && (right == NULL || right->type == NODE_NUMBER) &&
+        fold_operation(type, left->value, right ? right->value : 0.0, &folded)) {
+        free_node(left);
+        free_node(right);
+        return number(folded);
+    }
+    return create_node(type, left, right);
+}
+
+static Node* negate(Node *operand) {
+    if (operand != NULL && operand->type == NODE_NEG) {
+        Node *inner = operand->left;
+        operand->left = NULL;
+        free_node(operand);
+        return inner;
+    }
+    return operation(NODE_NEG, operand, NULL);
+}
+
+static Node* multiply(Node *left, Node *right);
+
+static Node* add(Node *left, Node *right) {
+    if (left == NULL || right == NULL) return operation(NODE_ADD, left, right);
+    if (is_number(left, 0)) {
+        free_node(left);
+        return right;
+    }
+    if (is_number(right, 0)) {
+        free_node(right);
+        return left;
+    }
+    if (same_tree(left, right)) {
+        free_node(right);
+        return multiply(number(2), left);
+    }
+    return operation(NODE_ADD, left, right);
+}
+
+static Node* subtract(Node *left, Node *right) {
+    if (left == NULL || right == NULL) return operation(NODE_SUB, left, right);
+    if (is_number(right, 0)) {
+        free_node(right);
+        return left;
+    }
+    if (is_number(left, 0)) {
+        free_node(left);
+        return negate(right);
+    }
+    if (same_tree(left, right)) {
+        free_node(left);
+        free_node(right);
+        return number(0);
+    }
+    return operation(NODE_SUB, left, right);
+}
+
+static Node* multiply(Node *left, Node *right) {
+    if (left == NULL || right == NULL) return operation(NODE_MUL, left, right);
+    // Constants first: "3 * x" rather than "x * 3" (multiplication commutes exactly)
+    if (right->type == NODE_NUMBER && left->type != NODE_NUMBER) {
+        Node *swap = left;
+        left = right;
+        right = swap;
+    }
+    if (is_number(left, 0)) {
+        free_node(right);
+        return left;
+    }
+    if (is_number(left, 1)) {
+        free_node(left);
+        return right;
+    }
+    if (is_number(left, -1)) {
+        free_node(left);
+        return negate(right);
+    }
+    // 4 * (3 * x) is 12 * x
+    if (left->type == NODE_NUMBER && right->type == NODE_MUL && right->left->type == NODE_NUMBER) {
+        Node *factor = right->left;
+        Node *rest = right->right;
+        right->left = right->right = NULL;
+        free_node(right);
+        return multiply(operation(NODE_MUL, left, factor), rest);
+    }
+    return operation(NODE_MUL, left, right);
+}
+
+static Node* divide(Node *left, Node *right) {
+    if (left == NULL || right == NULL) return operation(NODE_DIV, left, right);
+    if (is_number(left, 0) && !is_number(right, 0)) {
+        free_node(right);
+        return left;
+    }
+    if (is_number(right, 1)) {
+        free_node(right);
+        return left;
+    }
+    return operation(NODE_DIV, left, right);
+}
+
+static Node* copy(const Node *node) {
+    return copy_node(node);
+}
+
+// Symbolic differentiation
+
+Node* differentiate(const Node *node, const char *variable) {
+    switch (node->type) {
+        case NODE_NUMBER:
+        case NODE_MEMORY:
+            return number(0);
+        case NODE_VARIABLE:
+            return number(strcmp(node->name, variable) == 0 ? 1 : 0);
+        default:
+            break;
+    }
+
+    const Node *u = node->left;
+    const Node *v = node->right;
+    Node *du = differentiate(u, variable);
+    Node *dv = v != NULL ? differentiate(v, variable) : number(0);
+    if (du == NULL || dv == NULL) {
+        free_node(du);
+        free_node(dv);
+        return NULL;
+    }
+
+    // Nothing here depends on the variable
+    if (is_number(du, 0) && is_number(dv, 0)) {
+        free_node(dv);
+        return du;
+    }
+
+    switch (node->type) {
+        case NODE_NEG:
+            free_node(dv);
+            return negate(du);
+        case NODE_ADD:
+            return add(du, dv);
+        case NODE_SUB:
+            return subtract(du, dv);
+        case NODE_MUL:
+            // (uv)' = u'v + uv'
+            return add(multiply(du, copy(v)), multiply(copy(u), dv));
+        case NODE_DIV:
+            if (is_number(dv, 0)) {
+                free_node(dv);
+                return divide(du, copy(v));
+            }
+            // (u/v)' = (u'v - uv') / (v*v)
+            return divide(subtract(multiply(du, copy(v)), multiply(copy(u), dv)),
+                          multiply(copy(v), copy(v)));
+        case NODE_SIN:
+            free_node(dv);
+            return multiply(operation(NODE_COS, copy(u), NULL), du);
+        case NODE_COS:
+            free_node(dv);
+            return negate(multiply(operation(NODE_SIN, copy(u), NULL), du));
+        case NODE_TAN:
+            free_node(dv);
+            return divide(du, multiply(operation(NODE_COS, copy(u), NULL), operation(NODE_COS, copy(u), NULL)));
+        case NODE_LOG:
+            free_node(dv);
+            return divide(du, multiply(number(log(10.0)), copy(u)));
+        case NODE_LN:
+            free_node(dv);
+            return divide(du, copy(u));
+        case NODE_SQRT:
+            free_node(dv);
+            return divide(du, multiply(number(2), operation(NODE_SQRT, copy(u), NULL)));
+        case NODE_POW:
+            if (is_number(dv, 0)) {
+                // Constant exponent: (u^v)' = v * u^(v-1) * u'
+                free_node(dv);
+                Node *power = operation(NODE_POW, copy(u), subtract(copy(v), number(1)));
+                return multiply(multiply(copy(v), power), du);
+            }
+            if (is_number(du, 0)) {
+                // Constant base: (u^v)' = u^v * ln(u) * v'
+                free_node(du);
+                return multiply(multiply(operation(NODE_POW, copy(u), copy(v)), operation(NODE_LN, copy(u), NULL)), dv);
+            }
+            // (u^v)' = u^v * (v' ln(u) + v u' / u)
+            return multiply(operation(NODE_POW, copy(u), copy(v)),
+                            add(multiply(dv, operation(NODE_LN, copy(u), NULL)),
+                                divide(multiply(copy(v), du), copy(u))));
+        default:
+            free_node(du);
+            free_node(dv);
+            return NULL;
+    }
+}
+
+// Forward-mode evaluation. Every stack slot and local holds a value
+// followed by its partial derivatives, one per program variable.
+
+double evaluate_gradient(const Program *program, EvalEnv *env, double *gradient) {
+    int count = program->variable_count;
+    int width = count + 1;
+    size_t size = (size_t)(program->max_stack + program->local_count) * width;
+    double buffer[GRADIENT_BUFFER];
+    double *stack = size <= GRADIENT_BUFFER ? buffer : malloc(size * sizeof(double));
+    if (stack == NULL) {
+        env->error = EVAL_OUT_OF_RANGE;
+        return 0;
+    }
+    double *locals = stack + (size_t)program->max_stack * width;
+    double *top = stack - width;
+    double result = 0;
+
+    env->error = EVAL_OK;
+
+    for (int pc = 0; pc < program->code_length; pc++) {
+        const Instruction *instruction = &program->code[pc];
+        double *a = top;
+        double *b = top;
+        double scale = 1.0;
+
+        switch (instruction->op) {
+            case OP_CONST:
+            case OP_MEMORY:
+            case OP_VARIABLE:
+                top += width;
+                memset(top + 1, 0, count * sizeof(double));
+                if (instruction->op == OP_CONST) {
+                    top[0] = program->constants[instruction->arg];
+                } else if (instruction->op == OP_MEMORY) {
+                    top[0] = env->memory;
+                } else {
+                    top[0] = env->variables[instruction->arg];
+                    top[1 + instruction->arg] = 1.0;
+                }
+                continue;
+            case OP_STORE:
+                memcpy(locals + (size_t)instruction->arg * width, top, width * sizeof(double));
+                continue;
+            case OP_LOAD:
+                top += width;
+                memcpy(top, locals + (size_t)instruction->arg * width, width * sizeof(double));
+                continue;
+            case OP_NEG:
+                for (int i = 0; i < width; i++) a[i] = -a[i];
+                continue;
+            default:
+                break;
+        }
+
+        if (instruction->op == OP_ADD || instruction->op == OP_SUB || instruction->op == OP_MUL ||
+            instruction->op == OP_DIV || instruction->op == OP_POW) {
+            top -= width;
+            a = top;
+        }
+
+        switch (instruction->op) {
+            case OP_ADD:
+                for (int i = 0; i < width; i++) a[i] += b[i];
+                break;
+            case OP_SUB:
+                for (int i = 0; i < width; i++) a[i] -= b[i];
+                break;
+            case OP_MUL:
+                for (int i = 1; i < width; i++) a[i] = a[i] * b[0] + a[0] * b[i];
+                a[0] *= b[0];
+                break;
+            case OP_DIV: {
+                if (b[0] == 0) {
+                    env->error = EVAL_DIVISION_BY_ZERO;
+                    goto done;
+                }
+                double quotient = a[0] / b[0];
+                for (int i = 1; i < width; i++) a[i] = (a[i] - quotient * b[i]) / b[0];
+                a[0] = quotient;
+                break;
+            }
+            case OP_POW: {
+                // Each term only where its operand varies, so a constant
+                // negative base or exponent does not bring in ln's NaN
+                double power = pow(a[0], b[0]);
+                double by_base = b[0] * pow(a[0], b[0] - 1);
+                double by_exponent = power * log(a[0]);
+                for (int i = 1; i < width; i++) {
+                    a[i] = (a[i] != 0 ? by_base * a[i] : 0.0) + (b[i] != 0 ? by_exponent * b[i] : 0.0);
+                }
+                a[0] = power;
+                break;
+            }
+            case OP_SIN:  scale = cos(a[0]); a[0] = sin(a[0]); break;
+            case OP_COS:  scale = -sin(a[0]); a[0] = cos(a[0]); break;
+            case OP_TAN:  scale = 1.0 / (cos(a[0]) * cos(a[0])); a[0] = tan(a[0]); break;
+            case OP_LOG:  scale = 1.0 / (log(10.0) * a[0]); a[0] = log10(a[0]); break;
+            case OP_LN:   scale = 1.0 / a[0]; a[0] = log(a[0]); break;
+            case OP_SQRT: a[0] = sqrt(a[0]); scale = 0.5 / a[0]; break;
+        }
+        if (instruction->op >= OP_SIN && instruction->op <= OP_SQRT) {
+            for (int i = 1; i < width; i++) a[i] *= scale;
+        }
+    }
+
+    result = top[0];
+    memcpy(gradient, top + 1, count * sizeof(double));
+
+done:
+    if (stack != buffer) free(stack);
+    return result;
+}
+
+// Printing
+
+typedef struct {
+    char *text;
+    size_t length;
+    size_t capacity;
+    int failed;
+} Buffer;
+
+static void append(Buffer *buffer, const char *text) {
+    size_t length = strlen(text);
+    if (buffer->failed) return;
+    if (buffer->length + length + 1 > buffer->capacity) {
+        size_t capacity = buffer->capacity ? buffer->capacity * 2 : 64;
+        while (capacity < buffer->length + length + 1) capacity *= 2;
+        char *grown = realloc(buffer->text, capacity);
+        if (grown == NULL) {
+            buffer->failed = 1;
+            return;
+        }
+        buffer->text = grown;
+        buffer->capacity = capacity;
+    }
+    memcpy(buffer->text + buffer->length, text, length + 1);
+    buffer->length += length;
+}
+
+// Shortest digits that read back as the same double
+static void append_number(Buffer *buffer, double value) {
+    char text[40];
+    if (isinf(value)) {
+        append(buffer, value > 0 ? "1e999" : "-1e999");
+        return;
+    }
+    if (isnan(value)) {
+        append(buffer, "nan");
+        return;
+    }
+    for (int precision = 15; precision <= 17; precision++) {
+        snprintf(text, sizeof(text), "%.*g", precision, value);
+        double back;
+        const char *digits = text[0] == '-' ? text + 1 : text;
+        scan_number(digits, &back);
+        if ((text[0] == '-' ? -back : back) == value) break;
+    }
+    append(buffer, text);
+}
+
+static int precedence(const Node *node) {
+    switch (node->type) {
+        case NODE_ADD:
+        case NODE_SUB:
+            return 1;
+        case NODE_MUL:
+        case NODE_DIV:
+            return 2;
+        case NODE_NEG:
+            return 3;
+        case NODE_NUMBER:
+            return node->value < 0 || (node->value == 0 && signbit(node->value)) ? 3 : 4;
+        default:
+            return 4;
+    }
+}
+
+static const char* function_name(NodeType type) {
+    switch (type) {
+        case NODE_SIN:  return "sin";
+        case NODE_COS:  return "cos";
+        case NODE_TAN:  return "tan";
+        case NODE_LOG:  return "log";
+        case NODE_LN:   return "ln";
+        case NODE_SQRT: return "sqrt";
+        default:        return "pow";
+    }
+}
+
+static void format_tree(Buffer *buffer, const Node *node);
+
+static void format_operand(Buffer *buffer, const Node *node, int parenthesize) {
+    if (parenthesize) append(buffer, "(");
+    format_tree(buffer, node);
+    if (parenthesize) append(buffer, ")");
+}
+
+static void format_tree(Buffer *buffer, const Node *node) {
+    int own = precedence(node);
+
+    switch (node->type) {
+        case NODE_NUMBER:
+            append_number(buffer, node->value);
+            return;
+        case NODE_MEMORY:
+            append(buffer, "MR");
+            return;
+        case NODE_VARIABLE:
+            append(buffer, node->name);
+            return;
+        case NODE_NEG:
+            append(buffer, "-");
+            format_operand(buffer, node->left, precedence(node->left) < own);
+            return;
+        case NODE_ADD:
+        case NODE_SUB:
+        case NODE_MUL:
+        case NODE_DIV: {
+            static const char *operators[] = { " + ", " - ", " * ", " / " };
+            // Operators associate to the left, so an equal-precedence right
+            // operand keeps its parentheses
+            format_operand(buffer, node->left, precedence(node->left) < own);
+            append(buffer, operators[node->type - NODE_ADD]);
+            format_operand(buffer, node->right, precedence(node->right) <= own);
+            return;
+        }
+        default:
+            append(buffer, function_name(node->type));
+            append(buffer, "(");
+            format_tree(buffer, node->left);
+            if (node->right != NULL) {
+                append(buffer, ", ");
+                format_tree(buffer, node->right);
+            }
+            append(buffer, ")");
+            return;
+    }
+}
+
+char* format_node(const Node *node) {
+    Buffer buffer = { NULL, 0, 0, 0 };
+    format_tree(&buffer, node);
+    if (buffer.failed) {
+        free(buffer.text);
+        return NULL;
+    }
+    return buffer.text;
+}
@@ -0,0 +1,33 @@
+#ifndef DERIVATIVE_H
+#define DERIVATIVE_H
+
+#include "expression_parser.h"
+
+// Derivatives of expressions, two ways:
+//
+// Symbolic: differentiate() builds the derivative of a tree with respect to
+// one variable as a new tree, simplified as it is built (constants folded,
+// zeros and ones dropped). The parser uses it for diff(EXPR, NAME), so a
+// derivative can be evaluated, compiled or printed like any expression.
+//
+// Forward mode: evaluate_gradient() runs a compiled program on dual
+// numbers, carrying the partial derivative with respect to every program
+// variable next to each value. One pass gives the value and the whole
+// gradient, exact up to rounding, with no step size to choose.
+
+// diff() refuses expressions whose node count times depth exceeds this
+#define DERIVATIVE_MAX_WORK (1L << 18)
+
+// Returns NULL if memory runs out. node is not modified.
+Node* differentiate(const Node *node, const char *variable);
+
+// gradient[i] receives d(result)/d(variables[i]) for the program's
+// variable slots. Errors are reported through env->error as by
+// evaluate_program; the gradient is then unspecified.
+double evaluate_gradient(const Program *program, EvalEnv *env, double *gradient);
+
+// The tree as text the parser reads back into the same tree, with only
+// the parentheses precedence requires. Returns a malloc'ed string or NULL.
+char* format_node(const Node *node);
+
+#endif
@@ -0,0 +1,188 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "expression_optimizer.h"
+
+// Constant folding and common-subexpression elimination.
+// Folding uses the same libm functions as evaluate_program, so a folded
+// formula produces exactly the value it would have produced at run time.
+
+int node_arity(NodeType type) {
+    switch (type) {
+        case NODE_NUMBER:
+        case NODE_MEMORY:
+        case NODE_VARIABLE:
+            return 0;
+        case NODE_ADD:
+        case NODE_SUB:
+        case NODE_MUL:
+        case NODE_DIV:
+        case NODE_POW:
+            return 2;
+        default:
+            return 1;
+    }
+}
+
+// Computes an operation on constant operands. Returns 0 when the operation
+// must stay in the program (division by zero is reported at run time).
+int fold_operation(NodeType type, double left, double right, double *result) {
+    switch (type) {
+        case NODE_NEG:  *result = -left; return 1;
+        case NODE_ADD:  *result = left + right; return 1;
+        case NODE_SUB:  *result = left - right; return 1;
+        case NODE_MUL:  *result = left * right; return 1;
+        case NODE_DIV:
+            if (right == 0) return 0;
+            *result = left / right;
+            return 1;
+        case NODE_SIN:  *result = sin(left); return 1;
+        case NODE_COS:  *result = cos(left); return 1;
+        case NODE_TAN:  *result = tan(left); return 1;
+        case NODE_LOG:  *result = log10(left); return 1;
+        case NODE_LN:   *result = log(left); return 1;
+        case NODE_SQRT: *result = sqrt(left); return 1;
+        case NODE_POW:  *result = pow(left, right); return 1;
+        default:        return 0;
+    }
+}
+
+typedef struct {
+    ExpressionDag *dag;
+    int capacity;
+    int *table;             // open addressing: DAG ids, -1 for empty slots
+    int table_mask;
+} DagBuilder;
+
+static unsigned int hash_key(const DagNode *key) {
+    unsigned long long bits;
+    memcpy(&bits, &key->value, sizeof(bits));
+
+    unsigned int hash = 2166136261u;
+    hash = (hash ^ (unsigned int)key->type) * 16777619u;
+    hash = (hash ^ (unsigned int)key->left) * 16777619u;
+    hash = (hash ^ (unsigned int)key->right) * 16777619u;
+    hash = (hash ^ (unsigned int)bits) * 16777619u;
+    hash = (hash ^ (unsigned int)(bits >> 32)) * 16777619u;
+    if (key->name != NULL) {
+        for (const char *p = key->name; *p; p++) {
+            hash = (hash ^ (unsigned char)*p) * 16777619u;
+        }
+    }
+    return hash;
+}
+
+static int same_key(const DagNode *a, const DagNode *b) {
+    if (a->type != b->type || a->left != b->left || a->right != b->right) return 0;
+    if (memcmp(&a->value, &b->value, sizeof(double)) != 0) return 0;
+    if (a->name == NULL || b->name == NULL) return a->name == b->name;
+    return strcmp(a->name, b->name) == 0;
+}
+
+// Returns the id of a node equal to key, adding it if it is new
+static int intern(DagBuilder *builder, DagNode key) {
+    ExpressionDag *dag = builder->dag;
+    unsigned int slot = hash_key(&key) & builder->table_mask;
+
+    while (builder->table[slot] >= 0) {
+        int id = builder->table[slot];
+        if (same_key(&dag->nodes[id], &key)) {
+            if (node_arity(key.type) > 0) {
+                dag->stats.shared_nodes++;
+            }
+            return id;
+        }
+        slot = (slot + 1) & builder->table_mask;
+    }
+
+    key.uses = 0;
+    dag->nodes[dag->count] = key;
+    builder->table[slot] = dag->count;
+    return dag->count++;
+}
+
+static int build_node(DagBuilder *builder, const Node *node) {
+    ExpressionDag *dag = builder->dag;
+    DagNode key = { node->type, 0.0, NULL, -1, -1, 0 };
+
+    if (node_arity(node->type) == 0) {
+        key.value = node->type == NODE_NUMBER ? node->value : 0.0;
+        key.name = node->type == NODE_VARIABLE ? node->name : NULL;
+        return intern(builder, key);
+    }
+    key.left = build_node(builder, node->left);
+    if (node_arity(node->type) == 2) {
+        key.right = build_node(builder, node->right);
+    }
+
+    // Fold operations whose operands are all constants
+    const DagNode *left = &dag->nodes[key.left];
+    const DagNode *right = key.right >= 0 ? &dag->nodes[key.right] : NULL;
+    if (left->type == NODE_NUMBER && (right == NULL || right->type == NODE_NUMBER)) {
+        double folded;
+        if (fold_operation(node->type, left->value, right ? right->value : 0.0, &folded)) {
+            DagNode constant = { NODE_NUMBER, folded, NULL, -1, -1, 0 };
+            dag->stats.folded_nodes++;
+            return intern(builder, constant);
+        }
+    }
+
+    // Addition and multiplication are commutative (and exact either way),
+    // so order operands by id to let x*y and y*x share one node
+    if ((key.type == NODE_ADD || key.type == NODE_MUL) && key.left > key.right) {
+        int swap = key.left;
+        key.left = key.right;
+        key.right = swap;
+    }
+    return intern(builder, key);
+}
+
+static int count_tree_nodes(const Node *node) {
+    if (node == NULL) return 0;
+    return 1 + count_tree_nodes(node->left) + count_tree_nodes(node->right);
+}
+
+int build_dag(const Node *root, ExpressionDag *dag) {
+    DagBuilder builder;
+    int tree_nodes = count_tree_nodes(root);
+
+    memset(dag, 0, sizeof(*dag));
+    dag->stats.tree_nodes = tree_nodes;
+
+    // Folding and sharing only ever shrink the tree
+    dag->nodes = malloc(tree_nodes * sizeof(DagNode));
+    builder.dag = dag;
+    builder.capacity = 16;
+    while (builder.capacity < tree_nodes * 2) builder.capacity *= 2;
+    builder.table_mask = builder.capacity - 1;
+    builder.table = malloc(builder.capacity * sizeof(int));
+
+    if (dag->nodes == NULL || builder.table == NULL) {
+        printf("Memory allocation failed!\n");
+        free(builder.table);
+        free_dag(dag);
+        return -1;
+    }
+    memset(builder.table, -1, builder.capacity * sizeof(int));
+
+    dag->root = build_node(&builder, root);
+    free(builder.table);
+
+    // Count parents once per reachable node; children ids precede parents.
+    // Operands of folded operations stay in the array but are unreachable.
+    dag->nodes[dag->root].uses = 1;
+    for (int id = dag->count - 1; id >= 0; id--) {
+        if (dag->nodes[id].uses == 0) continue;
+        dag->stats.dag_nodes++;
+        if (dag->nodes[id].left >= 0) dag->nodes[dag->nodes[id].left].uses++;
+        if (dag->nodes[id].right >= 0) dag->nodes[dag->nodes[id].right].uses++;
+    }
+    return 0;
+}
+
+void free_dag(ExpressionDag *dag) {
+    free(dag->nodes);
+    dag->nodes = NULL;
+    dag->count = 0;
+}
@@ -0,0 +1,32 @@
+#ifndef EXPRESSION_OPTIMIZER_H
+#define EXPRESSION_OPTIMIZER_H
+
+#include "expression_parser.h"
+
+// Expression DAG: the parsed tree after constant folding, with identical
+// subexpressions merged into a single node (hash-consing). Children always
+// have smaller ids than their parents.
+typedef struct {
+    NodeType type;
+    double value;           // NODE_NUMBER
+    const char *name;       // NODE_VARIABLE, points into the source tree
+    int left;               // child ids, -1 if absent
+    int right;
+    int uses;               // parents referencing this node (+1 for the root)
+} DagNode;
+
+typedef struct {
+    DagNode *nodes;
+    int count;
+    int root;
+    OptimizeStats stats;
+} ExpressionDag;
+
+int node_arity(NodeType type);
+int fold_operation(NodeType type, double left, double right, double *result);
+
+// Returns 0 on success, -1 if memory could not be allocated
+int build_dag(const Node *root, ExpressionDag *dag);
+void free_dag(ExpressionDag *dag);
+
+#endif
@@ -0,0 +1,1026 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <ctype.h>
+#include "expression_parser.h"
+#include "expression_optimizer.h"
+#include "result_cache.h"
+#include "symbols.h"
+#include "derivative.h"
+#include "profile.h"
+#include "jit.h"
+
+// Expression tree
+
+static int subtree_depth(const Node *left, const Node *right) {
+    int depth = left ? left->depth : 0;
+    if (right != NULL && right->depth > depth) depth = right->depth;
+    return depth + 1;
+}
+
+Node* create_node(NodeType type, Node *left, Node *right) {
+    Node *node = malloc(sizeof(Node));
+    if (node == NULL) {
+        printf("Memory allocation failed!\n");
+        free_node(left);
+        free_node(right);
+        return NULL;
+    }
+    node->type = type;
+    node->depth = subtree_depth(left, right);
+    node->value = 0.0;
+    node->name = NULL;
+    node->left = left;
+    node->right = right;
+    return node;
+}
+
+Node* create_number_node(double value) {
+    Node *node = create_node(NODE_NUMBER, NULL, NULL);
+    if (node != NULL) {
+        node->value = value;
+    }
+    return node;
+}
+
+Node* create_variable_node(const char *name, int length) {
+    Node *node = create_node(NODE_VARIABLE, NULL, NULL);
+    if (node == NULL) return NULL;
+
+    node->name = malloc(length + 1);
+    if (node->name == NULL) {
+        printf("Memory allocation failed!\n");
+        free(node);
+        return NULL;
+    }
+    memcpy(node->name, name, length);
+    node->name[length] = '\0';
+    return node;
+}
+
+// A number node that keeps its literal text, so exact numeric backends
+// can read the digits instead of the rounded double
+Node* create_literal_node(const char *text, int length, double value) {
+    Node *node = create_variable_node(text, length);
+    if (node != NULL) {
+        node->type = NODE_NUMBER;
+        node->value = value;
+    }
+    return node;
+}
+
+// Negates a number node, including its literal text
+static Node* negate_number(Node *node) {
+    node->value = -node->value;
+    if (node->name == NULL) return node;
+
+    size_t length = strlen(node->name);
+    if (node->name[0] == '-') {
+        memmove(node->name, node->name + 1, length);
+        return node;
+    }
+    char *text = malloc(length + 2);
+    if (text == NULL) {
+        printf("Memory allocation failed!\n");
+        free_node(node);
+        return NULL;
+    }
+    text[0] = '-';
+    memcpy(text + 1, node->name, length + 1);
+    free(node->name);
+    node->name = text;
+    return node;
+}
+
+void free_node(Node *node) {
+    if (node == NULL) return;
+    free_node(node->left);
+    free_node(node->right);
+    free(node->name);
+    free(node);
+}
+
+// Recursive descent parser producing an expression tree from the lexer's
+// tokens. Every parse_* function returns NULL on a syntax error and records
+// the first error in the parser, so several parsers can run at the same time.
+
+static void advance(Parser *parser) {
+    parser->token = next_token(&parser->lexer);
+}
+
+void init_parser(Parser *parser, const char *text) {
+    parser->input = text;
+    parser->symbols = NULL;
+    parser->depth = 0;
+    parser->max_depth = PARSER_DEFAULT_MAX_DEPTH;
+    parser->inlined_nodes = 0;
+    init_lexer(&parser->lexer, text);
+    parser->error.position = -1;
+    parser->error.message[0] = '\0';
+    advance(parser);
+}
+
+static Node* syntax_error_at(Parser *parser, int position, const char *message) {
+    if (parser->error.position < 0) {
+        parser->error.position = position;
+        snprintf(parser->error.message, sizeof(parser->error.message), "%s", message);
+    }
+    return NULL;
+}
+
+static Node* syntax_error(Parser *parser, const char *message) {
+    return syntax_error_at(parser, parser->token.position, message);
+}
+
+// Rejects trees deeper than the parser's limit
+static Node* limit_depth(Parser *parser, Node *node) {
+    if (node == NULL || node->depth <= parser->max_depth) return node;
+    free_node(node);
+    return syntax_error(parser, "Expression too deeply nested");
+}
+
+// Skips the current token if it has the given type
+static int accept(Parser *parser, TokenType type) {
+    if (parser->token.type != type) return 0;
+    advance(parser);
+    return 1;
+}
+
+static int token_is(const Parser *parser, const Token *token, const char *word) {
+    return (int)strlen(word) == token->length &&
+           strncmp(parser->input + token->position, word, token->length) == 0;
+}
+
+// Parses "<argument>)" after "name(" and wraps it in a node; pow takes
+// two arguments. A missing ')' is accepted, as in "sqrt(16".
+static Node* parse_call(Parser *parser, NodeType type) {
+    Node *argument = parse_expression(parser);
+    if (argument == NULL) return NULL;
+
+    Node *second = NULL;
+    if (type == NODE_POW) {
+        accept(parser, TOKEN_COMMA);
+        second = parse_expression(parser);
+        if (second == NULL) {
+            free_node(argument);
+            return NULL;
+        }
+    }
+    accept(parser, TOKEN_RPAREN);
+    return create_node(type, argument, second);
+}
+
+static long count_nodes(const Node *node) {
+    return node ? 1 + count_nodes(node->left) + count_nodes(node->right) : 0;
+}
+
+// Nodes copy_tree would create for the same arguments
+static long inlined_size(const Node *node, char **parameters, int parameter_count, const long *argument_sizes) {
+    if (node == NULL) return 0;
+    if (node->type == NODE_VARIABLE) {
+        for (int i = 0; i < parameter_count; i++) {
+            if (strcmp(node->name, parameters[i]) == 0) return argument_sizes[i];
+        }
+    }
+    return 1 + inlined_size(node->left, parameters, parameter_count, argument_sizes) +
+           inlined_size(node->right, parameters, parameter_count, argument_sizes);
+}
+
+// Copies a tree, replacing each variable named like a parameter with a
+// copy of the matching argument
+static Node* copy_tree(const Node *node, char **parameters, int parameter_count, Node **arguments) {
+    if (node->type == NODE_VARIABLE) {
+        for (int i = 0; i < parameter_count; i++) {
+            if (strcmp(node->name, parameters[i]) == 0) {
+                return copy_tree(arguments[i], NULL, 0, NULL);
+            }
+        }
+    }
+
+    Node *copy = node->name ? create_variable_node(node->name, (int)strlen(node->name))
+                            : create_node(node->type, NULL, NULL);
+    if (copy == NULL) return NULL;
+    copy->type = node->type;
+    copy->value = node->value;
+
+    if (node->left != NULL) {
+        copy->left = copy_tree(node->left, parameters, parameter_count, arguments);
+        if (copy->left == NULL) {
+            free_node(copy);
+            return NULL;
+        }
+    }
+    if (node->right != NULL) {
+        copy->right = copy_tree(node->right, parameters, parameter_count, arguments);
+        if (copy->right == NULL) {
+            free_node(copy);
+            return NULL;
+        }
+    }
+    copy->depth = subtree_depth(copy->left, copy->right);
+    return copy;
+}
+
+Node* copy_node(const Node *node) {
+    return node ? copy_tree(node, NULL, 0, NULL) : NULL;
+}
+
+// Parses the arguments of a user function after "name(" and inlines its
+// body with the arguments in place of the parameters. Variables other than
+// parameters stay free and are bound when the expression is evaluated.
+static Node* parse_user_call(Parser *parser, const Symbol *function, int position) {
+    Node *arguments[MAX_PARAMETERS];
+    int count = 0;
+    Node *result = NULL;
+
+    if (!accept(parser, TOKEN_RPAREN)) {
+        do {
+            if (count == MAX_PARAMETERS) {
+                syntax_error(parser, "Too many arguments");
+                goto done;
+            }
+            arguments[count] = parse_expression(parser);
+            if (arguments[count] == NULL) goto done;
+            count++;
+        } while (accept(parser, TOKEN_COMMA));
+        accept(parser, TOKEN_RPAREN);
+    }
+
+    if (count != function->parameter_count) {
+        syntax_error_at(parser, position, "Wrong number of arguments");
+        goto done;
+    }
+    long argument_sizes[MAX_PARAMETERS];
+    for (int i = 0; i < count; i++) {
+        argument_sizes[i] = count_nodes(arguments[i]);
+    }
+    parser->inlined_nodes += inlined_size(function->body, function->parameters, count, argument_sizes);
+    if (parser->inlined_nodes > PARSER_MAX_INLINED_NODES) {
+        syntax_error_at(parser, position, "Function calls expand too far");
+        goto done;
+    }
+    result = copy_tree(function->body, function->parameters, count, arguments);
+
+done:
+    for (int i = 0; i < count; i++) {
+        free_node(arguments[i]);
+    }
+    return result;
+}
+
+static Node* create_constant_node(const char *digits) {
+    double value;
+    const char *end = scan_number(digits, &value);
+    return create_literal_node(digits, (int)(end - digits), value);
+}
+
+// Parses "<expression>, <variable>)" after "diff(" and returns the
+// derivative of the expression with respect to the variable
+static Node* parse_derivative(Parser *parser) {
+    Node *expression = parse_expression(parser);
+    if (expression == NULL) return NULL;
+
+    Node *result = NULL;
+    if (!accept(parser, TOKEN_COMMA)) {
+        syntax_error(parser, "Expected ','");
+        goto done;
+    }
+    Token token = parser->token;
+    const char *name = parser->input + token.position;
+    if (token.type != TOKEN_IDENTIFIER || find_builtin(name, token.length) != NULL) {
+        syntax_error(parser, "Expected a variable name");
+        goto done;
+    }
+    // The product, quotient and chain rules copy operands, so the
+    // derivative can have up to a few times nodes * depth nodes; nested
+    // diff() calls would otherwise grow without bound
+    if (count_nodes(expression) * expression->depth > DERIVATIVE_MAX_WORK) {
+        syntax_error_at(parser, token.position, "Expression too large to differentiate");
+        goto done;
+    }
+    advance(parser);
+    accept(parser, TOKEN_RPAREN);
+
+    Node *variable = create_variable_node(name, token.length);
+    if (variable == NULL) goto done;
+    result = differentiate(expression, variable->name);
+    if (result == NULL) printf("Memory allocation failed!\n");
+    free_node(variable);
+
+done:
+    free_node(expression);
+    return result;
+}
+
+// Built-in and user function calls, MR, the constants pi and e, and
+// variables, which stay free until the expression is evaluated
+static Node* parse_identifier(Parser *parser) {
+    Token token = parser->token;
+    const char *name = parser->input + token.position;
+    advance(parser);
+
+    const Builtin *builtin = find_builtin(name, token.length);
+    if (builtin != NULL) {
+        switch (builtin->kind) {
+            case BUILTIN_FUNCTION:
+                if (!accept(parser, TOKEN_LPAREN)) {
+                    return syntax_error(parser, "Expected '(' after function name");
+                }
+                return parse_call(parser, builtin->type);
+            case BUILTIN_DERIVATIVE:
+                if (!accept(parser, TOKEN_LPAREN)) {
+                    return syntax_error(parser, "Expected '(' after function name");
+                }
+                return parse_derivative(parser);
+            case BUILTIN_MEMORY:
+                return create_node(NODE_MEMORY, NULL, NULL);
+            case BUILTIN_CONSTANT:
+                return create_constant_node(builtin->digits);
+        }
+    }
+
+    if (accept(parser, TOKEN_LPAREN)) {
+        const Symbol *symbol = find_symbol(parser->symbols, name, token.length);
+        if (symbol == NULL || symbol->kind != SYMBOL_FUNCTION) {
+            return syntax_error_at(parser, token.position, "Unknown function");
+        }
+        return parse_user_call(parser, symbol, token.position);
+    }
+    return create_variable_node(name, token.length);
+}
+
+static Node* parse_operand(Parser *parser) {
+    Token token = parser->token;
+
+    switch (token.type) {
+        case TOKEN_LPAREN: {
+            advance(parser);
+            Node *result = parse_expression(parser);
+            if (result != NULL) accept(parser, TOKEN_RPAREN);
+            return result;
+        }
+        case TOKEN_MINUS: {
+            advance(parser);
+            Node *operand = parse_factor(parser);
+            if (operand == NULL) return NULL;
+            if (operand->type == NODE_NUMBER) {
+                return negate_number(operand);
+            }
+            return create_node(NODE_NEG, operand, NULL);
+        }
+        case TOKEN_IDENTIFIER:
+            return parse_identifier(parser);
+        case TOKEN_NUMBER:
+            advance(parser);
+            // Hex literals have no decimal digits for the exact backends
+            if (is_hex_literal(parser->input + token.position)) {
+                return create_number_node(token.value);
+            }
+            return create_literal_node(parser->input + token.position, token.length, token.value);
+        case TOKEN_END:
+            return syntax_error(parser, "Unexpected end of expression");
+        default:
+            return syntax_error(parser, "Expected a number");
+    }
+}
+
+// Parentheses, signs and calls nest through here, so counting calls in
+// progress bounds the parser's own recursion
+Node* parse_factor(Parser *parser) {
+    if (parser->depth >= parser->max_depth) {
+        return syntax_error(parser, "Expression too deeply nested");
+    }
+    parser->depth++;
+    Node *node = parse_operand(parser);
+    parser->depth--;
+    return limit_depth(parser, node);
+}
+
+Node* parse_term(Parser *parser) {
+    Node *left = parse_factor(parser);
+
+    while (left != NULL) {
+        NodeType type;
+        if (parser->token.type == TOKEN_STAR) {
+            type = NODE_MUL;
+        } else if (parser->token.type == TOKEN_SLASH) {
+            type = NODE_DIV;
+        } else {
+            break;
+        }
+        advance(parser);
+
+        Node *right = parse_factor(parser);
+        if (right == NULL) {
+            free_node(left);
+            return NULL;
+        }
+        left = limit_depth(parser, create_node(type, left, right));
+    }
+
+    return left;
+}
+
+Node* parse_expression(Parser *parser) {
+    Node *left = parse_term(parser);
+
+    while (left != NULL) {
+        NodeType type;
+        if (parser->token.type == TOKEN_PLUS) {
+            type = NODE_ADD;
+        } else if (parser->token.type == TOKEN_MINUS) {
+            type = NODE_SUB;
+        } else {
+            break;
+        }
+        advance(parser);
+
+        Node *right = parse_term(parser);
+        if (right == NULL) {
+            free_node(left);
+            return NULL;
+        }
+        left = limit_depth(parser, create_node(type, left, right));
+    }
+
+    return left;
+}
+
+// Parses the rest of the input as one formula; trailing input is an error
+Node* parse_formula(Parser *parser) {
+    Node *root = parse_expression(parser);
+    if (root == NULL) return NULL;
+
+    if (parser->token.type != TOKEN_END) {
+        free_node(root);
+        return syntax_error(parser, "Unexpected character");
+    }
+    return root;
+}
+
+// Bytecode compiler
+
+typedef struct {
+    Program *program;
+    int code_capacity;
+    int constant_capacity;
+    int variable_capacity;
+    int depth;
+    int failed;
+} Compiler;
+
+static void emit(Compiler *compiler, OpCode op, int arg, int stack_effect) {
+    Program *program = compiler->program;
+
+    if (program->code_length == compiler->code_capacity) {
+        int capacity = compiler->code_capacity ? compiler->code_capacity * 2 : 16;
+        Instruction *code = realloc(program->code, capacity * sizeof(Instruction));
+        if (code == NULL) {
+            compiler->failed = 1;
+            return;
+        }
+        program->code = code;
+        compiler->code_capacity = capacity;
+    }
+
+    program->code[program->code_length].op = (unsigned char)op;
+    program->code[program->code_length].arg = arg;
+    program->code_length++;
+
+    compiler->depth += stack_effect;
+    if (compiler->depth > program->max_stack) {
+        program->max_stack = compiler->depth;
+    }
+}
+
+// Returns the constant pool slot for value, reusing an existing entry
+static int add_constant(Compiler *compiler, double value) {
+    Program *program = compiler->program;
+
+    for (int i = 0; i < program->constant_count; i++) {
+        if (memcmp(&program->constants[i], &value, sizeof(double)) == 0) {
+            return i;
+        }
+    }
+
+    if (program->constant_count == compiler->constant_capacity) {
+        int capacity = compiler->constant_capacity ? compiler->constant_capacity * 2 : 8;
+        double *constants = realloc(program->constants, capacity * sizeof(double));
+        if (constants == NULL) {
+            compiler->failed = 1;
+            return 0;
+        }
+        program->constants = constants;
+        compiler->constant_capacity = capacity;
+    }
+
+    program->constants[program->constant_count] = value;
+    return program->constant_count++;
+}
+
+int program_variable_index(const Program *program, const char *name) {
+    for (int i = 0; i < program->variable_count; i++) {
+        if (strcmp(program->variable_names[i], name) == 0) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+// Returns the variable slot for name, assigning the next free one
+static int add_variable(Compiler *compiler, const char *name) {
+    Program *program = compiler->program;
+    int index = program_variable_index(program, name);
+    if (index >= 0) return index;
+
+    if (program->variable_count == compiler->variable_capacity) {
+        int capacity = compiler->variable_capacity ? compiler->variable_capacity * 2 : 4;
+        char **names = realloc(program->variable_names, capacity * sizeof(char *));
+        if (names == NULL) {
+            compiler->failed = 1;
+            return 0;
+        }
+        program->variable_names = names;
+        compiler->variable_capacity = capacity;
+    }
+
+    char *copy = malloc(strlen(name) + 1);
+    if (copy == NULL) {
+        compiler->failed = 1;
+        return 0;
+    }
+    strcpy(copy, name);
+    program->variable_names[program->variable_count] = copy;
+    return program->variable_count++;
+}
+
+static OpCode opcode_for(NodeType type) {
+    switch (type) {
+        case NODE_NEG:  return OP_NEG;
+        case NODE_ADD:  return OP_ADD;
+        case NODE_SUB:  return OP_SUB;
+        case NODE_MUL:  return OP_MUL;
+        case NODE_DIV:  return OP_DIV;
+        case NODE_SIN:  return OP_SIN;
+        case NODE_COS:  return OP_COS;
+        case NODE_TAN:  return OP_TAN;
+        case NODE_LOG:  return OP_LOG;
+        case NODE_LN:   return OP_LN;
+        case NODE_SQRT: return OP_SQRT;
+        default:        return OP_POW;
+    }
+}
+
+// Emits the DAG in post-order. The first evaluation of a shared operation
+// stores its value in a local slot; later uses load it instead.
+static void compile_dag(Compiler *compiler, const ExpressionDag *dag, int id, int *local_of) {
+    const DagNode *node = &dag->nodes[id];
+    if (compiler->failed) return;
+
+    switch (node->type) {
+        case NODE_NUMBER:
+            emit(compiler, OP_CONST, add_constant(compiler, node->value), 1);
+            return;
+        case NODE_MEMORY:
+            emit(compiler, OP_MEMORY, 0, 1);
+            return;
+        case NODE_VARIABLE:
+            emit(compiler, OP_VARIABLE, add_variable(compiler, node->name), 1);
+            return;
+        default:
+            break;
+    }
+
+    if (local_of[id] >= 0) {
+        emit(compiler, OP_LOAD, local_of[id], 1);
+        return;
+    }
+
+    // Operands on the stack are replaced by the result
+    compile_dag(compiler, dag, node->left, local_of);
+    if (node->right >= 0) {
+        compile_dag(compiler, dag, node->right, local_of);
+        emit(compiler, opcode_for(node->type), 0, -1);
+    } else {
+        emit(compiler, opcode_for(node->type), 0, 0);
+    }
+
+    if (node->uses > 1 && compiler->program->local_count < PROGRAM_MAX_LOCALS) {
+        local_of[id] = compiler->program->local_count++;
+        emit(compiler, OP_STORE, local_of[id], 0);
+    }
+}
+
+Program* compile_node(const Node *root) {
+    Compiler compiler = {0};
+    ExpressionDag dag;
+
+    if (build_dag(root, &dag) != 0) {
+        return NULL;
+    }
+
+    compiler.program = calloc(1, sizeof(Program));
+    int *local_of = malloc(dag.count * sizeof(int));
+    if (compiler.program == NULL || local_of == NULL) {
+        printf("Memory allocation failed!\n");
+        free(compiler.program);
+        free(local_of);
+        free_dag(&dag);
+        return NULL;
+    }
+    for (int i = 0; i < dag.count; i++) {
+        local_of[i] = -1;
+    }
+
+    compile_dag(&compiler, &dag, dag.root, local_of);
+    compiler.program->stats = dag.stats;
+    free(local_of);
+    free_dag(&dag);
+
+    if (compiler.failed || compiler.program->max_stack > PROGRAM_MAX_STACK) {
+        free_program(compiler.program);
+        return NULL;
+    }
+    return compiler.program;
+}
+
+Program* compile_expression(const char *text, ParseError *error) {
+    return compile_with_symbols(text, NULL, error);
+}
+
+Program* compile_with_symbols(const char *text, const SymbolTable *symbols, ParseError *error) {
+    Parser parser;
+    init_parser(&parser, text);
+    parser.symbols = symbols;
+
+    PROFILE_START(parse_start);
+    Node *root = parse_formula(&parser);
+    PROFILE_END(PROFILE_PARSE, parse_start);
+    if (error != NULL) {
+        *error = parser.error;
+    }
+    if (root == NULL) return NULL;
+    PROFILE_DEPTH(PROFILE_TREE_DEPTH, root->depth);
+
+    PROFILE_START(compile_start);
+    Program *program = compile_node(root);
+    PROFILE_END(PROFILE_COMPILE, compile_start);
+    free_node(root);
+    return program;
+}
+
+void free_program(Program *program) {
+    if (program == NULL) return;
+    free(program->code);
+    free(program->constants);
+    for (int i = 0; i < program->variable_count; i++) {
+        free(program->variable_names[i]);
+    }
+    free(program->variable_names);
+    free(program);
+}
+
+// Bytecode interpreter: never looks at the source text
+
+double evaluate_program(const Program *program, EvalEnv *env) {
+    double stack[PROGRAM_MAX_STACK];
+    double locals[PROGRAM_MAX_LOCALS];
+    int top = -1;
+    const Instruction *pc = program->code;
+    const Instruction *end = pc + program->code_length;
+    PROFILE_START(start);
+    PROFILE_DEPTH(PROFILE_STACK_DEPTH, program->max_stack);
+
+    env->error = EVAL_OK;
+
+    for (; pc < end; pc++) {
+        PROFILE_OP(pc->op);
+        switch (pc->op) {
+            case OP_CONST:  stack[++top] = program->constants[pc->arg]; break;
+            case OP_MEMORY: stack[++top] = env->memory; break;
+            case OP_VARIABLE: stack[++top] = env->variables[pc->arg]; break;
+            case OP_NEG:    stack[top] = -stack[top]; break;
+            case OP_ADD:    top--; stack[top] += stack[top + 1]; break;
+            case OP_SUB:    top--; stack[top] -= stack[top + 1]; break;
+            case OP_MUL:    top--; stack[top] *= stack[top + 1]; break;
+            case OP_DIV:
+                top--;
+                if (stack[top + 1] == 0) {
+                    env->error = EVAL_DIVISION_BY_ZERO;
+                    PROFILE_END(PROFILE_EVALUATE, start);
+                    return 0;
+                }
+                stack[top] /= stack[top + 1];
+                break;
+            case OP_SIN:    PROFILE_MATH(OP_SIN, stack[top] = sin(stack[top])); break;
+            case OP_COS:    PROFILE_MATH(OP_COS, stack[top] = cos(stack[top])); break;
+            case OP_TAN:    PROFILE_MATH(OP_TAN, stack[top] = tan(stack[top])); break;
+            case OP_LOG:    PROFILE_MATH(OP_LOG, stack[top] = log10(stack[top])); break;
+            case OP_LN:     PROFILE_MATH(OP_LN, stack[top] = log(stack[top])); break;
+            case OP_SQRT:   PROFILE_MATH(OP_SQRT, stack[top] = sqrt(stack[top])); break;
+            case OP_POW:    top--; PROFILE_MATH(OP_POW, stack[top] = pow(stack[top], stack[top + 1])); break;
+            case OP_STORE:  locals[pc->arg] = stack[top]; break;
+            case OP_LOAD:   stack[++top] = locals[pc->arg]; break;
+        }
+    }
+
+    PROFILE_END(PROFILE_EVALUATE, start);
+    return stack[top];
+}
+
+double evaluate_expression(const char *expression, EvalEnv *env) {
+    Program *program = compile_expression(expression, NULL);
+    if (program == NULL) {
+        env->error = EVAL_SYNTAX_ERROR;
+        return 0;
+    }
+    double result = evaluate_program(program, env);
+    free_program(program);
+    return result;
+}
+
+void init_context(CalcContext *context) {
+    context->memory = 0.0;
+    context->error[0] = '\0';
+    context->cache = NULL;
+    context->symbols = NULL;
+    context->programs = NULL;
+}
+
+void report_parse_error(CalcContext *context, const ParseError *error) {
+    if (error->position >= 0) {
+        snprintf(context->error, sizeof(context->error), "%s at position %d",
+                 error->message, error->position + 1);
+    } else {
+        snprintf(context->error, sizeof(context->error), "Invalid expression");
+    }
+}
+
+// Evaluates a compiled program, binding its variables to let definitions,
+// through tiered when the program has one
+static int run_program(CalcContext *context, const Program *program, TieredProgram *tiered, double *result) {
+    double stack_values[16];
+    double *values = stack_values;
+    if (program->variable_count > 16) {
+        values = malloc(program->variable_count * sizeof(double));
+        if (values == NULL) {
+            snprintf(context->error, sizeof(context->error), "Memory allocation failed!");
+            return -1;
+        }
+    }
+
+    for (int i = 0; i < program->variable_count; i++) {
+        const char *name = program->variable_names[i];
+        const Symbol *symbol = find_symbol(context->symbols, name, (int)strlen(name));
+        if (symbol == NULL || symbol->kind != SYMBOL_VARIABLE) {
+            snprintf(context->error, sizeof(context->error), "Unknown variable '%.64s'", name);
+            if (values != stack_values) free(values);
+            return -1;
+        }
+        values[i] = symbol->value;
+    }
+
+    EvalEnv env = { context->memory, values, EVAL_OK };
+    *result = tiered != NULL ? evaluate_tiered(tiered, &env) : evaluate_program(program, &env);
+    if (values != stack_values) free(values);
+
+    if (env.error == EVAL_DIVISION_BY_ZERO) {
+        snprintf(context->error, sizeof(context->error), "Division by zero!");
+        return -1;
+    }
+    return 0;
+}
+
+// User functions are inlined when parsed, so a call to one whose body
+// reads MR depends on memory without MR appearing in the text
+static int calls_memory_function(const SymbolTable *symbols, const char *key) {
+    if (symbols == NULL) return 0;
+    const char *p = key;
+    while (*p) {
+        if (!isalnum((unsigned char)*p) && *p != '_') {
+            p++;
+            continue;
+        }
+        const char *start = p;
+        while (isalnum((unsigned char)*p) || *p == '_') p++;
+        if (*p == '(' && !isdigit((unsigned char)*start)) {
+            const Symbol *symbol = find_symbol(symbols, start, (int)(p - start));
+            if (symbol != NULL && symbol->kind == SYMBOL_FUNCTION && symbol->reads_memory) return 1;
+        }
+    }
+    return 0;
+}
+
+static int program_reads_memory(const Program *program) {
+    for (int i = 0; i < program->code_length; i++) {
+        if (program->code[i].op == OP_MEMORY) return 1;
+    }
+    return 0;
+}
+
+// Parses, compiles and evaluates text against the context, or returns the
+// memoized result when the context has a cache that holds it.
+// Returns 0 on success, or -1 with a message in context->error.
+int calculate(CalcContext *context, const char *text, double *result) {
+    char key[CACHE_MAX_KEY];
+    int key_length = -1;
+    int uses_memory = 0;
+    if (context->cache != NULL || context->programs != NULL) {
+        key_length = normalize_expression(text, key, sizeof(key), &uses_memory);
+    }
+    int memoize = key_length >= 0 && context->cache != NULL;
+    if (memoize) {
+        if (!uses_memory) uses_memory = calls_memory_function(context->symbols, key);
+        if (cache_lookup(context->cache, key, key_length, uses_memory, context->memory, result)) {
+            return 0;
+        }
+    }
+
+    TieredProgram *tiered = NULL;
+    if (key_length >= 0 && context->programs != NULL) {
+        tiered = find_tiered(context->programs, key, key_length);
+    }
+    Program *program = tiered != NULL ? tiered->program : NULL;
+    if (program == NULL) {
+        ParseError parse_error;
+        program = compile_with_symbols(text, context->symbols, &parse_error);
+        if (program == NULL) {
+            report_parse_error(context, &parse_error);
+            return -1;
+        }
+        if (key_length >= 0 && context->programs != NULL) {
+            tiered = add_tiered(context->programs, key, key_length, program, 1);
+        }
+    }
+
+    // A program reading memory the key does not account for is not cached
+    if (memoize && !uses_memory && program_reads_memory(program)) {
+        memoize = 0;
+    }
+    int status = run_program(context, program, tiered, result);
+    if (tiered == NULL) free_program(program);
+
+    if (status == 0 && memoize) {
+        cache_store(context->cache, key, key_length, uses_memory, context->memory, *result);
+    }
+    return status;
+}
+
+// Definitions
+
+static int is_keyword(const Parser *parser, const Token *token) {
+    return token_is(parser, token, "let") || token_is(parser, token, "def");
+}
+
+int is_definition(const char *text) {
+    Parser parser;
+    init_parser(&parser, text);
+    return parser.token.type == TOKEN_IDENTIFIER && is_keyword(&parser, &parser.token);
+}
+
+// Checks that the current token can name a user symbol and copies it
+static char* parse_new_name(Parser *parser, const char *what) {
+    Token token = parser->token;
+    const char *name = parser->input + token.position;
+    if (token.type != TOKEN_IDENTIFIER) {
+        syntax_error(parser, what);
+        return NULL;
+    }
+    if (find_builtin(name, token.length) != NULL || is_keyword(parser, &token)) {
+        syntax_error(parser, "Cannot redefine a built-in name");
+        return NULL;
+    }
+    advance(parser);
+
+    char *copy = malloc(token.length + 1);
+    if (copy == NULL) {
+        syntax_error(parser, "Memory allocation failed!");
+        return NULL;
+    }
+    memcpy(copy, name, token.length);
+    copy[token.length] = '\0';
+    return copy;
+}
+
+// Parses "(A, B)" after a function name; returns the parameter count or -1
+static int parse_parameters(Parser *parser, char **parameters) {
+    if (!accept(parser, TOKEN_LPAREN)) {
+        syntax_error(parser, "Expected '(' after function name");
+        return -1;
+    }
+    if (accept(parser, TOKEN_RPAREN)) return 0;
+
+    int count = 0;
+    do {
+        if (count == MAX_PARAMETERS) {
+            syntax_error(parser, "Too many parameters");
+            break;
+        }
+        int position = parser->token.position;
+        char *name = parse_new_name(parser, "Expected a parameter name");
+        if (name == NULL) break;
+        for (int i = 0; i < count; i++) {
+            if (strcmp(parameters[i], name) == 0) {
+                syntax_error_at(parser, position, "Duplicate parameter name");
+                free(name);
+                name = NULL;
+                break;
+            }
+        }
+        if (name == NULL) break;
+        parameters[count++] = name;
+    } while (accept(parser, TOKEN_COMMA));
+
+    if (parser->error.position < 0 && !accept(parser, TOKEN_RPAREN)) {
+        syntax_error(parser, "Expected ')'");
+    }
+    if (parser->error.position >= 0) {
+        for (int i = 0; i < count; i++) {
+            free(parameters[i]);
+        }
+        return -1;
+    }
+    return count;
+}
+
+int define_symbol(CalcContext *context, const char *text, double *value) {
+    if (context->symbols == NULL) {
+        snprintf(context->error, sizeof(context->error), "Definitions are not available");
+        return -1;
+    }
+
+    Parser parser;
+    init_parser(&parser, text);
+    parser.symbols = context->symbols;
+    int is_function = token_is(&parser, &parser.token, "def");
+    advance(&parser);
+
+    char *parameters[MAX_PARAMETERS];
+    int parameter_count = 0;
+    Node *body = NULL;
+    char *name = parse_new_name(&parser, "Expected a name");
+    if (name != NULL && is_function) {
+        parameter_count = parse_parameters(&parser, parameters);
+    }
+    if (name != NULL && parameter_count >= 0) {
+        if (accept(&parser, TOKEN_EQUALS)) {
+            body = parse_formula(&parser);
+        } else {
+            syntax_error(&parser, "Expected '='");
+        }
+    }
+    if (body == NULL) {
+        report_parse_error(context, &parser.error);
+        for (int i = 0; i < parameter_count; i++) {
+            free(parameters[i]);
+        }
+        free(name);
+        return -1;
+    }
+
+    int status = 0;
+    if (is_function) {
+        // The table keeps its own copy of the parameter list
+        char **list = malloc((parameter_count ? parameter_count : 1) * sizeof(char *));
+        if (list == NULL) {
+            for (int i = 0; i < parameter_count; i++) {
+                free(parameters[i]);
+            }
+            free_node(body);
+            snprintf(context->error, sizeof(context->error), "Memory allocation failed!");
+            status = -1;
+        } else {
+            memcpy(list, parameters, parameter_count * sizeof(char *));
+            if (set_function(context->symbols, name, list, parameter_count, body) != 0) {
+                snprintf(context->error, sizeof(context->error), "Memory allocation failed!");
+                status = -1;
+            }
+        }
+    } else {
+        Program *program = compile_node(body);
+        free_node(body);
+        if (program == NULL) {
+            snprintf(context->error, sizeof(context->error), "Invalid expression");
+            status = -1;
+        } else {
+            status = run_program(context, program, NULL, value);
+            free_program(program);
+        }
+        if (status == 0 && set_variable(context->symbols, name, *value) != 0) {
+            snprintf(context->error, sizeof(context->error), "Memory allocation failed!");
+            status = -1;
+        }
+    }
+    free(name);
+    if (status != 0) return -1;
+
+    // Cached results and programs may depend on the old definition
+    if (context->cache != NULL) {
+        cache_clear(context->cache);
+    }
+    if (context->programs != NULL) {
+        clear_tiered_table(context->programs);
+    }
+    return 0;
+}
@@ -0,0 +1,170 @@
+#ifndef EXPRESSION_PARSER_H
+#define EXPRESSION_PARSER_H
+
+#include "lexer.h"
+
+// Expression tree built by the recursive descent parser
+typedef enum {
+    NODE_NUMBER,
+    NODE_MEMORY,
+    NODE_VARIABLE,
+    NODE_NEG,
+    NODE_ADD,
+    NODE_SUB,
+    NODE_MUL,
+    NODE_DIV,
+    NODE_SIN,
+    NODE_COS,
+    NODE_TAN,
+    NODE_LOG,
+    NODE_LN,
+    NODE_SQRT,
+    NODE_POW
+} NodeType;
+
+typedef struct Node {
+    NodeType type;
+    int depth;              // height of the subtree; a leaf is 1
+    double value;           // NODE_NUMBER only
+    char *name;             // NODE_VARIABLE: identifier; NODE_NUMBER: literal text
+    struct Node *left;      // operand / first argument
+    struct Node *right;     // second operand / argument
+} Node;
+
+// Flat stack-based bytecode
+typedef enum {
+    OP_CONST,               // push constants[arg]
+    OP_MEMORY,              // push env->memory
+    OP_VARIABLE,            // push env->variables[arg]
+    OP_NEG,
+    OP_ADD,
+    OP_SUB,
+    OP_MUL,
+    OP_DIV,
+    OP_SIN,
+    OP_COS,
+    OP_TAN,
+    OP_LOG,
+    OP_LN,
+    OP_SQRT,
+    OP_POW,
+    OP_STORE,               // locals[arg] = top of stack (value stays pushed)
+    OP_LOAD                 // push locals[arg]
+} OpCode;
+
+typedef struct {
+    unsigned char op;
+    int arg;
+} Instruction;
+
+#define PROGRAM_MAX_STACK 256
+#define PROGRAM_MAX_LOCALS 64
+
+// What the optimizer did while compiling a program
+typedef struct {
+    int tree_nodes;         // nodes in the parsed tree
+    int dag_nodes;          // nodes left after folding and sharing
+    int folded_nodes;       // operations computed at compile time
+    int shared_nodes;       // operations reused from an identical subexpression
+} OptimizeStats;
+
+typedef struct {
+    Instruction *code;
+    int code_length;
+    double *constants;      // constant pool
+    int constant_count;
+    int max_stack;          // deepest stack the program reaches
+    char **variable_names;  // free variables, indexed by OP_VARIABLE slot
+    int variable_count;
+    int local_count;        // slots holding shared subexpressions
+    OptimizeStats stats;
+} Program;
+
+// Evaluation errors reported through EvalEnv
+#define EVAL_OK 0
+#define EVAL_DIVISION_BY_ZERO 1
+#define EVAL_SYNTAX_ERROR 2
+#define EVAL_OUT_OF_RANGE 3     // result not representable (numeric backends)
+
+typedef struct {
+    double memory;          // value returned by MR
+    const double *variables; // one value per Program variable slot
+    int error;              // EVAL_OK or an EVAL_* error code
+} EvalEnv;
+
+// Parser state; one per thread of parsing
+struct SymbolTable;
+
+// Deepest tree (and deepest nesting of parentheses, signs and calls) the
+// parser accepts. Every pass over a tree recurses once per level, so this
+// bounds their stack use; the limit is a Parser field and can be changed.
+#define PARSER_DEFAULT_MAX_DEPTH 1024
+
+// Nodes that inlining user function calls may create in one parse; a
+// parameter used several times copies its argument each time, so nested
+// calls would otherwise grow exponentially
+#define PARSER_MAX_INLINED_NODES (1L << 18)
+
+typedef struct {
+    int position;           // offset of the first error, -1 if none
+    char message[64];
+} ParseError;
+
+typedef struct {
+    const char *input;
+    Lexer lexer;
+    Token token;            // current token, not yet consumed
+    const struct SymbolTable *symbols;  // user functions to inline (NULL: none)
+    int depth;              // parse_factor calls in progress
+    int max_depth;          // PARSER_DEFAULT_MAX_DEPTH unless changed after init_parser
+    long inlined_nodes;     // created by inlining so far
+    ParseError error;
+} Parser;
+
+// Parsing
+Node* create_node(NodeType type, Node *left, Node *right);
+Node* create_number_node(double value);
+Node* create_variable_node(const char *name, int length);
+Node* create_literal_node(const char *text, int length, double value);
+Node* copy_node(const Node *node);
+void free_node(Node *node);
+void init_parser(Parser *parser, const char *text);
+Node* parse_expression(Parser *parser);
+Node* parse_term(Parser *parser);
+Node* parse_factor(Parser *parser);
+Node* parse_formula(Parser *parser);
+
+// Compilation and evaluation
+Program* compile_node(const Node *root);
+Program* compile_expression(const char *text, ParseError *error);
+Program* compile_with_symbols(const char *text, const struct SymbolTable *symbols, ParseError *error);
+double evaluate_program(const Program *program, EvalEnv *env);
+int program_variable_index(const Program *program, const char *name);
+void free_program(Program *program);
+
+// One-shot parse, compile and evaluate (re-parses the text every call)
+double evaluate_expression(const char *expression, EvalEnv *env);
+
+// Per-context calculator state. Every thread evaluating expressions owns
+// its own context, so memory and error messages are never shared.
+struct ResultCache;
+struct TieredTable;
+
+typedef struct {
+    double memory;          // value returned by MR
+    char error[96];         // message describing the last failed calculation
+    struct ResultCache *cache;  // optional memoized results (NULL: none)
+    struct SymbolTable *symbols; // let / def definitions (NULL: none)
+    struct TieredTable *programs; // optional compiled programs, JIT-compiled once hot (NULL: none)
+} CalcContext;
+
+void init_context(CalcContext *context);
+void report_parse_error(CalcContext *context, const ParseError *error);
+int calculate(CalcContext *context, const char *text, double *result);
+
+// "let NAME = EXPR" stores the value of EXPR (also returned in *value);
+// "def NAME(A, B) = EXPR" defines a function. Returns 0 or -1 on error.
+int is_definition(const char *text);
+int define_symbol(CalcContext *context, const char *text, double *value);
+
+#endif
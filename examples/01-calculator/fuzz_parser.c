@@ -0,0 +1,310 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <math.h>
+#include "expression_parser.h"
+
+// Fuzz target for the parser, compiler and evaluator. Built with
+// -DFUZZ_LIBFUZZER it is a libFuzzer target (make fuzz). Otherwise main()
+// checks each file named on the command line, or stdin, which is how AFL
+// runs it; --random N checks N generated expressions instead.
+//
+// Every input must either fail to parse with an error position inside the
+// text, or give a tree whose recorded depths are right and within the
+// parser's limit. A tree that fits the evaluation stack must compile, and
+// the program must agree bit for bit with walking the tree directly.
+// Any failure aborts, which both fuzzers report as a crash.
+
+#define FUZZ_MAX_DEPTH 200          // lower than the default, so the limit is hit often
+#define FUZZ_MEMORY 2.5             // value of MR
+#define RANDOM_LENGTH 4096
+
+static const char *current_input;
+
+static void fail(const char *what) {
+    printf("FAIL: %s for input '%.200s'\n", what, current_input);
+    abort();
+}
+
+static double variable_value(const char *name) {
+    double value = 0.25;
+    for (; *name; name++) {
+        value += (unsigned char)*name * 0.01;
+    }
+    return value;
+}
+
+// Recomputes every subtree's depth; recursion is bounded by the limit
+static int check_depths(const Node *node) {
+    if (node == NULL) return 0;
+    int left = check_depths(node->left);
+    int right = check_depths(node->right);
+    int depth = 1 + (left > right ? left : right);
+    if (node->depth != depth) fail("wrong depth recorded in tree");
+    return depth;
+}
+
+static double evaluate_tree(const Node *node, int *error) {
+    double left = node->left ? evaluate_tree(node->left, error) : 0.0;
+    double right = node->right ? evaluate_tree(node->right, error) : 0.0;
+
+    switch (node->type) {
+        case NODE_NUMBER:   return node->value;
+        case NODE_MEMORY:   return FUZZ_MEMORY;
+        case NODE_VARIABLE: return variable_value(node->name);
+        case NODE_NEG:      return -left;
+        case NODE_ADD:      return left + right;
+        case NODE_SUB:      return left - right;
+        case NODE_MUL:      return left * right;
+        case NODE_DIV:
+            if (right == 0) {
+                *error = 1;
+                return 0.0;
+            }
+            return left / right;
+        case NODE_SIN:      return sin(left);
+        case NODE_COS:      return cos(left);
+        case NODE_TAN:      return tan(left);
+        case NODE_LOG:      return log10(left);
+        case NODE_LN:       return log(left);
+        case NODE_SQRT:     return sqrt(left);
+        case NODE_POW:      return pow(left, right);
+    }
+    return 0.0;
+}
+
+static int same_double(double a, double b) {
+    return (isnan(a) && isnan(b)) || memcmp(&a, &b, sizeof(double)) == 0;
+}
+
+static void check_program(const Node *root) {
+    Program *program = compile_node(root);
+    if (program == NULL) {
+        // Only a tree deeper than the evaluation stack may be refused
+        if (root->depth <= PROGRAM_MAX_STACK) fail("compile_node refused a tree that fits the stack");
+        return;
+    }
+    if (program->max_stack > PROGRAM_MAX_STACK) fail("program exceeds the evaluation stack");
+
+    double values[64];
+    double *variables = program->variable_count <= 64 ? values
+                                                      : malloc(program->variable_count * sizeof(double));
+    if (variables == NULL) {
+        free_program(program);
+        return;
+    }
+    for (int i = 0; i < program->variable_count; i++) {
+        variables[i] = variable_value(program->variable_names[i]);
+    }
+
+    EvalEnv env = { FUZZ_MEMORY, variables, EVAL_OK };
+    double result = evaluate_program(program, &env);
+    int tree_error = 0;
+    double expected = evaluate_tree(root, &tree_error);
+
+    if ((env.error != EVAL_OK) != tree_error) {
+        fail("division by zero reported differently");
+    }
+    if (!tree_error && !same_double(result, expected)) {
+        printf("program gave %.17g, tree gave %.17g\n", result, expected);
+        fail("program and tree disagree");
+    }
+
+    if (variables != values) free(variables);
+    free_program(program);
+}
+
+static void check_input(const char *text, int max_depth) {
+    current_input = text;
+
+    Parser parser;
+    init_parser(&parser, text);
+    parser.max_depth = max_depth;
+    Node *root = parse_formula(&parser);
+
+    if (root == NULL) {
+        int length = (int)strlen(text);
+        if (parser.error.position < 0 || parser.error.position > length) fail("error position outside the input");
+        if (parser.error.message[0] == '\0') fail("error without a message");
+        return;
+    }
+    if (parser.error.position >= 0) fail("tree returned along with an error");
+    if (parser.depth != 0) fail("parser depth not unwound");
+    if (root->depth > max_depth) fail("tree deeper than the limit");
+    check_depths(root);
+    check_program(root);
+    free_node(root);
+}
+
+#ifdef FUZZ_LIBFUZZER
+
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size) {
+    char *text = malloc(size + 1);
+    if (text == NULL) return 0;
+    memcpy(text, data, size);
+    text[size] = '\0';
+    check_input(text, FUZZ_MAX_DEPTH);
+    free(text);
+    return 0;
+}
+
+#else
+
+static unsigned long long random_state = 88172645463325252ULL;
+
+static unsigned int next_random() {
+    random_state ^= random_state << 13;
+    random_state ^= random_state >> 7;
+    random_state ^= random_state << 17;
+    return (unsigned int)(random_state >> 32);
+}
+
+static void append(char *out, size_t *length, const char *text) {
+    size_t size = strlen(text);
+    if (*length + size >= RANDOM_LENGTH) return;
+    memcpy(out + *length, text, size + 1);
+    *length += size;
+}
+
+// Mostly well-formed expressions from the calculator's grammar
+static void generate(char *out, size_t *length, int depth) {
+    static const char *leaves[] = {
+        "0", "1", "2.5", ".5", "1e308", "1e-320", "0x1F", "123456789012345678901234", "x", "y", "rate",
+        "MR", "pi", "e", "0.0", "3", "7"
+    };
+    static const char *unary[] = { "sin(", "cos(", "tan(", "log(", "ln(", "sqrt(", "-", "(" };
+    static const char *binary[] = { " + ", "-", "*", " / ", "+" };
+
+    unsigned int choice = next_random() % (depth > 12 ? 2 : 10);
+    if (choice < 2) {
+        append(out, length, leaves[next_random() % (sizeof(leaves) / sizeof(leaves[0]))]);
+    } else if (choice < 5) {
+        const char *prefix = unary[next_random() % (sizeof(unary) / sizeof(unary[0]))];
+        append(out, length, prefix);
+        generate(out, length, depth + 1);
+        if (prefix[0] != '-') append(out, length, ")");
+    } else if (choice < 6) {
+        append(out, length, "pow(");
+        generate(out, length, depth + 1);
+        append(out, length, ", ");
+        generate(out, length, depth + 1);
+        append(out, length, ")");
+    } else {
+        generate(out, length, depth + 1);
+        append(out, length, binary[next_random() % (sizeof(binary) / sizeof(binary[0]))]);
+        generate(out, length, depth + 1);
+    }
+}
+
+// Flips, inserts or deletes a few characters
+static void mutate(char *text, size_t *length) {
+    static const char alphabet[] = "0123456789.eExX+-*/(),= \tabcMRpisnqrtowl\x80";
+    int edits = 1 + next_random() % 3;
+    for (int i = 0; i < edits && *length > 0; i++) {
+        size_t at = next_random() % *length;
+        char c = alphabet[next_random() % (sizeof(alphabet) - 1)];
+        switch (next_random() % 3) {
+            case 0:
+                text[at] = c;
+                break;
+            case 1:
+                if (*length + 1 < RANDOM_LENGTH) {
+                    memmove(text + at + 1, text + at, *length - at + 1);
+                    text[at] = c;
+                    (*length)++;
+                }
+                break;
+            default:
+                memmove(text + at, text + at + 1, *length - at);
+                (*length)--;
+                break;
+        }
+    }
+}
+
+// Inputs far past any limit, checked with the fuzzing and the default limits
+static void check_deep_inputs() {
+    static const char *units[][3] = {
+        { "(", "1", ")" },          // parentheses
+        { "-", "x", "" },           // signs
+        { "sqrt(", "2", ")" },      // calls
+        { "", "1", "+1" },          // a long left-leaning chain
+        { "1+(", "1", ")" },        // right-leaning, needs a deep stack
+    };
+    const int count = 100000;
+    for (size_t u = 0; u < sizeof(units) / sizeof(units[0]); u++) {
+        size_t open = strlen(units[u][0]), middle = strlen(units[u][1]), close = strlen(units[u][2]);
+        char *text = malloc(count * (open + close) + middle + 1);
+        if (text == NULL) fail("out of memory");
+        char *p = text;
+        for (int i = 0; i < count; i++, p += open) memcpy(p, units[u][0], open);
+        memcpy(p, units[u][1], middle);
+        p += middle;
+        for (int i = 0; i < count; i++, p += close) memcpy(p, units[u][2], close);
+        *p = '\0';
+
+        check_input(text, FUZZ_MAX_DEPTH);
+        check_input(text, PARSER_DEFAULT_MAX_DEPTH);
+        free(text);
+    }
+}
+
+static int run_random(long count) {
+    printf("Testing parser with %ld generated inputs\n", count);
+    printf("==========================================\n");
+
+    check_deep_inputs();
+
+    char text[RANDOM_LENGTH];
+    for (long i = 0; i < count; i++) {
+        size_t length = 0;
+        text[0] = '\0';
+        generate(text, &length, 0);
+        if (next_random() % 4 == 0) mutate(text, &length);
+        check_input(text, i % 2 ? FUZZ_MAX_DEPTH : 8);
+    }
+
+    printf("\nAll tests completed successfully!\n");
+    return 0;
+}
+
+static char* read_all(FILE *file) {
+    size_t length = 0, capacity = 4096;
+    char *text = malloc(capacity);
+    while (text != NULL) {
+        length += fread(text + length, 1, capacity - length - 1, file);
+        if (length < capacity - 1) break;
+        capacity *= 2;
+        char *larger = realloc(text, capacity);
+        if (larger == NULL) free(text);
+        text = larger;
+    }
+    if (text != NULL) text[length] = '\0';
+    return text;
+}
+
+int main(int argc, char *argv[]) {
+    if (argc == 3 && strcmp(argv[1], "--random") == 0) {
+        return run_random(atol(argv[2]));
+    }
+
+    for (int i = argc > 1 ? 1 : 0; i < argc; i++) {
+        FILE *file = argc > 1 ? fopen(argv[i], "rb") : stdin;
+        if (file == NULL) {
+            fprintf(stderr, "Error: Cannot open file '%s'\n", argv[i]);
+            return 1;
+        }
+        char *text = read_all(file);
+        if (file != stdin) fclose(file);
+        if (text == NULL) {
+            printf("Memory allocation failed!\n");
+            return 1;
+        }
+        check_input(text, FUZZ_MAX_DEPTH);
+        free(text);
+    }
+    return 0;
+}
+
+#endif
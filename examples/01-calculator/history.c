@@ -0,0 +1,262 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "history.h"
+
+// The arena is used as a byte ring: live strings run from the oldest
+// entry's offset up to arena_write, possibly wrapping once to offset 0.
+// A string never straddles the end of the arena; if it does not fit in the
+// tail it is placed at offset 0 and the tail is left unused until the
+// writer comes around again. Entries are evicted only by count: when a
+// string does not fit anywhere, the arena doubles and the live strings are
+// copied to its front, oldest first.
+
+static unsigned int prefix_hash(const char *text) {
+    unsigned int hash = 2166136261u;
+    for (int i = 0; i < HISTORY_INDEX_PREFIX && text[i] != '\0'; i++) {
+        hash = (hash ^ (unsigned char)text[i]) * 16777619u;
+    }
+    return hash;
+}
+
+HistoryManager* create_history_manager(size_t capacity) {
+    if (capacity == 0 || capacity >= HISTORY_NONE) {
+        printf("Error: Invalid history size %zu\n", capacity);
+        return NULL;
+    }
+
+    HistoryManager *manager = calloc(1, sizeof(HistoryManager));
+    if (manager == NULL) {
+        printf("Memory allocation failed!\n");
+        return NULL;
+    }
+
+    size_t buckets = 16;
+    while (buckets < capacity) buckets *= 2;
+
+    manager->capacity = capacity;
+    manager->arena_size = capacity * HISTORY_BYTES_PER_ENTRY;
+    if (manager->arena_size < HISTORY_MIN_ARENA) manager->arena_size = HISTORY_MIN_ARENA;
+    manager->bucket_mask = buckets - 1;
+    manager->entries = malloc(capacity * sizeof(HistoryEntry));
+    manager->arena = malloc(manager->arena_size);
+    manager->buckets = malloc(buckets * sizeof(unsigned int));
+
+    if (manager->entries == NULL || manager->arena == NULL || manager->buckets == NULL) {
+        printf("Memory allocation failed!\n");
+        free_history_manager(manager);
+        return NULL;
+    }
+    memset(manager->buckets, 0xff, buckets * sizeof(unsigned int));
+    return manager;
+}
+
+const char* history_expression(const HistoryManager *manager, const HistoryEntry *entry) {
+    return manager->arena + entry->offset;
+}
+
+// Returns the entry age steps back from the newest one (0 = newest)
+const HistoryEntry* history_entry(const HistoryManager *manager, size_t age) {
+    if (age >= manager->count) return NULL;
+    size_t index = (manager->oldest + manager->count - 1 - age) % manager->capacity;
+    return &manager->entries[index];
+}
+
+static void unlink_entry(HistoryManager *manager, unsigned int index) {
+    HistoryEntry *entry = &manager->entries[index];
+    if (entry->newer != HISTORY_NONE) {
+        manager->entries[entry->newer].older = entry->older;
+    } else {
+        unsigned int bucket = prefix_hash(history_expression(manager, entry)) & manager->bucket_mask;
+        manager->buckets[bucket] = entry->older;
+    }
+    if (entry->older != HISTORY_NONE) {
+        manager->entries[entry->older].newer = entry->newer;
+    }
+}
+
+static void evict_oldest(HistoryManager *manager) {
+    unlink_entry(manager, (unsigned int)manager->oldest);
+    manager->oldest = (manager->oldest + 1) % manager->capacity;
+    manager->count--;
+    if (manager->count == 0) {
+        manager->oldest = 0;
+        manager->arena_write = 0;
+    }
+}
+
+// Moves the live strings, oldest first, to the front of an arena at least
+// twice as large with room for length more bytes. Returns -1 if out of memory.
+static int grow_arena(HistoryManager *manager, size_t length) {
+    size_t used = 0;
+    for (size_t age = 0; age < manager->count; age++) {
+        used += history_entry(manager, age)->length;
+    }
+    size_t size = manager->arena_size * 2;
+    while (size < used + length) size *= 2;
+    char *arena = malloc(size);
+    if (arena == NULL) return -1;
+
+    size_t write = 0;
+    for (size_t i = 0; i < manager->count; i++) {
+        HistoryEntry *entry = &manager->entries[(manager->oldest + i) % manager->capacity];
+        memcpy(arena + write, manager->arena + entry->offset, entry->length);
+        entry->offset = write;
+        write += entry->length;
+    }
+    free(manager->arena);
+    manager->arena = arena;
+    manager->arena_size = size;
+    manager->arena_write = write;
+    return 0;
+}
+
+// Finds room for length bytes in the arena, growing it as needed. Old
+// entries are evicted only if it cannot grow.
+static size_t reserve_arena(HistoryManager *manager, size_t length) {
+    while (1) {
+        size_t write = manager->arena_write;
+        if (manager->count == 0) {
+            if (length <= manager->arena_size) return 0;
+        } else {
+            size_t start = manager->entries[manager->oldest].offset;
+            if (write > start) {
+                // Live bytes are [start, write): use the tail, or wrap to the front
+                if (length <= manager->arena_size - write) return write;
+                if (length < start) return 0;
+            } else if (length < start - write) {
+                // Live bytes wrapped: the gap is [write, start)
+                return write;
+            }
+        }
+        if (grow_arena(manager, length) != 0) {
+            if (manager->count == 0) return (size_t)-1;
+            evict_oldest(manager);
+        }
+    }
+}
+
+void add_to_history(HistoryManager *manager, const char *expression, double result) {
+    size_t length = strlen(expression) + 1;
+    if (manager->count == manager->capacity) {
+        evict_oldest(manager);
+    }
+    size_t offset = reserve_arena(manager, length);
+    if (offset == (size_t)-1) {
+        printf("Memory allocation failed!\n");
+        return;
+    }
+    memcpy(manager->arena + offset, expression, length);
+    manager->arena_write = offset + length;
+
+    unsigned int index = (unsigned int)((manager->oldest + manager->count) % manager->capacity);
+    unsigned int bucket = prefix_hash(expression) & manager->bucket_mask;
+    HistoryEntry *entry = &manager->entries[index];
+
+    entry->offset = offset;
+    entry->length = (unsigned int)length;
+    entry->result = result;
+    entry->newer = HISTORY_NONE;
+    entry->older = manager->buckets[bucket];
+    if (entry->older != HISTORY_NONE) {
+        manager->entries[entry->older].newer = index;
+    }
+    manager->buckets[bucket] = index;
+    manager->count++;
+}
+
+// Formats one row as snprintf would, returning the length it needed
+static int format_row(char *text, size_t size, size_t age, const HistoryManager *manager,
+                      const HistoryEntry *entry) {
+    return snprintf(text, size, "%-3zu %-30s %-15.6f\n", age + 1, history_expression(manager, entry),
+                    entry->result);
+}
+
+void show_history(HistoryManager *manager) {
+    if (manager->count == 0) {
+        printf("No history available.\n");
+        return;
+    }
+
+    // Rows are formatted into one buffer and written in large blocks
+    char buffer[HISTORY_PRINT_BUFFER];
+    size_t used = snprintf(buffer, sizeof(buffer), "\nCalculation History:\n%-3s %-30s %-15s\n%-3s %-30s %-15s\n",
+                           "#", "Expression", "Result", "---", "----------", "------");
+
+    for (size_t age = 0; age < manager->count; age++) {
+        const HistoryEntry *entry = history_entry(manager, age);
+        size_t space = sizeof(buffer) - used;
+        int length = format_row(buffer + used, space, age, manager, entry);
+        if (length < 0) continue;
+        if ((size_t)length >= space) {
+            // Did not fit: flush and format it again at the start, or print
+            // it directly if it is longer than the whole buffer
+            fwrite(buffer, 1, used, stdout);
+            used = 0;
+            length = format_row(buffer, sizeof(buffer), age, manager, entry);
+            if (length < 0) continue;
+            if ((size_t)length >= sizeof(buffer)) {
+                printf("%-3zu %-30s %-15.6f\n", age + 1, history_expression(manager, entry), entry->result);
+                continue;
+            }
+        }
+        used += (size_t)length;
+    }
+    fwrite(buffer, 1, used, stdout);
+    printf("\n");
+}
+
+// Age of a ring index, for numbering search results like show_history
+static size_t entry_age(const HistoryManager *manager, unsigned int index) {
+    size_t position = (index + manager->capacity - manager->oldest) % manager->capacity;
+    return manager->count - 1 - position;
+}
+
+static void print_match(const HistoryManager *manager, unsigned int index) {
+    const HistoryEntry *entry = &manager->entries[index];
+    printf("%-3zu %-30s %-15.6f\n", entry_age(manager, index) + 1,
+           history_expression(manager, entry), entry->result);
+}
+
+void search_history(HistoryManager *manager, const char *prefix) {
+    size_t prefix_length = strlen(prefix);
+    size_t matches = 0;
+
+    printf("\nHistory matching '%s':\n", prefix);
+    printf("%-3s %-30s %-15s\n", "#", "Expression", "Result");
+    printf("%-3s %-30s %-15s\n", "---", "----------", "------");
+
+    if (prefix_length >= HISTORY_INDEX_PREFIX) {
+        // Every match shares the indexed prefix, so one chain holds them all
+        unsigned int bucket = prefix_hash(prefix) & manager->bucket_mask;
+        for (unsigned int index = manager->buckets[bucket]; index != HISTORY_NONE;
+             index = manager->entries[index].older) {
+            const char *expression = history_expression(manager, &manager->entries[index]);
+            if (strncmp(expression, prefix, prefix_length) != 0) continue;
+            if (matches++ < HISTORY_SEARCH_LIMIT) print_match(manager, index);
+        }
+    } else {
+        // Prefixes shorter than the index key can match many chains
+        for (size_t age = 0; age < manager->count; age++) {
+            size_t index = (manager->oldest + manager->count - 1 - age) % manager->capacity;
+            const char *expression = history_expression(manager, &manager->entries[index]);
+            if (strncmp(expression, prefix, prefix_length) != 0) continue;
+            if (matches++ < HISTORY_SEARCH_LIMIT) print_match(manager, (unsigned int)index);
+        }
+    }
+
+    if (matches == 0) {
+        printf("No matching entries.\n");
+    } else if (matches > HISTORY_SEARCH_LIMIT) {
+        printf("... %zu more\n", matches - HISTORY_SEARCH_LIMIT);
+    }
+    printf("\n");
+}
+
+void free_history_manager(HistoryManager *manager) {
+    if (manager == NULL) return;
+    free(manager->entries);
+    free(manager->arena);
+    free(manager->buckets);
+    free(manager);
+}
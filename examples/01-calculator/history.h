@@ -0,0 +1,50 @@
+#ifndef HISTORY_H
+#define HISTORY_H
+
+#include <stddef.h>
+
+// Calculation history: a fixed-capacity ring buffer of entries whose
+// expression strings live in a ring-shaped string arena. The arena starts
+// at HISTORY_BYTES_PER_ENTRY per entry and grows when it fills, so the
+// history always keeps its last capacity entries. Appending and evicting
+// the oldest entry are O(1), apart from the occasional growth. Entries are also chained by the
+// first HISTORY_INDEX_PREFIX characters of their expression, so prefix
+// searches only visit matching entries.
+
+#define HISTORY_DEFAULT_CAPACITY 100
+#define HISTORY_BYTES_PER_ENTRY 32     // initial arena size per entry
+#define HISTORY_MIN_ARENA 4096
+#define HISTORY_INDEX_PREFIX 4
+#define HISTORY_SEARCH_LIMIT 20
+#define HISTORY_PRINT_BUFFER 65536
+#define HISTORY_NONE 0xffffffffu
+
+typedef struct {
+    size_t offset;              // expression (NUL-terminated) in the arena
+    unsigned int length;        // bytes used in the arena, including the NUL
+    double result;
+    unsigned int newer;         // prefix chain links (HISTORY_NONE at the ends)
+    unsigned int older;
+} HistoryEntry;
+
+typedef struct {
+    HistoryEntry *entries;
+    size_t capacity;
+    size_t oldest;              // ring index of the oldest entry
+    size_t count;
+    char *arena;
+    size_t arena_size;
+    size_t arena_write;         // next free byte in the arena
+    unsigned int *buckets;      // newest entry per prefix hash
+    size_t bucket_mask;
+} HistoryManager;
+
+HistoryManager* create_history_manager(size_t capacity);
+void add_to_history(HistoryManager *manager, const char *expression, double result);
+const HistoryEntry* history_entry(const HistoryManager *manager, size_t age);
+const char* history_expression(const HistoryManager *manager, const HistoryEntry *entry);
+void show_history(HistoryManager *manager);
+void search_history(HistoryManager *manager, const char *prefix);
+void free_history_manager(HistoryManager *manager);
+
+#endif
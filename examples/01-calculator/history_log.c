@@ -0,0 +1,305 @@
+#define _DEFAULT_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "history_log.h"
+
+// Records are only ever appended after their string, so a crash can leave
+// at most a torn record at the end of the record file or unreferenced bytes
+// at the end of the string file. Both are trimmed when the log is opened.
+//
+// Several calculators may share a log. Each append holds an exclusive
+// flock on the record file and takes the string offset from the real end
+// of the string file, not from what this process last wrote; opening,
+// loading and exporting hold a shared one while they read the sizes.
+
+typedef struct {
+    void *record_map;
+    size_t record_map_size;
+    void *string_map;
+    size_t string_map_size;
+    const HistoryRecord *records;
+    const char *strings;
+    int lock_fd;                // record file, locked shared while mapped
+} LogMapping;
+
+static int write_all(int fd, const void *data, size_t size) {
+    const char *bytes = data;
+    while (size > 0) {
+        ssize_t written = write(fd, bytes, size);
+        if (written <= 0) return -1;
+        bytes += written;
+        size -= written;
+    }
+    return 0;
+}
+
+static int record_valid(const HistoryRecord *record, unsigned long long string_size) {
+    return record->offset < string_size &&
+           record->length < string_size - record->offset;
+}
+
+static int read_record(HistoryLog *log, unsigned long long index, HistoryRecord *record) {
+    off_t position = sizeof(HistoryLogHeader) + index * sizeof(HistoryRecord);
+    return pread(log->record_fd, record, sizeof(*record), position) == sizeof(*record) ? 0 : -1;
+}
+
+// Picks up what other processes have appended since the sizes were read
+static int read_sizes(HistoryLog *log) {
+    struct stat record_stat, string_stat;
+    if (fstat(log->record_fd, &record_stat) != 0 || fstat(log->string_fd, &string_stat) != 0) return -1;
+    off_t records_size = record_stat.st_size > (off_t)sizeof(HistoryLogHeader)
+                         ? record_stat.st_size - (off_t)sizeof(HistoryLogHeader) : 0;
+    log->record_count = records_size / sizeof(HistoryRecord);
+    log->string_size = string_stat.st_size;
+    return 0;
+}
+
+// Checks the header of an existing record file, or writes one to a new file
+static int prepare_record_file(int fd, off_t size) {
+    HistoryLogHeader header;
+    if (size == 0) {
+        memset(&header, 0, sizeof(header));
+        memcpy(header.magic, HISTORY_LOG_MAGIC, sizeof(header.magic));
+        header.record_size = sizeof(HistoryRecord);
+        return write_all(fd, &header, sizeof(header));
+    }
+    if (pread(fd, &header, sizeof(header), 0) != sizeof(header)) return -1;
+    if (memcmp(header.magic, HISTORY_LOG_MAGIC, sizeof(header.magic)) != 0) return -1;
+    return header.record_size == sizeof(HistoryRecord) ? 0 : -1;
+}
+
+HistoryLog* open_history_log(const char *path) {
+    HistoryLog *log = malloc(sizeof(HistoryLog));
+    char *string_path = malloc(strlen(path) + sizeof(HISTORY_LOG_STRINGS_SUFFIX));
+    if (log == NULL || string_path == NULL) {
+        printf("Memory allocation failed!\n");
+        free(log);
+        free(string_path);
+        return NULL;
+    }
+    strcpy(string_path, path);
+    strcat(string_path, HISTORY_LOG_STRINGS_SUFFIX);
+
+    log->record_fd = open(path, O_RDWR | O_CREAT | O_APPEND, 0600);
+    log->string_fd = open(string_path, O_RDWR | O_CREAT | O_APPEND, 0600);
+    free(string_path);
+
+    // Another process may be writing the header or appending meanwhile
+    struct stat record_stat;
+    if (log->record_fd < 0 || log->string_fd < 0 || flock(log->record_fd, LOCK_EX) != 0 ||
+        fstat(log->record_fd, &record_stat) != 0 || read_sizes(log) != 0) {
+        printf("Error: Cannot open history log '%s'\n", path);
+        close_history_log(log);
+        return NULL;
+    }
+    if (prepare_record_file(log->record_fd, record_stat.st_size) != 0) {
+        printf("Error: '%s' is not a calculator history log\n", path);
+        close_history_log(log);
+        return NULL;
+    }
+
+    off_t records_size = record_stat.st_size > (off_t)sizeof(HistoryLogHeader)
+                         ? record_stat.st_size - (off_t)sizeof(HistoryLogHeader) : 0;
+
+    // Drop records left behind by an interrupted append
+    HistoryRecord last;
+    unsigned long long kept = log->record_count;
+    while (kept > 0 && (read_record(log, kept - 1, &last) != 0 ||
+                        !record_valid(&last, log->string_size))) {
+        kept--;
+    }
+    if (kept != log->record_count || records_size % sizeof(HistoryRecord) != 0) {
+        log->record_count = kept;
+        if (ftruncate(log->record_fd, sizeof(HistoryLogHeader) + kept * sizeof(HistoryRecord)) != 0) {
+            printf("Error: Cannot repair history log '%s'\n", path);
+            close_history_log(log);
+            return NULL;
+        }
+    }
+    flock(log->record_fd, LOCK_UN);
+    return log;
+}
+
+int history_log_append(HistoryLog *log, const char *expression, double result) {
+    HistoryRecord record;
+    memset(&record, 0, sizeof(record));
+    record.length = strlen(expression);
+    record.result = result;
+
+    if (flock(log->record_fd, LOCK_EX) != 0) return -1;
+    int status = -1;
+    if (read_sizes(log) != 0) goto done;
+    record.offset = log->string_size;
+    if (write_all(log->string_fd, expression, record.length + 1) != 0) goto done;
+    log->string_size += record.length + 1;
+    if (write_all(log->record_fd, &record, sizeof(record)) != 0) goto done;
+    log->record_count++;
+    status = 0;
+
+done:
+    flock(log->record_fd, LOCK_UN);
+    return status;
+}
+
+static int map_log(HistoryLog *log, LogMapping *mapping) {
+    memset(mapping, 0, sizeof(*mapping));
+    // Held until unmap_log, so no append is half done and no other
+    // process repairs the files under the mapping
+    if (flock(log->record_fd, LOCK_SH) != 0) return -1;
+    mapping->lock_fd = log->record_fd;
+    if (read_sizes(log) != 0) {
+        flock(log->record_fd, LOCK_UN);
+        return -1;
+    }
+    if (log->record_count == 0) return 0;
+
+    mapping->record_map_size = sizeof(HistoryLogHeader) + log->record_count * sizeof(HistoryRecord);
+    mapping->string_map_size = log->string_size;
+    mapping->record_map = mmap(NULL, mapping->record_map_size, PROT_READ, MAP_PRIVATE, log->record_fd, 0);
+    mapping->string_map = mmap(NULL, mapping->string_map_size, PROT_READ, MAP_PRIVATE, log->string_fd, 0);
+
+    if (mapping->record_map == MAP_FAILED || mapping->string_map == MAP_FAILED) {
+        if (mapping->record_map != MAP_FAILED) munmap(mapping->record_map, mapping->record_map_size);
+        if (mapping->string_map != MAP_FAILED) munmap(mapping->string_map, mapping->string_map_size);
+        flock(log->record_fd, LOCK_UN);
+        return -1;
+    }
+    mapping->records = (const HistoryRecord *)((const char *)mapping->record_map + sizeof(HistoryLogHeader));
+    mapping->strings = mapping->string_map;
+    return 0;
+}
+
+static void unmap_log(LogMapping *mapping) {
+    if (mapping->records != NULL) {
+        munmap(mapping->record_map, mapping->record_map_size);
+        munmap(mapping->string_map, mapping->string_map_size);
+    }
+    flock(mapping->lock_fd, LOCK_UN);
+}
+
+// Copies the newest records (as many as the history holds) into manager
+int history_log_load(HistoryLog *log, HistoryManager *manager) {
+    LogMapping mapping;
+    if (map_log(log, &mapping) != 0) return -1;
+
+    unsigned long long first = log->record_count > manager->capacity
+                               ? log->record_count - manager->capacity : 0;
+    for (unsigned long long i = first; i < log->record_count; i++) {
+        const HistoryRecord *record = &mapping.records[i];
+        if (!record_valid(record, log->string_size) ||
+            mapping.strings[record->offset + record->length] != '\0') continue;
+        add_to_history(manager, mapping.strings + record->offset, record->result);
+    }
+
+    unmap_log(&mapping);
+    return 0;
+}
+
+typedef struct {
+    FILE *output;
+    char *data;
+    size_t used;
+} ExportBuffer;
+
+static void flush_export(ExportBuffer *buffer) {
+    fwrite(buffer->data, 1, buffer->used, buffer->output);
+    buffer->used = 0;
+}
+
+// Appends one CSV row; the expression is always quoted since it may
+// contain commas (pow(2, 3))
+static void export_row(ExportBuffer *buffer, const char *expression, size_t length, double result) {
+    size_t worst_case = 2 * length + 64;
+    if (worst_case > HISTORY_EXPORT_BUFFER - buffer->used) {
+        flush_export(buffer);
+    }
+    if (worst_case > HISTORY_EXPORT_BUFFER) {
+        // Too long for the buffer: write it piece by piece
+        fputc('"', buffer->output);
+        for (size_t i = 0; i < length; i++) {
+            if (expression[i] == '"') fputc('"', buffer->output);
+            fputc(expression[i], buffer->output);
+        }
+        fprintf(buffer->output, "\",%.17g\n", result);
+        return;
+    }
+
+    char *out = buffer->data + buffer->used;
+    *out++ = '"';
+    if (memchr(expression, '"', length) == NULL) {
+        memcpy(out, expression, length);
+        out += length;
+    } else {
+        for (size_t i = 0; i < length; i++) {
+            if (expression[i] == '"') *out++ = '"';
+            *out++ = expression[i];
+        }
+    }
+    out += sprintf(out, "\",%.17g\n", result);
+    buffer->used = out - buffer->data;
+}
+
+static int start_export(ExportBuffer *buffer, FILE *output) {
+    buffer->output = output;
+    buffer->used = 0;
+    buffer->data = malloc(HISTORY_EXPORT_BUFFER);
+    if (buffer->data == NULL) {
+        printf("Memory allocation failed!\n");
+        return -1;
+    }
+    static const char header[] = "expression,result\n";
+    memcpy(buffer->data, header, sizeof(header) - 1);
+    buffer->used = sizeof(header) - 1;
+    return 0;
+}
+
+static int finish_export(ExportBuffer *buffer) {
+    flush_export(buffer);
+    free(buffer->data);
+    return fflush(buffer->output) == 0 && !ferror(buffer->output) ? 0 : -1;
+}
+
+// Writes every record in the log as CSV, oldest first
+int export_history_log(HistoryLog *log, FILE *output) {
+    LogMapping mapping;
+    ExportBuffer buffer;
+    if (map_log(log, &mapping) != 0) return -1;
+    if (start_export(&buffer, output) != 0) {
+        unmap_log(&mapping);
+        return -1;
+    }
+
+    for (unsigned long long i = 0; i < log->record_count; i++) {
+        const HistoryRecord *record = &mapping.records[i];
+        if (!record_valid(record, log->string_size)) continue;
+        export_row(&buffer, mapping.strings + record->offset, record->length, record->result);
+    }
+
+    unmap_log(&mapping);
+    return finish_export(&buffer);
+}
+
+// Writes the in-memory history as CSV, oldest first
+int export_history(HistoryManager *manager, FILE *output) {
+    ExportBuffer buffer;
+    if (start_export(&buffer, output) != 0) return -1;
+
+    for (size_t age = manager->count; age > 0; age--) {
+        const HistoryEntry *entry = history_entry(manager, age - 1);
+        export_row(&buffer, history_expression(manager, entry), entry->length - 1, entry->result);
+    }
+    return finish_export(&buffer);
+}
+
+void close_history_log(HistoryLog *log) {
+    if (log == NULL) return;
+    if (log->record_fd >= 0) close(log->record_fd);
+    if (log->string_fd >= 0) close(log->string_fd);
+    free(log);
+}
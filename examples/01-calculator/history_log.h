@@ -0,0 +1,46 @@
+#ifndef HISTORY_LOG_H
+#define HISTORY_LOG_H
+
+#include <stdio.h>
+#include "history.h"
+
+// Persistent history: an append-only record file of fixed-size records plus
+// an append-only string file holding the NUL-terminated expressions the
+// records point into. Opening a log maps both files and reads only the
+// newest records back into the in-memory history, so reload time does not
+// depend on the size of the log. Calculators running at the same time may
+// share a log; appends are serialized with flock.
+
+#define HISTORY_LOG_MAGIC "CALCLOG1"
+#define HISTORY_LOG_STRINGS_SUFFIX ".strings"
+#define HISTORY_LOG_DEFAULT_NAME ".calculator_history"
+#define HISTORY_EXPORT_BUFFER (1 << 20)
+
+typedef struct {
+    char magic[8];
+    unsigned int record_size;
+    unsigned int reserved;
+} HistoryLogHeader;
+
+typedef struct {
+    unsigned long long offset;  // expression in the string file
+    unsigned int length;        // expression length, without the NUL
+    unsigned int reserved;
+    double result;
+} HistoryRecord;
+
+typedef struct {
+    int record_fd;
+    int string_fd;
+    unsigned long long record_count;
+    unsigned long long string_size;
+} HistoryLog;
+
+HistoryLog* open_history_log(const char *path);
+int history_log_append(HistoryLog *log, const char *expression, double result);
+int history_log_load(HistoryLog *log, HistoryManager *manager);
+int export_history_log(HistoryLog *log, FILE *output);
+int export_history(HistoryManager *manager, FILE *output);
+void close_history_log(HistoryLog *log);
+
+#endif
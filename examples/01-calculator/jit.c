@@ -0,0 +1,398 @@
+#define _DEFAULT_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "jit.h"
+#include "profile.h"
+
+#if defined(__x86_64__) && !defined(_WIN32)
+#define JIT_SUPPORTED 1
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+#ifdef JIT_SUPPORTED
+
+// Register use in the generated code (System V AMD64 ABI):
+//   r12  constants        (callee-saved copy of rdi)
+//   r13  variables        (callee-saved copy of rsi)
+//   r14  error pointer    (callee-saved copy of rdx)
+//   xmm0 top of the bytecode stack; the rest of the stack, the locals and
+//        the MR value live in the native stack frame at [rsp + disp32]
+
+enum { FN_SIN, FN_COS, FN_TAN, FN_LOG10, FN_LN, FN_POW, FN_COUNT };
+
+typedef struct {
+    unsigned char *bytes;
+    size_t length;
+    size_t capacity;
+    int failed;
+} CodeBuffer;
+
+typedef struct {
+    size_t position;        // offset of a rel32 field
+    int target;             // FN_* stub, or FN_COUNT for the error block
+} Fixup;
+
+static void emit_bytes(CodeBuffer *code, const unsigned char *bytes, size_t count) {
+    if (code->length + count > code->capacity) {
+        size_t capacity = code->capacity ? code->capacity * 2 : 512;
+        while (capacity < code->length + count) capacity *= 2;
+        unsigned char *grown = realloc(code->bytes, capacity);
+        if (grown == NULL) {
+            code->failed = 1;
+            return;
+        }
+        code->bytes = grown;
+        code->capacity = capacity;
+    }
+    memcpy(code->bytes + code->length, bytes, count);
+    code->length += count;
+}
+
+static void emit_u32(CodeBuffer *code, unsigned int value) {
+    unsigned char bytes[4] = { value, value >> 8, value >> 16, value >> 24 };
+    emit_bytes(code, bytes, 4);
+}
+
+static void emit_u64(CodeBuffer *code, unsigned long long value) {
+    emit_u32(code, (unsigned int)value);
+    emit_u32(code, (unsigned int)(value >> 32));
+}
+
+static void patch_u32(CodeBuffer *code, size_t position, unsigned int value) {
+    code->bytes[position] = value;
+    code->bytes[position + 1] = value >> 8;
+    code->bytes[position + 2] = value >> 16;
+    code->bytes[position + 3] = value >> 24;
+}
+
+#define EMIT(code, ...) do { \
+    static const unsigned char bytes_[] = { __VA_ARGS__ }; \
+    emit_bytes(code, bytes_, sizeof(bytes_)); \
+} while (0)
+
+// movsd xmmN, [rsp + offset]
+static void emit_load_frame(CodeBuffer *code, int xmm, int offset) {
+    unsigned char bytes[] = { 0xF2, 0x0F, 0x10, 0x84 | (xmm << 3), 0x24 };
+    emit_bytes(code, bytes, sizeof(bytes));
+    emit_u32(code, offset);
+}
+
+// movsd [rsp + offset], xmm0
+static void emit_store_frame(CodeBuffer *code, int offset) {
+    EMIT(code, 0xF2, 0x0F, 0x11, 0x84, 0x24);
+    emit_u32(code, offset);
+}
+
+// call rel32 to a trampoline stub, patched once the stubs are placed
+static void emit_call(CodeBuffer *code, Fixup *fixups, int *fixup_count, int function) {
+    EMIT(code, 0xE8);
+    fixups[*fixup_count].position = code->length;
+    fixups[*fixup_count].target = function;
+    (*fixup_count)++;
+    emit_u32(code, 0);
+}
+
+static const unsigned char *function_address(int function) {
+    switch (function) {
+        case FN_SIN:   return (const unsigned char *)(size_t)&sin;
+        case FN_COS:   return (const unsigned char *)(size_t)&cos;
+        case FN_TAN:   return (const unsigned char *)(size_t)&tan;
+        case FN_LOG10: return (const unsigned char *)(size_t)&log10;
+        case FN_LN:    return (const unsigned char *)(size_t)&log;
+        default:       return (const unsigned char *)(size_t)&pow;
+    }
+}
+
+static int generate(const Program *program, CodeBuffer *code) {
+    int stack_offset = 0;
+    int locals_offset = 8 * program->max_stack;
+    int memory_offset = locals_offset + 8 * program->local_count;
+    int frame_size = (memory_offset + 8 + 15) & ~15;
+    int depth = 0;
+
+    // Every instruction has at most one fixup
+    Fixup *fixups = malloc((program->code_length + 1) * sizeof(Fixup));
+    int fixup_count = 0;
+    if (fixups == NULL) return -1;
+
+    // Prologue: three pushes plus a 16-byte multiple keep rsp 16-byte aligned
+    EMIT(code, 0x41, 0x54,                  // push r12
+               0x41, 0x55,                  // push r13
+               0x41, 0x56,                  // push r14
+               0x49, 0x89, 0xFC,            // mov r12, rdi
+               0x49, 0x89, 0xF5,            // mov r13, rsi
+               0x49, 0x89, 0xD6,            // mov r14, rdx
+               0x48, 0x81, 0xEC);           // sub rsp, imm32
+    emit_u32(code, frame_size);
+    emit_store_frame(code, memory_offset);
+    EMIT(code, 0x41, 0xC7, 0x06, 0, 0, 0, 0);   // mov dword [r14], 0
+
+    for (int pc = 0; pc < program->code_length; pc++) {
+        const Instruction *in = &program->code[pc];
+
+        // Instructions that push spill the current top of stack first
+        if (in->op == OP_CONST || in->op == OP_MEMORY ||
+            in->op == OP_VARIABLE || in->op == OP_LOAD) {
+            if (depth > 0) {
+                emit_store_frame(code, stack_offset + 8 * (depth - 1));
+            }
+            depth++;
+        }
+
+        switch (in->op) {
+            case OP_CONST:
+                EMIT(code, 0xF2, 0x41, 0x0F, 0x10, 0x84, 0x24);   // movsd xmm0, [r12 + disp32]
+                emit_u32(code, 8 * in->arg);
+                break;
+            case OP_VARIABLE:
+                EMIT(code, 0xF2, 0x41, 0x0F, 0x10, 0x85);         // movsd xmm0, [r13 + disp32]
+                emit_u32(code, 8 * in->arg);
+                break;
+            case OP_MEMORY:
+                emit_load_frame(code, 0, memory_offset);
+                break;
+            case OP_LOAD:
+                emit_load_frame(code, 0, locals_offset + 8 * in->arg);
+                break;
+            case OP_STORE:
+                emit_store_frame(code, locals_offset + 8 * in->arg);
+                break;
+            case OP_NEG:
+                EMIT(code, 0x66, 0x48, 0x0F, 0x7E, 0xC0,          // movq rax, xmm0
+                           0x48, 0x0F, 0xBA, 0xF8, 0x3F,          // btc rax, 63
+                           0x66, 0x48, 0x0F, 0x6E, 0xC0);         // movq xmm0, rax
+                break;
+            case OP_SQRT:
+                EMIT(code, 0xF2, 0x0F, 0x51, 0xC0);               // sqrtsd xmm0, xmm0
+                break;
+            case OP_SIN: emit_call(code, fixups, &fixup_count, FN_SIN); break;
+            case OP_COS: emit_call(code, fixups, &fixup_count, FN_COS); break;
+            case OP_TAN: emit_call(code, fixups, &fixup_count, FN_TAN); break;
+            case OP_LOG: emit_call(code, fixups, &fixup_count, FN_LOG10); break;
+            case OP_LN:  emit_call(code, fixups, &fixup_count, FN_LN); break;
+            default:
+                // Binary: right operand to xmm1, left operand from its slot
+                depth--;
+                EMIT(code, 0x66, 0x0F, 0x28, 0xC8);               // movapd xmm1, xmm0
+                emit_load_frame(code, 0, stack_offset + 8 * (depth - 1));
+                switch (in->op) {
+                    case OP_ADD: EMIT(code, 0xF2, 0x0F, 0x58, 0xC1); break;   // addsd xmm0, xmm1
+                    case OP_SUB: EMIT(code, 0xF2, 0x0F, 0x5C, 0xC1); break;   // subsd xmm0, xmm1
+                    case OP_MUL: EMIT(code, 0xF2, 0x0F, 0x59, 0xC1); break;   // mulsd xmm0, xmm1
+                    case OP_DIV:
+                        EMIT(code, 0x66, 0x0F, 0x57, 0xD2,        // xorpd xmm2, xmm2
+                                   0x66, 0x0F, 0x2E, 0xCA,        // ucomisd xmm1, xmm2
+                                   0x7A, 0x06,                    // jp +6 (NaN is not zero)
+                                   0x0F, 0x84);                   // je error
+                        fixups[fixup_count].position = code->length;
+                        fixups[fixup_count].target = FN_COUNT;
+                        fixup_count++;
+                        emit_u32(code, 0);
+                        EMIT(code, 0xF2, 0x0F, 0x5E, 0xC1);       // divsd xmm0, xmm1
+                        break;
+                    default:
+                        emit_call(code, fixups, &fixup_count, FN_POW);
+                        break;
+                }
+                break;
+        }
+    }
+
+    // Epilogue: result is already in xmm0
+    size_t epilogue = code->length;
+    EMIT(code, 0x48, 0x81, 0xC4);                                 // add rsp, imm32
+    emit_u32(code, frame_size);
+    EMIT(code, 0x41, 0x5E, 0x41, 0x5D, 0x41, 0x5C, 0xC3);         // pop r14/r13/r12, ret
+
+    // Division by zero: *error = EVAL_DIVISION_BY_ZERO, return 0
+    size_t error_block = code->length;
+    EMIT(code, 0x41, 0xC7, 0x06);                                 // mov dword [r14], imm32
+    emit_u32(code, EVAL_DIVISION_BY_ZERO);
+    EMIT(code, 0x66, 0x0F, 0x57, 0xC0, 0xE9);                     // xorpd xmm0, xmm0; jmp
+    emit_u32(code, (unsigned int)(epilogue - (code->length + 4)));
+
+    // Trampoline: jmp [rip + 0] followed by the absolute address
+    size_t stubs[FN_COUNT];
+    for (int f = 0; f < FN_COUNT; f++) {
+        stubs[f] = code->length;
+        EMIT(code, 0xFF, 0x25, 0, 0, 0, 0);
+        emit_u64(code, (unsigned long long)(size_t)function_address(f));
+    }
+
+    if (!code->failed) {
+        for (int i = 0; i < fixup_count; i++) {
+            size_t target = fixups[i].target == FN_COUNT ? error_block : stubs[fixups[i].target];
+            patch_u32(code, fixups[i].position,
+                      (unsigned int)(target - (fixups[i].position + 4)));
+        }
+    }
+    free(fixups);
+    return code->failed ? -1 : 0;
+}
+
+int jit_available() {
+    return 1;
+}
+
+JitCode* jit_compile(const Program *program) {
+    CodeBuffer code = { NULL, 0, 0, 0 };
+    if (generate(program, &code) != 0) {
+        free(code.bytes);
+        return NULL;
+    }
+
+    JitCode *jit = malloc(sizeof(JitCode));
+    if (jit == NULL) {
+        free(code.bytes);
+        return NULL;
+    }
+
+    // Write the code into a fresh mapping, then make it read-only executable
+    size_t page = (size_t)sysconf(_SC_PAGESIZE);
+    jit->size = (code.length + page - 1) / page * page;
+    jit->memory = mmap(NULL, jit->size, PROT_READ | PROT_WRITE,
+                       MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (jit->memory == MAP_FAILED) {
+        free(code.bytes);
+        free(jit);
+        return NULL;
+    }
+    memcpy(jit->memory, code.bytes, code.length);
+    free(code.bytes);
+
+    if (mprotect(jit->memory, jit->size, PROT_READ | PROT_EXEC) != 0) {
+        munmap(jit->memory, jit->size);
+        free(jit);
+        return NULL;
+    }
+    jit->entry = (JitFunction)(size_t)jit->memory;
+    return jit;
+}
+
+void free_jit(JitCode *jit) {
+    if (jit == NULL) return;
+    munmap(jit->memory, jit->size);
+    free(jit);
+}
+
+#else
+
+int jit_available() {
+    return 0;
+}
+
+JitCode* jit_compile(const Program *program) {
+    (void)program;
+    return NULL;
+}
+
+void free_jit(JitCode *jit) {
+    (void)jit;
+}
+
+#endif
+
+double evaluate_jit(const JitCode *jit, const Program *program, EvalEnv *env) {
+    int error;
+    PROFILE_START(start);
+    double result = jit->entry(program->constants, env->variables, env->memory, &error);
+    PROFILE_END(PROFILE_NATIVE, start);
+    env->error = error;
+    return result;
+}
+
+// Tiered evaluation
+
+void init_tiered(TieredProgram *tiered, Program *program, unsigned long threshold) {
+    tiered->program = program;
+    tiered->jit = NULL;
+    tiered->evaluations = 0;
+    tiered->threshold = threshold;
+    tiered->jit_failed = !jit_available();
+}
+
+double evaluate_tiered(TieredProgram *tiered, EvalEnv *env) {
+    if (tiered->jit != NULL) {
+        return evaluate_jit(tiered->jit, tiered->program, env);
+    }
+
+    if (!tiered->jit_failed && ++tiered->evaluations > tiered->threshold) {
+        tiered->jit = jit_compile(tiered->program);
+        if (tiered->jit == NULL) {
+            tiered->jit_failed = 1;
+        } else {
+            return evaluate_jit(tiered->jit, tiered->program, env);
+        }
+    }
+    return evaluate_program(tiered->program, env);
+}
+
+void free_tiered(TieredProgram *tiered) {
+    free_jit(tiered->jit);
+    tiered->jit = NULL;
+}
+
+// Tiered program tables
+
+static unsigned int hash_text(const char *key, int length) {
+    unsigned int hash = 2166136261u;
+    for (int i = 0; i < length; i++) {
+        hash = (hash ^ (unsigned char)key[i]) * 16777619u;
+    }
+    return hash;
+}
+
+TieredTable* create_tiered_table() {
+    TieredTable *table = calloc(1, sizeof(TieredTable));
+    if (table == NULL) printf("Memory allocation failed!\n");
+    return table;
+}
+
+static void release_slot(TieredSlot *slot) {
+    if (slot->tiered.program == NULL) return;
+    free_tiered(&slot->tiered);
+    if (slot->owned) free_program(slot->tiered.program);
+    free(slot->key);
+    memset(slot, 0, sizeof(TieredSlot));
+}
+
+TieredProgram* find_tiered(TieredTable *table, const char *key, int length) {
+    unsigned int hash = hash_text(key, length);
+    TieredSlot *slot = &table->slots[hash % TIERED_TABLE_SLOTS];
+    if (slot->tiered.program == NULL || slot->hash != hash || slot->length != length ||
+        memcmp(slot->key, key, length) != 0) {
+        return NULL;
+    }
+    return &slot->tiered;
+}
+
+TieredProgram* add_tiered(TieredTable *table, const char *key, int length, Program *program, int owned) {
+    unsigned int hash = hash_text(key, length);
+    TieredSlot *slot = &table->slots[hash % TIERED_TABLE_SLOTS];
+    char *copy = malloc(length);
+    if (copy == NULL) return NULL;
+    memcpy(copy, key, length);
+
+    release_slot(slot);
+    init_tiered(&slot->tiered, program, JIT_DEFAULT_THRESHOLD);
+    slot->owned = owned;
+    slot->hash = hash;
+    slot->length = length;
+    slot->key = copy;
+    return &slot->tiered;
+}
+
+void clear_tiered_table(TieredTable *table) {
+    for (int i = 0; i < TIERED_TABLE_SLOTS; i++) {
+        release_slot(&table->slots[i]);
+    }
+}
+
+void free_tiered_table(TieredTable *table) {
+    if (table == NULL) return;
+    clear_tiered_table(table);
+    free(table);
+}
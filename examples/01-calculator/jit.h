@@ -0,0 +1,72 @@
+#ifndef JIT_H
+#define JIT_H
+
+#include <stddef.h>
+#include "expression_parser.h"
+
+// Native x86-64 backend: translates a compiled Program into SSE2 scalar
+// machine code in an mmap'ed executable page. Math functions are called
+// through a small trampoline (one jmp stub per function) placed after the
+// code. On other platforms jit_compile always returns NULL and callers keep
+// using evaluate_program.
+
+typedef double (*JitFunction)(const double *constants, const double *variables,
+                              double memory, int *error);
+
+typedef struct {
+    void *memory;
+    size_t size;
+    JitFunction entry;
+} JitCode;
+
+int jit_available();
+JitCode* jit_compile(const Program *program);
+double evaluate_jit(const JitCode *jit, const Program *program, EvalEnv *env);
+void free_jit(JitCode *jit);
+
+// Tiered evaluation: interpret until the program has been evaluated
+// threshold times, then switch to native code (or stay interpreted if the
+// JIT is unavailable). Not thread-safe; give each thread its own.
+#define JIT_DEFAULT_THRESHOLD 1000
+
+typedef struct {
+    Program *program;
+    JitCode *jit;
+    unsigned long evaluations;
+    unsigned long threshold;
+    int jit_failed;
+} TieredProgram;
+
+void init_tiered(TieredProgram *tiered, Program *program, unsigned long threshold);
+double evaluate_tiered(TieredProgram *tiered, EvalEnv *env);
+void free_tiered(TieredProgram *tiered);
+
+// One thread's programs by normalized expression text, each behind a
+// TieredProgram, so that expressions evaluated over and over reach native
+// code. Direct-mapped on a hash of the text: a new expression takes over
+// its slot, releasing the old program's code (and the program itself if
+// the table owned it). Not thread-safe; give each thread its own.
+#define TIERED_TABLE_SLOTS 256
+
+typedef struct {
+    TieredProgram tiered;   // tiered.program NULL: empty
+    int owned;              // program freed along with the slot
+    unsigned int hash;
+    int length;
+    char *key;
+} TieredSlot;
+
+typedef struct TieredTable {
+    TieredSlot slots[TIERED_TABLE_SLOTS];
+} TieredTable;
+
+TieredTable* create_tiered_table();
+TieredProgram* find_tiered(TieredTable *table, const char *key, int length);
+// Returns the new slot's TieredProgram, or NULL if memory ran out (the
+// caller keeps program)
+TieredProgram* add_tiered(TieredTable *table, const char *key, int length, Program *program, int owned);
+// Empties every slot, as when definitions the programs inlined change
+void clear_tiered_table(TieredTable *table);
+void free_tiered_table(TieredTable *table);
+
+#endif
@@ -0,0 +1,233 @@
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <ctype.h>
+#include "lexer.h"
+#include "lexer_tables.h"
+
+#define MAX_DIGITS 19               // significant digits that always fit in 64 bits
+#define MAX_EXACT_POWER 22          // 10^22 is the largest power of ten a double holds exactly
+#define MANTISSA_BITS 52
+#define INFINITY_BITS 0x7ff0000000000000ULL
+
+static const double exact_powers_of_ten[MAX_EXACT_POWER + 1] = {
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+static int is_digit(char c) {
+    return (unsigned char)(c - '0') < 10;
+}
+
+static int is_identifier_start(char c) {
+    return isalpha((unsigned char)c) || c == '_';
+}
+
+static int hex_value(char c) {
+    return is_digit(c) ? c - '0' : (c | 0x20) - 'a' + 10;
+}
+
+// Eisel-Lemire: the bits of the double nearest to w * 10^q, ties to even,
+// for a nonzero w of at most MAX_DIGITS digits. Multiplies w by a 128-bit
+// approximation of 5^q; the top 55 bits of the product are exact whenever
+// they can decide the rounding (Lemire, "Number Parsing at a Gigabyte per
+// Second", and Mushtak & Lemire, "Fast Number Parsing Without Fallback").
+static unsigned long long eisel_lemire(long long q, unsigned long long w) {
+    if (q < LEXER_MIN_POWER) return 0;
+    if (q > LEXER_MAX_POWER) return INFINITY_BITS;
+
+    int leading_zeros = __builtin_clzll(w);
+    w <<= leading_zeros;
+
+    const unsigned long long *power = powers_of_five[q - LEXER_MIN_POWER];
+    unsigned __int128 product = (unsigned __int128)w * power[0];
+    unsigned long long high = (unsigned long long)(product >> 64);
+    unsigned long long low = (unsigned long long)product;
+
+    // Only when the bits below the result are all ones can the low half of
+    // the power carry into them
+    if ((high & 0x1ff) == 0x1ff) {
+        unsigned long long carry = (unsigned long long)(((unsigned __int128)w * power[1]) >> 64);
+        low += carry;
+        if (low < carry) high++;
+    }
+
+    int upper_bit = (int)(high >> 63);
+    int shift = upper_bit + 64 - MANTISSA_BITS - 3;
+    unsigned long long mantissa = high >> shift;
+    // floor(log2(10^q)) + 63, computed without floating point
+    int exponent = (int)((((152170 + 65536) * q) >> 16) + 63) + upper_bit - leading_zeros + 1023;
+
+    if (exponent <= 0) {
+        // Subnormal: shift into place and round; rounding up can reach the
+        // smallest normal number, whose bits follow on naturally
+        if (-exponent + 1 >= 64) return 0;
+        mantissa >>= -exponent + 1;
+        mantissa += mantissa & 1;
+        return mantissa >> 1;
+    }
+
+    // An exact tie between two doubles is only possible for small q, and
+    // shows up as a product with nothing below the round bit
+    if (low <= 1 && q >= -4 && q <= 23 && (mantissa & 3) == 1 && (mantissa << shift) == high) {
+        mantissa &= ~1ULL;
+    }
+    mantissa += mantissa & 1;
+    mantissa >>= 1;
+    if (mantissa >= (2ULL << MANTISSA_BITS)) {
+        mantissa = 1ULL << MANTISSA_BITS;
+        exponent++;
+    }
+    mantissa &= ~(1ULL << MANTISSA_BITS);
+
+    if (exponent >= 0x7ff) return INFINITY_BITS;
+    return mantissa | (unsigned long long)exponent << MANTISSA_BITS;
+}
+
+static const char* scan_decimal(const char *text, double *value) {
+    const char *p = text;
+    unsigned long long w = 0;       // the first MAX_DIGITS significant digits
+    int digits = 0;
+    int truncated = 0;              // a nonzero digit did not fit in w
+    long long exponent = 0;         // value = w * 10^exponent
+
+    for (; is_digit(*p); p++) {
+        if (digits < MAX_DIGITS) {
+            w = w * 10 + (*p - '0');
+            digits += w != 0;
+        } else {
+            truncated |= *p != '0';
+            exponent++;
+        }
+    }
+    int digit_count = (int)(p - text);
+
+    if (*p == '.') {
+        const char *fraction = ++p;
+        for (; is_digit(*p); p++) {
+            if (digits < MAX_DIGITS) {
+                w = w * 10 + (*p - '0');
+                digits += w != 0;
+                exponent--;
+            } else {
+                truncated |= *p != '0';
+            }
+        }
+        digit_count += (int)(p - fraction);
+    }
+    if (digit_count == 0) return text;
+
+    // An exponent needs at least one digit; "2e" is the number 2 followed by e
+    if (*p == 'e' || *p == 'E') {
+        const char *e = p + 1;
+        int negative = 0;
+        if (*e == '+' || *e == '-') negative = *e++ == '-';
+        if (is_digit(*e)) {
+            long long power = 0;
+            for (; is_digit(*e); e++) {
+                if (power < 100000) power = power * 10 + (*e - '0');
+            }
+            exponent += negative ? -power : power;
+            p = e;
+        }
+    }
+
+    if (w == 0) {
+        *value = 0.0;
+        return p;
+    }
+
+    // Clinger's fast path: both operands are exact, so one IEEE operation
+    // rounds correctly
+    if (!truncated && w <= 1ULL << 53 && exponent >= -MAX_EXACT_POWER && exponent <= MAX_EXACT_POWER) {
+        *value = exponent < 0 ? (double)w / exact_powers_of_ten[-exponent]
+                              : (double)w * exact_powers_of_ten[exponent];
+        return p;
+    }
+
+    unsigned long long bits = eisel_lemire(exponent, w);
+    if (truncated && eisel_lemire(exponent, w + 1) != bits) {
+        // The dropped digits decide the rounding; strtod reads the same grammar
+        *value = strtod(text, NULL);
+        return p;
+    }
+    memcpy(value, &bits, sizeof(double));
+    return p;
+}
+
+int is_hex_literal(const char *text) {
+    return text[0] == '0' && (text[1] == 'x' || text[1] == 'X') && isxdigit((unsigned char)text[2]);
+}
+
+// Keeps the top 61 to 64 bits and ORs every dropped bit into the lowest
+// one; that bit is far below the rounding position, so the integer to
+// double conversion still rounds correctly, and ldexp scales exactly
+static const char* scan_hex(const char *text, double *value) {
+    const char *p = text + 2;
+    unsigned long long w = 0;
+    int sticky = 0;
+    int shift = 0;
+
+    for (; isxdigit((unsigned char)*p); p++) {
+        int digit = hex_value(*p);
+        if (w >> 60 == 0) {
+            w = w << 4 | digit;
+        } else {
+            sticky |= digit != 0;
+            if (shift < 2048) shift += 4;
+        }
+    }
+    *value = ldexp((double)(w | sticky), shift);
+    return p;
+}
+
+const char* scan_number(const char *text, double *value) {
+    if (is_hex_literal(text)) return scan_hex(text, value);
+    return scan_decimal(text, value);
+}
+
+void init_lexer(Lexer *lexer, const char *text) {
+    lexer->input = text;
+    lexer->pos = text;
+}
+
+Token next_token(Lexer *lexer) {
+    while (isspace((unsigned char)*lexer->pos)) lexer->pos++;
+
+    const char *start = lexer->pos;
+    Token token;
+    token.position = (int)(start - lexer->input);
+    token.length = 1;
+    token.value = 0.0;
+
+    switch (*start) {
+        case '\0': token.type = TOKEN_END; token.length = 0; return token;
+        case '+':  token.type = TOKEN_PLUS; break;
+        case '-':  token.type = TOKEN_MINUS; break;
+        case '*':  token.type = TOKEN_STAR; break;
+        case '/':  token.type = TOKEN_SLASH; break;
+        case '(':  token.type = TOKEN_LPAREN; break;
+        case ')':  token.type = TOKEN_RPAREN; break;
+        case ',':  token.type = TOKEN_COMMA; break;
+        case '=':  token.type = TOKEN_EQUALS; break;
+        default:
+            if (is_identifier_start(*start)) {
+                const char *end = start + 1;
+                while (isalnum((unsigned char)*end) || *end == '_') end++;
+                token.type = TOKEN_IDENTIFIER;
+                token.length = (int)(end - start);
+            } else {
+                const char *end = scan_number(start, &token.value);
+                if (end == start) {
+                    token.type = TOKEN_ERROR;
+                } else {
+                    token.type = TOKEN_NUMBER;
+                    token.length = (int)(end - start);
+                }
+            }
+            break;
+    }
+
+    lexer->pos = start + token.length;
+    return token;
+}
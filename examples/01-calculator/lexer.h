@@ -0,0 +1,45 @@
+#ifndef LEXER_H
+#define LEXER_H
+
+// Tokenizer for calculator expressions. The lexer produces one token at a
+// time from a NUL-terminated string, so the parser needs no token buffer.
+typedef enum {
+    TOKEN_NUMBER,           // decimal, exponent or hex literal
+    TOKEN_IDENTIFIER,       // function, constant or variable name
+    TOKEN_PLUS,
+    TOKEN_MINUS,
+    TOKEN_STAR,
+    TOKEN_SLASH,
+    TOKEN_LPAREN,
+    TOKEN_RPAREN,
+    TOKEN_COMMA,
+    TOKEN_EQUALS,           // only in let / def statements
+    TOKEN_END,
+    TOKEN_ERROR             // character that starts no token
+} TokenType;
+
+typedef struct {
+    TokenType type;
+    int position;           // offset of the first character in the input
+    int length;
+    double value;           // TOKEN_NUMBER: correctly rounded value
+} Token;
+
+typedef struct {
+    const char *input;
+    const char *pos;
+} Lexer;
+
+void init_lexer(Lexer *lexer, const char *text);
+Token next_token(Lexer *lexer);
+
+// Scans a number literal at text: digits with an optional fraction and
+// exponent ("12", "1.5", ".5", "2.", "1e-9"), or "0x" and hex digits.
+// Stores the correctly rounded double (the same one strtod gives) and
+// returns the end of the literal, or text itself if none starts there.
+const char* scan_number(const char *text, double *value);
+
+// True for a "0x" literal, which has no exact decimal text
+int is_hex_literal(const char *text);
+
+#endif
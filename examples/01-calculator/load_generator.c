@@ -0,0 +1,229 @@
+#define _DEFAULT_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include "expression_parser.h"
+
+// Load generator for calculator --serve. Each connection runs on its own
+// thread and keeps up to DEPTH requests in the pipeline; every response is
+// checked against the same expression evaluated locally. Reports requests
+// per second and latency percentiles from send to matching response.
+
+#define EXPRESSIONS 1024
+#define RESPONSE_SIZE 128
+#define MAX_DEPTH 4096
+#define READ_SIZE 65536
+
+typedef struct {
+    const char *socket_path;
+    int offset;                 // first expression this client sends
+    long requests;
+    int depth;
+    double *latencies;          // seconds, one per request
+    long mismatches;
+    int failed;
+} Client;
+
+static char expressions[EXPRESSIONS][96];
+static char expected[EXPRESSIONS][RESPONSE_SIZE];
+
+static double now_seconds() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// A mix of cheap and heavier expressions, with some division by zero errors
+static int build_expressions() {
+    for (int i = 0; i < EXPRESSIONS; i++) {
+        int a = i % 97 + 1, b = i % 13, c = i / 7 + 2;
+        switch (i % 5) {
+            case 0: snprintf(expressions[i], sizeof(expressions[i]), "%d + %d * %d", a, b, c); break;
+            case 1: snprintf(expressions[i], sizeof(expressions[i]), "sin(%d) * cos(%d) + sqrt(%d)", a, b, c); break;
+            case 2: snprintf(expressions[i], sizeof(expressions[i]), "pow(%d, 0.5) + ln(%d) - %d / 7", a, c, b); break;
+            case 3: snprintf(expressions[i], sizeof(expressions[i]), "(%d + %d) * (%d - 3) / 2.5 + pi", a, b, c); break;
+            default: snprintf(expressions[i], sizeof(expressions[i]), "%d / (%d - 6)", a, b); break;
+        }
+
+        Program *program = compile_expression(expressions[i], NULL);
+        if (program == NULL) {
+            printf("Error: Cannot compile '%s'\n", expressions[i]);
+            return -1;
+        }
+        EvalEnv env = { 0.0, NULL, EVAL_OK };
+        double result = evaluate_program(program, &env);
+        if (env.error == EVAL_DIVISION_BY_ZERO) {
+            snprintf(expected[i], RESPONSE_SIZE, "Error: Division by zero!");
+        } else {
+            snprintf(expected[i], RESPONSE_SIZE, "%.17g", result);
+        }
+        free_program(program);
+    }
+    return 0;
+}
+
+static int connect_to(const char *path) {
+    struct sockaddr_un address;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    strncpy(address.sun_path, path, sizeof(address.sun_path) - 1);
+
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) return -1;
+    if (connect(fd, (struct sockaddr *)&address, sizeof(address)) != 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+static int write_all(int fd, const char *data, size_t length) {
+    while (length > 0) {
+        ssize_t written = write(fd, data, length);
+        if (written <= 0) return -1;
+        data += written;
+        length -= written;
+    }
+    return 0;
+}
+
+static void* run_client(void *arg) {
+    Client *client = arg;
+    double *send_times = malloc(client->requests * sizeof(double));
+    char *output = malloc((size_t)client->depth * 100);
+    char *input = malloc(READ_SIZE);
+    int fd = connect_to(client->socket_path);
+    if (send_times == NULL || output == NULL || input == NULL || fd < 0) {
+        client->failed = 1;
+        goto done;
+    }
+
+    long sent = 0, received = 0;
+    size_t buffered = 0;
+    while (received < client->requests) {
+        // Top up the pipeline
+        size_t length = 0;
+        double now = now_seconds();
+        while (sent < client->requests && sent - received < client->depth) {
+            const char *text = expressions[(client->offset + sent) % EXPRESSIONS];
+            length += sprintf(output + length, "%s\n", text);
+            send_times[sent++] = now;
+        }
+        if (length > 0 && write_all(fd, output, length) != 0) {
+            client->failed = 1;
+            goto done;
+        }
+
+        ssize_t bytes = read(fd, input + buffered, READ_SIZE - buffered);
+        if (bytes <= 0) {
+            client->failed = 1;
+            goto done;
+        }
+        now = now_seconds();
+        buffered += bytes;
+
+        char *line = input;
+        char *newline;
+        while ((newline = memchr(line, '\n', buffered - (line - input))) != NULL) {
+            *newline = '\0';
+            if (strcmp(line, expected[(client->offset + received) % EXPRESSIONS]) != 0) {
+                if (client->mismatches++ < 3) {
+                    printf("Mismatch for '%s': got '%s', expected '%s'\n",
+                           expressions[(client->offset + received) % EXPRESSIONS], line,
+                           expected[(client->offset + received) % EXPRESSIONS]);
+                }
+            }
+            client->latencies[received] = now - send_times[received];
+            received++;
+            line = newline + 1;
+        }
+        buffered -= line - input;
+        memmove(input, line, buffered);
+    }
+
+done:
+    if (fd >= 0) close(fd);
+    free(send_times);
+    free(output);
+    free(input);
+    return NULL;
+}
+
+static int compare_doubles(const void *a, const void *b) {
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+static double percentile(const double *sorted, long count, double fraction) {
+    long index = (long)(fraction * (count - 1) + 0.5);
+    return sorted[index];
+}
+
+int main(int argc, char *argv[]) {
+    if (argc < 2) {
+        fprintf(stderr, "Usage: %s SOCKET [connections=8] [requests=200000] [depth=16]\n", argv[0]);
+        return 1;
+    }
+    const char *socket_path = argv[1];
+    int connections = argc > 2 ? atoi(argv[2]) : 8;
+    long requests = argc > 3 ? atol(argv[3]) : 200000;
+    int depth = argc > 4 ? atoi(argv[4]) : 16;
+    if (connections < 1 || requests < connections || depth < 1 || depth > MAX_DEPTH) {
+        fprintf(stderr, "Error: Need 1+ connections, at least one request each and depth 1 to %d\n", MAX_DEPTH);
+        return 1;
+    }
+    if (build_expressions() != 0) return 1;
+
+    long per_client = requests / connections;
+    Client *clients = calloc(connections, sizeof(Client));
+    pthread_t *threads = malloc(connections * sizeof(pthread_t));
+    double *latencies = malloc(per_client * connections * sizeof(double));
+    if (clients == NULL || threads == NULL || latencies == NULL) {
+        printf("Memory allocation failed!\n");
+        return 1;
+    }
+
+    double start = now_seconds();
+    for (int i = 0; i < connections; i++) {
+        clients[i].socket_path = socket_path;
+        clients[i].offset = (i * 389) % EXPRESSIONS;
+        clients[i].requests = per_client;
+        clients[i].depth = depth;
+        clients[i].latencies = latencies + i * per_client;
+        pthread_create(&threads[i], NULL, run_client, &clients[i]);
+    }
+    long mismatches = 0;
+    int failed = 0;
+    for (int i = 0; i < connections; i++) {
+        pthread_join(threads[i], NULL);
+        mismatches += clients[i].mismatches;
+        failed += clients[i].failed;
+    }
+    double elapsed = now_seconds() - start;
+
+    if (failed > 0) {
+        fprintf(stderr, "Error: %d connection(s) to %s failed\n", failed, socket_path);
+        return 1;
+    }
+
+    long total = per_client * connections;
+    qsort(latencies, total, sizeof(double), compare_doubles);
+    printf("%d connection(s), pipeline depth %d, %ld requests in %.3f s\n", connections, depth, total, elapsed);
+    printf("%12s %10s %10s %10s %10s\n", "Requests/s", "p50 us", "p90 us", "p99 us", "max us");
+    printf("%12.0f %10.1f %10.1f %10.1f %10.1f\n", total / elapsed,
+           percentile(latencies, total, 0.50) * 1e6, percentile(latencies, total, 0.90) * 1e6,
+           percentile(latencies, total, 0.99) * 1e6, latencies[total - 1] * 1e6);
+    if (mismatches > 0) {
+        printf("%ld response(s) did not match local evaluation\n", mismatches);
+    }
+
+    free(clients);
+    free(threads);
+    free(latencies);
+    return mismatches > 0 ? 1 : 0;
+}
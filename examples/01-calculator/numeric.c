@@ -0,0 +1,357 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <limits.h>
+#include <math.h>
+#include "numeric.h"
+#include "expression_optimizer.h"
+#include "symbols.h"
+
+// Functions every backend may fall back to, in double precision
+static double apply_function(NodeType type, double x) {
+    switch (type) {
+        case NODE_NEG:  return -x;
+        case NODE_SIN:  return sin(x);
+        case NODE_COS:  return cos(x);
+        case NODE_TAN:  return tan(x);
+        case NODE_LOG:  return log10(x);
+        case NODE_LN:   return log(x);
+        case NODE_SQRT: return sqrt(x);
+        default:        return NAN;
+    }
+}
+
+static char* format_text(const char *format, ...) {
+    char *text = malloc(64);
+    if (text == NULL) return NULL;
+    va_list args;
+    va_start(args, format);
+    vsnprintf(text, 64, format, args);
+    va_end(args);
+    return text;
+}
+
+static void release_nothing(NumValue *value) {
+    (void)value;
+}
+
+// double
+
+static int double_from_double(double value, NumValue *out) {
+    out->real = value;
+    return EVAL_OK;
+}
+
+static int double_unary(NodeType type, const NumValue *operand, NumValue *out) {
+    out->real = apply_function(type, operand->real);
+    return EVAL_OK;
+}
+
+static int double_binary(NodeType type, const NumValue *left, const NumValue *right, NumValue *out) {
+    switch (type) {
+        case NODE_ADD: out->real = left->real + right->real; return EVAL_OK;
+        case NODE_SUB: out->real = left->real - right->real; return EVAL_OK;
+        case NODE_MUL: out->real = left->real * right->real; return EVAL_OK;
+        case NODE_DIV:
+            if (right->real == 0) return EVAL_DIVISION_BY_ZERO;
+            out->real = left->real / right->real;
+            return EVAL_OK;
+        case NODE_POW: out->real = pow(left->real, right->real); return EVAL_OK;
+        default:       return EVAL_SYNTAX_ERROR;
+    }
+}
+
+static double double_to_double(const NumValue *value) {
+    return value->real;
+}
+
+static char* double_format(const NumValue *value) {
+    return format_text("%.17g", value->real);
+}
+
+// fixed: value * FIXED_ONE in a long long; results are rounded half away
+// from zero and anything outside the long long range is an error
+
+static int fixed_store(__int128 value, NumValue *out) {
+    if (value > LLONG_MAX || value < -(__int128)LLONG_MAX) return EVAL_OUT_OF_RANGE;
+    out->fixed = (long long)value;
+    return EVAL_OK;
+}
+
+static __int128 divide_rounded(__int128 numerator, __int128 denominator) {
+    __int128 quotient = numerator / denominator;
+    __int128 remainder = numerator % denominator;
+    if (remainder < 0) remainder = -remainder;
+    if (2 * remainder >= (denominator < 0 ? -denominator : denominator)) {
+        quotient += (numerator < 0) != (denominator < 0) ? -1 : 1;
+    }
+    return quotient;
+}
+
+static int fixed_from_literal(const char *text, NumValue *out) {
+    int negative = *text == '-';
+    if (negative) text++;
+
+    // Place value of the first digit, so "1.5e3" is read as exactly as "1500"
+    const char *mark = text + strcspn(text, "eE");
+    long place = -1;
+    if (*mark != '\0') {
+        long exponent = strtol(mark + 1, NULL, 10);
+        place += exponent < -100000 ? -100000 : exponent > 100000 ? 100000 : exponent;
+    }
+    for (const char *p = text; *p >= '0' && *p <= '9'; p++) place++;
+
+    // Keep FIXED_DECIMALS fraction digits and round on the next one
+    __int128 units = 0;
+    int round_up = 0;
+    for (; text < mark; text++) {
+        if (*text == '.') continue;
+        if (place >= -FIXED_DECIMALS) {
+            units = units * 10 + (*text - '0');
+            if (units > LLONG_MAX) return EVAL_OUT_OF_RANGE;
+        } else if (place == -FIXED_DECIMALS - 1) {
+            round_up = *text >= '5';
+        }
+        place--;
+    }
+    for (; place >= -FIXED_DECIMALS; place--) {
+        units *= 10;
+        if (units > LLONG_MAX) return EVAL_OUT_OF_RANGE;
+    }
+    units += round_up;
+
+    return fixed_store(negative ? -units : units, out);
+}
+
+static int fixed_from_double(double value, NumValue *out) {
+    double scaled = value * FIXED_ONE;
+    if (!isfinite(scaled) || fabs(scaled) >= 9.2e18) return EVAL_OUT_OF_RANGE;
+    out->fixed = llround(scaled);
+    return EVAL_OK;
+}
+
+static double fixed_to_double(const NumValue *value) {
+    return (double)value->fixed / FIXED_ONE;
+}
+
+static int fixed_unary(NodeType type, const NumValue *operand, NumValue *out) {
+    if (type == NODE_NEG) {
+        return fixed_store(-(__int128)operand->fixed, out);
+    }
+    return fixed_from_double(apply_function(type, fixed_to_double(operand)), out);
+}
+
+static int fixed_multiply(long long left, long long right, NumValue *out) {
+    return fixed_store(divide_rounded((__int128)left * right, FIXED_ONE), out);
+}
+
+static int fixed_divide(long long left, long long right, NumValue *out) {
+    if (right == 0) return EVAL_DIVISION_BY_ZERO;
+    return fixed_store(divide_rounded((__int128)left * FIXED_ONE, right), out);
+}
+
+static int fixed_binary(NodeType type, const NumValue *left, const NumValue *right, NumValue *out) {
+    long long result;
+    switch (type) {
+        case NODE_ADD:
+            if (__builtin_add_overflow(left->fixed, right->fixed, &result)) return EVAL_OUT_OF_RANGE;
+            out->fixed = result;
+            return EVAL_OK;
+        case NODE_SUB:
+            if (__builtin_sub_overflow(left->fixed, right->fixed, &result)) return EVAL_OUT_OF_RANGE;
+            out->fixed = result;
+            return EVAL_OK;
+        case NODE_MUL: return fixed_multiply(left->fixed, right->fixed, out);
+        case NODE_DIV: return fixed_divide(left->fixed, right->fixed, out);
+        case NODE_POW:
+            // Rounding every step of repeated squaring drifts (1.05^10 would
+            // lose a cent per thousand), so round the double result once
+            return fixed_from_double(pow(fixed_to_double(left), fixed_to_double(right)), out);
+        default:       return EVAL_SYNTAX_ERROR;
+    }
+}
+
+static char* fixed_format(const NumValue *value) {
+    unsigned long long magnitude = value->fixed < 0 ? -(unsigned long long)value->fixed
+                                                    : (unsigned long long)value->fixed;
+    return format_text("%s%llu.%0*llu", value->fixed < 0 ? "-" : "",
+                       magnitude / FIXED_ONE, FIXED_DECIMALS, magnitude % FIXED_ONE);
+}
+
+// decimal
+
+static int decimal_result(BigDecimal *result, NumValue *out) {
+    if (result == NULL) return EVAL_OUT_OF_RANGE;
+    out->decimal = result;
+    return EVAL_OK;
+}
+
+static int decimal_from_literal(const char *text, NumValue *out) {
+    return decimal_result(decimal_parse(text), out);
+}
+
+static int decimal_from_real(double value, NumValue *out) {
+    return decimal_result(decimal_from_double(value), out);
+}
+
+static double decimal_value_to_double(const NumValue *value) {
+    return decimal_to_double(value->decimal);
+}
+
+static int decimal_unary(NodeType type, const NumValue *operand, NumValue *out) {
+    switch (type) {
+        case NODE_NEG:  return decimal_result(decimal_negate(operand->decimal), out);
+        case NODE_SQRT: return decimal_result(decimal_sqrt(operand->decimal, DECIMAL_DIVISION_SCALE), out);
+        default:
+            return decimal_from_real(apply_function(type, decimal_to_double(operand->decimal)), out);
+    }
+}
+
+static int decimal_binary(NodeType type, const NumValue *left, const NumValue *right, NumValue *out) {
+    long exponent;
+    switch (type) {
+        case NODE_ADD: return decimal_result(decimal_add(left->decimal, right->decimal), out);
+        case NODE_SUB: return decimal_result(decimal_sub(left->decimal, right->decimal), out);
+        case NODE_MUL: return decimal_result(decimal_mul(left->decimal, right->decimal), out);
+        case NODE_DIV:
+            if (decimal_is_zero(right->decimal)) return EVAL_DIVISION_BY_ZERO;
+            return decimal_result(decimal_div(left->decimal, right->decimal, DECIMAL_DIVISION_SCALE), out);
+        case NODE_POW:
+            if (decimal_to_long(right->decimal, &exponent) &&
+                exponent <= DECIMAL_MAX_POWER && exponent >= -DECIMAL_MAX_POWER) {
+                if (exponent < 0 && decimal_is_zero(left->decimal)) return EVAL_DIVISION_BY_ZERO;
+                return decimal_result(decimal_pow_int(left->decimal, exponent, DECIMAL_DIVISION_SCALE), out);
+            }
+            return decimal_from_real(pow(decimal_to_double(left->decimal),
+                                         decimal_to_double(right->decimal)), out);
+        default:
+            return EVAL_SYNTAX_ERROR;
+    }
+}
+
+static char* decimal_value_format(const NumValue *value) {
+    return decimal_format(value->decimal);
+}
+
+static void decimal_release(NumValue *value) {
+    decimal_free(value->decimal);
+}
+
+static const NumericBackend backends[] = {
+    { "double", NULL, double_from_double, double_unary, double_binary,
+      double_to_double, double_format, release_nothing },
+    { "fixed", fixed_from_literal, fixed_from_double, fixed_unary, fixed_binary,
+      fixed_to_double, fixed_format, release_nothing },
+    { "decimal", decimal_from_literal, decimal_from_real, decimal_unary, decimal_binary,
+      decimal_value_to_double, decimal_value_format, decimal_release },
+};
+
+const NumericBackend* numeric_backend(NumericMode mode) {
+    return &backends[mode];
+}
+
+const NumericBackend* numeric_backend_by_name(const char *name) {
+    for (size_t i = 0; i < sizeof(backends) / sizeof(backends[0]); i++) {
+        if (strcmp(backends[i].name, name) == 0) return &backends[i];
+    }
+    return NULL;
+}
+
+// Evaluates the tree bottom-up, releasing operands as soon as they are used
+int evaluate_numeric(const NumericBackend *backend, const Node *node, double memory, NumValue *out) {
+    switch (node->type) {
+        case NODE_NUMBER:
+            // The parser already rounded the literal to node->value
+            return node->name && backend->from_literal ? backend->from_literal(node->name, out)
+                                                       : backend->from_double(node->value, out);
+        case NODE_MEMORY:
+            return backend->from_double(memory, out);
+        case NODE_VARIABLE:
+            return EVAL_SYNTAX_ERROR;
+        default:
+            break;
+    }
+
+    NumValue left, right;
+    int status = evaluate_numeric(backend, node->left, memory, &left);
+    if (status != EVAL_OK) return status;
+
+    if (node_arity(node->type) == 1) {
+        status = backend->unary(node->type, &left, out);
+        backend->release(&left);
+        return status;
+    }
+
+    status = evaluate_numeric(backend, node->right, memory, &right);
+    if (status != EVAL_OK) {
+        backend->release(&left);
+        return status;
+    }
+    status = backend->binary(node->type, &left, &right, out);
+    backend->release(&left);
+    backend->release(&right);
+    return status;
+}
+
+// Replaces variables with the values of their let definitions; returns
+// the name of the first undefined one, or NULL if all are bound
+static const char* bind_variables(Node *node, const SymbolTable *symbols) {
+    if (node == NULL) return NULL;
+    if (node->type == NODE_VARIABLE) {
+        const Symbol *symbol = find_symbol(symbols, node->name, (int)strlen(node->name));
+        if (symbol == NULL || symbol->kind != SYMBOL_VARIABLE) return node->name;
+        free(node->name);
+        node->name = NULL;
+        node->type = NODE_NUMBER;
+        node->value = symbol->value;
+        return NULL;
+    }
+    const char *name = bind_variables(node->left, symbols);
+    return name ? name : bind_variables(node->right, symbols);
+}
+
+int calculate_numeric(CalcContext *context, const NumericBackend *backend, const char *text,
+                      char **formatted, double *approximation) {
+    Parser parser;
+    init_parser(&parser, text);
+    parser.symbols = context->symbols;
+    Node *root = parse_formula(&parser);
+    if (root == NULL) {
+        report_parse_error(context, &parser.error);
+        return -1;
+    }
+
+    const char *variable = bind_variables(root, context->symbols);
+    if (variable != NULL) {
+        snprintf(context->error, sizeof(context->error), "Unknown variable '%.64s'", variable);
+        free_node(root);
+        return -1;
+    }
+
+    NumValue value;
+    int status = evaluate_numeric(backend, root, context->memory, &value);
+    free_node(root);
+
+    if (status == EVAL_DIVISION_BY_ZERO) {
+        snprintf(context->error, sizeof(context->error), "Division by zero!");
+        return -1;
+    }
+    if (status == EVAL_OUT_OF_RANGE) {
+        snprintf(context->error, sizeof(context->error), "Result out of range");
+        return -1;
+    }
+    if (status != EVAL_OK) {
+        snprintf(context->error, sizeof(context->error), "Invalid expression");
+        return -1;
+    }
+
+    *formatted = backend->format(&value);
+    *approximation = backend->to_double(&value);
+    backend->release(&value);
+    if (*formatted == NULL) {
+        snprintf(context->error, sizeof(context->error), "Memory allocation failed!");
+        return -1;
+    }
+    return 0;
+}
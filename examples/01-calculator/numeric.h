@@ -0,0 +1,54 @@
+#ifndef NUMERIC_H
+#define NUMERIC_H
+
+#include "expression_parser.h"
+#include "big_decimal.h"
+
+// Numeric backends for evaluating a parsed expression tree:
+//   double  - IEEE doubles, like the bytecode evaluator
+//   fixed   - 64-bit integers counting 1/10^FIXED_DECIMALS (for money)
+//   decimal - arbitrary-precision decimals (big_decimal.c)
+// Number literals are read from their text, so 0.1 is exact in the fixed
+// and decimal backends. Functions without an exact implementation (sin,
+// cos, tan, log, ln, fixed-point sqrt and pow, decimal pow with a
+// fractional exponent) are computed in double precision and rounded back.
+
+#define FIXED_DECIMALS 4
+#define FIXED_ONE 10000LL
+#define DECIMAL_DIVISION_SCALE 40   // decimal places kept by / and sqrt
+#define DECIMAL_MAX_POWER 10000     // larger integer exponents use doubles
+
+typedef enum {
+    NUMERIC_DOUBLE,
+    NUMERIC_FIXED,
+    NUMERIC_DECIMAL
+} NumericMode;
+
+typedef union {
+    double real;
+    long long fixed;
+    BigDecimal *decimal;
+} NumValue;
+
+// Operations return EVAL_OK or an EVAL_* error code
+typedef struct {
+    const char *name;
+    int (*from_literal)(const char *text, NumValue *out);   // NULL: use the parsed double
+    int (*from_double)(double value, NumValue *out);
+    int (*unary)(NodeType type, const NumValue *operand, NumValue *out);
+    int (*binary)(NodeType type, const NumValue *left, const NumValue *right, NumValue *out);
+    double (*to_double)(const NumValue *value);
+    char* (*format)(const NumValue *value);      // caller frees
+    void (*release)(NumValue *value);
+} NumericBackend;
+
+const NumericBackend* numeric_backend(NumericMode mode);
+const NumericBackend* numeric_backend_by_name(const char *name);
+int evaluate_numeric(const NumericBackend *backend, const Node *root, double memory, NumValue *out);
+
+// calculate() with a numeric backend: on success stores the formatted
+// result (caller frees) and its double approximation
+int calculate_numeric(CalcContext *context, const NumericBackend *backend, const char *text,
+                      char **formatted, double *approximation);
+
+#endif
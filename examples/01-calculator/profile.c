@@ -0,0 +1,262 @@
+#define _POSIX_C_SOURCE 199309L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "profile.h"
+
+#ifdef CALC_PROFILE
+
+#include <pthread.h>
+#include <time.h>
+
+#define CALIBRATION_NS 10000000     // shortest interval for measuring the tick rate
+
+__thread ProfileCounters *profile_thread_counters;
+
+static pthread_mutex_t registry_lock = PTHREAD_MUTEX_INITIALIZER;
+static ProfileCounters *registry;   // every thread's block, newest first
+static ProfileCounters fallback;    // shared by threads whose block could not be allocated
+static int thread_count;
+static unsigned long long start_ticks;
+static unsigned long long start_ns;
+static unsigned long long tick_overhead;    // cost of one profile_ticks() pair
+
+static const char *op_names[PROFILE_OPS] = {
+    [OP_CONST] = "const", [OP_MEMORY] = "memory", [OP_VARIABLE] = "variable",
+    [OP_NEG] = "neg", [OP_ADD] = "add", [OP_SUB] = "sub", [OP_MUL] = "mul",
+    [OP_DIV] = "div", [OP_SIN] = "sin", [OP_COS] = "cos", [OP_TAN] = "tan",
+    [OP_LOG] = "log", [OP_LN] = "ln", [OP_SQRT] = "sqrt", [OP_POW] = "pow",
+    [OP_STORE] = "store", [OP_LOAD] = "load"
+};
+
+static const char *phase_names[PROFILE_PHASES] = { "parse", "compile", "evaluate", "native" };
+static const char *histogram_names[PROFILE_HISTOGRAMS] = { "tree_depth", "stack_depth" };
+
+static unsigned long long now_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (unsigned long long)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+#if !defined(__x86_64__) && !defined(__i386__)
+unsigned long long profile_ticks() {
+    return now_ns();
+}
+#endif
+
+static int is_math_op(int op) {
+    return op >= OP_SIN && op <= OP_POW;
+}
+
+ProfileCounters* profile_register_thread() {
+    ProfileCounters *counters = calloc(1, sizeof(ProfileCounters));
+
+    pthread_mutex_lock(&registry_lock);
+    if (thread_count == 0) {
+        // The cheapest of many back-to-back reads is the timer's own cost
+        tick_overhead = ~0ULL;
+        for (int i = 0; i < 1000; i++) {
+            unsigned long long first = profile_ticks();
+            unsigned long long elapsed = profile_ticks() - first;
+            if (elapsed < tick_overhead) tick_overhead = elapsed;
+        }
+        start_ticks = profile_ticks();
+        start_ns = now_ns();
+    }
+    if (counters != NULL) {
+        counters->next = registry;
+        registry = counters;
+    } else {
+        counters = &fallback;
+    }
+    thread_count++;
+    pthread_mutex_unlock(&registry_lock);
+
+    profile_thread_counters = counters;
+    return counters;
+}
+
+void profile_record_depth(ProfileHistogram histogram, int depth) {
+    int bucket = 0;
+    while (depth > 0 && bucket < PROFILE_DEPTH_BUCKETS - 1) {
+        depth >>= 1;
+        bucket++;
+    }
+    profile_counters()->depths[histogram][bucket]++;
+}
+
+// Totals over every thread. Other threads may still be counting, so a
+// report taken while they run is a snapshot, not an exact cut.
+int profile_totals(ProfileCounters *total) {
+    memset(total, 0, sizeof(*total));
+    pthread_mutex_lock(&registry_lock);
+    for (ProfileCounters *counters = registry; ; counters = counters->next) {
+        if (counters == NULL) counters = &fallback;
+        for (int i = 0; i < PROFILE_OPS; i++) {
+            total->op_counts[i] += counters->op_counts[i];
+            total->math_ticks[i] += counters->math_ticks[i];
+        }
+        for (int i = 0; i < PROFILE_PHASES; i++) {
+            total->phase_calls[i] += counters->phase_calls[i];
+            total->phase_ticks[i] += counters->phase_ticks[i];
+        }
+        for (int h = 0; h < PROFILE_HISTOGRAMS; h++) {
+            for (int i = 0; i < PROFILE_DEPTH_BUCKETS; i++) {
+                total->depths[h][i] += counters->depths[h][i];
+            }
+        }
+        if (counters == &fallback) break;
+    }
+    int threads = thread_count;
+    pthread_mutex_unlock(&registry_lock);
+    return threads;
+}
+
+// Ticks per nanosecond since the first thread registered
+static double tick_rate() {
+    if (thread_count == 0) return 1.0;
+    unsigned long long ns;
+    while ((ns = now_ns() - start_ns) < CALIBRATION_NS) {
+        // wait until the interval is long enough to measure
+    }
+    return (double)(profile_ticks() - start_ticks) / ns;
+}
+
+// Nanoseconds spent, less the cost of reading the timer around each call
+static double net_ns(unsigned long long ticks, unsigned long long calls, double rate) {
+    unsigned long long overhead = calls * tick_overhead;
+    return ticks > overhead ? (ticks - overhead) / rate : 0.0;
+}
+
+static void bucket_label(int bucket, char *label, size_t size) {
+    if (bucket <= 1) {
+        snprintf(label, size, "%d", bucket);
+    } else if (bucket == PROFILE_DEPTH_BUCKETS - 1) {
+        snprintf(label, size, "%d+", 1 << (bucket - 1));
+    } else {
+        snprintf(label, size, "%d-%d", 1 << (bucket - 1), (1 << bucket) - 1);
+    }
+}
+
+int profile_enabled() {
+    return 1;
+}
+
+void profile_report(FILE *out) {
+    ProfileCounters total;
+    int threads = profile_totals(&total);
+    double rate = tick_rate();
+
+    fprintf(out, "Evaluator profile (%d thread(s), %.2f ticks/ns)\n", threads, rate);
+    fprintf(out, "%-10s %12s %12s %10s\n", "Phase", "Calls", "Total ms", "ns/call");
+    for (int i = 0; i < PROFILE_PHASES; i++) {
+        unsigned long long calls = total.phase_calls[i];
+        double ns = net_ns(total.phase_ticks[i], calls, rate);
+        fprintf(out, "%-10s %12llu %12.3f %10.1f\n", phase_names[i], calls, ns / 1e6,
+                calls ? ns / calls : 0.0);
+    }
+
+    fprintf(out, "\n%-10s %12s %12s %10s\n", "Operation", "Count", "libm ms", "ns/call");
+    for (int i = 0; i < PROFILE_OPS; i++) {
+        unsigned long long count = total.op_counts[i];
+        if (count == 0) continue;
+        if (is_math_op(i)) {
+            double ns = net_ns(total.math_ticks[i], count, rate);
+            fprintf(out, "%-10s %12llu %12.3f %10.1f\n", op_names[i], count, ns / 1e6, ns / count);
+        } else {
+            fprintf(out, "%-10s %12llu\n", op_names[i], count);
+        }
+    }
+
+    static const char *titles[PROFILE_HISTOGRAMS] = {
+        "Tree depth (parsing)", "Stack depth (evaluation)"
+    };
+    for (int h = 0; h < PROFILE_HISTOGRAMS; h++) {
+        fprintf(out, "\n%s\n", titles[h]);
+        for (int i = 0; i < PROFILE_DEPTH_BUCKETS; i++) {
+            if (total.depths[h][i] == 0) continue;
+            char label[32];
+            bucket_label(i, label, sizeof(label));
+            fprintf(out, "  %-12s %12llu\n", label, total.depths[h][i]);
+        }
+    }
+}
+
+int profile_write_json(const char *path) {
+    FILE *out = fopen(path, "w");
+    if (out == NULL) {
+        fprintf(stderr, "Error: Cannot write profile to '%s'\n", path);
+        return -1;
+    }
+
+    ProfileCounters total;
+    int threads = profile_totals(&total);
+    double rate = tick_rate();
+
+    fprintf(out, "{\n  \"threads\": %d,\n  \"ticks_per_ns\": %.4f,\n", threads, rate);
+    fprintf(out, "  \"phases\": {");
+    for (int i = 0; i < PROFILE_PHASES; i++) {
+        fprintf(out, "%s\n    \"%s\": {\"calls\": %llu, \"ns\": %.0f}", i ? "," : "", phase_names[i],
+                total.phase_calls[i], net_ns(total.phase_ticks[i], total.phase_calls[i], rate));
+    }
+    fprintf(out, "\n  },\n  \"operations\": {");
+    for (int i = 0; i < PROFILE_OPS; i++) {
+        fprintf(out, "%s\n    \"%s\": {\"count\": %llu", i ? "," : "", op_names[i], total.op_counts[i]);
+        if (is_math_op(i)) {
+            fprintf(out, ", \"libm_ns\": %.0f", net_ns(total.math_ticks[i], total.op_counts[i], rate));
+        }
+        fprintf(out, "}");
+    }
+    fprintf(out, "\n  },\n  \"depth_buckets\": [");
+    for (int i = 0; i < PROFILE_DEPTH_BUCKETS; i++) {
+        char label[32];
+        bucket_label(i, label, sizeof(label));
+        fprintf(out, "%s\"%s\"", i ? ", " : "", label);
+    }
+    fprintf(out, "]");
+    for (int h = 0; h < PROFILE_HISTOGRAMS; h++) {
+        fprintf(out, ",\n  \"%s\": [", histogram_names[h]);
+        for (int i = 0; i < PROFILE_DEPTH_BUCKETS; i++) {
+            fprintf(out, "%s%llu", i ? ", " : "", total.depths[h][i]);
+        }
+        fprintf(out, "]");
+    }
+    fprintf(out, "\n}\n");
+
+    if (fclose(out) != 0) {
+        fprintf(stderr, "Error: Cannot write profile to '%s'\n", path);
+        return -1;
+    }
+    return 0;
+}
+
+void profile_reset() {
+    pthread_mutex_lock(&registry_lock);
+    for (ProfileCounters *counters = registry; counters != NULL; counters = counters->next) {
+        ProfileCounters *next = counters->next;
+        memset(counters, 0, sizeof(*counters));
+        counters->next = next;
+    }
+    memset(&fallback, 0, sizeof(fallback));
+    pthread_mutex_unlock(&registry_lock);
+}
+
+#else
+
+int profile_enabled() {
+    return 0;
+}
+
+void profile_report(FILE *out) {
+    fprintf(out, "Profiling is not compiled in; rebuild with 'make PROFILE=1'.\n");
+}
+
+int profile_write_json(const char *path) {
+    fprintf(stderr, "Error: Cannot write profile to '%s': profiling is not compiled in\n", path);
+    return -1;
+}
+
+void profile_reset() {
+}
+
+#endif
@@ -0,0 +1,94 @@
+#ifndef PROFILE_H
+#define PROFILE_H
+
+#include <stdio.h>
+#include "expression_parser.h"
+
+// Evaluator instrumentation, compiled in only with -DCALC_PROFILE
+// (make PROFILE=1). Without it the PROFILE_* macros expand to nothing and
+// the report functions just say profiling is off.
+//
+// Counters are per thread: each thread gets its own block on first use, so
+// recording never takes a lock or shares a cache line. Blocks are kept
+// after their thread exits, and reports add up all of them. Times are TSC
+// ticks (clock_gettime nanoseconds where there is no TSC), converted to
+// nanoseconds in reports.
+
+typedef enum {
+    PROFILE_PARSE,          // text to tree (parse_formula)
+    PROFILE_COMPILE,        // tree to bytecode (compile_node)
+    PROFILE_EVALUATE,       // bytecode interpreter (evaluate_program)
+    PROFILE_NATIVE,         // JIT-compiled code (evaluate_jit)
+    PROFILE_PHASES
+} ProfilePhase;
+
+typedef enum {
+    PROFILE_TREE_DEPTH,     // depth of each parsed tree, limited by the parser
+    PROFILE_STACK_DEPTH,    // bytecode stack depth of each evaluation
+    PROFILE_HISTOGRAMS
+} ProfileHistogram;
+
+#define PROFILE_OPS (OP_LOAD + 1)
+#define PROFILE_DEPTH_BUCKETS 16    // 0, 1, 2-3, 4-7, ... 16384+
+
+// Reports whatever was recorded by every thread so far
+int profile_enabled();
+void profile_report(FILE *out);
+int profile_write_json(const char *path);
+void profile_reset();
+
+#ifdef CALC_PROFILE
+
+typedef struct ProfileCounters {
+    unsigned long long op_counts[PROFILE_OPS];      // instructions run, by opcode
+    unsigned long long math_ticks[PROFILE_OPS];     // time inside libm, by opcode
+    unsigned long long phase_calls[PROFILE_PHASES];
+    unsigned long long phase_ticks[PROFILE_PHASES];
+    unsigned long long depths[PROFILE_HISTOGRAMS][PROFILE_DEPTH_BUCKETS];
+    struct ProfileCounters *next;
+} ProfileCounters;
+
+extern __thread ProfileCounters *profile_thread_counters;
+ProfileCounters* profile_register_thread();
+int profile_totals(ProfileCounters *total);    // sums every thread; returns the thread count
+void profile_record_depth(ProfileHistogram histogram, int depth);
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+static inline unsigned long long profile_ticks() {
+    return __rdtsc();
+}
+#else
+unsigned long long profile_ticks();
+#endif
+
+static inline ProfileCounters* profile_counters() {
+    ProfileCounters *counters = profile_thread_counters;
+    return counters != NULL ? counters : profile_register_thread();
+}
+
+#define PROFILE_START(start) unsigned long long start = profile_ticks()
+#define PROFILE_END(phase, start) do { \
+        ProfileCounters *counters_ = profile_counters(); \
+        counters_->phase_ticks[phase] += profile_ticks() - (start); \
+        counters_->phase_calls[phase]++; \
+    } while (0)
+#define PROFILE_OP(op) (profile_counters()->op_counts[op]++)
+#define PROFILE_MATH(op, statement) do { \
+        unsigned long long start_ = profile_ticks(); \
+        statement; \
+        profile_counters()->math_ticks[op] += profile_ticks() - start_; \
+    } while (0)
+#define PROFILE_DEPTH(histogram, depth) profile_record_depth(histogram, depth)
+
+#else
+
+#define PROFILE_START(start) ((void)0)
+#define PROFILE_END(phase, start) ((void)0)
+#define PROFILE_OP(op) ((void)0)
+#define PROFILE_MATH(op, statement) statement
+#define PROFILE_DEPTH(histogram, depth) ((void)0)
+
+#endif
+
+#endif
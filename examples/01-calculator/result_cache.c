@@ -0,0 +1,207 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include "result_cache.h"
+
+// Budget spent on the bucket array: one pointer per this many bytes
+#define CACHE_BYTES_PER_BUCKET 128
+
+ResultCache* create_result_cache(size_t budget) {
+    if (budget < CACHE_MIN_BUDGET) budget = CACHE_MIN_BUDGET;
+
+    ResultCache *cache = calloc(1, sizeof(ResultCache));
+    if (cache == NULL) {
+        printf("Memory allocation failed!\n");
+        return NULL;
+    }
+
+    size_t buckets = 16;
+    while (buckets * 2 <= budget / CACHE_BYTES_PER_BUCKET) buckets *= 2;
+
+    cache->buckets = calloc(buckets, sizeof(CacheEntry *));
+    if (cache->buckets == NULL) {
+        printf("Memory allocation failed!\n");
+        free(cache);
+        return NULL;
+    }
+    cache->bucket_mask = buckets - 1;
+    cache->budget = budget;
+    cache->bytes = buckets * sizeof(CacheEntry *);
+    return cache;
+}
+
+static int is_word_char(char c) {
+    return isalnum((unsigned char)c) || c == '_' || c == '.';
+}
+
+// Writes the cache key for text into key: whitespace is dropped except
+// for a single space where it separates two word characters ("1 2" must
+// not become "12"). Returns the key length, or -1 if it does not fit.
+int normalize_expression(const char *text, char *key, size_t size, int *uses_memory) {
+    size_t length = 0;
+    int pending_space = 0;
+
+    for (const char *p = text; *p; p++) {
+        if (isspace((unsigned char)*p)) {
+            pending_space = 1;
+            continue;
+        }
+        if (pending_space && length > 0 && is_word_char(key[length - 1]) && is_word_char(*p)) {
+            if (length + 1 >= size) return -1;
+            key[length++] = ' ';
+        }
+        pending_space = 0;
+        if (length + 1 >= size) return -1;
+        key[length++] = *p;
+    }
+    key[length] = '\0';
+
+    // Conservative: any MR in the text makes the memory value part of the key
+    *uses_memory = strstr(key, "MR") != NULL;
+    return (int)length;
+}
+
+static unsigned int hash_key(const char *key, size_t length, int uses_memory, double memory) {
+    unsigned int hash = 2166136261u;
+    for (size_t i = 0; i < length; i++) {
+        hash = (hash ^ (unsigned char)key[i]) * 16777619u;
+    }
+    if (uses_memory) {
+        unsigned long long bits;
+        memcpy(&bits, &memory, sizeof(bits));
+        hash = (hash ^ (unsigned int)bits) * 16777619u;
+        hash = (hash ^ (unsigned int)(bits >> 32)) * 16777619u;
+    }
+    return hash;
+}
+
+static size_t entry_bytes(const CacheEntry *entry) {
+    return sizeof(CacheEntry) + entry->length + 1;
+}
+
+static void unlink_lru(ResultCache *cache, CacheEntry *entry) {
+    if (entry->newer) entry->newer->older = entry->older;
+    else cache->newest = entry->older;
+    if (entry->older) entry->older->newer = entry->newer;
+    else cache->oldest = entry->newer;
+}
+
+static void push_newest(ResultCache *cache, CacheEntry *entry) {
+    entry->newer = NULL;
+    entry->older = cache->newest;
+    if (cache->newest) cache->newest->newer = entry;
+    else cache->oldest = entry;
+    cache->newest = entry;
+}
+
+static void evict_oldest(ResultCache *cache) {
+    CacheEntry *victim = cache->oldest;
+    CacheEntry **link = &cache->buckets[victim->hash & cache->bucket_mask];
+    while (*link != victim) {
+        link = &(*link)->bucket_next;
+    }
+    *link = victim->bucket_next;
+
+    unlink_lru(cache, victim);
+    cache->bytes -= entry_bytes(victim);
+    cache->count--;
+    cache->stats.evictions++;
+    free(victim);
+}
+
+static CacheEntry* find_entry(ResultCache *cache, unsigned int hash, const char *key, size_t length,
+                              int uses_memory, double memory) {
+    for (CacheEntry *entry = cache->buckets[hash & cache->bucket_mask]; entry; entry = entry->bucket_next) {
+        if (entry->hash != hash || entry->length != length) continue;
+        if (memcmp(entry->key, key, length) != 0) continue;
+        // Compare memory bit for bit, so -0 and 0 or different NaNs stay apart
+        if (uses_memory && memcmp(&entry->memory, &memory, sizeof(double)) != 0) continue;
+        return entry;
+    }
+    return NULL;
+}
+
+// Returns 1 and the cached result on a hit, 0 on a miss
+int cache_lookup(ResultCache *cache, const char *key, size_t length,
+                 int uses_memory, double memory, double *result) {
+    unsigned int hash = hash_key(key, length, uses_memory, memory);
+    CacheEntry *entry = find_entry(cache, hash, key, length, uses_memory, memory);
+    if (entry == NULL) {
+        cache->stats.misses++;
+        return 0;
+    }
+
+    if (entry != cache->newest) {
+        unlink_lru(cache, entry);
+        push_newest(cache, entry);
+    }
+    cache->stats.hits++;
+    *result = entry->result;
+    return 1;
+}
+
+void cache_store(ResultCache *cache, const char *key, size_t length,
+                 int uses_memory, double memory, double result) {
+    unsigned int hash = hash_key(key, length, uses_memory, memory);
+    if (find_entry(cache, hash, key, length, uses_memory, memory) != NULL) return;
+
+    CacheEntry *entry = malloc(sizeof(CacheEntry) + length + 1);
+    if (entry == NULL) return;
+    entry->hash = hash;
+    entry->length = (unsigned int)length;
+    entry->uses_memory = uses_memory;
+    entry->memory = uses_memory ? memory : 0.0;
+    entry->result = result;
+    memcpy(entry->key, key, length);
+    entry->key[length] = '\0';
+
+    while (cache->count > 0 && cache->bytes + entry_bytes(entry) > cache->budget) {
+        evict_oldest(cache);
+    }
+
+    CacheEntry **bucket = &cache->buckets[hash & cache->bucket_mask];
+    entry->bucket_next = *bucket;
+    *bucket = entry;
+    push_newest(cache, entry);
+    cache->bytes += entry_bytes(entry);
+    cache->count++;
+}
+
+void show_cache_stats(const ResultCache *cache) {
+    unsigned long long lookups = cache->stats.hits + cache->stats.misses;
+    printf("\nResult Cache:\n");
+    printf("  Hits:      %llu\n", cache->stats.hits);
+    printf("  Misses:    %llu\n", cache->stats.misses);
+    printf("  Hit rate:  %.1f%%\n", lookups ? 100.0 * cache->stats.hits / lookups : 0.0);
+    printf("  Entries:   %zu\n", cache->count);
+    printf("  Evictions: %llu\n", cache->stats.evictions);
+    printf("  Memory:    %zu of %zu bytes\n\n", cache->bytes, cache->budget);
+}
+
+// Drops every entry, e.g. after a definition changes what a name means
+void cache_clear(ResultCache *cache) {
+    CacheEntry *entry = cache->newest;
+    while (entry != NULL) {
+        CacheEntry *next = entry->older;
+        free(entry);
+        entry = next;
+    }
+    memset(cache->buckets, 0, (cache->bucket_mask + 1) * sizeof(CacheEntry *));
+    cache->newest = NULL;
+    cache->oldest = NULL;
+    cache->bytes = (cache->bucket_mask + 1) * sizeof(CacheEntry *);
+    cache->count = 0;
+}
+
+void free_result_cache(ResultCache *cache) {
+    if (cache == NULL) return;
+    CacheEntry *entry = cache->newest;
+    while (entry != NULL) {
+        CacheEntry *next = entry->older;
+        free(entry);
+        entry = next;
+    }
+    free(cache->buckets);
+    free(cache);
+}
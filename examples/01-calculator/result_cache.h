@@ -0,0 +1,55 @@
+#ifndef RESULT_CACHE_H
+#define RESULT_CACHE_H
+
+#include <stddef.h>
+
+// Memoized results of calculate(), keyed by the normalized expression text.
+// Expressions that mention MR are also keyed by the memory value they were
+// evaluated with, so changing memory never returns a stale result. Entries
+// are evicted least recently used first once the memory budget is reached.
+// Not thread-safe: each CalcContext owns its cache.
+
+#define CACHE_DEFAULT_BUDGET (16 * 1024 * 1024)
+#define CACHE_MIN_BUDGET 4096
+#define CACHE_MAX_KEY 1024
+
+typedef struct CacheEntry {
+    struct CacheEntry *bucket_next;
+    struct CacheEntry *newer;       // LRU list, most recently used at the head
+    struct CacheEntry *older;
+    unsigned int hash;
+    unsigned int length;
+    int uses_memory;
+    double memory;
+    double result;
+    char key[];
+} CacheEntry;
+
+typedef struct {
+    unsigned long long hits;
+    unsigned long long misses;
+    unsigned long long evictions;
+} CacheStats;
+
+typedef struct ResultCache {
+    CacheEntry **buckets;
+    size_t bucket_mask;
+    CacheEntry *newest;
+    CacheEntry *oldest;
+    size_t count;
+    size_t bytes;                   // entries plus the bucket array
+    size_t budget;
+    CacheStats stats;
+} ResultCache;
+
+ResultCache* create_result_cache(size_t budget);
+int normalize_expression(const char *text, char *key, size_t size, int *uses_memory);
+int cache_lookup(ResultCache *cache, const char *key, size_t length,
+                 int uses_memory, double memory, double *result);
+void cache_store(ResultCache *cache, const char *key, size_t length,
+                 int uses_memory, double memory, double result);
+void cache_clear(ResultCache *cache);
+void show_cache_stats(const ResultCache *cache);
+void free_result_cache(ResultCache *cache);
+
+#endif
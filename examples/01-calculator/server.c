@@ -0,0 +1,706 @@
+#define _DEFAULT_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <errno.h>
+#include <signal.h>
+#include <pthread.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include "expression_parser.h"
+#include "result_cache.h"
+#include "jit.h"
+#include "server.h"
+
+#define READ_SIZE 65536
+#define MAX_EVENTS 64
+#define RESPONSE_SIZE 128
+
+typedef struct Connection Connection;
+
+// One line from a client; a worker fills in the response
+typedef struct Request {
+    struct Request *next;
+    Connection *connection;
+    unsigned long sequence;
+    int response_length;
+    char response[RESPONSE_SIZE];
+    char text[];
+} Request;
+
+// Only the event loop thread touches a connection. Workers hold requests
+// that point at it, so it is freed only once none are in flight.
+struct Connection {
+    int fd;
+    unsigned int events;            // epoll events currently requested
+    char *input;                    // bytes read but not yet split into requests
+    size_t input_length;
+    size_t input_capacity;
+    char *output;                   // responses, sent from output_start
+    size_t output_start;
+    size_t output_length;
+    size_t output_capacity;
+    Request *finished[SERVER_MAX_IN_FLIGHT];  // by sequence, waiting for earlier ones
+    unsigned long next_sequence;    // given to the next request read
+    unsigned long next_response;    // next sequence to write
+    int in_flight;                  // requests read but not yet answered
+    int read_closed;                // client sent EOF
+    int discarding;                 // skipping the rest of an overlong line
+    int broken;                     // socket error: drop responses, then close
+    int dirty;                      // on the list of connections to service
+    Connection *dirty_next;
+    Connection *prev;
+    Connection *next;
+};
+
+// Compiled programs by normalized expression. Entries are only added, never
+// changed or removed, so a program found under the read lock stays valid.
+typedef struct ProgramEntry {
+    struct ProgramEntry *next;
+    unsigned int hash;
+    int length;
+    Program *program;
+    char key[];
+} ProgramEntry;
+
+typedef struct {
+    ProgramEntry **buckets;
+    size_t mask;
+    size_t count;
+    pthread_rwlock_t lock;
+} ProgramCache;
+
+typedef struct {
+    int epoll_fd;
+    int listen_fd;
+    int wake_fd;                    // eventfd the workers signal
+    Connection *connections;
+    Connection *dirty;
+    ProgramCache programs;
+
+    pthread_mutex_t lock;           // protects the two queues and stopping
+    pthread_cond_t work_ready;
+    Request *queue_head;            // requests waiting for a worker
+    Request *queue_tail;
+    Request *done;                  // evaluated requests for the event loop
+    int stopping;
+} Server;
+
+static volatile sig_atomic_t stop_requested;
+
+// epoll tags for the listening socket and the eventfd
+static int listen_tag;
+static int wake_tag;
+
+static void request_stop(int signal_number) {
+    (void)signal_number;
+    stop_requested = 1;
+}
+
+// Program cache
+
+static unsigned int hash_key(const char *key, int length) {
+    unsigned int hash = 2166136261u;
+    for (int i = 0; i < length; i++) {
+        hash = (hash ^ (unsigned char)key[i]) * 16777619u;
+    }
+    return hash;
+}
+
+static int init_program_cache(ProgramCache *cache) {
+    cache->buckets = calloc(SERVER_PROGRAM_CACHE, sizeof(ProgramEntry *));
+    if (cache->buckets == NULL) return -1;
+    cache->mask = SERVER_PROGRAM_CACHE - 1;
+    cache->count = 0;
+    pthread_rwlock_init(&cache->lock, NULL);
+    return 0;
+}
+
+static ProgramEntry* find_entry(const ProgramCache *cache, const char *key, int length, unsigned int hash) {
+    for (ProgramEntry *entry = cache->buckets[hash & cache->mask]; entry != NULL; entry = entry->next) {
+        if (entry->hash == hash && entry->length == length && memcmp(entry->key, key, length) == 0) {
+            return entry;
+        }
+    }
+    return NULL;
+}
+
+static Program* find_program(ProgramCache *cache, const char *key, int length, unsigned int hash) {
+    pthread_rwlock_rdlock(&cache->lock);
+    ProgramEntry *entry = find_entry(cache, key, length, hash);
+    pthread_rwlock_unlock(&cache->lock);
+    return entry ? entry->program : NULL;
+}
+
+// Returns the cached program for key: program itself, or the one another
+// worker added first. NULL if the cache is full (the caller keeps program).
+static Program* add_program(ProgramCache *cache, const char *key, int length, unsigned int hash, Program *program) {
+    pthread_rwlock_wrlock(&cache->lock);
+    ProgramEntry *entry = find_entry(cache, key, length, hash);
+    if (entry == NULL && cache->count < SERVER_PROGRAM_CACHE) {
+        entry = malloc(sizeof(ProgramEntry) + length);
+        if (entry != NULL) {
+            entry->hash = hash;
+            entry->length = length;
+            entry->program = program;
+            memcpy(entry->key, key, length);
+            entry->next = cache->buckets[hash & cache->mask];
+            cache->buckets[hash & cache->mask] = entry;
+            cache->count++;
+        }
+    }
+    pthread_rwlock_unlock(&cache->lock);
+    return entry ? entry->program : NULL;
+}
+
+static void free_program_cache(ProgramCache *cache) {
+    for (size_t i = 0; i <= cache->mask; i++) {
+        ProgramEntry *entry = cache->buckets[i];
+        while (entry != NULL) {
+            ProgramEntry *next = entry->next;
+            free_program(entry->program);
+            free(entry);
+            entry = next;
+        }
+    }
+    free(cache->buckets);
+    pthread_rwlock_destroy(&cache->lock);
+}
+
+// Workers
+
+static void respond(Request *request, const char *format, ...) {
+    va_list args;
+    va_start(args, format);
+    int length = vsnprintf(request->response, RESPONSE_SIZE, format, args);
+    va_end(args);
+    if (length < 0) {
+        length = snprintf(request->response, RESPONSE_SIZE, "Error\n");
+    } else if (length >= RESPONSE_SIZE) {
+        length = RESPONSE_SIZE - 1;
+        request->response[length - 1] = '\n';     // keep one line per request
+    }
+    request->response_length = length;
+}
+
+static void evaluate_request(Server *server, CalcContext *context, Request *request) {
+    char key[CACHE_MAX_KEY];
+    int uses_memory;
+    int length = normalize_expression(request->text, key, sizeof(key), &uses_memory);
+    unsigned int hash = length >= 0 ? hash_key(key, length) : 0;
+    // The worker's own table first: its entries carry the tiering state
+    TieredProgram *tiered = length >= 0 && context->programs != NULL ? find_tiered(context->programs, key, length) : NULL;
+    Program *program = tiered != NULL ? tiered->program : NULL;
+    int owned = 0;
+
+    if (program == NULL) {
+        program = length >= 0 ? find_program(&server->programs, key, length, hash) : NULL;
+    }
+    if (program == NULL) {
+        ParseError error;
+        program = compile_expression(request->text, &error);
+        if (program == NULL) {
+            report_parse_error(context, &error);
+            respond(request, "Error: %s\n", context->error);
+            return;
+        }
+        owned = 1;
+        if (length >= 0 && program->variable_count == 0) {
+            Program *cached = add_program(&server->programs, key, length, hash, program);
+            if (cached != NULL) {
+                if (cached != program) free_program(program);
+                program = cached;
+                owned = 0;
+            }
+        }
+    }
+    // Programs in the shared cache live as long as the server
+    if (tiered == NULL && !owned && context->programs != NULL) {
+        tiered = add_tiered(context->programs, key, length, program, 0);
+    }
+
+    if (program->variable_count > 0) {
+        respond(request, "Error: Unknown variable '%.64s'\n", program->variable_names[0]);
+    } else {
+        // There is no memory to recall in server mode: MR is 0
+        EvalEnv env = { 0.0, NULL, EVAL_OK };
+        double result = tiered != NULL ? evaluate_tiered(tiered, &env) : evaluate_program(program, &env);
+        if (env.error == EVAL_DIVISION_BY_ZERO) {
+            respond(request, "Error: Division by zero!\n");
+        } else {
+            respond(request, "%.17g\n", result);
+        }
+    }
+    if (owned) free_program(program);
+}
+
+static void* server_worker(void *arg) {
+    Server *server = arg;
+    CalcContext context;
+    init_context(&context);
+    context.programs = create_tiered_table();
+
+    pthread_mutex_lock(&server->lock);
+    while (1) {
+        while (server->queue_head == NULL && !server->stopping) {
+            pthread_cond_wait(&server->work_ready, &server->lock);
+        }
+        Request *request = server->queue_head;
+        if (request == NULL) break;
+        server->queue_head = request->next;
+        if (server->queue_head == NULL) server->queue_tail = NULL;
+        pthread_mutex_unlock(&server->lock);
+
+        evaluate_request(server, &context, request);
+
+        pthread_mutex_lock(&server->lock);
+        int was_empty = server->done == NULL;
+        request->next = server->done;
+        server->done = request;
+        if (was_empty) {
+            // The event loop takes the whole list per wakeup
+            unsigned long long one = 1;
+            if (write(server->wake_fd, &one, sizeof(one)) < 0) {
+                perror("eventfd");
+            }
+        }
+    }
+    pthread_mutex_unlock(&server->lock);
+    free_tiered_table(context.programs);
+    return NULL;
+}
+
+// Connections
+
+static void mark_dirty(Server *server, Connection *connection) {
+    if (connection->dirty) return;
+    connection->dirty = 1;
+    connection->dirty_next = server->dirty;
+    server->dirty = connection;
+}
+
+static void append_output(Connection *connection, const char *data, size_t length) {
+    if (connection->output_length + length > connection->output_capacity && connection->output_start > 0) {
+        connection->output_length -= connection->output_start;
+        memmove(connection->output, connection->output + connection->output_start, connection->output_length);
+        connection->output_start = 0;
+    }
+    if (connection->output_length + length > connection->output_capacity) {
+        size_t capacity = connection->output_capacity ? connection->output_capacity * 2 : 4096;
+        while (capacity < connection->output_length + length) capacity *= 2;
+        char *output = realloc(connection->output, capacity);
+        if (output == NULL) {
+            connection->broken = 1;
+            return;
+        }
+        connection->output = output;
+        connection->output_capacity = capacity;
+    }
+    memcpy(connection->output + connection->output_length, data, length);
+    connection->output_length += length;
+}
+
+// Stores a response and writes out every response that is now in order
+static void finish_request(Request *request) {
+    Connection *connection = request->connection;
+    connection->finished[request->sequence % SERVER_MAX_IN_FLIGHT] = request;
+
+    while ((request = connection->finished[connection->next_response % SERVER_MAX_IN_FLIGHT]) != NULL) {
+        connection->finished[connection->next_response % SERVER_MAX_IN_FLIGHT] = NULL;
+        connection->next_response++;
+        connection->in_flight--;
+        if (!connection->broken) {
+            append_output(connection, request->response, request->response_length);
+        }
+        free(request);
+    }
+}
+
+static void submit(Server *server, Connection *connection, const char *text, size_t length) {
+    if (length > 0 && text[length - 1] == '\r') length--;
+
+    Request *request = malloc(sizeof(Request) + length + 1);
+    if (request == NULL) {
+        connection->broken = 1;
+        return;
+    }
+    memcpy(request->text, text, length);
+    request->text[length] = '\0';
+    request->next = NULL;
+    request->connection = connection;
+    request->sequence = connection->next_sequence++;
+    connection->in_flight++;
+
+    if (length > SERVER_MAX_LINE) {
+        respond(request, "Error: Expression too long\n");
+        finish_request(request);
+        return;
+    }
+
+    pthread_mutex_lock(&server->lock);
+    if (server->queue_tail != NULL) {
+        server->queue_tail->next = request;
+    } else {
+        server->queue_head = request;
+    }
+    server->queue_tail = request;
+    pthread_cond_signal(&server->work_ready);
+    pthread_mutex_unlock(&server->lock);
+}
+
+// Turns complete lines of input into requests, up to the in-flight limit
+static void dispatch_lines(Server *server, Connection *connection) {
+    size_t pos = 0;
+
+    while (connection->in_flight < SERVER_MAX_IN_FLIGHT && !connection->broken) {
+        char *line = connection->input + pos;
+        size_t rest = connection->input_length - pos;
+        char *newline = memchr(line, '\n', rest);
+
+        if (newline == NULL) {
+            if (connection->read_closed && rest > 0) {
+                // Last line without a newline, or the tail of an overlong one
+                if (!connection->discarding) submit(server, connection, line, rest);
+                connection->discarding = 0;
+                pos += rest;
+            } else if (rest > SERVER_MAX_LINE) {
+                // Answer an overlong line once, then skip to its end
+                if (!connection->discarding) submit(server, connection, line, rest);
+                connection->discarding = 1;
+                pos += rest;
+            }
+            break;
+        }
+
+        size_t length = newline - line;
+        if (connection->discarding) {
+            connection->discarding = 0;
+        } else {
+            submit(server, connection, line, length);
+        }
+        pos += length + 1;
+    }
+
+    connection->input_length -= pos;
+    memmove(connection->input, connection->input + pos, connection->input_length);
+}
+
+static void read_input(Connection *connection) {
+    if (connection->input_capacity - connection->input_length < READ_SIZE) {
+        size_t capacity = connection->input_length + READ_SIZE;
+        char *input = realloc(connection->input, capacity);
+        if (input == NULL) {
+            connection->broken = 1;
+            return;
+        }
+        connection->input = input;
+        connection->input_capacity = capacity;
+    }
+
+    ssize_t bytes = read(connection->fd, connection->input + connection->input_length, READ_SIZE);
+    if (bytes > 0) {
+        connection->input_length += bytes;
+    } else if (bytes == 0) {
+        connection->read_closed = 1;
+    } else if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+        connection->broken = 1;
+    }
+}
+
+static void flush_output(Connection *connection) {
+    while (!connection->broken && connection->output_start < connection->output_length) {
+        ssize_t sent = send(connection->fd, connection->output + connection->output_start,
+                            connection->output_length - connection->output_start, MSG_NOSIGNAL);
+        if (sent > 0) {
+            connection->output_start += sent;
+        } else if (sent < 0 && errno == EINTR) {
+            continue;
+        } else if (sent < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            break;
+        } else {
+            connection->broken = 1;
+        }
+    }
+    if (connection->output_start == connection->output_length) {
+        connection->output_start = 0;
+        connection->output_length = 0;
+    }
+}
+
+// Reads while the connection has room for more requests and its client
+// keeps up with the responses; waits for writability while output is queued
+static void update_events(Server *server, Connection *connection) {
+    unsigned int events = 0;
+    if (!connection->broken) {
+        if (!connection->read_closed && connection->in_flight < SERVER_MAX_IN_FLIGHT &&
+            connection->output_length - connection->output_start < SERVER_MAX_OUTPUT) {
+            events |= EPOLLIN;
+        }
+        if (connection->output_start < connection->output_length) {
+            events |= EPOLLOUT;
+        }
+    }
+    if (events != connection->events) {
+        struct epoll_event event;
+        event.events = events;
+        event.data.ptr = connection;
+        epoll_ctl(server->epoll_fd, EPOLL_CTL_MOD, connection->fd, &event);
+        connection->events = events;
+    }
+}
+
+static void free_connection(Connection *connection) {
+    for (int i = 0; i < SERVER_MAX_IN_FLIGHT; i++) {
+        free(connection->finished[i]);
+    }
+    close(connection->fd);
+    free(connection->input);
+    free(connection->output);
+    free(connection);
+}
+
+static void close_connection(Server *server, Connection *connection) {
+    epoll_ctl(server->epoll_fd, EPOLL_CTL_DEL, connection->fd, NULL);
+    if (connection->prev != NULL) {
+        connection->prev->next = connection->next;
+    } else {
+        server->connections = connection->next;
+    }
+    if (connection->next != NULL) connection->next->prev = connection->prev;
+    free_connection(connection);
+}
+
+static void service_connection(Server *server, Connection *connection) {
+    dispatch_lines(server, connection);
+    flush_output(connection);
+
+    // Workers still hold requests pointing at the connection until in_flight is 0
+    int finished = connection->broken ||
+                   (connection->read_closed && connection->input_length == 0 &&
+                    connection->output_length == 0);
+    if (finished && connection->in_flight == 0) {
+        close_connection(server, connection);
+    } else {
+        update_events(server, connection);
+    }
+}
+
+static void accept_clients(Server *server) {
+    while (1) {
+        int fd = accept(server->listen_fd, NULL, NULL);
+        if (fd < 0) {
+            if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) perror("accept");
+            return;
+        }
+        fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+
+        Connection *connection = calloc(1, sizeof(Connection));
+        struct epoll_event event;
+        event.events = EPOLLIN;
+        event.data.ptr = connection;
+        if (connection == NULL || epoll_ctl(server->epoll_fd, EPOLL_CTL_ADD, fd, &event) != 0) {
+            free(connection);
+            close(fd);
+            continue;
+        }
+        connection->fd = fd;
+        connection->events = EPOLLIN;
+        connection->next = server->connections;
+        if (server->connections != NULL) server->connections->prev = connection;
+        server->connections = connection;
+    }
+}
+
+static void collect_results(Server *server) {
+    unsigned long long count;
+    if (read(server->wake_fd, &count, sizeof(count)) < 0 && errno != EAGAIN) {
+        perror("eventfd");
+    }
+
+    pthread_mutex_lock(&server->lock);
+    Request *request = server->done;
+    server->done = NULL;
+    pthread_mutex_unlock(&server->lock);
+
+    while (request != NULL) {
+        Request *next = request->next;
+        mark_dirty(server, request->connection);
+        finish_request(request);
+        request = next;
+    }
+}
+
+// Setup and shutdown
+
+static int open_socket(const char *path) {
+    struct sockaddr_un address;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof(address.sun_path)) {
+        fprintf(stderr, "Error: Socket path too long: %s\n", path);
+        return -1;
+    }
+    strcpy(address.sun_path, path);
+
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) {
+        perror("socket");
+        return -1;
+    }
+    if (bind(fd, (struct sockaddr *)&address, sizeof(address)) != 0) {
+        if (errno != EADDRINUSE) {
+            perror("bind");
+            close(fd);
+            return -1;
+        }
+        // Replace a socket file left behind, but not a live server
+        int probe = socket(AF_UNIX, SOCK_STREAM, 0);
+        int live = probe >= 0 && connect(probe, (struct sockaddr *)&address, sizeof(address)) == 0;
+        if (probe >= 0) close(probe);
+        if (live) {
+            fprintf(stderr, "Error: A server is already listening on %s\n", path);
+            close(fd);
+            return -1;
+        }
+        unlink(path);
+        if (bind(fd, (struct sockaddr *)&address, sizeof(address)) != 0) {
+            perror("bind");
+            close(fd);
+            return -1;
+        }
+    }
+
+    if (listen(fd, SOMAXCONN) != 0) {
+        perror("listen");
+        close(fd);
+        unlink(path);
+        return -1;
+    }
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+    return fd;
+}
+
+static int add_to_epoll(int epoll_fd, int fd, void *tag) {
+    struct epoll_event event;
+    event.events = EPOLLIN;
+    event.data.ptr = tag;
+    return epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &event);
+}
+
+int run_server(const char *socket_path, int threads) {
+    Server server;
+    memset(&server, 0, sizeof(server));
+
+    server.listen_fd = open_socket(socket_path);
+    if (server.listen_fd < 0) return 1;
+    server.epoll_fd = epoll_create1(0);
+    server.wake_fd = eventfd(0, EFD_NONBLOCK);
+    if (server.epoll_fd < 0 || server.wake_fd < 0 || init_program_cache(&server.programs) != 0 ||
+        add_to_epoll(server.epoll_fd, server.listen_fd, &listen_tag) != 0 ||
+        add_to_epoll(server.epoll_fd, server.wake_fd, &wake_tag) != 0) {
+        perror("Error: Cannot start server");
+        close(server.listen_fd);
+        unlink(socket_path);
+        return 1;
+    }
+
+    if (threads <= 0) {
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        threads = cpus > 0 ? (int)cpus : 1;
+    }
+    pthread_mutex_init(&server.lock, NULL);
+    pthread_cond_init(&server.work_ready, NULL);
+    pthread_t *workers = malloc(threads * sizeof(pthread_t));
+    int started = 0;
+    if (workers != NULL) {
+        while (started < threads && pthread_create(&workers[started], NULL, server_worker, &server) == 0) {
+            started++;
+        }
+    }
+    if (started == 0) {
+        fprintf(stderr, "Error: Cannot start worker threads\n");
+        stop_requested = 1;
+    }
+
+    // Interrupt epoll_wait on SIGINT / SIGTERM instead of restarting it
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = request_stop;
+    sigemptyset(&action.sa_mask);
+    sigaction(SIGINT, &action, NULL);
+    sigaction(SIGTERM, &action, NULL);
+    signal(SIGPIPE, SIG_IGN);
+
+    printf("Serving on %s with %d worker(s)\n", socket_path, started);
+    fflush(stdout);
+
+    struct epoll_event events[MAX_EVENTS];
+    while (!stop_requested) {
+        int count = epoll_wait(server.epoll_fd, events, MAX_EVENTS, -1);
+        if (count < 0) {
+            if (errno == EINTR) continue;
+            perror("epoll_wait");
+            break;
+        }
+
+        for (int i = 0; i < count; i++) {
+            void *tag = events[i].data.ptr;
+            if (tag == &listen_tag) {
+                accept_clients(&server);
+            } else if (tag == &wake_tag) {
+                collect_results(&server);
+            } else {
+                Connection *connection = tag;
+                if (events[i].events & EPOLLIN) {
+                    read_input(connection);
+                } else if (events[i].events & (EPOLLERR | EPOLLHUP)) {
+                    connection->broken = 1;
+                }
+                mark_dirty(&server, connection);
+            }
+        }
+
+        while (server.dirty != NULL) {
+            Connection *connection = server.dirty;
+            server.dirty = connection->dirty_next;
+            connection->dirty = 0;
+            service_connection(&server, connection);
+        }
+    }
+
+    printf("Shutting down\n");
+    pthread_mutex_lock(&server.lock);
+    server.stopping = 1;
+    pthread_cond_broadcast(&server.work_ready);
+    pthread_mutex_unlock(&server.lock);
+    for (int i = 0; i < started; i++) {
+        pthread_join(workers[i], NULL);
+    }
+    free(workers);
+
+    // Workers drained the queue; their results may belong to any connection
+    while (server.done != NULL) {
+        Request *next = server.done->next;
+        free(server.done);
+        server.done = next;
+    }
+    while (server.connections != NULL) {
+        Connection *next = server.connections->next;
+        free_connection(server.connections);
+        server.connections = next;
+    }
+
+    free_program_cache(&server.programs);
+    pthread_mutex_destroy(&server.lock);
+    pthread_cond_destroy(&server.work_ready);
+    close(server.wake_fd);
+    close(server.epoll_fd);
+    close(server.listen_fd);
+    unlink(socket_path);
+    return 0;
+}
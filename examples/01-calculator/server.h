@@ -0,0 +1,21 @@
+#ifndef SERVER_H
+#define SERVER_H
+
+// Calculator service on a Unix domain socket. Clients send expressions one
+// per line and may pipeline as many as they like; each line gets one
+// response line, "%.17g" or "Error: message", in request order per
+// connection. An epoll loop does all socket I/O and a pool of worker
+// threads evaluates. Compiled programs are shared between the workers
+// through a cache that only grows, so a cached program is never freed
+// while the server runs and workers evaluate it without locking.
+
+#define SERVER_MAX_IN_FLIGHT 256        // requests per connection being evaluated
+#define SERVER_MAX_OUTPUT (1 << 20)     // unsent response bytes before reading pauses
+#define SERVER_MAX_LINE 4096
+#define SERVER_PROGRAM_CACHE 65536      // compiled programs kept
+
+// threads <= 0 uses one worker per online CPU. Runs until SIGINT or
+// SIGTERM; returns 0 then, or 1 if the socket could not be set up.
+int run_server(const char *socket_path, int threads);
+
+#endif
@@ -0,0 +1,197 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "symbols.h"
+
+// Enough digits for the exact numeric backends; both round to M_PI / M_E
+#define PI_DIGITS "3.14159265358979323846264338327950288419716939937510"
+#define E_DIGITS "2.71828182845904523536028747135266249775724709369995"
+
+// Built-ins: (first * 3 + last * 5 + length) & 15 puts every name in its
+// own slot, so a lookup is one hash and one comparison. The multipliers
+// were found by trying small values until the eleven slots were distinct:
+//
+//   for a, b in itertools.product(range(1, 64), range(64)):
+//       slots = {(ord(n[0]) * a + ord(n[-1]) * b + len(n)) & 15 for n in names}
+//       if len(slots) == len(names): break
+//
+// Adding a built-in means rerunning the search and re-placing the table.
+
+#define BUILTIN_SLOTS 16
+
+static const Builtin builtins[BUILTIN_SLOTS] = {
+    [1]  = { "sqrt", BUILTIN_FUNCTION, NODE_SQRT, NULL },
+    [2]  = { "sin", BUILTIN_FUNCTION, NODE_SIN, NULL },
+    [3]  = { "MR", BUILTIN_MEMORY, NODE_MEMORY, NULL },
+    [5]  = { "tan", BUILTIN_FUNCTION, NODE_TAN, NULL },
+    [6]  = { "pow", BUILTIN_FUNCTION, NODE_POW, NULL },
+    [9]  = { "e", BUILTIN_CONSTANT, NODE_NUMBER, E_DIGITS },
+    [10] = { "log", BUILTIN_FUNCTION, NODE_LOG, NULL },
+    [11] = { "cos", BUILTIN_FUNCTION, NODE_COS, NULL },
+    [12] = { "ln", BUILTIN_FUNCTION, NODE_LN, NULL },
+    [14] = { "diff", BUILTIN_DERIVATIVE, NODE_NUMBER, NULL },
+    [15] = { "pi", BUILTIN_CONSTANT, NODE_NUMBER, PI_DIGITS }
+};
+
+static int name_equals(const char *stored, const char *name, int length) {
+    return strncmp(stored, name, length) == 0 && stored[length] == '\0';
+}
+
+const Builtin* find_builtin(const char *name, int length) {
+    if (length <= 0) return NULL;
+    unsigned int slot = ((unsigned char)name[0] * 3u + (unsigned char)name[length - 1] * 5u +
+                         (unsigned int)length) & (BUILTIN_SLOTS - 1);
+    const Builtin *builtin = &builtins[slot];
+    return builtin->name != NULL && name_equals(builtin->name, name, length) ? builtin : NULL;
+}
+
+// User symbols
+
+static unsigned int hash_name(const char *name, int length) {
+    unsigned int hash = 2166136261u;
+    for (int i = 0; i < length; i++) {
+        hash = (hash ^ (unsigned char)name[i]) * 16777619u;
+    }
+    return hash;
+}
+
+// The slot holding name, or the empty slot where it would go
+static Symbol* find_slot(const SymbolTable *table, const char *name, int length, unsigned int hash) {
+    size_t index = hash & table->mask;
+    while (table->slots[index].name != NULL) {
+        Symbol *symbol = &table->slots[index];
+        if (symbol->hash == hash && name_equals(symbol->name, name, length)) {
+            return symbol;
+        }
+        index = (index + 1) & table->mask;
+    }
+    return &table->slots[index];
+}
+
+SymbolTable* create_symbol_table() {
+    SymbolTable *table = malloc(sizeof(SymbolTable));
+    if (table == NULL) {
+        printf("Memory allocation failed!\n");
+        return NULL;
+    }
+    table->slots = calloc(SYMBOL_MIN_CAPACITY, sizeof(Symbol));
+    if (table->slots == NULL) {
+        printf("Memory allocation failed!\n");
+        free(table);
+        return NULL;
+    }
+    table->mask = SYMBOL_MIN_CAPACITY - 1;
+    table->count = 0;
+    return table;
+}
+
+const Symbol* find_symbol(const SymbolTable *table, const char *name, int length) {
+    if (table == NULL) return NULL;
+    const Symbol *symbol = find_slot(table, name, length, hash_name(name, length));
+    return symbol->name != NULL ? symbol : NULL;
+}
+
+static void clear_definition(Symbol *symbol) {
+    free_node(symbol->body);
+    for (int i = 0; i < symbol->parameter_count; i++) {
+        free(symbol->parameters[i]);
+    }
+    free(symbol->parameters);
+    symbol->body = NULL;
+    symbol->parameters = NULL;
+    symbol->parameter_count = 0;
+    symbol->reads_memory = 0;
+}
+
+static int grow(SymbolTable *table) {
+    size_t capacity = (table->mask + 1) * 2;
+    Symbol *slots = calloc(capacity, sizeof(Symbol));
+    if (slots == NULL) return -1;
+
+    Symbol *old = table->slots;
+    size_t old_capacity = table->mask + 1;
+    table->slots = slots;
+    table->mask = capacity - 1;
+    for (size_t i = 0; i < old_capacity; i++) {
+        if (old[i].name == NULL) continue;
+        size_t index = old[i].hash & table->mask;
+        while (slots[index].name != NULL) index = (index + 1) & table->mask;
+        slots[index] = old[i];
+    }
+    free(old);
+    return 0;
+}
+
+// Returns the symbol named name with any old definition released, adding
+// it if needed; NULL if out of memory
+static Symbol* claim_symbol(SymbolTable *table, const char *name) {
+    int length = (int)strlen(name);
+    unsigned int hash = hash_name(name, length);
+    Symbol *symbol = find_slot(table, name, length, hash);
+    if (symbol->name != NULL) {
+        clear_definition(symbol);
+        return symbol;
+    }
+
+    if ((table->count + 1) * 4 > (table->mask + 1) * 3) {
+        if (grow(table) != 0) return NULL;
+        symbol = find_slot(table, name, length, hash);
+    }
+    char *copy = malloc(length + 1);
+    if (copy == NULL) return NULL;
+    memcpy(copy, name, length + 1);
+
+    memset(symbol, 0, sizeof(Symbol));
+    symbol->name = copy;
+    symbol->hash = hash;
+    table->count++;
+    return symbol;
+}
+
+int set_variable(SymbolTable *table, const char *name, double value) {
+    Symbol *symbol = claim_symbol(table, name);
+    if (symbol == NULL) {
+        printf("Memory allocation failed!\n");
+        return -1;
+    }
+    symbol->kind = SYMBOL_VARIABLE;
+    symbol->value = value;
+    return 0;
+}
+
+static int node_reads_memory(const Node *node) {
+    if (node == NULL) return 0;
+    return node->type == NODE_MEMORY || node_reads_memory(node->left) || node_reads_memory(node->right);
+}
+
+int set_function(SymbolTable *table, const char *name, char **parameters,
+                 int parameter_count, Node *body) {
+    Symbol *symbol = claim_symbol(table, name);
+    if (symbol == NULL) {
+        printf("Memory allocation failed!\n");
+        for (int i = 0; i < parameter_count; i++) {
+            free(parameters[i]);
+        }
+        free(parameters);
+        free_node(body);
+        return -1;
+    }
+    symbol->kind = SYMBOL_FUNCTION;
+    symbol->value = 0.0;
+    symbol->body = body;
+    symbol->parameters = parameters;
+    symbol->parameter_count = parameter_count;
+    symbol->reads_memory = node_reads_memory(body);
+    return 0;
+}
+
+void free_symbol_table(SymbolTable *table) {
+    if (table == NULL) return;
+    for (size_t i = 0; i <= table->mask; i++) {
+        if (table->slots[i].name == NULL) continue;
+        clear_definition(&table->slots[i]);
+        free(table->slots[i].name);
+    }
+    free(table->slots);
+    free(table);
+}
@@ -0,0 +1,62 @@
+#ifndef SYMBOLS_H
+#define SYMBOLS_H
+
+#include <stddef.h>
+#include "expression_parser.h"
+
+// Names the parser resolves. Built-ins (functions, diff, MR, pi, e) are
+// found with a perfect hash generated offline; user variables (let) and
+// functions (def) live in an open-addressing hash table. Either lookup
+// costs one hash and one comparison, however many names are defined.
+
+typedef enum {
+    BUILTIN_FUNCTION,       // sin(x) ... pow(x, y)
+    BUILTIN_MEMORY,         // MR
+    BUILTIN_CONSTANT,       // pi, e
+    BUILTIN_DERIVATIVE      // diff(EXPR, NAME)
+} BuiltinKind;
+
+typedef struct {
+    const char *name;
+    BuiltinKind kind;
+    NodeType type;          // BUILTIN_FUNCTION: node type of a call
+    const char *digits;     // BUILTIN_CONSTANT: literal text of the value
+} Builtin;
+
+typedef enum {
+    SYMBOL_VARIABLE,
+    SYMBOL_FUNCTION
+} SymbolKind;
+
+#define MAX_PARAMETERS 16
+#define SYMBOL_MIN_CAPACITY 16
+
+typedef struct {
+    char *name;             // NULL: empty slot
+    unsigned int hash;
+    SymbolKind kind;
+    double value;           // SYMBOL_VARIABLE
+    Node *body;             // SYMBOL_FUNCTION: parameters appear as variables
+    char **parameters;
+    int parameter_count;
+    int reads_memory;       // SYMBOL_FUNCTION: body reads MR
+} Symbol;
+
+typedef struct SymbolTable {
+    Symbol *slots;          // linear probing, at most 3/4 full
+    size_t mask;            // capacity - 1; capacity is a power of two
+    size_t count;
+} SymbolTable;
+
+const Builtin* find_builtin(const char *name, int length);
+
+SymbolTable* create_symbol_table();
+const Symbol* find_symbol(const SymbolTable *table, const char *name, int length);
+// Both replace any existing symbol of the same name; 0 on success, -1 if
+// out of memory. set_function takes ownership of parameters and body.
+int set_variable(SymbolTable *table, const char *name, double value);
+int set_function(SymbolTable *table, const char *name, char **parameters,
+                 int parameter_count, Node *body);
+void free_symbol_table(SymbolTable *table);
+
+#endif
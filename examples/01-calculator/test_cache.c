@@ -0,0 +1,141 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "expression_parser.h"
+#include "result_cache.h"
+#include "symbols.h"
+
+// Checks that calculate() with a result cache returns exactly what it
+// returns without one, including when memory changes between calls.
+
+static int failures = 0;
+
+static void check(int condition, const char *description) {
+    if (!condition) {
+        printf("FAIL: %s\n", description);
+        failures++;
+    }
+}
+
+// Evaluates text with and without the cache and compares the outcomes
+static void compare(CalcContext *cached, const char *text) {
+    CalcContext plain;
+    init_context(&plain);
+    plain.memory = cached->memory;
+
+    double expected = 0, actual = 0;
+    int expected_status = calculate(&plain, text, &expected);
+    int actual_status = calculate(cached, text, &actual);
+    if (expected_status != actual_status ||
+        (expected_status == 0 && memcmp(&expected, &actual, sizeof(double)) != 0)) {
+        printf("FAIL: '%s' with MR=%g: cached %.17g, expected %.17g\n",
+               text, cached->memory, actual, expected);
+        failures++;
+    }
+}
+
+static void test_normalization() {
+    char a[CACHE_MAX_KEY], b[CACHE_MAX_KEY];
+    int memory_a, memory_b;
+
+    normalize_expression(" sqrt( 16 ) +  2 ", a, sizeof(a), &memory_a);
+    normalize_expression("sqrt(16)+2", b, sizeof(b), &memory_b);
+    check(strcmp(a, b) == 0, "whitespace between tokens is ignored");
+    check(!memory_a, "expression without MR does not depend on memory");
+
+    normalize_expression("1 2", a, sizeof(a), &memory_a);
+    normalize_expression("12", b, sizeof(b), &memory_b);
+    check(strcmp(a, b) != 0, "whitespace inside a token sequence is kept");
+
+    normalize_expression("MR * 2", a, sizeof(a), &memory_a);
+    check(memory_a, "MR makes the key depend on memory");
+}
+
+static void test_hits_and_memory() {
+    CalcContext context;
+    init_context(&context);
+    context.cache = create_result_cache(CACHE_DEFAULT_BUDGET);
+
+    compare(&context, "2 + 3 * 4");
+    compare(&context, "2+3*4");
+    check(context.cache->stats.hits == 1, "normalized repeat is a hit");
+
+    for (int i = 0; i < 5; i++) {
+        context.memory = i;
+        compare(&context, "MR * 2 + sin(MR)");
+        compare(&context, "MR * 2 + sin(MR)");
+    }
+    context.memory = 1;
+    compare(&context, "MR * 2 + sin(MR)");
+    context.memory = -0.0;
+    compare(&context, "1 / MR");
+    context.memory = 0.0;
+    compare(&context, "1 / MR");
+    compare(&context, "1 / 0");
+    compare(&context, "1 / 0");
+    compare(&context, "unknown + 1");
+    check(context.cache->stats.hits == 7, "memory-dependent results are keyed by memory");
+
+    free_result_cache(context.cache);
+}
+
+// User functions are inlined, so MR in a body never shows in the text
+static void test_functions_reading_memory() {
+    CalcContext context;
+    double result;
+    init_context(&context);
+    context.symbols = create_symbol_table();
+    context.cache = create_result_cache(CACHE_DEFAULT_BUDGET);
+
+    define_symbol(&context, "def recall() = MR + 1", &result);
+    define_symbol(&context, "def twice(a) = 2 * a", &result);
+    context.memory = 0;
+    check(calculate(&context, "twice(recall())", &result) == 0 && result == 2, "body reading memory evaluated");
+    context.memory = 5;
+    check(calculate(&context, "twice(recall())", &result) == 0 && result == 12, "body reading memory keyed by memory");
+    check(calculate(&context, "twice(recall())", &result) == 0 && result == 12, "repeat with the same memory");
+    check(context.cache->stats.hits == 1, "repeat with the same memory is a hit");
+
+    free_result_cache(context.cache);
+    free_symbol_table(context.symbols);
+}
+
+static void test_eviction() {
+    CalcContext context;
+    char text[64];
+    init_context(&context);
+    context.cache = create_result_cache(CACHE_MIN_BUDGET);
+
+    for (int i = 0; i < 1000; i++) {
+        snprintf(text, sizeof(text), "%d * 3", i);
+        compare(&context, text);
+    }
+    check(context.cache->bytes <= context.cache->budget, "cache stays within its budget");
+    check(context.cache->stats.evictions > 0, "old entries are evicted");
+
+    // The most recent entry survives; the first one is long gone
+    unsigned long long hits = context.cache->stats.hits;
+    compare(&context, "999 * 3");
+    check(context.cache->stats.hits == hits + 1, "newest entry is kept");
+    compare(&context, "0 * 3");
+    check(context.cache->stats.hits == hits + 1, "least recently used entry is evicted");
+
+    free_result_cache(context.cache);
+}
+
+int main() {
+    printf("Testing result cache\n");
+    printf("====================\n");
+
+    test_normalization();
+    test_hits_and_memory();
+    test_functions_reading_memory();
+    test_eviction();
+
+    if (failures > 0) {
+        printf("\n%d test(s) failed\n", failures);
+        return 1;
+    }
+    printf("\nAll tests completed successfully!\n");
+    return 0;
+}
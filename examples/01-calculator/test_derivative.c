@@ -0,0 +1,177 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "expression_parser.h"
+#include "derivative.h"
+#include "symbols.h"
+
+static int failures;
+
+static void check(int condition, const char *description) {
+    if (!condition) {
+        printf("FAIL: %s\n", description);
+        failures++;
+    }
+}
+
+static Node* parse(const char *text) {
+    Parser parser;
+    init_parser(&parser, text);
+    return parse_formula(&parser);
+}
+
+// diff() output is simplified while it is built
+static void test_symbolic() {
+    static const char *cases[][2] = {
+        { "diff(x * x, x)", "2 * x" },
+        { "diff(3 * x, x)", "3" },
+        { "diff(pow(x, 3), x)", "3 * pow(x, 2)" },
+        { "diff(sin(x), x)", "cos(x)" },
+        { "diff(cos(x), x)", "-sin(x)" },
+        { "diff(y * 2, x)", "0" },
+        { "diff(ln(x), x)", "1 / x" },
+        { "diff(x - 2 * x, x)", "-1" },
+        { "diff(x * sin(x) / y, x)", "(sin(x) + x * cos(x)) / y" },
+        { "diff(pow(x, y), y)", "pow(x, y) * ln(x)" },
+        { "diff(diff(pow(x, 4), x), x)", "12 * pow(x, 2)" },
+    };
+    for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
+        Node *root = parse(cases[i][0]);
+        char *text = root ? format_node(root) : NULL;
+        if (text == NULL || strcmp(text, cases[i][1]) != 0) {
+            printf("FAIL: %s gave '%s', expected '%s'\n", cases[i][0], text ? text : "(error)", cases[i][1]);
+            failures++;
+        }
+        free(text);
+        free_node(root);
+    }
+}
+
+// Printed trees read back as the same tree
+static void test_format() {
+    static const char *texts[] = {
+        "a - (b - c)", "a / (b * c)", "-(a + b) * c", "pow(a, -b) / -c", "0.1 + 1e300 * 3",
+        "sqrt(MR) - -2", "a - b - c"
+    };
+    for (size_t i = 0; i < sizeof(texts) / sizeof(texts[0]); i++) {
+        Node *root = parse(texts[i]);
+        char *text = root ? format_node(root) : NULL;
+        Node *again = text ? parse(text) : NULL;
+        char *second = again ? format_node(again) : NULL;
+        check(second != NULL && strcmp(text, second) == 0, texts[i]);
+        free(text);
+        free(second);
+        free_node(root);
+        free_node(again);
+    }
+}
+
+// Forward mode agrees with the compiled symbolic derivatives
+static void test_gradient() {
+    static const char *formulas[] = {
+        "x * sin(y) + pow(x, 2) / sqrt(y)",
+        "pow(1 - x, 2) + 100 * pow(y - x * x, 2)",
+        "ln(x * y) + tan(x / y) - log(y) * cos(x)",
+        "pow(x, y) + pow(2, x) + pow(y, 3)",
+        "(x + y) * (x + y) / (x - y)",
+    };
+    static const char *names[] = { "x", "y" };
+
+    for (size_t f = 0; f < sizeof(formulas) / sizeof(formulas[0]); f++) {
+        Program *program = compile_expression(formulas[f], NULL);
+        if (program == NULL) {
+            printf("FAIL: cannot compile '%s'\n", formulas[f]);
+            failures++;
+            continue;
+        }
+        double variables[2];
+        variables[program_variable_index(program, "x")] = 1.3;
+        variables[program_variable_index(program, "y")] = 0.7;
+        EvalEnv env = { 0.0, variables, EVAL_OK };
+
+        double gradient[2];
+        double value = evaluate_gradient(program, &env, gradient);
+        check(env.error == EVAL_OK, formulas[f]);
+        check(value == evaluate_program(program, &env), "gradient pass gives the program's value");
+
+        for (int v = 0; v < 2; v++) {
+            char text[256];
+            snprintf(text, sizeof(text), "diff(%s, %s)", formulas[f], names[v]);
+            Program *derivative = compile_expression(text, NULL);
+            if (derivative == NULL) {
+                printf("FAIL: cannot compile '%s'\n", text);
+                failures++;
+                continue;
+            }
+            double values[2] = { 0, 0 };
+            for (int i = 0; i < derivative->variable_count; i++) {
+                values[i] = strcmp(derivative->variable_names[i], "x") == 0 ? 1.3 : 0.7;
+            }
+            EvalEnv derivative_env = { 0.0, values, EVAL_OK };
+            double expected = evaluate_program(derivative, &derivative_env);
+            double actual = gradient[program_variable_index(program, names[v])];
+            if (fabs(actual - expected) > 1e-12 * fmax(1.0, fabs(expected))) {
+                printf("FAIL: %s gave %.17g by forward mode, %.17g symbolically\n", text, actual, expected);
+                failures++;
+            }
+            free_program(derivative);
+        }
+        free_program(program);
+    }
+
+    // Division by zero is reported as by evaluate_program
+    Program *program = compile_expression("1 / (x - x)", NULL);
+    if (program != NULL) {
+        double x = 2, gradient[1];
+        EvalEnv env = { 0.0, &x, EVAL_OK };
+        evaluate_gradient(program, &env, gradient);
+        check(env.error == EVAL_DIVISION_BY_ZERO, "division by zero in forward mode");
+        free_program(program);
+    }
+}
+
+static void test_calculate() {
+    CalcContext context;
+    init_context(&context);
+    context.symbols = create_symbol_table();
+    double result, value;
+
+    define_symbol(&context, "let x = 3", &value);
+    check(calculate(&context, "diff(x * x * x, x)", &result) == 0 && result == 27, "diff with a let variable");
+    define_symbol(&context, "def f(t) = t * t + x", &value);
+    check(calculate(&context, "diff(f(y), y) + 1", &result) != 0, "free variable after diff");
+    define_symbol(&context, "let y = 4", &value);
+    check(calculate(&context, "diff(f(y), y) + 1", &result) == 0 && result == 9, "diff of a user function");
+
+    check(calculate(&context, "diff(x, 2)", &result) != 0, "number as variable rejected");
+    check(calculate(&context, "diff(x, pi)", &result) != 0, "constant as variable rejected");
+    check(calculate(&context, "diff(x x)", &result) != 0, "missing comma rejected");
+    check(calculate(&context, "diff", &result) != 0, "diff without arguments rejected");
+
+    // Repeated derivatives of a long product grow polynomially; refused, not built
+    char text[1024] = "";
+    for (int i = 0; i < 20; i++) strcat(text, "diff(");
+    for (int i = 0; i < 60; i++) strcat(text, i ? " * x" : "x");
+    for (int i = 0; i < 20; i++) strcat(text, ", x)");
+    check(calculate(&context, text, &result) != 0 && strstr(context.error, "too large") != NULL,
+          "runaway derivative refused");
+    free_symbol_table(context.symbols);
+}
+
+int main() {
+    printf("Testing derivatives\n");
+    printf("===================\n");
+
+    test_symbolic();
+    test_format();
+    test_gradient();
+    test_calculate();
+
+    if (failures > 0) {
+        printf("\n%d test(s) failed\n", failures);
+        return 1;
+    }
+    printf("\nAll tests completed successfully!\n");
+    return 0;
+}
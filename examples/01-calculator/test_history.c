@@ -0,0 +1,184 @@
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "history.h"
+#include "history_log.h"
+
+// Checks the ring buffer against a plain array of everything ever added:
+// the kept entries must be exactly the newest ones, and the prefix chains
+// must link every kept entry once, newest first.
+
+#define OPERATIONS 200000
+#define MAX_GENERATED 600
+
+static char **added;
+static int added_count;
+
+static void generate(char *buffer, int sequence) {
+    // Mostly short expressions, sometimes long ones that force arena eviction
+    int padding = rand() % 8 == 0 ? rand() % 250 : rand() % 8;
+    int length = snprintf(buffer, MAX_GENERATED, "%s(%d)", rand() % 2 ? "sqrt" : "sin", sequence);
+    for (int i = 0; i < padding; i++) {
+        buffer[length++] = '+';
+        buffer[length++] = '0';
+    }
+    buffer[length] = '\0';
+}
+
+static int check_contents(const HistoryManager *manager) {
+    if (manager->count > manager->capacity || (int)manager->count > added_count) {
+        printf("FAIL: count %zu out of range\n", manager->count);
+        return 0;
+    }
+    for (size_t age = 0; age < manager->count; age++) {
+        const HistoryEntry *entry = history_entry(manager, age);
+        const char *expected = added[added_count - 1 - age];
+        if (strcmp(history_expression(manager, entry), expected) != 0) {
+            printf("FAIL: entry %zu is '%s', expected '%s'\n", age,
+                   history_expression(manager, entry), expected);
+            return 0;
+        }
+    }
+    return 1;
+}
+
+static int check_chains(const HistoryManager *manager) {
+    size_t linked = 0;
+    for (size_t bucket = 0; bucket <= manager->bucket_mask; bucket++) {
+        unsigned int previous = HISTORY_NONE;
+        for (unsigned int index = manager->buckets[bucket]; index != HISTORY_NONE;
+             index = manager->entries[index].older) {
+            if (manager->entries[index].newer != previous || ++linked > manager->count) {
+                printf("FAIL: broken prefix chain in bucket %zu\n", bucket);
+                return 0;
+            }
+            previous = index;
+        }
+    }
+    if (linked != manager->count) {
+        printf("FAIL: %zu entries linked, %zu kept\n", linked, manager->count);
+        return 0;
+    }
+    return 1;
+}
+
+static int run_capacity(size_t capacity) {
+    HistoryManager *manager = create_history_manager(capacity);
+    if (manager == NULL) return 0;
+
+    char buffer[MAX_GENERATED];
+    int ok = 1;
+    added_count = 0;
+    for (int i = 0; i < OPERATIONS && ok; i++) {
+        generate(buffer, i);
+        added[added_count++] = strdup(buffer);
+        add_to_history(manager, buffer, i);
+
+        // Full checks are O(capacity); do them every so often
+        if (i % 997 == 0 || i == OPERATIONS - 1) {
+            ok = check_contents(manager) && check_chains(manager);
+        }
+    }
+    if (ok && manager->count != capacity) {
+        printf("FAIL: history holds %zu of %zu entries\n", manager->count, capacity);
+        ok = 0;
+    }
+
+    printf("Capacity %-7zu kept %-7zu %s\n", capacity, manager->count, ok ? "ok" : "FAILED");
+    for (int i = 0; i < added_count; i++) {
+        free(added[i]);
+    }
+    free_history_manager(manager);
+    return ok;
+}
+
+// Calculations as typed, longer than HISTORY_BYTES_PER_ENTRY on average:
+// the history must still keep exactly the last capacity of them
+static int run_realistic(size_t capacity) {
+    HistoryManager *manager = create_history_manager(capacity);
+    if (manager == NULL) return 0;
+    char buffer[128];
+    for (size_t i = 0; i < capacity * 3; i++) {
+        snprintf(buffer, sizeof(buffer), "sqrt(%zu) * pow(1.05, %zu) + sin(%zu / 7)", i, i % 30, i);
+        add_to_history(manager, buffer, (double)i);
+    }
+    snprintf(buffer, sizeof(buffer), "sqrt(%zu) * pow(1.05, %zu) + sin(%zu / 7)",
+             capacity * 3 - 1, (capacity * 3 - 1) % 30, capacity * 3 - 1);
+    const HistoryEntry *newest = history_entry(manager, 0);
+    const HistoryEntry *oldest = history_entry(manager, capacity - 1);
+    int ok = manager->count == capacity && strcmp(history_expression(manager, newest), buffer) == 0 &&
+             oldest->result == (double)(capacity * 2) && check_chains(manager);
+    printf("Realistic %-7zu kept %-7zu %s\n", capacity, manager->count, ok ? "ok" : "FAILED");
+    free_history_manager(manager);
+    return ok;
+}
+
+// Two sessions append to one log in turn; reloading must link every record
+// to its own expression
+static int run_shared_log() {
+    char path[] = "/tmp/test_history_XXXXXX";
+    int fd = mkstemp(path);
+    if (fd < 0) return 0;
+    close(fd);
+    unlink(path);
+    char strings[sizeof(path) + sizeof(HISTORY_LOG_STRINGS_SUFFIX)];
+    snprintf(strings, sizeof(strings), "%s%s", path, HISTORY_LOG_STRINGS_SUFFIX);
+
+    const char *expressions[] = { "1+1", "sqrt(16)", "2*3", "sin(0)+40" };
+    HistoryLog *first = open_history_log(path);
+    HistoryLog *second = open_history_log(path);
+    int ok = first != NULL && second != NULL;
+    for (int i = 0; i < 4 && ok; i++) {
+        ok = history_log_append(i % 2 ? second : first, expressions[i], i) == 0;
+    }
+    close_history_log(first);
+    close_history_log(second);
+
+    HistoryLog *reopened = ok ? open_history_log(path) : NULL;
+    HistoryManager *manager = create_history_manager(10);
+    ok = reopened != NULL && manager != NULL && history_log_load(reopened, manager) == 0 && manager->count == 4;
+    for (size_t age = 0; ok && age < 4; age++) {
+        const HistoryEntry *entry = history_entry(manager, age);
+        ok = strcmp(history_expression(manager, entry), expressions[3 - age]) == 0 &&
+             entry->result == (double)(3 - age);
+    }
+    printf("Shared log: %s\n", ok ? "ok" : "FAILED");
+    close_history_log(reopened);
+    free_history_manager(manager);
+    unlink(path);
+    unlink(strings);
+    return ok;
+}
+
+int main() {
+    printf("Testing ring-buffer history\n");
+    printf("===========================\n");
+
+    added = malloc(OPERATIONS * sizeof(char *));
+    if (added == NULL) {
+        printf("Memory allocation failed!\n");
+        return 1;
+    }
+
+    srand(12345);
+    size_t capacities[] = { 1, 6, 64, 1000, 100000 };
+    int failures = 0;
+    for (size_t i = 0; i < sizeof(capacities) / sizeof(capacities[0]); i++) {
+        if (!run_capacity(capacities[i])) failures++;
+    }
+    free(added);
+    size_t realistic[] = { 1000, 100000 };
+    for (size_t i = 0; i < sizeof(realistic) / sizeof(realistic[0]); i++) {
+        if (!run_realistic(realistic[i])) failures++;
+    }
+    if (!run_shared_log()) failures++;
+
+    if (failures > 0) {
+        printf("\n%d test(s) failed\n", failures);
+        return 1;
+    }
+    printf("\nAll tests completed successfully!\n");
+    return 0;
+}
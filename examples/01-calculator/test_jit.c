@@ -0,0 +1,211 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "expression_parser.h"
+#include "jit.h"
+#include "symbols.h"
+
+// Compares the JIT with the bytecode interpreter bit for bit on a corpus of
+// randomly generated expressions and environments.
+
+#define CORPUS_SIZE 5000
+#define ENVIRONMENTS 20
+#define MAX_GENERATED 4096
+
+static const char *functions[] = { "sin", "cos", "tan", "log", "ln", "sqrt" };
+static const char *operators = "+-*/";
+
+static int random_int(int limit) {
+    return rand() % limit;
+}
+
+static double random_value() {
+    switch (random_int(4)) {
+        case 0:  return 0.0;
+        case 1:  return random_int(10);
+        case 2:  return (rand() / (double)RAND_MAX) * 200.0 - 100.0;
+        default: return (rand() / (double)RAND_MAX) * 1e-3;
+    }
+}
+
+// Appends a random expression of at most the given depth to buffer
+static void generate(char *buffer, size_t size, int depth) {
+    size_t used = strlen(buffer);
+    char *out = buffer + used;
+    size_t left = size - used;
+    if (left < 64) return;
+
+    int choice = depth <= 0 ? random_int(4) : random_int(10);
+    switch (choice) {
+        case 0: snprintf(out, left, "%d", random_int(10)); return;
+        case 1: snprintf(out, left, "%.4f", random_value()); return;
+        case 2: snprintf(out, left, "%s", random_int(2) ? "x" : "y"); return;
+        case 3: snprintf(out, left, "%s", random_int(2) ? "MR" : "pi"); return;
+        case 4:
+        case 5:
+        case 6:
+            strcat(out, "(");
+            generate(buffer, size, depth - 1);
+            snprintf(buffer + strlen(buffer), size - strlen(buffer), " %c ", operators[random_int(4)]);
+            generate(buffer, size, depth - 1);
+            strcat(buffer, ")");
+            return;
+        case 7:
+            snprintf(out, left, "%s(", functions[random_int(6)]);
+            generate(buffer, size, depth - 1);
+            strcat(buffer, ")");
+            return;
+        case 8:
+            strcat(out, "pow(");
+            generate(buffer, size, depth - 1);
+            strcat(buffer, ", ");
+            generate(buffer, size, depth - 1);
+            strcat(buffer, ")");
+            return;
+        default:
+            strcat(out, "-(");
+            generate(buffer, size, depth - 1);
+            strcat(buffer, ")");
+            return;
+    }
+}
+
+static int check_expression(const char *text, int *compared) {
+    Program *program = compile_expression(text, NULL);
+    if (program == NULL) {
+        printf("FAIL: cannot compile '%s'\n", text);
+        return 0;
+    }
+
+    JitCode *jit = jit_compile(program);
+    if (jit == NULL) {
+        printf("FAIL: JIT rejected '%s'\n", text);
+        free_program(program);
+        return 0;
+    }
+
+    int ok = 1;
+    for (int e = 0; e < ENVIRONMENTS && ok; e++) {
+        double variables[2];
+        for (int v = 0; v < program->variable_count; v++) {
+            variables[v] = random_value();
+        }
+
+        EvalEnv interpreted = { random_value(), variables, EVAL_OK };
+        EvalEnv native = interpreted;
+        double expected = evaluate_program(program, &interpreted);
+        double actual = evaluate_jit(jit, program, &native);
+
+        if (interpreted.error != native.error ||
+            memcmp(&expected, &actual, sizeof(double)) != 0) {
+            printf("FAIL: '%s' with MR=%.17g: interpreter %.17g (error %d), JIT %.17g (error %d)\n",
+                   text, interpreted.memory, expected, interpreted.error, actual, native.error);
+            ok = 0;
+        }
+        (*compared)++;
+    }
+
+    free_jit(jit);
+    free_program(program);
+    return ok;
+}
+
+static int check_tiering() {
+    Program *program = compile_expression("sin(MR) * 2 + MR / 3", NULL);
+    TieredProgram tiered;
+    init_tiered(&tiered, program, 10);
+
+    int ok = 1;
+    for (int i = 0; i < 50; i++) {
+        EvalEnv tiered_env = { i * 0.5, NULL, EVAL_OK };
+        EvalEnv plain_env = tiered_env;
+        double actual = evaluate_tiered(&tiered, &tiered_env);
+        double expected = evaluate_program(program, &plain_env);
+        if (memcmp(&expected, &actual, sizeof(double)) != 0) ok = 0;
+    }
+    if (tiered.jit == NULL) ok = 0;
+
+    free_tiered(&tiered);
+    free_program(program);
+    return ok;
+}
+
+// calculate() with a program table reaches native code for a repeated
+// expression and still agrees with a context without one
+static int check_program_table() {
+    CalcContext tiered_context, plain_context;
+    init_context(&tiered_context);
+    init_context(&plain_context);
+    tiered_context.programs = create_tiered_table();
+    tiered_context.symbols = create_symbol_table();
+    plain_context.symbols = create_symbol_table();
+    const char *definition = "def f(a) = a * MR + 1";
+    double value;
+    define_symbol(&tiered_context, definition, &value);
+    define_symbol(&plain_context, definition, &value);
+
+    int ok = 1;
+    for (int i = 0; i < 2 * JIT_DEFAULT_THRESHOLD; i++) {
+        tiered_context.memory = plain_context.memory = i * 0.25;
+        double actual = 0, expected = 0;
+        int actual_status = calculate(&tiered_context, "f(3) / (MR - 5)", &actual);
+        int expected_status = calculate(&plain_context, "f(3)/(MR-5)", &expected);
+        if (actual_status != expected_status || memcmp(&expected, &actual, sizeof(double)) != 0) ok = 0;
+    }
+    TieredProgram *tiered = find_tiered(tiered_context.programs, "f(3)/(MR-5)", 11);
+    if (tiered == NULL || tiered->jit == NULL) ok = 0;
+
+    // Redefining f drops programs that inlined the old body
+    define_symbol(&tiered_context, "def f(a) = a", &value);
+    if (find_tiered(tiered_context.programs, "f(3)/(MR-5)", 11) != NULL) ok = 0;
+    if (calculate(&tiered_context, "f(3)", &value) != 0 || value != 3) ok = 0;
+
+    free_tiered_table(tiered_context.programs);
+    free_symbol_table(tiered_context.symbols);
+    free_symbol_table(plain_context.symbols);
+    return ok;
+}
+
+int main() {
+    printf("Testing JIT against the interpreter\n");
+    printf("===================================\n");
+
+    if (!jit_available()) {
+        printf("JIT not available on this platform, nothing to compare\n");
+        return 0;
+    }
+
+    srand(12345);
+    int failures = 0;
+    int compared = 0;
+    char text[MAX_GENERATED];
+
+    for (int i = 0; i < CORPUS_SIZE; i++) {
+        text[0] = '\0';
+        generate(text, sizeof(text), 1 + random_int(6));
+        if (!check_expression(text, &compared)) failures++;
+    }
+    printf("Fuzzed corpus: %d expressions, %d evaluations, %d failures\n",
+           CORPUS_SIZE, compared, failures);
+
+    if (!check_tiering()) {
+        printf("FAIL: tiered evaluation did not switch to the JIT correctly\n");
+        failures++;
+    } else {
+        printf("Tiered evaluation: switched to JIT after threshold\n");
+    }
+
+    if (!check_program_table()) {
+        printf("FAIL: calculate() with a program table disagreed or never reached the JIT\n");
+        failures++;
+    } else {
+        printf("Program table: repeated expression reached the JIT\n");
+    }
+
+    if (failures > 0) {
+        printf("\n%d test(s) failed\n", failures);
+        return 1;
+    }
+    printf("\nAll tests completed successfully!\n");
+    return 0;
+}
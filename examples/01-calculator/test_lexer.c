@@ -0,0 +1,209 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "lexer.h"
+
+// Checks scan_number against strtod bit for bit: shortest and long
+// round-trip strings of random doubles, random digit strings with extreme
+// exponents, subnormals, exact halfway cases and hex literals. Then checks
+// that the lexer splits expressions into the expected tokens.
+
+#define RANDOM_DOUBLES 100000
+#define RANDOM_STRINGS 1000000
+#define HALFWAY_CASES 50000
+
+static long checked;
+
+static unsigned long long random_bits() {
+    unsigned long long bits = 0;
+    for (int i = 0; i < 4; i++) bits = bits << 16 | (rand() & 0xffff);
+    return bits;
+}
+
+static int compare(const char *text) {
+    char *expected_end;
+    double expected = strtod(text, &expected_end);
+    double value = -1.0;
+    const char *end = scan_number(text, &value);
+    checked++;
+
+    if (end != expected_end || (end != text && memcmp(&value, &expected, sizeof(double)) != 0)) {
+        printf("FAIL: '%s': got %.17g (%d chars), strtod %.17g (%d chars)\n", text, value,
+               (int)(end - text), expected, (int)(expected_end - text));
+        return 0;
+    }
+    return 1;
+}
+
+static int test_random_doubles() {
+    char text[64];
+    for (int i = 0; i < RANDOM_DOUBLES; i++) {
+        unsigned long long bits = random_bits() & ~(1ULL << 63);
+        double value;
+        memcpy(&value, &bits, sizeof(double));
+        if (!isfinite(value)) continue;
+
+        // Every precision from a rough 1 digit to exact round-trip 17
+        for (int precision = 1; precision <= 17; precision++) {
+            snprintf(text, sizeof(text), "%.*g", precision, value);
+            if (!compare(text)) return 0;
+        }
+        snprintf(text, sizeof(text), "%.25e", value);
+        if (!compare(text)) return 0;
+    }
+    return 1;
+}
+
+static int test_subnormals() {
+    char text[64];
+    for (int i = 0; i < RANDOM_DOUBLES; i++) {
+        unsigned long long bits = random_bits() >> (12 + rand() % 52);
+        double value;
+        memcpy(&value, &bits, sizeof(double));
+        snprintf(text, sizeof(text), "%.*g", 1 + rand() % 17, value);
+        if (!compare(text)) return 0;
+    }
+    return 1;
+}
+
+// Digit strings of 1 to 40 digits with the point anywhere and exponents
+// well past both ends of the double range
+static int test_random_strings() {
+    char text[128];
+    for (int i = 0; i < RANDOM_STRINGS; i++) {
+        int digits = 1 + rand() % 40;
+        int point = rand() % (digits + 2) - 1;
+        int length = 0;
+        for (int d = 0; d < digits; d++) {
+            if (d == point) text[length++] = '.';
+            text[length++] = '0' + (rand() % 4 == 0 ? 0 : rand() % 10);
+        }
+        if (point == digits) text[length++] = '.';
+        if (rand() % 3 != 0) {
+            length += sprintf(text + length, "%s%d", rand() % 2 ? "e" : "E-", rand() % 360);
+        }
+        text[length] = '\0';
+        if (!compare(text)) return 0;
+    }
+    return 1;
+}
+
+// The exact decimal expansion of the midpoint between two neighbouring
+// doubles must round to even, and anything just above it must round up.
+// A long double holds the midpoint exactly and printf prints it in full.
+static int test_halfway_cases() {
+    char text[1500];
+    for (int i = 0; i < HALFWAY_CASES; i++) {
+        unsigned long long bits = random_bits() & ~(1ULL << 63);
+        if (i % 4 == 0) bits &= 0x43ffffffffffffffULL;     // near 2^53, where integers tie
+        double value;
+        memcpy(&value, &bits, sizeof(double));
+        double next = nextafter(value, INFINITY);
+        if (!isfinite(value) || !isfinite(next)) continue;
+
+        long double midpoint = ((long double)value + next) / 2;
+        int length = snprintf(text, sizeof(text), "%.1100Lf", midpoint);
+        while (length > 1 && text[length - 1] == '0') text[--length] = '\0';
+        if (text[length - 1] == '.') text[--length] = '\0';
+        if (!compare(text)) return 0;
+
+        if (strchr(text, '.') == NULL) {
+            strcat(text, ".0000000000000000000000001");
+        } else {
+            strcat(text, "1");
+        }
+        if (!compare(text)) return 0;
+    }
+    return 1;
+}
+
+static int test_edge_cases() {
+    static const char *cases[] = {
+        "0", "000", "0.0", ".5", "5.", "007", "0.000000000000000000000000000001",
+        "1e0", "1e+0", "1e-0", "1E5", "2e", "2e+", "2e-x", "3.e2", ".e2", ".",
+        "9007199254740992", "9007199254740993", "9007199254740995", "18014398509481985",
+        "1e22", "1e23", "8.98846567431158e307", "1.7976931348623157e308",
+        "1.7976931348623158e308", "1.7976931348623159e308", "1e309", "1e99999999",
+        "2.2250738585072011e-308", "2.2250738585072014e-308", "4.9406564584124654e-324",
+        "2.4703282292062327e-324", "2.4703282292062328e-324", "1e-324", "1e-400",
+        "1e-99999999", "123456789012345678901234567890", "0.1234567890123456789012345",
+        "179769313486231580793728971405303415079934132710037826936173778980444968292764750946649017977587207096330286416692887910946555547851940402630657488671505820681908902000708383676273854845817711531764475730270069855571366959622842914819860834936475292719074168444365510704342711559699508093042880177904174497791",
+        "0x0", "0x1F", "0xdeadBEEF", "0x20000000000001", "0x20000000000003",
+        "0xffffffffffffffff", "0x1fffffffffffffff0000000000000001", "0x", "0xg"
+    };
+    for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
+        if (!compare(cases[i])) return 0;
+    }
+    return 1;
+}
+
+static int test_hex() {
+    char text[64];
+    for (int i = 0; i < RANDOM_DOUBLES; i++) {
+        unsigned long long bits = random_bits() >> (rand() % 64);
+        snprintf(text, sizeof(text), rand() % 2 ? "0x%llx" : "0X%llX", bits);
+        if (rand() % 4 == 0) {
+            snprintf(text + strlen(text), 20, "%llx", random_bits() >> (rand() % 64));
+        }
+        if (!compare(text)) return 0;
+    }
+    return 1;
+}
+
+static int test_tokens() {
+    static const TokenType expected[] = {
+        TOKEN_IDENTIFIER, TOKEN_LPAREN, TOKEN_NUMBER, TOKEN_COMMA, TOKEN_MINUS,
+        TOKEN_NUMBER, TOKEN_RPAREN, TOKEN_STAR, TOKEN_IDENTIFIER, TOKEN_SLASH,
+        TOKEN_NUMBER, TOKEN_PLUS, TOKEN_NUMBER, TOKEN_IDENTIFIER, TOKEN_IDENTIFIER, TOKEN_ERROR,
+        TOKEN_NUMBER, TOKEN_END, TOKEN_END
+    };
+    const char *text = " pow(1.5e3, -.25) * MR_2/0x10 + 2e x $ 7 ";
+    Lexer lexer;
+    init_lexer(&lexer, text);
+
+    for (size_t i = 0; i < sizeof(expected) / sizeof(expected[0]); i++) {
+        Token token = next_token(&lexer);
+        if (token.type != expected[i]) {
+            printf("FAIL: token %zu of '%s' has type %d, expected %d\n", i, text, token.type, expected[i]);
+            return 0;
+        }
+    }
+
+    init_lexer(&lexer, "  12.5e-1)");
+    Token token = next_token(&lexer);
+    if (token.position != 2 || token.length != 7 || token.value != 1.25) {
+        printf("FAIL: '12.5e-1' lexed at %d, length %d, value %g\n", token.position, token.length, token.value);
+        return 0;
+    }
+    return 1;
+}
+
+static int run(const char *name, int (*test)()) {
+    long before = checked;
+    int passed = test();
+    printf("%-40s %s (%ld literals)\n", name, passed ? "ok" : "FAILED", checked - before);
+    return passed;
+}
+
+int main() {
+    printf("Testing number lexer against strtod\n");
+    printf("===================================\n");
+    srand(1234);
+
+    int failures = 0;
+    failures += !run("Edge cases", test_edge_cases);
+    failures += !run("Random doubles at every precision", test_random_doubles);
+    failures += !run("Subnormals", test_subnormals);
+    failures += !run("Random digit strings and exponents", test_random_strings);
+    failures += !run("Exact halfway cases", test_halfway_cases);
+    failures += !run("Hex literals", test_hex);
+    failures += !run("Token stream", test_tokens);
+
+    if (failures > 0) {
+        printf("\n%d test(s) failed\n", failures);
+        return 1;
+    }
+    printf("\nAll tests completed successfully!\n");
+    return 0;
+}
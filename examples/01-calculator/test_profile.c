@@ -0,0 +1,127 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include "expression_parser.h"
+#include "profile.h"
+
+// Built with -DCALC_PROFILE. Checks that instruction counts match the
+// programs that ran, across threads that have already exited, and that
+// phases, libm timings and depth histograms are recorded.
+
+#define EVALUATIONS 10000
+#define THREADS 4
+
+static const char *formula = "x * sin(x) + pow(y, 2) / sqrt(y)";
+
+static int failures;
+
+static void check(int condition, const char *description) {
+    if (!condition) {
+        printf("FAIL: %s\n", description);
+        failures++;
+    }
+}
+
+static int bucket_of(int depth) {
+    int bucket = 0;
+    for (; depth > 0; depth >>= 1) bucket++;
+    return bucket;
+}
+
+static void* evaluate_many(void *arg) {
+    Program *program = arg;
+    double variables[2] = { 0.5, 3.0 };
+    EvalEnv env = { 0.0, variables, EVAL_OK };
+    for (int i = 0; i < EVALUATIONS; i++) {
+        variables[0] = i * 0.001;
+        evaluate_program(program, &env);
+    }
+    return NULL;
+}
+
+static void test_counts() {
+    Program *program = compile_expression(formula, NULL);
+    if (program == NULL) {
+        printf("FAIL: cannot compile '%s'\n", formula);
+        failures++;
+        return;
+    }
+    profile_reset();
+
+    pthread_t threads[THREADS];
+    for (int t = 0; t < THREADS; t++) {
+        pthread_create(&threads[t], NULL, evaluate_many, program);
+    }
+    for (int t = 0; t < THREADS; t++) {
+        pthread_join(threads[t], NULL);
+    }
+
+    unsigned long long expected[PROFILE_OPS] = { 0 };
+    for (int i = 0; i < program->code_length; i++) {
+        expected[program->code[i].op] += (unsigned long long)EVALUATIONS * THREADS;
+    }
+
+    ProfileCounters total;
+    int thread_count = profile_totals(&total);
+    check(thread_count >= THREADS, "every thread registered");
+    check(memcmp(total.op_counts, expected, sizeof(expected)) == 0, "instruction counts from exited threads");
+    check(total.phase_calls[PROFILE_EVALUATE] == (unsigned long long)EVALUATIONS * THREADS, "evaluation count");
+    check(total.phase_ticks[PROFILE_EVALUATE] > 0, "evaluation time");
+    check(total.math_ticks[OP_SIN] > 0 && total.math_ticks[OP_POW] > 0 && total.math_ticks[OP_SQRT] > 0,
+          "libm time for sin, pow and sqrt");
+    check(total.math_ticks[OP_COS] == 0, "no libm time for cos");
+    check(total.depths[PROFILE_STACK_DEPTH][bucket_of(program->max_stack)] == (unsigned long long)EVALUATIONS * THREADS,
+          "stack depth histogram");
+    free_program(program);
+}
+
+static void test_parse() {
+    profile_reset();
+    // Tree depths 1, 4 and 9: buckets 1, 3 and 4
+    const char *texts[] = { "x", "-(-(-x))", "-(-(-(-(-(-(-(-x)))))))" };
+    for (int i = 0; i < 3; i++) {
+        free_program(compile_expression(texts[i], NULL));
+    }
+    free_program(compile_expression("1 +", NULL));
+
+    ProfileCounters total;
+    profile_totals(&total);
+    check(total.phase_calls[PROFILE_PARSE] == 4, "parse count includes failures");
+    check(total.phase_calls[PROFILE_COMPILE] == 3, "compile count");
+    check(total.depths[PROFILE_TREE_DEPTH][1] == 1 && total.depths[PROFILE_TREE_DEPTH][3] == 1 &&
+          total.depths[PROFILE_TREE_DEPTH][4] == 1, "tree depth histogram");
+}
+
+static void test_output() {
+    const char *path = "/tmp/test_profile.json";
+    check(profile_write_json(path) == 0, "write JSON");
+
+    FILE *file = fopen(path, "r");
+    char text[4096] = "";
+    if (file != NULL) {
+        size_t length = fread(text, 1, sizeof(text) - 1, file);
+        text[length] = '\0';
+        fclose(file);
+    }
+    remove(path);
+    check(strstr(text, "\"parse\": {\"calls\": 4") != NULL, "JSON phase counts");
+    check(strstr(text, "\"tree_depth\": [0, 1, 0, 1, 1,") != NULL, "JSON histogram");
+}
+
+int main() {
+    printf("Testing evaluator profile\n");
+    printf("=========================\n");
+
+    check(profile_enabled(), "profiling compiled in");
+    test_counts();
+    test_parse();
+    test_output();
+
+    if (failures > 0) {
+        printf("\n%d test(s) failed\n", failures);
+        return 1;
+    }
+    printf("\nAll tests completed successfully!\n");
+    return 0;
+}
@@ -0,0 +1,152 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "expression_parser.h"
+#include "symbols.h"
+
+// Checks the symbol table against a plain array through growth and
+// redefinition, the built-in perfect hash, and that let / def statements
+// give the same results as the expressions written out by hand.
+
+#define SYMBOLS 50000
+
+static int failures;
+
+static void check(int condition, const char *description) {
+    if (!condition) {
+        printf("FAIL: %s\n", description);
+        failures++;
+    }
+}
+
+static void test_table() {
+    SymbolTable *table = create_symbol_table();
+    char name[32];
+
+    // Every name, including redefinitions, must find its latest value
+    for (int round = 0; round < 2; round++) {
+        for (int i = 0; i < SYMBOLS; i++) {
+            snprintf(name, sizeof(name), "name_%d", i);
+            set_variable(table, name, i * 10.0 + round);
+        }
+    }
+    int wrong = 0;
+    for (int i = 0; i < SYMBOLS; i++) {
+        int length = snprintf(name, sizeof(name), "name_%d", i);
+        const Symbol *symbol = find_symbol(table, name, length);
+        if (symbol == NULL || symbol->value != i * 10.0 + 1) wrong++;
+        name[length - 1] = 'x';
+        if (find_symbol(table, name, length) != NULL) wrong++;
+    }
+    check(wrong == 0, "table lookups after growth and redefinition");
+    check(table->count == SYMBOLS, "table count");
+    check(table->count * 4 <= (table->mask + 1) * 3, "table load factor");
+
+    // A prefix of a longer name is a different name
+    check(find_symbol(table, "name_1", 4) == NULL, "prefix lookup misses");
+    free_symbol_table(table);
+}
+
+static void test_builtins() {
+    static const char *names[] = { "sin", "cos", "tan", "log", "ln", "sqrt", "pow", "MR", "pi", "e", "diff" };
+    static const char *others[] = { "s", "sinh", "cosine", "exp", "p", "E", "mr", "Pi", "lg", "x", "dif" };
+    for (int i = 0; i < 11; i++) {
+        const Builtin *builtin = find_builtin(names[i], (int)strlen(names[i]));
+        check(builtin != NULL && strcmp(builtin->name, names[i]) == 0, names[i]);
+        check(find_builtin(others[i], (int)strlen(others[i])) == NULL, others[i]);
+    }
+}
+
+// Runs each line, definition or expression, and compares the last result
+static void compare(CalcContext *context, const char *lines[], int count, const char *expected) {
+    double result = 0.0;
+    for (int i = 0; i < count; i++) {
+        int status = is_definition(lines[i]) ? define_symbol(context, lines[i], &result)
+                                             : calculate(context, lines[i], &result);
+        if (status != 0) {
+            printf("FAIL: '%s': %s\n", lines[i], context->error);
+            failures++;
+            return;
+        }
+    }
+    double reference;
+    if (calculate(context, expected, &reference) != 0 || reference != result) {
+        printf("FAIL: '%s' gave %.17g, '%s' gives %.17g\n", lines[count - 1], result, expected, reference);
+        failures++;
+    }
+}
+
+static void expect_error(CalcContext *context, const char *line, const char *message) {
+    double result;
+    int status = is_definition(line) ? define_symbol(context, line, &result)
+                                     : calculate(context, line, &result);
+    if (status == 0 || strstr(context->error, message) == NULL) {
+        printf("FAIL: '%s' should fail with '%s', got '%s'\n", line, message,
+               status == 0 ? "success" : context->error);
+        failures++;
+    }
+}
+
+static void test_definitions() {
+    CalcContext context;
+    init_context(&context);
+    context.symbols = create_symbol_table();
+    context.cache = NULL;
+
+    const char *interest[] = {
+        "let rate = 0.05",
+        "def grow(p, years) = p * pow(1 + rate, years)",
+        "grow(1000, 3) - grow(500, 2)"
+    };
+    compare(&context, interest, 3, "1000 * pow(1.05, 3) - 500 * pow(1.05, 2)");
+
+    // Variables in a body are read when the function is called
+    const char *late[] = { "let rate = 0.1", "grow(1000, 3)" };
+    compare(&context, late, 2, "1000 * pow(1.1, 3)");
+
+    // Parameters shadow variables; functions call earlier functions
+    const char *nested[] = {
+        "let x = 100",
+        "def square(x) = x * x",
+        "def norm(a, b) = sqrt(square(a) + square(b))",
+        "norm(3, 4) + x + square(-2)"
+    };
+    compare(&context, nested, 4, "5 + 100 + 4");
+
+    const char *constant[] = { "def answer() = 42", "let e2 = answer() + e", "e2 * 2" };
+    compare(&context, constant, 3, "(42 + e) * 2");
+
+    expect_error(&context, "let pi = 3", "built-in");
+    expect_error(&context, "def sin(x) = x", "built-in");
+    expect_error(&context, "def f(a, a) = a", "Duplicate");
+    expect_error(&context, "let = 2", "Expected a name");
+    expect_error(&context, "let y 2", "Expected '='");
+    expect_error(&context, "square(1, 2)", "Wrong number");
+    expect_error(&context, "undefined(1)", "Unknown function");
+    expect_error(&context, "norm(1, y)", "Unknown variable 'y'");
+    expect_error(&context, "let z = 1 / 0", "Division by zero");
+    expect_error(&context, "z", "Unknown variable 'z'");
+
+    // Each call copies its argument four times
+    double result;
+    define_symbol(&context, "def quad(a) = a + a + a + a", &result);
+    expect_error(&context, "quad(quad(quad(quad(quad(quad(quad(quad(quad(1)))))))))", "expand too far");
+
+    free_symbol_table(context.symbols);
+}
+
+int main() {
+    printf("Testing symbol table\n");
+    printf("====================\n");
+
+    test_table();
+    test_builtins();
+    test_definitions();
+
+    if (failures > 0) {
+        printf("\n%d test(s) failed\n", failures);
+        return 1;
+    }
+    printf("\nAll tests completed successfully!\n");
+    return 0;
+}
@@ -0,0 +1,586 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <limits.h>
+#include <unistd.h>
+#include <time.h>
+#include <pthread.h>
+#include "batch.h"
+
+#define BATCH_MAX_THREADS 64
+#define NODES_MIN_CAPACITY 1024
+#define SCRIPT_CHUNK (64 * 1024)
+
+typedef struct {
+    int *items;
+    int count;
+    int capacity;
+} CommandList;
+
+typedef struct {
+    char *line;                         // points into the script text
+    int accesses;                       // -1: a barrier
+    char *paths[BATCH_MAX_ACCESSES];    // as written, then absolute
+    int writes[BATCH_MAX_ACCESSES];
+    int waiting;                        // unfinished commands it waits for
+    int stamp;                          // last command made to wait for this one
+    CommandList dependents;
+    char *output;                       // NULL if no buffer could be made
+    size_t output_length;
+    int done;
+} Command;
+
+// One per path named in a section and per directory above one. Nodes of
+// directories double as a cache of where their symbolic links lead.
+typedef struct {
+    char *key;                  // absolute path; NULL for an empty slot
+    size_t length;
+    uint64_t hash;
+    int last_write;             // last command writing here, or -1
+    CommandList readers;        // reading here since then
+    CommandList below;          // touching anything below here since then
+    CommandList below_writes;   // ... and writing it
+    char *resolved;             // realpath of the directory, once looked up
+} PathNode;
+
+// The commands between two barriers
+typedef struct {
+    const BatchOptions *options;
+    Command *commands;
+    int count;
+    PathNode *nodes;
+    size_t node_count;
+    size_t node_capacity;
+    unsigned long long waits;
+    int failed;                 // out of memory while planning
+
+    pthread_mutex_t lock;       // guards everything below and Command waiting and done
+    pthread_cond_t work;        // a command became ready, or all are done
+    pthread_cond_t finished;    // the awaited command is done
+    int *ready;
+    int ready_head;
+    int ready_tail;
+    int finished_count;
+    int awaited;                // the command whose output is due next
+} Section;
+
+void init_batch_options(BatchOptions *options) {
+    options->threads = 0;
+    options->plan = NULL;
+    options->run = NULL;
+    options->arg = NULL;
+}
+
+static double now_seconds() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static int push_command(CommandList *list, int command) {
+    if (list->count == list->capacity) {
+        int capacity = list->capacity ? list->capacity * 2 : 4;
+        int *items = realloc(list->items, capacity * sizeof(int));
+        if (items == NULL) return -1;
+        list->items = items;
+        list->capacity = capacity;
+    }
+    list->items[list->count++] = command;
+    return 0;
+}
+
+// Path nodes
+
+static uint64_t hash_path(const char *path, size_t length) {
+    uint64_t hash = 0xcbf29ce484222325ull;
+    for (size_t i = 0; i < length; i++) {
+        hash = (hash ^ (unsigned char)path[i]) * 0x100000001b3ull;
+    }
+    return hash;
+}
+
+static size_t node_slot(const PathNode *nodes, size_t capacity, const char *path, size_t length, uint64_t hash) {
+    size_t slot = hash & (capacity - 1);
+    while (nodes[slot].key != NULL && (nodes[slot].hash != hash || nodes[slot].length != length ||
+                                       memcmp(nodes[slot].key, path, length) != 0)) {
+        slot = (slot + 1) & (capacity - 1);
+    }
+    return slot;
+}
+
+// The node for the first length characters of path, made if new. Returns
+// its slot, or -1 if out of memory; slots move when the table grows.
+static long find_node(Section *section, const char *path, size_t length) {
+    if (2 * (section->node_count + 1) > section->node_capacity) {
+        size_t capacity = section->node_capacity ? section->node_capacity * 2 : NODES_MIN_CAPACITY;
+        PathNode *nodes = calloc(capacity, sizeof(PathNode));
+        if (nodes == NULL) return -1;
+        for (size_t i = 0; i < section->node_capacity; i++) {
+            const PathNode *node = &section->nodes[i];
+            if (node->key != NULL) {
+                nodes[node_slot(nodes, capacity, node->key, node->length, node->hash)] = *node;
+            }
+        }
+        free(section->nodes);
+        section->nodes = nodes;
+        section->node_capacity = capacity;
+    }
+    uint64_t hash = hash_path(path, length);
+    size_t slot = node_slot(section->nodes, section->node_capacity, path, length, hash);
+    PathNode *node = &section->nodes[slot];
+    if (node->key == NULL) {
+        node->key = malloc(length + 1);
+        if (node->key == NULL) return -1;
+        memcpy(node->key, path, length);
+        node->key[length] = '\0';
+        node->length = length;
+        node->hash = hash;
+        node->last_write = -1;
+        section->node_count++;
+    }
+    return (long)slot;
+}
+
+// Joins path to cwd unless it is absolute and drops ".", ".." and
+// repeated slashes, without looking at the filesystem
+static char *absolute_path(const char *cwd, const char *path) {
+    size_t size = strlen(cwd) + strlen(path) + 3;
+    char *joined = malloc(size), *clean = malloc(size);
+    if (joined == NULL || clean == NULL) {
+        free(joined);
+        free(clean);
+        return NULL;
+    }
+    snprintf(joined, size, "%s/%s", path[0] == '/' ? "" : cwd, path);
+
+    size_t out = 0;
+    const char *part = joined;
+    while (*part != '\0') {
+        size_t length = strcspn(part, "/");
+        if (length == 2 && part[0] == '.' && part[1] == '.') {
+            while (out > 0 && clean[--out] != '/') {}
+        } else if (length > 0 && !(length == 1 && part[0] == '.')) {
+            clean[out++] = '/';
+            memcpy(clean + out, part, length);
+            out += length;
+        }
+        part += length;
+        if (*part == '/') part++;
+    }
+    if (out == 0) clean[out++] = '/';
+    clean[out] = '\0';
+    free(joined);
+    return clean;
+}
+
+static char *join_name(const char *directory, const char *slash_name) {
+    size_t size = strlen(directory) + strlen(slash_name) + 1;
+    char *joined = malloc(size);
+    if (joined != NULL) {
+        snprintf(joined, size, "%s%s", strcmp(directory, "/") == 0 ? "" : directory, slash_name);
+    }
+    return joined;
+}
+
+// Where the directory named by the first length characters of path
+// really is. One not made yet is placed in where its parent really is.
+static const char *resolve_directory(Section *section, const char *path, size_t length) {
+    long slot = find_node(section, path, length);
+    if (slot < 0) return NULL;
+    if (section->nodes[slot].resolved != NULL) return section->nodes[slot].resolved;
+
+    const char *key = section->nodes[slot].key;        // stays put when the table grows
+    char real[PATH_MAX];
+    char *resolved = NULL;
+    if (realpath(key, real) != NULL) {
+        resolved = strdup(real);
+    } else {
+        const char *slash = strrchr(key, '/');
+        const char *above = slash == key ? "/" : resolve_directory(section, key, (size_t)(slash - key));
+        if (above != NULL) resolved = join_name(above, slash);
+    }
+    if (resolved == NULL) return NULL;
+    slot = find_node(section, path, length);
+    if (slot < 0) {
+        free(resolved);
+        return NULL;
+    }
+    section->nodes[slot].resolved = resolved;
+    return resolved;
+}
+
+// The absolute path, with symbolic links in the directories above it
+// resolved. The last name is kept: rm removes a link, not what it points
+// to.
+static char *resolve_path(Section *section, const char *cwd, const char *path) {
+    char *clean = absolute_path(cwd, path);
+    if (clean == NULL) return NULL;
+    char *slash = strrchr(clean, '/');
+    if (slash == clean) return clean;
+
+    const char *directory = resolve_directory(section, clean, (size_t)(slash - clean));
+    char *resolved = directory != NULL ? join_name(directory, slash) : NULL;
+    free(clean);
+    return resolved;
+}
+
+// Planning
+
+static int wait_for(Section *section, int command, int earlier) {
+    if (earlier < 0 || earlier == command || section->commands[earlier].stamp == command) return 0;
+    section->commands[earlier].stamp = command;
+    if (push_command(&section->commands[earlier].dependents, command) != 0) return -1;
+    section->commands[command].waiting++;
+    section->waits++;
+    return 0;
+}
+
+static int wait_for_all(Section *section, int command, const CommandList *earlier) {
+    for (int i = 0; i < earlier->count; i++) {
+        if (wait_for(section, command, earlier->items[i]) != 0) return -1;
+    }
+    return 0;
+}
+
+// Calls step for "/", each directory above path and path itself, with
+// the length of each; stops at the first nonzero return
+static int each_prefix(Section *section, int command, const char *path, int write,
+                       int (*step)(Section *, int, PathNode *, int, int)) {
+    size_t length = strlen(path);
+    for (size_t end = 1; end <= length; end++) {
+        if (end > 1 && end < length && path[end] != '/') continue;
+        long slot = find_node(section, path, end);
+        if (slot < 0 || step(section, command, &section->nodes[slot], write, end == length) != 0) return -1;
+    }
+    return 0;
+}
+
+// Makes command wait for earlier commands writing a path that overlaps,
+// and, if it writes, for those reading one
+static int add_waits(Section *section, int command, PathNode *node, int write, int last) {
+    if (wait_for(section, command, node->last_write) != 0) return -1;
+    if (write && wait_for_all(section, command, &node->readers) != 0) return -1;
+    if (last) return wait_for_all(section, command, write ? &node->below : &node->below_writes);
+    return 0;
+}
+
+// Records the access for the commands after this one. A write here
+// waited for everything recorded so far, so they need only wait for it.
+static int record_access(Section *section, int command, PathNode *node, int write, int last) {
+    (void)section;
+    if (!last) {
+        if (push_command(&node->below, command) != 0) return -1;
+        return write ? push_command(&node->below_writes, command) : 0;
+    }
+    if (!write) return push_command(&node->readers, command);
+    node->last_write = command;
+    node->readers.count = 0;
+    node->below.count = 0;
+    node->below_writes.count = 0;
+    return 0;
+}
+
+static void plan_section(Section *section) {
+    char cwd[PATH_MAX];
+    if (getcwd(cwd, sizeof(cwd)) == NULL) {
+        section->failed = 1;
+        return;
+    }
+    for (int c = 0; c < section->count; c++) {
+        Command *command = &section->commands[c];
+        for (int a = 0; a < command->accesses; a++) {
+            char *resolved = resolve_path(section, cwd, command->paths[a]);
+            if (resolved == NULL) {
+                section->failed = 1;
+                return;
+            }
+            free(command->paths[a]);
+            command->paths[a] = resolved;
+        }
+        for (int a = 0; a < command->accesses; a++) {
+            if (each_prefix(section, c, command->paths[a], command->writes[a], add_waits) != 0) {
+                section->failed = 1;
+                return;
+            }
+        }
+        for (int a = 0; a < command->accesses; a++) {
+            if (each_prefix(section, c, command->paths[a], command->writes[a], record_access) != 0) {
+                section->failed = 1;
+                return;
+            }
+        }
+    }
+}
+
+// Running
+
+static void run_buffered(const BatchOptions *options, Command *command) {
+    FILE *out = open_memstream(&command->output, &command->output_length);
+    if (out == NULL) {
+        command->output = NULL;
+        return;
+    }
+    options->run(command->line, out, options->arg);
+    fclose(out);
+}
+
+// A thread finishing a command goes on with the first command that was
+// waiting only for it, rather than handing it to another thread
+static void *section_thread(void *arg) {
+    Section *section = arg;
+    int c = -1;
+    pthread_mutex_lock(&section->lock);
+    while (1) {
+        if (c < 0) {
+            while (section->ready_head == section->ready_tail && section->finished_count < section->count) {
+                pthread_cond_wait(&section->work, &section->lock);
+            }
+            if (section->ready_head == section->ready_tail) break;
+            c = section->ready[section->ready_head++];
+        }
+        pthread_mutex_unlock(&section->lock);
+
+        Command *command = &section->commands[c];
+        run_buffered(section->options, command);
+
+        pthread_mutex_lock(&section->lock);
+        command->done = 1;
+        section->finished_count++;
+        if (c == section->awaited) pthread_cond_signal(&section->finished);
+        c = -1;
+        for (int i = 0; i < command->dependents.count; i++) {
+            int next = command->dependents.items[i];
+            if (--section->commands[next].waiting > 0) continue;
+            if (c < 0) {
+                c = next;
+            } else {
+                section->ready[section->ready_tail++] = next;
+                pthread_cond_signal(&section->work);
+            }
+        }
+        if (section->finished_count == section->count) pthread_cond_broadcast(&section->work);
+    }
+    pthread_mutex_unlock(&section->lock);
+    return NULL;
+}
+
+static void print_output(Command *command) {
+    if (command->output == NULL) {
+        printf("Memory allocation failed!\n");
+        return;
+    }
+    fwrite(command->output, 1, command->output_length, stdout);
+    free(command->output);
+    command->output = NULL;
+}
+
+static void run_section(const BatchOptions *options, Command *commands, int count, int threads,
+                        BatchStats *stats) {
+    stats->concurrent += (unsigned long long)count;
+    if (count == 1 || threads == 1) {
+        for (int c = 0; c < count; c++) {
+            options->run(commands[c].line, stdout, options->arg);
+        }
+        return;
+    }
+
+    Section section;
+    memset(&section, 0, sizeof(section));
+    section.options = options;
+    section.commands = commands;
+    section.count = count;
+    section.ready = malloc(count * sizeof(int));
+    if (section.ready != NULL) plan_section(&section);
+
+    if (section.ready == NULL || section.failed) {
+        // Without a plan the commands still run, one after another
+        for (int c = 0; c < count; c++) {
+            options->run(commands[c].line, stdout, options->arg);
+        }
+    } else {
+        for (int c = 0; c < count; c++) {
+            if (commands[c].waiting == 0) section.ready[section.ready_tail++] = c;
+        }
+        stats->waits += section.waits;
+        pthread_mutex_init(&section.lock, NULL);
+        pthread_cond_init(&section.work, NULL);
+        pthread_cond_init(&section.finished, NULL);
+
+        pthread_t workers[BATCH_MAX_THREADS];
+        int started = 0;
+        while (started < threads && started < count &&
+               pthread_create(&workers[started], NULL, section_thread, &section) == 0) {
+            started++;
+        }
+        if (started == 0) section_thread(&section);
+
+        // Output goes out in script order, each as soon as those before it,
+        // taking every finished command in a row at once
+        int c = 0;
+        while (c < count) {
+            pthread_mutex_lock(&section.lock);
+            section.awaited = c;
+            while (!commands[c].done) {
+                pthread_cond_wait(&section.finished, &section.lock);
+            }
+            int end = c + 1;
+            while (end < count && commands[end].done) end++;
+            pthread_mutex_unlock(&section.lock);
+            while (c < end) {
+                print_output(&commands[c++]);
+            }
+        }
+        for (int t = 0; t < started; t++) {
+            pthread_join(workers[t], NULL);
+        }
+        pthread_cond_destroy(&section.finished);
+        pthread_cond_destroy(&section.work);
+        pthread_mutex_destroy(&section.lock);
+    }
+
+    for (size_t i = 0; i < section.node_capacity; i++) {
+        PathNode *node = &section.nodes[i];
+        free(node->key);
+        free(node->readers.items);
+        free(node->below.items);
+        free(node->below_writes.items);
+        free(node->resolved);
+    }
+    free(section.nodes);
+    free(section.ready);
+}
+
+// Script
+
+static char *read_script(const char *path, size_t *length) {
+    FILE *file = strcmp(path, "-") == 0 ? stdin : fopen(path, "r");
+    if (file == NULL) {
+        printf("Error: Cannot open script '%s'\n", path);
+        return NULL;
+    }
+    char *text = NULL;
+    size_t used = 0, capacity = 0;
+    while (1) {
+        if (capacity - used < SCRIPT_CHUNK) {
+            capacity = capacity ? capacity * 2 : SCRIPT_CHUNK * 2;
+            char *grown = realloc(text, capacity);
+            if (grown == NULL) {
+                printf("Memory allocation failed!\n");
+                free(text);
+                text = NULL;
+                break;
+            }
+            text = grown;
+        }
+        size_t got = fread(text + used, 1, capacity - used - 1, file);
+        used += got;
+        if (got == 0) break;
+    }
+    if (text != NULL && ferror(file)) {
+        printf("Error: Cannot read script '%s'\n", path);
+        free(text);
+        text = NULL;
+    }
+    if (file != stdin) fclose(file);
+    if (text != NULL) text[used] = '\0';
+    *length = used;
+    return text;
+}
+
+// Takes the commands out of the script text, which is cut into lines,
+// and asks the plan callback which paths each touches
+static int parse_script(char *text, const BatchOptions *options, Command *commands) {
+    int count = 0;
+    char *line = text;
+    while (line != NULL && *line != '\0') {
+        char *end = strchr(line, '\n');
+        if (end != NULL) *end = '\0';
+        char *next = end != NULL ? end + 1 : NULL;
+
+        line += strspn(line, " \t");
+        size_t length = strlen(line);
+        while (length > 0 && (line[length - 1] == '\r' || line[length - 1] == ' ' || line[length - 1] == '\t')) {
+            line[--length] = '\0';
+        }
+        if (length > 0 && line[0] != '#') {
+            Command *command = &commands[count++];
+            command->line = line;
+            command->stamp = -1;
+            command->accesses = -1;
+
+            char *copy = strdup(line);
+            BatchAccess accesses[BATCH_MAX_ACCESSES];
+            int planned = copy != NULL && options->plan != NULL ? options->plan(copy, accesses, options->arg) : -1;
+            for (int a = 0; a < planned; a++) {
+                command->paths[a] = strdup(accesses[a].path);
+                command->writes[a] = accesses[a].write;
+                if (command->paths[a] == NULL) planned = -1;
+            }
+            if (planned < 0) {
+                for (int a = 0; a < BATCH_MAX_ACCESSES; a++) {
+                    free(command->paths[a]);
+                    command->paths[a] = NULL;
+                }
+            }
+            command->accesses = planned;
+            free(copy);
+        }
+        line = next;
+    }
+    return count;
+}
+
+int run_batch(const char *path, const BatchOptions *options, BatchStats *stats) {
+    double start = now_seconds();
+    BatchStats total;
+    memset(&total, 0, sizeof(total));
+
+    size_t length;
+    char *text = read_script(path, &length);
+    if (text == NULL) return -1;
+    size_t lines = 1;
+    for (size_t i = 0; i < length; i++) {
+        if (text[i] == '\n') lines++;
+    }
+    Command *commands = calloc(lines, sizeof(Command));
+    if (commands == NULL) {
+        printf("Memory allocation failed!\n");
+        free(text);
+        return -1;
+    }
+    int count = parse_script(text, options, commands);
+
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    int threads = options->threads > 0 ? options->threads : cpus > 0 ? (int)cpus : 1;
+    if (threads > BATCH_MAX_THREADS) threads = BATCH_MAX_THREADS;
+    total.threads = threads;
+
+    int c = 0;
+    while (c < count) {
+        if (commands[c].accesses < 0) {
+            total.barriers++;
+            if (options->run(commands[c++].line, stdout, options->arg) != 0) break;
+            continue;
+        }
+        int end = c;
+        while (end < count && commands[end].accesses >= 0) end++;
+        run_section(options, commands + c, end - c, threads, &total);
+        c = end;
+    }
+    total.commands = total.barriers + total.concurrent;
+
+    for (int i = 0; i < count; i++) {
+        for (int a = 0; a < BATCH_MAX_ACCESSES; a++) {
+            free(commands[i].paths[a]);
+        }
+        free(commands[i].dependents.items);
+        free(commands[i].output);
+    }
+    free(commands);
+    free(text);
+    total.seconds = now_seconds() - start;
+    if (stats != NULL) *stats = total;
+    return 0;
+}
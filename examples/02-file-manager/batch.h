@@ -0,0 +1,66 @@
+#ifndef BATCH_H
+#define BATCH_H
+
+// Script mode: file_manager -c FILE runs a file of commands without the
+// prompt.
+//
+// The whole script is read and planned before anything runs. A command
+// that only creates, copies, moves, removes or changes the mode of the
+// paths it names says which of them it reads and which it writes; any
+// other command, such as cd or ls, is a barrier that runs alone. Between
+// barriers, commands run on a pool of threads, each once every earlier
+// command touching an overlapping path has finished. Two paths overlap
+// when they are the same or one lies below the other, and commands that
+// only read a path do not wait for each other. Each command prints into a
+// buffer of its own, and the buffers are written out in script order as
+// soon as all earlier ones have been, so the output is what running the
+// script a line at a time would print. Most of these commands keep a CPU
+// busy in the kernel rather than wait for a disk, and threads making
+// entries in one directory queue for its lock, so the pool has a thread
+// per CPU and no more.
+//
+// Paths are compared once made absolute, with symbolic links resolved in
+// the directories that exist when the run reaches the commands naming
+// them. Blank lines and lines starting with '#' are skipped.
+
+#include <stdio.h>
+
+#define BATCH_MAX_ACCESSES 4        // paths one command may name
+
+typedef struct {
+    const char *path;
+    int write;                  // else only read
+} BatchAccess;
+
+// Fills accesses with the paths command touches and returns how many, or
+// -1 if it must run alone. command is a copy the callback may split up;
+// the paths may point into it.
+typedef int (*BatchPlan)(char *command, BatchAccess accesses[BATCH_MAX_ACCESSES], void *arg);
+
+// Runs command, printing to out: a buffer, or stdout for a barrier.
+// Returns nonzero to end the script there.
+typedef int (*BatchRun)(const char *command, FILE *out, void *arg);
+
+typedef struct {
+    int threads;                // <= 0: one per online CPU; 1 runs the commands in order
+    BatchPlan plan;
+    BatchRun run;
+    void *arg;
+} BatchOptions;
+
+typedef struct {
+    unsigned long long commands;
+    unsigned long long concurrent;      // run on the pool
+    unsigned long long barriers;
+    unsigned long long waits;           // commands each concurrent one waited for, summed
+    int threads;
+    double seconds;
+} BatchStats;
+
+void init_batch_options(BatchOptions *options);
+
+// Runs the script in path, "-" for standard input. Returns 0, or -1 if
+// it cannot be read.
+int run_batch(const char *path, const BatchOptions *options, BatchStats *stats);
+
+#endif
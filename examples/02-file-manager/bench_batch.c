@@ -0,0 +1,182 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/stat.h>
+#include "batch.h"
+#include "copy.h"
+
+// A bulk-maintenance script of mkdir, cp, chmod, mv, rm and rmdir over
+// many directories, run a line at a time with the output flushed after
+// each, as piping it into the prompt does, and as a script on one thread
+// and on the pool. The commands are stand-ins for file_manager's, making
+// the same calls and printing the same kind of lines.
+//
+//   ./bench_batch [--dirs N] [--size KB] [--threads N] [--dir DIR]
+//
+// The pool gets 4 threads unless told otherwise, whatever the CPUs.
+
+#define REPETITIONS 3
+
+static double now_seconds() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static int plan_command(char *command, BatchAccess accesses[BATCH_MAX_ACCESSES], void *arg) {
+    (void)arg;
+    char *save, *words[3];
+    int count = 0;
+    for (char *word = strtok_r(command, " ", &save); word != NULL && count < 3; word = strtok_r(NULL, " ", &save)) {
+        words[count++] = word;
+    }
+    if (count == 2) {
+        accesses[0].path = words[1];
+        accesses[0].write = 1;
+        return 1;
+    }
+    if (count == 3 && strcmp(words[0], "chmod") == 0) {
+        accesses[0].path = words[2];
+        accesses[0].write = 1;
+        return 1;
+    }
+    if (count != 3) return -1;
+    accesses[0].path = words[1];
+    accesses[0].write = strcmp(words[0], "mv") == 0;
+    accesses[1].path = words[2];
+    accesses[1].write = 1;
+    return 2;
+}
+
+static int run_command(const char *command, FILE *out, void *arg) {
+    (void)arg;
+    char copy[1024], *save;
+    snprintf(copy, sizeof(copy), "%s", command);
+    char *op = strtok_r(copy, " ", &save);
+    char *first = strtok_r(NULL, " ", &save);
+    char *second = strtok_r(NULL, " ", &save);
+    int failed;
+    if (strcmp(op, "mkdir") == 0) {
+        failed = mkdir(first, 0755);
+    } else if (strcmp(op, "rmdir") == 0) {
+        failed = rmdir(first);
+    } else if (strcmp(op, "rm") == 0) {
+        failed = unlink(first);
+    } else if (strcmp(op, "chmod") == 0) {
+        failed = chmod(second, 0600);
+    } else if (strcmp(op, "mv") == 0) {
+        failed = rename(first, second);
+    } else {
+        CopyOptions options;
+        init_copy_options(&options);
+        options.output = out;
+        failed = copy_path(first, second, &options, NULL);
+    }
+    fprintf(out, failed ? "Error: %s failed\n" : "%s done\n", command);
+    return 0;
+}
+
+// The way commands piped into the prompt run
+static void run_line_at_a_time(const char *script) {
+    FILE *file = fopen(script, "r");
+    char line[1024];
+    while (fgets(line, sizeof(line), file) != NULL) {
+        line[strcspn(line, "\n")] = '\0';
+        printf("fm> ");
+        run_command(line, stdout, NULL);
+        fflush(stdout);
+    }
+    fclose(file);
+}
+
+int main(int argc, char *argv[]) {
+    long dirs = 2000, size_kb = 16;
+    int threads = 4;
+    const char *directory = "/tmp";
+    for (int i = 1; i + 1 < argc; i += 2) {
+        if (strcmp(argv[i], "--dirs") == 0) {
+            dirs = atol(argv[i + 1]);
+        } else if (strcmp(argv[i], "--size") == 0) {
+            size_kb = atol(argv[i + 1]);
+        } else if (strcmp(argv[i], "--threads") == 0) {
+            threads = atoi(argv[i + 1]);
+        } else if (strcmp(argv[i], "--dir") == 0) {
+            directory = argv[i + 1];
+        }
+    }
+
+    char root[4096], path[4200];
+    snprintf(root, sizeof(root), "%s/bench_batch_tree", directory);
+    mkdir(root, 0755);
+    if (chdir(root) != 0) {
+        printf("Error: Cannot access directory '%s'\n", root);
+        return 1;
+    }
+    char *data = calloc(1024, (size_t)size_kb);
+    FILE *file = fopen("template", "w");
+    if (data == NULL || file == NULL) {
+        printf("Error: Cannot create the template file\n");
+        return 1;
+    }
+    fwrite(data, 1024, (size_t)size_kb, file);
+    fclose(file);
+    free(data);
+
+    // Every directory goes through the same six steps, which depend on
+    // each other; different directories do not
+    snprintf(path, sizeof(path), "%s/script", root);
+    file = fopen(path, "w");
+    for (long d = 0; d < dirs; d++) {
+        fprintf(file, "mkdir d%ld\ncp template d%ld/f\nchmod 600 d%ld/f\nmv d%ld/f d%ld/g\nrm d%ld/g\nrmdir d%ld\n",
+                d, d, d, d, d, d, d);
+    }
+    fclose(file);
+    printf("Script of %ld commands over %ld directories, copying %ld KB files\n\n", dirs * 6, dirs, size_kb);
+
+    BatchOptions options;
+    init_batch_options(&options);
+    options.plan = plan_command;
+    options.run = run_command;
+    BatchStats stats;
+    double best[3] = { 0, 0, 0 };
+    int best_threads = 0;
+    for (int r = 0; r < REPETITIONS; r++) {
+        for (int mode = 0; mode < 3; mode++) {
+            fflush(stdout);
+            int saved = dup(STDOUT_FILENO);
+            int null = open("/dev/null", O_WRONLY);
+            dup2(null, STDOUT_FILENO);
+            close(null);
+            double start = now_seconds();
+            if (mode == 0) {
+                run_line_at_a_time(path);
+            } else {
+                options.threads = mode == 1 ? 1 : threads;
+                run_batch(path, &options, &stats);
+            }
+            fflush(stdout);
+            double elapsed = now_seconds() - start;
+            dup2(saved, STDOUT_FILENO);
+            close(saved);
+            if (best[mode] == 0 || elapsed < best[mode]) best[mode] = elapsed;
+            if (mode == 2) best_threads = stats.threads;
+        }
+    }
+
+    char pool[64];
+    snprintf(pool, sizeof(pool), "script, %d threads", best_threads);
+    const char *names[] = { "a line at a time, flushed", "script, 1 thread", pool };
+    for (int mode = 0; mode < 3; mode++) {
+        printf("%-36s %9.1f ms %9.0f commands/s\n", names[mode], best[mode] * 1000, dirs * 6 / best[mode]);
+    }
+    printf("  %llu waits between commands\n", stats.waits);
+
+    unlink(path);
+    unlink("template");
+    rmdir(root);
+    return 0;
+}
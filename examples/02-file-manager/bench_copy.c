@@ -0,0 +1,169 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/stat.h>
+#include "copy.h"
+
+// Copy throughput of the old fread/fwrite loop against each copy method,
+// for a few file sizes. Small files are copied many times so per-file
+// costs show; every size moves at least TARGET_BYTES per run. The files
+// stay in the page cache, so this measures the copy path, not the disk.
+//
+//   ./bench_copy [--dir DIR] [SIZE...]     sizes like 1K, 1M, 10G
+
+#define TARGET_BYTES (256ULL << 20)
+#define MAX_COPIES 4000
+#define REPETITIONS 3
+
+static double now_seconds() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static unsigned long long parse_size(const char *text) {
+    char *end;
+    unsigned long long value = strtoull(text, &end, 10);
+    switch (*end) {
+        case 'K': case 'k': return value << 10;
+        case 'M': case 'm': return value << 20;
+        case 'G': case 'g': return value << 30;
+        default: return value;
+    }
+}
+
+// The copy loop cp used before the copy engine
+static int legacy_copy(const char *src, const char *dest) {
+    FILE *source = fopen(src, "rb");
+    if (source == NULL) return -1;
+    FILE *destination = fopen(dest, "wb");
+    if (destination == NULL) {
+        fclose(source);
+        return -1;
+    }
+    char buffer[4096];
+    size_t bytes_read;
+    while ((bytes_read = fread(buffer, 1, sizeof(buffer), source)) > 0) {
+        fwrite(buffer, 1, bytes_read, destination);
+    }
+    fclose(source);
+    fclose(destination);
+    return 0;
+}
+
+static int engine_copy(const char *src, const char *dest, int method, CopyScratch *scratch) {
+    int in = open(src, O_RDONLY);
+    int out = open(dest, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    struct stat st;
+    int result = -1;
+    if (in >= 0 && out >= 0 && fstat(in, &st) == 0) {
+        CopyMethod used;
+        unsigned long long holes = 0;
+        result = copy_file_data(in, out, st.st_size, method, scratch, &used, &holes);
+    }
+    if (in >= 0) close(in);
+    if (out >= 0) close(out);
+    return result;
+}
+
+static int create_source(const char *path, unsigned long long size) {
+    int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) return -1;
+    char *block = malloc(1 << 20);
+    if (block == NULL) {
+        close(fd);
+        return -1;
+    }
+    unsigned int state = 12345;
+    for (int i = 0; i < (1 << 20); i++) {
+        state = state * 1103515245u + 12345u;
+        block[i] = (char)(state >> 16);
+    }
+    for (unsigned long long done = 0; done < size;) {
+        size_t chunk = size - done < (1 << 20) ? (size_t)(size - done) : (1 << 20);
+        if (write(fd, block, chunk) != (ssize_t)chunk) {
+            free(block);
+            close(fd);
+            return -1;
+        }
+        done += chunk;
+    }
+    free(block);
+    return close(fd);
+}
+
+int main(int argc, char *argv[]) {
+    const char *directory = "/tmp";
+    unsigned long long sizes[16];
+    int size_count = 0;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--dir") == 0 && i + 1 < argc) {
+            directory = argv[++i];
+        } else if (size_count < 16) {
+            sizes[size_count++] = parse_size(argv[i]);
+        }
+    }
+    if (size_count == 0) {
+        sizes[0] = 1ULL << 10;
+        sizes[1] = 1ULL << 20;
+        sizes[2] = 256ULL << 20;
+        size_count = 3;
+    }
+
+    char source[4096], target[4096];
+    snprintf(source, sizeof(source), "%s/bench_copy_source", directory);
+    CopyScratch scratch;
+    init_copy_scratch(&scratch);
+
+    printf("Copy throughput, best of %d runs (page cache, %s)\n", REPETITIONS, directory);
+    printf("%-10s %-16s %8s %12s %12s\n", "Size", "Method", "Copies", "MB/s", "Files/s");
+
+    for (int s = 0; s < size_count; s++) {
+        unsigned long long size = sizes[s];
+        if (create_source(source, size) != 0) {
+            printf("Error: Cannot create %llu byte file in '%s'\n", size, directory);
+            return 1;
+        }
+        unsigned long long copies = size >= TARGET_BYTES ? 1 : TARGET_BYTES / (size ? size : 1);
+        if (copies > MAX_COPIES) copies = MAX_COPIES;
+
+        // -1 is the old loop; COPY_AUTO is what cp does
+        for (int method = -1; method <= COPY_AUTO; method++) {
+            double best = 0;
+            int failed = 0;
+            for (int r = 0; r < REPETITIONS && !failed; r++) {
+                double start = now_seconds();
+                for (unsigned long long c = 0; c < copies && !failed; c++) {
+                    snprintf(target, sizeof(target), "%s/bench_copy_%llu", directory, c);
+                    failed = method < 0 ? legacy_copy(source, target) != 0
+                                        : engine_copy(source, target, method, &scratch) != 0;
+                }
+                double elapsed = now_seconds() - start;
+                if (best == 0 || elapsed < best) best = elapsed;
+                for (unsigned long long c = 0; c < copies; c++) {
+                    snprintf(target, sizeof(target), "%s/bench_copy_%llu", directory, c);
+                    unlink(target);
+                }
+            }
+
+            char size_text[32];
+            snprintf(size_text, sizeof(size_text), "%llu%s", size >= (1ULL << 30) ? size >> 30 :
+                     size >= (1ULL << 20) ? size >> 20 : size >> 10,
+                     size >= (1ULL << 30) ? "G" : size >= (1ULL << 20) ? "M" : "K");
+            const char *name = method < 0 ? "fread/fwrite 4K" : copy_method_name((CopyMethod)method);
+            if (failed) {
+                printf("%-10s %-16s %8s %12s %12s\n", size_text, name, "-", "n/a", "n/a");
+            } else {
+                printf("%-10s %-16s %8llu %12.0f %12.0f\n", size_text, name, copies,
+                       copies * (double)size / best / 1e6, copies / best);
+            }
+        }
+    }
+    unlink(source);
+    free_copy_scratch(&scratch);
+    return 0;
+}
@@ -0,0 +1,158 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <time.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include "dedupe.h"
+
+// dedupe over a scratch tree where some files have a size of their own,
+// some share a size but not their first bytes, some differ only near the
+// end and some are true copies, against what a script piping every file
+// through a checksum does: hash all of every file, one file at a time.
+// Reading every byte once, with nothing else done, is the yardstick.
+//
+//   ./bench_dedupe [--files N] [--size KB] [--dir DIR]
+
+#define REPETITIONS 3
+
+static double now_seconds() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void fill(unsigned char *data, size_t size, unsigned seed) {
+    for (size_t i = 0; i < size; i += 4) {
+        seed = seed * 1103515245u + 12345u;
+        memcpy(data + i, &seed, size - i < 4 ? size - i : 4);
+    }
+}
+
+static int write_file(const char *path, const unsigned char *data, size_t size) {
+    int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0 || write(fd, data, size) != (ssize_t)size) {
+        printf("Error: Cannot create '%s'\n", path);
+        if (fd >= 0) close(fd);
+        return -1;
+    }
+    close(fd);
+    return 0;
+}
+
+// Reads (and with hash, hashes) every file whole, one after another
+static unsigned long long read_everything(const char *root, long files, unsigned char *buffer, int hash) {
+    char path[4200];
+    unsigned long long bytes = 0;
+    for (long f = 0; f < files; f++) {
+        snprintf(path, sizeof(path), "%s/dir%02ld/file%05ld", root, f % 32, f);
+        int fd = open(path, O_RDONLY);
+        if (fd < 0) continue;
+        ContentHash state;
+        init_content_hash(&state);
+        ssize_t got;
+        while ((got = read(fd, buffer, DEDUPE_CHUNK)) > 0) {
+            if (hash) update_content_hash(&state, buffer, (size_t)got);
+            bytes += (unsigned long long)got;
+        }
+        uint64_t result[2];
+        finish_content_hash(&state, result);
+        close(fd);
+    }
+    return bytes;
+}
+
+int main(int argc, char *argv[]) {
+    long files = 1000, size_kb = 400;
+    const char *directory = "/tmp";
+    for (int i = 1; i + 1 < argc; i += 2) {
+        if (strcmp(argv[i], "--files") == 0) {
+            files = atol(argv[i + 1]);
+        } else if (strcmp(argv[i], "--size") == 0) {
+            size_kb = atol(argv[i + 1]);
+        } else if (strcmp(argv[i], "--dir") == 0) {
+            directory = argv[i + 1];
+        }
+    }
+
+    char root[4096], path[4200];
+    snprintf(root, sizeof(root), "%s/bench_dedupe_tree", directory);
+    mkdir(root, 0755);
+    for (int d = 0; d < 32; d++) {
+        snprintf(path, sizeof(path), "%s/dir%02d", root, d);
+        mkdir(path, 0755);
+    }
+    size_t base = (size_t)size_kb * 1024;
+    unsigned char *data = malloc(2 * base + 4096);
+    unsigned char *buffer = malloc(DEDUPE_CHUNK);
+    if (data == NULL || buffer == NULL) {
+        printf("Memory allocation failed!\n");
+        return 1;
+    }
+    fill(data, 2 * base + 4096, 7);
+
+    // In each group of ten: five files of sizes all their own, a pair of
+    // one size starting from different bytes, a pair of another size
+    // differing only in their last byte, and a copy of the first file of
+    // the group before. Files of one size and offset into data are equal.
+    printf("Creating %ld files of about %ld KB...\n", files, size_kb);
+    unsigned long long total = 0;
+    for (long f = 0; f < files; f++) {
+        long group = f / 10, slot = f % 10;
+        long like = slot == 6 || slot == 8 ? f - 1 : slot == 9 && group > 0 ? f - 19 : f;
+        size_t size = base + (size_t)(like / 10) * 10 + (size_t)(like % 10);
+        unsigned char *start = data + like % 4096 + (slot == 6);
+        int flip = slot == 8;
+        snprintf(path, sizeof(path), "%s/dir%02ld/file%05ld", root, f % 32, f);
+        start[size - 1] ^= flip;
+        int failed = write_file(path, start, size);
+        start[size - 1] ^= flip;
+        if (failed) return 1;
+        total += size;
+    }
+    printf("%.0f MB in all\n\n", total / 1048576.0);
+
+    double best_read = 0, best_script = 0, best_dedupe = 0;
+    DedupeStats stats;
+    for (int r = 0; r < REPETITIONS; r++) {
+        double start = now_seconds();
+        read_everything(root, files, buffer, 0);
+        double elapsed = now_seconds() - start;
+        if (best_read == 0 || elapsed < best_read) best_read = elapsed;
+
+        start = now_seconds();
+        read_everything(root, files, buffer, 1);
+        elapsed = now_seconds() - start;
+        if (best_script == 0 || elapsed < best_script) best_script = elapsed;
+
+        DedupeOptions options;
+        init_dedupe_options(&options);
+        find_duplicates(root, &options, NULL, NULL, &stats);
+        if (best_dedupe == 0 || stats.seconds < best_dedupe) best_dedupe = stats.seconds;
+    }
+    printf("%-36s %9.1f ms %8.0f MB/s of tree\n", "read every byte", best_read * 1000,
+           total / 1048576.0 / best_read);
+    printf("%-36s %9.1f ms %8.0f MB/s of tree\n", "hash every file whole", best_script * 1000,
+           total / 1048576.0 / best_script);
+    printf("%-36s %9.1f ms %8.0f MB/s of tree\n", "dedupe", best_dedupe * 1000,
+           total / 1048576.0 / best_dedupe);
+    printf("  %llu sets, %llu duplicates; %llu files, %llu sharing a size, %llu a head;"
+           " %.0f MB read, %d threads\n", stats.sets, stats.duplicates, stats.files, stats.same_size,
+           stats.same_head, stats.bytes_read / 1048576.0, stats.threads);
+
+    for (long f = 0; f < files; f++) {
+        snprintf(path, sizeof(path), "%s/dir%02ld/file%05ld", root, f % 32, f);
+        unlink(path);
+    }
+    for (int d = 0; d < 32; d++) {
+        snprintf(path, sizeof(path), "%s/dir%02d", root, d);
+        rmdir(path);
+    }
+    rmdir(root);
+    free(data);
+    free(buffer);
+    return 0;
+}
@@ -0,0 +1,154 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <time.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include "index.h"
+#include "walker.h"
+
+// find and du over a synthetic tree, answered by walking the disk and by
+// replaying the index, plus what building and refreshing the index cost.
+//
+//   ./bench_index [--dirs N] [--files N] [--dir DIR]
+
+#define REPETITIONS 3
+
+static double now_seconds() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+typedef struct {
+    unsigned long long matches[WALK_MAX_THREADS];
+} FindCount;
+
+static int find_visit(const WalkEntry *entry, void *arg) {
+    FindCount *count = arg;
+    if (strstr(entry->name, "42") != NULL) count->matches[entry->worker]++;
+    return WALK_CONTINUE;
+}
+
+static void du_leave(const WalkEntry *directory, const WalkTotals *totals, void *arg) {
+    if (directory->depth < 0) *(unsigned long long *)arg = totals->bytes;
+}
+
+static void report(const char *name, double seconds) {
+    printf("%-28s %10.2f ms\n", name, seconds * 1000);
+}
+
+// Best of REPETITIONS of find (du = 0) or du (du = 1), walked or replayed
+static double run_query(const char *root, const Index *index, int du) {
+    double best = 0;
+    for (int r = 0; r < REPETITIONS; r++) {
+        FindCount count;
+        unsigned long long bytes = 0;
+        memset(&count, 0, sizeof(count));
+        WalkOptions options;
+        init_walk_options(&options);
+        if (du) {
+            options.flags = WALK_STAT;
+            options.leave = du_leave;
+            options.arg = &bytes;
+        } else {
+            options.visit = find_visit;
+            options.arg = &count;
+        }
+        double start = now_seconds();
+        if (index != NULL) {
+            index_walk(index, "", root, &options, NULL);
+        } else {
+            walk_tree(root, &options, NULL);
+        }
+        double elapsed = now_seconds() - start;
+        if (best == 0 || elapsed < best) best = elapsed;
+    }
+    return best;
+}
+
+int main(int argc, char *argv[]) {
+    long dirs = 2000, files = 100;
+    const char *directory = "/tmp";
+    for (int i = 1; i + 1 < argc; i += 2) {
+        if (strcmp(argv[i], "--dirs") == 0) {
+            dirs = atol(argv[i + 1]);
+        } else if (strcmp(argv[i], "--files") == 0) {
+            files = atol(argv[i + 1]);
+        } else if (strcmp(argv[i], "--dir") == 0) {
+            directory = argv[i + 1];
+        }
+    }
+
+    char root[4096], path[4200];
+    snprintf(root, sizeof(root), "%s/bench_index_tree", directory);
+    mkdir(root, 0755);
+    printf("Creating %ld directories of %ld files...\n", dirs, files);
+    for (long d = 0; d < dirs; d++) {
+        // Two levels, so there is some depth to walk
+        snprintf(path, sizeof(path), "%s/group%03ld", root, d / 50);
+        mkdir(path, 0755);
+        snprintf(path, sizeof(path), "%s/group%03ld/dir%05ld", root, d / 50, d);
+        mkdir(path, 0755);
+        for (long f = 0; f < files; f++) {
+            snprintf(path, sizeof(path), "%s/group%03ld/dir%05ld/file%04ld.dat", root, d / 50, d, f);
+            int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+            if (fd < 0) {
+                printf("Error: Cannot create '%s'\n", path);
+                return 1;
+            }
+            if (f % 3 == 0) ftruncate(fd, f * 100);
+            close(fd);
+        }
+    }
+
+    IndexStats stats;
+    if (build_index(root, &stats) != 0) return 1;
+    printf("%llu entries, %llu byte index\n\n", stats.entries, stats.file_size);
+    report("index build", stats.seconds);
+
+    Index index;
+    if (open_index(root, &index) != 0) {
+        printf("Error: Cannot open the index\n");
+        return 1;
+    }
+    report("find, walking", run_query(root, NULL, 0));
+    report("find, from the index", run_query(root, &index, 0));
+    report("du, walking", run_query(root, NULL, 1));
+    report("du, from the index", run_query(root, &index, 1));
+    close_index(&index);
+
+    refresh_index(root, &stats);
+    report("refresh, nothing changed", stats.seconds);
+    printf("  %llu of %llu directories read, %llu stat calls\n", stats.rescanned, stats.directories,
+           stats.stat_calls);
+    snprintf(path, sizeof(path), "%s/group000/dir00001/added", root);
+    close(open(path, O_WRONLY | O_CREAT, 0644));
+    refresh_index(root, &stats);
+    report("refresh, one file added", stats.seconds);
+    printf("  %llu of %llu directories read, %llu stat calls\n", stats.rescanned, stats.directories,
+           stats.stat_calls);
+    build_index(root, &stats);
+    report("rebuild for comparison", stats.seconds);
+
+    unlink(path);
+    snprintf(path, sizeof(path), "%s/%s", root, INDEX_FILE);
+    unlink(path);
+    for (long d = 0; d < dirs; d++) {
+        for (long f = 0; f < files; f++) {
+            snprintf(path, sizeof(path), "%s/group%03ld/dir%05ld/file%04ld.dat", root, d / 50, d, f);
+            unlink(path);
+        }
+        snprintf(path, sizeof(path), "%s/group%03ld/dir%05ld", root, d / 50, d);
+        rmdir(path);
+        if (d % 50 == 49 || d == dirs - 1) {
+            snprintf(path, sizeof(path), "%s/group%03ld", root, d / 50);
+            rmdir(path);
+        }
+    }
+    rmdir(root);
+    return 0;
+}
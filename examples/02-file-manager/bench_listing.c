@@ -0,0 +1,195 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <time.h>
+#include <dirent.h>
+#include <pwd.h>
+#include <sys/stat.h>
+#include "listing.h"
+
+// ls over one huge synthetic directory, output sent to /dev/null: the
+// readdir, stat, getpwuid, localtime and printf loop ls used to run, then
+// list_directory with plain stat calls, with io_uring, and sorted. Stat
+// calls dominate those totals, so the row formatting alone is compared as
+// well: the printf loop over metadata gathered beforehand, against the
+// time list_directory reports for its own formatting.
+//
+//   ./bench_listing [--files N] [--dir DIR]
+
+#define REPETITIONS 3
+
+static double now_seconds() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void legacy_row(const struct stat *st, const char *name) {
+    char permissions[16], time_str[32];
+    struct passwd *pwd = getpwuid(st->st_uid);
+    snprintf(permissions, sizeof(permissions), "%c%c%c%c%c%c%c%c%c%c",
+             S_ISDIR(st->st_mode) ? 'd' : '-',
+             st->st_mode & S_IRUSR ? 'r' : '-', st->st_mode & S_IWUSR ? 'w' : '-',
+             st->st_mode & S_IXUSR ? 'x' : '-', st->st_mode & S_IRGRP ? 'r' : '-',
+             st->st_mode & S_IWGRP ? 'w' : '-', st->st_mode & S_IXGRP ? 'x' : '-',
+             st->st_mode & S_IROTH ? 'r' : '-', st->st_mode & S_IWOTH ? 'w' : '-',
+             st->st_mode & S_IXOTH ? 'x' : '-');
+    struct tm *tm_info = localtime(&st->st_mtime);
+    strftime(time_str, sizeof(time_str), "%Y-%m-%d %H:%M:%S", tm_info);
+    printf("%-15s %-10ld %-15s %-20s %s\n", permissions, (long)st->st_size,
+           pwd ? pwd->pw_name : "unknown", time_str, name);
+}
+
+static void legacy_list(const char *path) {
+    DIR *dir = opendir(path);
+    if (dir == NULL) return;
+    char full[4400];
+    struct dirent *entry;
+    printf("\nContents of %s:\n", path);
+    while ((entry = readdir(dir)) != NULL) {
+        if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) continue;
+        snprintf(full, sizeof(full), "%s/%s", path, entry->d_name);
+        struct stat st;
+        if (stat(full, &st) != 0) continue;
+        legacy_row(&st, entry->d_name);
+    }
+    closedir(dir);
+}
+
+static int silence_stdout(const char *target) {
+    fflush(stdout);
+    int saved = dup(STDOUT_FILENO);
+    int fd = open(target, O_WRONLY | O_TRUNC);
+    dup2(fd, STDOUT_FILENO);
+    close(fd);
+    return saved;
+}
+
+static void restore_stdout(int saved) {
+    fflush(stdout);
+    dup2(saved, STDOUT_FILENO);
+    close(saved);
+}
+
+static void bench_formatting(const char *root, long files) {
+    struct stat *stats = malloc(files * sizeof(struct stat));
+    char (*names)[32] = malloc(files * sizeof(*names));
+    if (stats == NULL || names == NULL) {
+        printf("Memory allocation failed!\n");
+        free(stats);
+        free(names);
+        return;
+    }
+    char path[4200];
+    for (long i = 0; i < files; i++) {
+        snprintf(names[i], sizeof(names[i]), "entry_%07ld.dat", i);
+        snprintf(path, sizeof(path), "%s/%s", root, names[i]);
+        stat(path, &stats[i]);
+    }
+
+    double legacy = 0, batched = 0;
+    char output_path[] = "/dev/shm/bench_listing_out_XXXXXX";
+    close(mkstemp(output_path));
+    for (int r = 0; r < REPETITIONS; r++) {
+        int saved = silence_stdout("/dev/null");
+        double start = now_seconds();
+        for (long i = 0; i < files; i++) legacy_row(&stats[i], names[i]);
+        fflush(stdout);
+        double elapsed = now_seconds() - start;
+        restore_stdout(saved);
+        if (legacy == 0 || elapsed < legacy) legacy = elapsed;
+
+        // list_directory times its own formatting with --stats
+        saved = silence_stdout(output_path);
+        ListOptions options;
+        init_list_options(&options);
+        options.show_stats = 1;
+        list_directory(root, &options);
+        restore_stdout(saved);
+        FILE *file = fopen(output_path, "r");
+        char line[512];
+        double ms;
+        while (file != NULL && fgets(line, sizeof(line), file) != NULL) {
+            if (sscanf(line, "%*u rows formatted in %lf ms", &ms) == 1 &&
+                (batched == 0 || ms / 1000 < batched)) {
+                batched = ms / 1000;
+            }
+        }
+        if (file != NULL) fclose(file);
+    }
+    unlink(output_path);
+    printf("%-26s %10.1f ms %12.0f lines/s\n", "formatting, printf", legacy * 1000, files / legacy);
+    if (batched > 0) {
+        printf("%-26s %10.1f ms %12.0f lines/s\n", "formatting, list_directory", batched * 1000, files / batched);
+    }
+    free(stats);
+    free(names);
+}
+
+int main(int argc, char *argv[]) {
+    long files = 200000;
+    const char *directory = "/tmp";
+    for (int i = 1; i + 1 < argc; i += 2) {
+        if (strcmp(argv[i], "--files") == 0) {
+            files = atol(argv[i + 1]);
+        } else if (strcmp(argv[i], "--dir") == 0) {
+            directory = argv[i + 1];
+        }
+    }
+
+    char root[4096], path[4200];
+    snprintf(root, sizeof(root), "%s/bench_listing_dir", directory);
+    mkdir(root, 0755);
+    printf("Creating %ld files...\n", files);
+    time_t now = time(NULL);
+    for (long i = 0; i < files; i++) {
+        snprintf(path, sizeof(path), "%s/entry_%07ld.dat", root, i);
+        int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (fd < 0) {
+            printf("Error: Cannot create '%s'\n", path);
+            return 1;
+        }
+        if (i % 7 != 0) ftruncate(fd, i % 100000);
+        // Spread over a few months, so most rows fall on a day seen before
+        struct timespec times[2] = { { now - (i * 613) % (86400 * 90), 0 },
+                                     { now - (i * 613) % (86400 * 90), 0 } };
+        futimens(fd, times);
+        close(fd);
+    }
+
+    static const char *names[] = { "printf loop (legacy)", "list_directory, stat", "list_directory, io_uring",
+                                   "list_directory, by size", "list_directory, by mtime" };
+    printf("Listing %ld entries to /dev/null, best of %d\n", files, REPETITIONS);
+    for (int variant = 0; variant < 5; variant++) {
+        double best = 0;
+        for (int r = 0; r < REPETITIONS; r++) {
+            int saved = silence_stdout("/dev/null");
+            double start = now_seconds();
+            if (variant == 0) {
+                legacy_list(root);
+            } else {
+                ListOptions options;
+                init_list_options(&options);
+                options.sync = variant == 1;
+                options.sort = variant == 3 ? SORT_SIZE : variant == 4 ? SORT_MTIME : SORT_NONE;
+                list_directory(root, &options);
+            }
+            fflush(stdout);
+            double elapsed = now_seconds() - start;
+            restore_stdout(saved);
+            if (best == 0 || elapsed < best) best = elapsed;
+        }
+        printf("%-26s %10.1f ms %12.0f lines/s\n", names[variant], best * 1000, files / best);
+    }
+    bench_formatting(root, files);
+
+    for (long i = 0; i < files; i++) {
+        snprintf(path, sizeof(path), "%s/entry_%07ld.dat", root, i);
+        unlink(path);
+    }
+    rmdir(root);
+    return 0;
+}
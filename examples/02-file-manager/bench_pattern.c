@@ -0,0 +1,173 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <fnmatch.h>
+#include <regex.h>
+#include "pattern.h"
+
+// Names matched per second over a million-entry tree held in memory: the
+// strstr loop find runs for a plain pattern against the same search as a
+// DFA, then globs and regexes as DFAs next to fnmatch and regexec, and a
+// path glob that prunes the walk against one that looks at every entry.
+//
+//   ./bench_pattern [--groups N] [--dirs N] [--files N]
+
+#define REPETITIONS 3
+
+static double now_seconds() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+typedef struct {
+    char (*names)[32];          // file names, files per directory
+    char (*directories)[32];    // "groupNN/dirNNNN", one per directory
+    long groups;
+    long dirs;                  // per group
+    long files;                 // per directory
+} Tree;
+
+static const char *extensions[] = { "log", "txt", "dat", "c", "h", "json", "png" };
+
+static void make_tree(Tree *tree) {
+    long directories = tree->groups * tree->dirs;
+    tree->names = malloc((size_t)directories * tree->files * sizeof(*tree->names));
+    tree->directories = malloc((size_t)directories * sizeof(*tree->directories));
+    unsigned state = 1;
+    for (long d = 0; d < directories; d++) {
+        snprintf(tree->directories[d], sizeof(tree->directories[d]), "group%02ld/dir%04ld",
+                 (d / tree->dirs) % 100, d % 10000);
+        for (long f = 0; f < tree->files; f++) {
+            state = state * 1103515245u + 12345u;
+            snprintf(tree->names[d * tree->files + f], sizeof(tree->names[0]), "file%05u.%s",
+                     (state >> 8) % 100000, extensions[(state >> 20) % 7]);
+        }
+    }
+}
+
+typedef enum { MATCH_STRSTR, MATCH_PATTERN, MATCH_FNMATCH, MATCH_REGEXEC } Matcher;
+
+typedef struct {
+    Matcher matcher;
+    const char *text;
+    const Pattern *pattern;
+    const regex_t *regex;
+} Query;
+
+// Every name in the tree, or with prune only the directories the pattern
+// can match below; returns matches and counts the names examined
+static unsigned long long run_query(const Tree *tree, const Query *query, int prune,
+                                    unsigned long long *examined) {
+    unsigned long long matches = 0;
+    char path[64];
+    *examined = 0;
+    for (long d = 0; d < tree->groups * tree->dirs; d++) {
+        if (prune && !pattern_may_match_below(query->pattern, tree->directories[d])) continue;
+        // As find sees it: the directory's path, then each name after it
+        size_t length = strlen(tree->directories[d]);
+        memcpy(path, tree->directories[d], length);
+        path[length] = '/';
+        for (long f = 0; f < tree->files; f++) {
+            const char *name = tree->names[d * tree->files + f];
+            int matched;
+            switch (query->matcher) {
+            case MATCH_STRSTR:
+                matched = strstr(name, query->text) != NULL;
+                break;
+            case MATCH_FNMATCH:
+                matched = fnmatch(query->text, name, 0) == 0;
+                break;
+            case MATCH_REGEXEC:
+                matched = regexec(query->regex, name, 0, NULL, 0) == 0;
+                break;
+            default:
+                if (query->pattern->match_path) {
+                    strcpy(path + length + 1, name);
+                    name = path;
+                }
+                matched = pattern_matches(query->pattern, name);
+                break;
+            }
+            matches += matched;
+        }
+        *examined += tree->files;
+    }
+    return matches;
+}
+
+static void report(const char *name, const Tree *tree, const Query *query, int prune) {
+    double best = 0;
+    unsigned long long matches = 0, examined = 0;
+    for (int r = 0; r < REPETITIONS; r++) {
+        double start = now_seconds();
+        matches = run_query(tree, query, prune, &examined);
+        double elapsed = now_seconds() - start;
+        if (best == 0 || elapsed < best) best = elapsed;
+    }
+    double names = (double)tree->groups * tree->dirs * tree->files;
+    printf("%-40s %8llu matches %9llu examined %8.2f ms %8.1f M names/s\n", name, matches, examined,
+           best * 1000, names / best / 1e6);
+}
+
+// baseline runs baseline_text, which asks what text does
+static void compare(const Tree *tree, const char *text, PatternKind kind, Matcher baseline,
+                    const char *baseline_text) {
+    Pattern pattern;
+    if (compile_pattern(&pattern, text, kind) != 0) return;
+    regex_t regex;
+    Query query = { MATCH_PATTERN, text, &pattern, &regex };
+    char name[64];
+    snprintf(name, sizeof(name), "%s, DFA (%d states)", text, pattern.states);
+    report(name, tree, &query, 0);
+    query.matcher = baseline;
+    query.text = baseline_text;
+    if (baseline == MATCH_REGEXEC) {
+        regcomp(&regex, text, REG_EXTENDED | REG_NOSUB);
+    }
+    snprintf(name, sizeof(name), "%s, %s", baseline_text, baseline == MATCH_STRSTR ? "strstr" :
+             baseline == MATCH_FNMATCH ? "fnmatch" : "regexec");
+    report(name, tree, &query, 0);
+    if (baseline == MATCH_REGEXEC) {
+        regfree(&regex);
+    }
+    free_pattern(&pattern);
+}
+
+int main(int argc, char *argv[]) {
+    Tree tree = { NULL, NULL, 20, 50, 1000 };
+    for (int i = 1; i + 1 < argc; i += 2) {
+        if (strcmp(argv[i], "--groups") == 0) {
+            tree.groups = atol(argv[i + 1]);
+        } else if (strcmp(argv[i], "--dirs") == 0) {
+            tree.dirs = atol(argv[i + 1]);
+        } else if (strcmp(argv[i], "--files") == 0) {
+            tree.files = atol(argv[i + 1]);
+        }
+    }
+    make_tree(&tree);
+    printf("%ld directories of %ld names, best of %d\n\n", tree.groups * tree.dirs, tree.files, REPETITIONS);
+
+    compare(&tree, "*42*", PATTERN_GLOB, MATCH_STRSTR, "42");
+    compare(&tree, "*file0*", PATTERN_GLOB, MATCH_STRSTR, "file0");
+    compare(&tree, "*.log", PATTERN_GLOB, MATCH_FNMATCH, "*.log");
+    compare(&tree, "file[0-4]*7.[ch]", PATTERN_GLOB, MATCH_FNMATCH, "file[0-4]*7.[ch]");
+    compare(&tree, "^file0[0-9]{3}1\\.(log|txt)$", PATTERN_REGEX, MATCH_REGEXEC, "^file0[0-9]{3}1\\.(log|txt)$");
+    compare(&tree, "(json|png)$", PATTERN_REGEX, MATCH_REGEXEC, "(json|png)$");
+
+    printf("\n");
+    Pattern pattern;
+    const char *text = "group03/*/file1*.log";
+    if (compile_pattern(&pattern, text, PATTERN_GLOB) == 0) {
+        Query query = { MATCH_PATTERN, text, &pattern, NULL };
+        report("group03/*/file1*.log, every entry", &tree, &query, 0);
+        report("group03/*/file1*.log, pruned", &tree, &query, 1);
+        free_pattern(&pattern);
+    }
+
+    free(tree.names);
+    free(tree.directories);
+    return 0;
+}
@@ -0,0 +1,160 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/stat.h>
+#include "search.h"
+
+// Search throughput over text held in memory: strstr line by line, glibc
+// memmem and the matcher's vector loops, for a pattern that never occurs
+// so every byte is examined. Then grep over a scratch tree, one thread
+// against all of them.
+//
+//   ./bench_search [--size MB] [--dir DIR]
+
+#define REPETITIONS 3
+#define TREE_FILES 64
+#define TREE_FILE_SIZE (4 << 20)
+
+static const char *pattern = "connection refused by peer";
+
+static double now_seconds() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void fill_log(char *text, size_t size) {
+    static const char *words[] = { "GET", "/index.html", "200", "user", "session", "timeout", "worker",
+                                   "INFO", "DEBUG", "request", "completed", "in", "ms", "cache", "hit" };
+    unsigned int state = 1;
+    size_t length = 0;
+    while (length < size) {
+        state = state * 1103515245u + 12345u;
+        const char *word = words[(state >> 16) % 15];
+        size_t word_length = strlen(word);
+        if (length + word_length + 1 > size) break;
+        memcpy(text + length, word, word_length);
+        length += word_length;
+        text[length++] = (state >> 8) % 9 == 0 ? '\n' : ' ';
+    }
+    memset(text + length, '\n', size - length);
+    text[size - 1] = '\0';
+}
+
+static size_t strstr_lines(const char *text, size_t size) {
+    // What a fgets/strstr loop does, minus the reading
+    size_t found = 0;
+    char line[1024];
+    const char *end = text + size - 1;
+    while (text < end) {
+        const char *newline = memchr(text, '\n', (size_t)(end - text));
+        size_t length = newline != NULL ? (size_t)(newline - text) : (size_t)(end - text);
+        if (length >= sizeof(line)) length = sizeof(line) - 1;
+        memcpy(line, text, length);
+        line[length] = '\0';
+        if (strstr(line, pattern) != NULL) found++;
+        text = newline != NULL ? newline + 1 : end;
+    }
+    return found;
+}
+
+static void report(const char *name, double seconds, size_t size) {
+    printf("%-24s %10.1f ms %10.2f GB/s\n", name, seconds * 1000, size / seconds / 1e9);
+}
+
+static void bench_memory(size_t size) {
+    char *text = malloc(size);
+    if (text == NULL) {
+        printf("Memory allocation failed!\n");
+        return;
+    }
+    fill_log(text, size);
+    Matcher matcher;
+    init_matcher(&matcher, pattern);
+    int has_avx2 = matcher.use_avx2;
+    volatile size_t sink = 0;
+
+    for (int variant = 0; variant < 4; variant++) {
+        if (variant == 3 && !has_avx2) continue;
+        double best = 0;
+        for (int r = 0; r < REPETITIONS; r++) {
+            double start = now_seconds();
+            switch (variant) {
+                case 0: sink += strstr_lines(text, size); break;
+                case 1: sink += memmem(text, size, pattern, strlen(pattern)) != NULL; break;
+                case 2:
+                    matcher.use_avx2 = 0;
+                    sink += find_match(&matcher, text, size) != NULL;
+                    break;
+                default:
+                    matcher.use_avx2 = 1;
+                    sink += find_match(&matcher, text, size) != NULL;
+                    break;
+            }
+            double elapsed = now_seconds() - start;
+            if (best == 0 || elapsed < best) best = elapsed;
+        }
+        static const char *names[] = { "strstr per line", "memmem", "matcher (SSE2)", "matcher (AVX2)" };
+        report(names[variant], best, size);
+    }
+    (void)sink;
+    free(text);
+}
+
+static void bench_tree(const char *directory) {
+    char root[4096], path[4200];
+    snprintf(root, sizeof(root), "%s/bench_search_tree", directory);
+    mkdir(root, 0755);
+    char *text = malloc(TREE_FILE_SIZE);
+    fill_log(text, TREE_FILE_SIZE);
+    text[TREE_FILE_SIZE - 1] = '\n';
+    for (int i = 0; i < TREE_FILES; i++) {
+        snprintf(path, sizeof(path), "%s/file%02d.log", root, i);
+        FILE *file = fopen(path, "wb");
+        fwrite(text, 1, TREE_FILE_SIZE, file);
+        fclose(file);
+    }
+    free(text);
+
+    int thread_counts[] = { 1, 0 };
+    for (int t = 0; t < 2; t++) {
+        GrepOptions options;
+        init_grep_options(&options);
+        options.threads = thread_counts[t];
+        double best = 0;
+        for (int r = 0; r < REPETITIONS; r++) {
+            GrepStats stats;
+            grep_path(pattern, root, &options, &stats);
+            if (best == 0 || stats.seconds < best) best = stats.seconds;
+        }
+        report(t == 0 ? "grep tree, 1 thread" : "grep tree, all threads", best,
+               (size_t)TREE_FILES * TREE_FILE_SIZE);
+    }
+
+    for (int i = 0; i < TREE_FILES; i++) {
+        snprintf(path, sizeof(path), "%s/file%02d.log", root, i);
+        unlink(path);
+    }
+    rmdir(root);
+}
+
+int main(int argc, char *argv[]) {
+    size_t size = 256 << 20;
+    const char *directory = "/tmp";
+    for (int i = 1; i + 1 < argc; i += 2) {
+        if (strcmp(argv[i], "--size") == 0) {
+            size = (size_t)atol(argv[i + 1]) << 20;
+        } else if (strcmp(argv[i], "--dir") == 0) {
+            directory = argv[i + 1];
+        }
+    }
+
+    printf("Searching %zu MB for a pattern that does not occur, best of %d\n", size >> 20, REPETITIONS);
+    bench_memory(size);
+    bench_tree(directory);
+    return 0;
+}
@@ -0,0 +1,155 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/stat.h>
+#include "uring.h"
+#include "copy.h"
+
+// System calls and wall time of the synchronous paths against io_uring:
+// the metadata ls needs for a directory, and a file copied with reads and
+// writes. On a local disk everything is in the page cache and the two
+// come out close; point --dir at a network mount to see the latency the
+// batching hides.
+//
+//   ./bench_uring [--dir DIR] [--files N] [--size BYTES]
+
+#define REPETITIONS 5
+#define METADATA_BATCH 256
+
+static double now_seconds() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void report(const char *what, unsigned long long sync_calls, double sync_time,
+                   unsigned long long ring_calls, double ring_time) {
+    printf("%-22s %10llu %10.2f %10llu %10.2f %10lld %9.2f\n", what, sync_calls, sync_time * 1000,
+           ring_calls, ring_time * 1000, (long long)sync_calls - (long long)ring_calls,
+           (sync_time - ring_time) * 1000);
+}
+
+static void bench_metadata(const char *directory, int files) {
+    char path[4096];
+    snprintf(path, sizeof(path), "%s/bench_uring_dir", directory);
+    mkdir(path, 0755);
+    int dir_fd = open(path, O_RDONLY | O_DIRECTORY);
+    char **names = malloc(files * sizeof(char *));
+    for (int i = 0; i < files; i++) {
+        names[i] = malloc(32);
+        snprintf(names[i], 32, "file%06d", i);
+        close(openat(dir_fd, names[i], O_WRONLY | O_CREAT, 0644));
+    }
+    struct stat *results = malloc(files * sizeof(struct stat));
+    int *errors = malloc(files * sizeof(int));
+
+    double sync_best = 0, ring_best = 0;
+    long ring_calls = 0;
+    Uring *ring = create_uring(METADATA_BATCH);
+    for (int r = 0; r < REPETITIONS; r++) {
+        double start = now_seconds();
+        for (int i = 0; i < files; i++) fstatat(dir_fd, names[i], &results[i], 0);
+        double elapsed = now_seconds() - start;
+        if (sync_best == 0 || elapsed < sync_best) sync_best = elapsed;
+
+        start = now_seconds();
+        ring_calls = uring_stat_names(ring, dir_fd, names, files, results, errors);
+        elapsed = now_seconds() - start;
+        if (ring_best == 0 || elapsed < ring_best) ring_best = elapsed;
+    }
+    free_uring(ring);
+
+    char label[64];
+    snprintf(label, sizeof(label), "ls %d entries", files);
+    report(label, (unsigned long long)files, sync_best, (unsigned long long)ring_calls, ring_best);
+
+    for (int i = 0; i < files; i++) {
+        unlinkat(dir_fd, names[i], 0);
+        free(names[i]);
+    }
+    free(names);
+    free(results);
+    free(errors);
+    close(dir_fd);
+    rmdir(path);
+}
+
+static void bench_copy(const char *directory, unsigned long long size) {
+    char source[4096], target[4096];
+    snprintf(source, sizeof(source), "%s/bench_uring_source", directory);
+    snprintf(target, sizeof(target), "%s/bench_uring_target", directory);
+    int fd = open(source, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    char *block = malloc(1 << 20);
+    memset(block, 'u', 1 << 20);
+    for (unsigned long long done = 0; done < size; done += 1 << 20) {
+        size_t chunk = size - done < (1 << 20) ? (size_t)(size - done) : (1 << 20);
+        if (write(fd, block, chunk) != (ssize_t)chunk) break;
+    }
+    close(fd);
+    free(block);
+
+    CopyMethod methods[] = { COPY_BUFFER, COPY_URING };
+    double best[2] = { 0, 0 };
+    unsigned long long calls[2] = { 0, 0 };
+    for (int m = 0; m < 2; m++) {
+        for (int r = 0; r < REPETITIONS; r++) {
+            CopyScratch scratch;
+            init_copy_scratch(&scratch);
+            int in = open(source, O_RDONLY);
+            int out = open(target, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+            CopyMethod used;
+            unsigned long long holes = 0;
+            double start = now_seconds();
+            int result = copy_file_data(in, out, (off_t)size, methods[m], &scratch, &used, &holes);
+            double elapsed = now_seconds() - start;
+            close(in);
+            close(out);
+            free_copy_scratch(&scratch);
+            if (result != 0) {
+                printf("Error: %s copy failed: %s\n", copy_method_name(methods[m]), strerror(errno));
+                goto done;
+            }
+            if (best[m] == 0 || elapsed < best[m]) best[m] = elapsed;
+            calls[m] = scratch.syscalls;
+        }
+    }
+    char label[64];
+    snprintf(label, sizeof(label), "cp %lluM", size >> 20);
+    report(label, calls[0], best[0], calls[1], best[1]);
+
+done:
+    unlink(source);
+    unlink(target);
+}
+
+int main(int argc, char *argv[]) {
+    const char *directory = "/tmp";
+    int files = 5000;
+    unsigned long long size = 256ULL << 20;
+    for (int i = 1; i + 1 < argc; i += 2) {
+        if (strcmp(argv[i], "--dir") == 0) {
+            directory = argv[i + 1];
+        } else if (strcmp(argv[i], "--files") == 0) {
+            files = atoi(argv[i + 1]);
+        } else if (strcmp(argv[i], "--size") == 0) {
+            size = strtoull(argv[i + 1], NULL, 10);
+        }
+    }
+    if (!uring_supported()) {
+        printf("io_uring is not available on this system\n");
+        return 0;
+    }
+
+    printf("Synchronous calls against io_uring, best of %d runs (%s)\n", REPETITIONS, directory);
+    printf("%-22s %10s %10s %10s %10s %10s %9s\n", "", "sync calls", "sync ms", "ring calls",
+           "ring ms", "calls saved", "ms saved");
+    bench_metadata(directory, files > 0 ? files : 1);
+    bench_copy(directory, size);
+    return 0;
+}
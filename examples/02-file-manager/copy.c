@@ -0,0 +1,600 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <unistd.h>
+#include <time.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <sys/ioctl.h>
+#include <sys/sendfile.h>
+#include <linux/fs.h>
+#include "copy.h"
+#include "walker.h"
+
+#ifndef FICLONE
+#define FICLONE _IOW(0x94, 9, int)
+#endif
+
+#define PIPE_SIZE (1 << 20)             // asked for; the kernel may give less
+#define MAX_TRANSFER 0x7ffff000         // most any of the calls moves at once
+#define URING_SLOTS 8                   // reads or writes in flight per file
+#define URING_SLOT_SIZE (512 * 1024)
+
+void init_copy_options(CopyOptions *options) {
+    options->threads = 0;
+    options->method = COPY_AUTO;
+    options->output = stdout;
+}
+
+const char* copy_method_name(CopyMethod method) {
+    static const char *names[] = { "reflink", "copy_file_range", "io_uring", "sendfile", "splice", "buffer" };
+    return method < COPY_METHODS ? names[method] : "auto";
+}
+
+void init_copy_scratch(CopyScratch *scratch) {
+    memset(scratch, 0, sizeof(*scratch));
+}
+
+void free_copy_scratch(CopyScratch *scratch) {
+    // The ring goes first: closing it ends any request still using the buffer
+    free_uring(scratch->ring);
+    free(scratch->ring_buffer);
+    free(scratch->buffer);
+    scratch->ring = NULL;
+    scratch->ring_buffer = NULL;
+    scratch->buffer = NULL;
+}
+
+static double now_seconds() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Errors that mean a method cannot be used for this pair of files, rather
+// than that the copy failed
+static int unsupported(int error) {
+    return error == ENOSYS || error == EOPNOTSUPP || error == EXDEV || error == EINVAL ||
+           error == ENOTTY || error == EBADF;
+}
+
+static ssize_t write_all(int out, const char *data, size_t length, off_t offset,
+                         unsigned long long *syscalls) {
+    size_t done = 0;
+    while (done < length) {
+        ssize_t written = pwrite(out, data + done, length - done, offset + (off_t)done);
+        (*syscalls)++;
+        if (written < 0) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        done += (size_t)written;
+    }
+    return (ssize_t)done;
+}
+
+static int get_buffer(CopyScratch *scratch) {
+    if (scratch->buffer == NULL) {
+        long page = sysconf(_SC_PAGESIZE);
+        if (posix_memalign(&scratch->buffer, page > 0 ? (size_t)page : 4096, COPY_BUFFER_SIZE) != 0) {
+            scratch->buffer = NULL;
+            errno = ENOMEM;
+            return -1;
+        }
+    }
+    return 0;
+}
+
+typedef struct {
+    off_t start;
+    size_t length;
+    size_t done;                // bytes read, or written once writing
+    int writing;
+} UringSlot;
+
+static void queue_slot(Uring *ring, UringSlot *slot, int slot_index, int in, int out, char *buffer) {
+    struct io_uring_sqe *sqe = uring_get_sqe(ring);
+    sqe->opcode = slot->writing ? IORING_OP_WRITE : IORING_OP_READ;
+    sqe->fd = slot->writing ? out : in;
+    sqe->addr = (unsigned long)(buffer + (size_t)slot_index * URING_SLOT_SIZE + slot->done);
+    sqe->len = (unsigned)(slot->length - slot->done);
+    sqe->off = (unsigned long long)(slot->start + (off_t)slot->done);
+    sqe->user_data = (unsigned long long)slot_index;
+}
+
+// Copies through a buffer split into URING_SLOTS pieces, each
+// reading its chunk and then writing it while the others do the same, so
+// up to URING_SLOTS requests are waiting on the filesystem at any time.
+// Returns the bytes moved, fewer if the source ended early, or -1.
+static ssize_t uring_range(int in, int out, off_t offset, size_t length, CopyScratch *scratch) {
+    if (scratch->ring == NULL) {
+        if (scratch->ring_failed || !uring_supported() ||
+            (scratch->ring = create_uring(2 * URING_SLOTS)) == NULL) {
+            scratch->ring_failed = 1;
+            errno = ENOSYS;
+            return -1;
+        }
+    }
+    if (scratch->ring_buffer == NULL) {
+        long page = sysconf(_SC_PAGESIZE);
+        if (posix_memalign(&scratch->ring_buffer, page > 0 ? (size_t)page : 4096,
+                           URING_SLOTS * URING_SLOT_SIZE) != 0) {
+            scratch->ring_buffer = NULL;
+            errno = ENOMEM;
+            return -1;
+        }
+    }
+    Uring *ring = scratch->ring;
+    char *buffer = scratch->ring_buffer;
+
+    UringSlot slots[URING_SLOTS];
+    off_t next = offset, end = offset + (off_t)length;
+    int active = 0, error = 0;
+    for (int i = 0; i < URING_SLOTS && next < end; i++) {
+        slots[i].start = next;
+        slots[i].length = end - next < URING_SLOT_SIZE ? (size_t)(end - next) : URING_SLOT_SIZE;
+        slots[i].done = 0;
+        slots[i].writing = 0;
+        next += (off_t)slots[i].length;
+        queue_slot(ring, &slots[i], i, in, out, buffer);
+        active++;
+    }
+
+    unsigned long long calls = uring_enter_calls(ring);
+    while (active > 0) {
+        // Waiting for half the slots halves the calls, and the other half
+        // keeps the filesystem busy meanwhile
+        if (uring_submit(ring, (unsigned)(active + 1) / 2) < 0) {
+            // Requests may still be running on the buffer; give it up
+            scratch->ring_buffer = NULL;
+            free_uring(ring);
+            scratch->ring = NULL;
+            scratch->ring_failed = 1;
+            return -1;
+        }
+        struct io_uring_cqe *cqe;
+        while ((cqe = uring_peek(ring)) != NULL) {
+            int i = (int)cqe->user_data;
+            int res = cqe->res;
+            uring_seen(ring);
+            UringSlot *slot = &slots[i];
+
+            if (res == -EINTR || res == -EAGAIN) {
+                if (!error) {
+                    queue_slot(ring, slot, i, in, out, buffer);
+                    continue;
+                }
+                res = 0;
+            }
+            if (res < 0 || error) {
+                if (res < 0 && !error) error = -res;
+                active--;
+                continue;
+            }
+            if (!slot->writing && res == 0) {
+                // The source ended inside this chunk
+                slot->length = slot->done;
+                if (end > slot->start + (off_t)slot->length) end = slot->start + (off_t)slot->length;
+                next = end;
+                slot->done = 0;
+                slot->writing = 1;
+                if (slot->length == 0) {
+                    active--;
+                    continue;
+                }
+            } else {
+                slot->done += (size_t)res;
+                if (res == 0) {
+                    error = EIO;
+                    active--;
+                    continue;
+                }
+                if (slot->done == slot->length) {
+                    if (!slot->writing) {
+                        slot->writing = 1;
+                        slot->done = 0;
+                    } else if (next < end) {
+                        slot->start = next;
+                        slot->length = end - next < URING_SLOT_SIZE ? (size_t)(end - next) : URING_SLOT_SIZE;
+                        slot->done = 0;
+                        slot->writing = 0;
+                        next += (off_t)slot->length;
+                    } else {
+                        active--;
+                        continue;
+                    }
+                }
+            }
+            queue_slot(ring, slot, i, in, out, buffer);
+        }
+    }
+    scratch->syscalls += uring_enter_calls(ring) - calls;
+    if (error) {
+        errno = error;
+        return -1;
+    }
+    return (ssize_t)(end - offset);
+}
+
+// Moves up to length bytes at offset from in to out with one method.
+// Returns the bytes moved, 0 if the source ended early, or -1.
+static ssize_t move_range(int in, int out, off_t offset, size_t length, CopyMethod method,
+                          CopyScratch *scratch, int *pipe_fds) {
+    if (length > MAX_TRANSFER) length = MAX_TRANSFER;
+
+    switch (method) {
+        case COPY_FILE_RANGE: {
+            loff_t from = offset, to = offset;
+            scratch->syscalls++;
+            return copy_file_range(in, &from, out, &to, length, 0);
+        }
+        case COPY_URING:
+            return uring_range(in, out, offset, length, scratch);
+        case COPY_SENDFILE: {
+            off_t from = offset;
+            scratch->syscalls += 2;
+            if (lseek(out, offset, SEEK_SET) < 0) return -1;
+            return sendfile(out, in, &from, length);
+        }
+        case COPY_SPLICE: {
+            if (pipe_fds[0] < 0) {
+                if (pipe2(pipe_fds, O_CLOEXEC) != 0) return -1;
+                fcntl(pipe_fds[1], F_SETPIPE_SZ, PIPE_SIZE);
+            }
+            loff_t from = offset, to = offset;
+            scratch->syscalls++;
+            ssize_t filled = splice(in, &from, pipe_fds[1], NULL, length, SPLICE_F_MOVE);
+            if (filled <= 0) return filled;
+            // Whatever entered the pipe has to leave it before anything else
+            for (ssize_t drained = 0; drained < filled;) {
+                scratch->syscalls++;
+                ssize_t moved = splice(pipe_fds[0], NULL, out, &to, filled - drained, SPLICE_F_MOVE);
+                if (moved <= 0) {
+                    if (moved < 0 && errno == EINTR) continue;
+                    close(pipe_fds[0]);
+                    close(pipe_fds[1]);
+                    pipe_fds[0] = pipe_fds[1] = -1;
+                    if (moved == 0) errno = EIO;
+                    return -1;
+                }
+                drained += moved;
+            }
+            return filled;
+        }
+        default: {
+            if (get_buffer(scratch) != 0) return -1;
+            if (length > COPY_BUFFER_SIZE) length = COPY_BUFFER_SIZE;
+            scratch->syscalls++;
+            ssize_t got = pread(in, scratch->buffer, length, offset);
+            if (got <= 0) return got;
+            return write_all(out, scratch->buffer, (size_t)got, offset, &scratch->syscalls);
+        }
+    }
+}
+
+int copy_file_data(int in, int out, off_t size, int method, CopyScratch *scratch,
+                   CopyMethod *used, unsigned long long *hole_bytes) {
+    CopyMethod current = method == COPY_AUTO ? COPY_REFLINK : (CopyMethod)method;
+    *used = current;
+    if (current == COPY_REFLINK) {
+        scratch->syscalls++;
+        if (ioctl(out, FICLONE, in) == 0) return 0;
+        if (method != COPY_AUTO) return -1;
+        current = COPY_FILE_RANGE;
+        *used = current;
+    }
+
+    int pipe_fds[2] = { -1, -1 };
+    int result = -1;
+    off_t offset = 0, end = 0;
+    while (offset < size) {
+        // Data runs between holes; without SEEK_DATA the file is one run
+        off_t data = lseek(in, offset, SEEK_DATA);
+        if (data < 0 && errno == ENXIO) break;         // only a hole remains
+        off_t hole = data < 0 ? size : lseek(in, data, SEEK_HOLE);
+        if (data < 0) data = offset;
+        if (hole < 0 || hole > size) hole = size;
+        if (data >= size) break;
+        *hole_bytes += (unsigned long long)(data - offset);
+
+        while (data < hole) {
+            ssize_t moved = move_range(in, out, data, (size_t)(hole - data), current, scratch, pipe_fds);
+            if (moved < 0 && errno == EINTR) continue;
+            if (moved < 0 && method == COPY_AUTO && current < COPY_BUFFER && unsupported(errno)) {
+                current++;
+                *used = current;
+                continue;
+            }
+            if (moved < 0) goto done;
+            if (moved == 0) {
+                size = data;        // the source was truncated while copying
+                break;
+            }
+            data += moved;
+        }
+        offset = end = data;
+    }
+    // A trailing hole is made by extending the file
+    *hole_bytes += (unsigned long long)(size - end);
+    if (end < size && ftruncate(out, size) != 0) goto done;
+    result = 0;
+
+done:
+    if (pipe_fds[0] >= 0) {
+        close(pipe_fds[0]);
+        close(pipe_fds[1]);
+    }
+    return result;
+}
+
+// Single files, links and directories
+
+typedef struct {
+    CopyStats stats;
+    CopyScratch scratch;
+    FILE *output;               // CopyOptions.output
+    char path[PATH_MAX];        // destination of the entry being copied
+} CopyWorker;
+
+typedef struct {
+    const CopyOptions *options;
+    size_t source_length;       // entry paths continue after this many characters
+    const char *destination;
+    CopyWorker *workers;
+} CopyTree;
+
+static int copy_regular(const char *source, const char *destination, const struct stat *st,
+                        const CopyOptions *options, CopyWorker *worker) {
+    int in = open(source, O_RDONLY | O_CLOEXEC);
+    if (in < 0) {
+        fprintf(worker->output, "Error: Cannot open source file '%s'\n", source);
+        worker->stats.errors++;
+        return -1;
+    }
+    int out = open(destination, O_WRONLY | O_CREAT | O_CLOEXEC, st->st_mode & 07777);
+    if (out < 0) {
+        fprintf(worker->output, "Error: Cannot create destination file '%s'\n", destination);
+        close(in);
+        worker->stats.errors++;
+        return -1;
+    }
+
+    // Truncating first would destroy a file copied onto itself
+    struct stat out_stat;
+    int result = -1;
+    CopyMethod used;
+    if (fstat(out, &out_stat) == 0 && out_stat.st_dev == st->st_dev && out_stat.st_ino == st->st_ino) {
+        fprintf(worker->output, "Error: '%s' and '%s' are the same file\n", source, destination);
+    } else if (ftruncate(out, 0) != 0 ||
+               copy_file_data(in, out, st->st_size, options->method, &worker->scratch, &used,
+                              &worker->stats.hole_bytes) != 0) {
+        fprintf(worker->output, "Error: Cannot copy '%s' to '%s': %s\n", source, destination, strerror(errno));
+    } else {
+        result = 0;
+    }
+    close(in);
+    if (close(out) != 0 && result == 0) {
+        fprintf(worker->output, "Error: Cannot write '%s': %s\n", destination, strerror(errno));
+        result = -1;
+    }
+
+    if (result == 0) {
+        worker->stats.files++;
+        worker->stats.bytes += (unsigned long long)st->st_size;
+        worker->stats.by_method[used]++;
+    } else {
+        worker->stats.errors++;
+    }
+    return result;
+}
+
+static int copy_link(const char *source, const char *destination, CopyWorker *worker) {
+    char target[PATH_MAX];
+    ssize_t length = readlink(source, target, sizeof(target) - 1);
+    if (length < 0) {
+        fprintf(worker->output, "Error: Cannot read link '%s'\n", source);
+        worker->stats.errors++;
+        return -1;
+    }
+    target[length] = '\0';
+    if (symlink(target, destination) != 0) {
+        fprintf(worker->output, "Error: Cannot create link '%s': %s\n", destination, strerror(errno));
+        worker->stats.errors++;
+        return -1;
+    }
+    worker->stats.links++;
+    return 0;
+}
+
+// Directories start out writable so their contents can be copied in;
+// their own permissions are applied once they are complete
+static int make_directory(const char *destination, const struct stat *st, CopyWorker *worker) {
+    if (mkdir(destination, (st->st_mode & 07777) | S_IRWXU) != 0) {
+        struct stat existing;
+        if (errno != EEXIST || stat(destination, &existing) != 0 || !S_ISDIR(existing.st_mode)) {
+            fprintf(worker->output, "Error: Cannot create directory '%s'\n", destination);
+            worker->stats.errors++;
+            return -1;
+        }
+    }
+    worker->stats.directories++;
+    return 0;
+}
+
+static const char* tree_destination(CopyTree *tree, const WalkEntry *entry, CopyWorker *worker) {
+    int length = snprintf(worker->path, sizeof(worker->path), "%s%s", tree->destination,
+                          entry->path + tree->source_length);
+    if (length < 0 || length >= (int)sizeof(worker->path)) {
+        fprintf(worker->output, "Error: Path too long: '%s'\n", entry->path);
+        worker->stats.errors++;
+        return NULL;
+    }
+    return worker->path;
+}
+
+// Runs on the walker's threads, so files are copied several at a time
+static int copy_visit(const WalkEntry *entry, void *arg) {
+    CopyTree *tree = arg;
+    CopyWorker *worker = &tree->workers[entry->worker];
+    const char *destination = tree_destination(tree, entry, worker);
+    if (destination == NULL) return WALK_SKIP;
+
+    switch (entry->type) {
+        case DT_DIR:
+            return make_directory(destination, entry->stat, worker) == 0 ? WALK_CONTINUE : WALK_SKIP;
+        case DT_REG:
+            copy_regular(entry->path, destination, entry->stat, tree->options, worker);
+            break;
+        case DT_LNK:
+            copy_link(entry->path, destination, worker);
+            break;
+        default:
+            fprintf(worker->output, "Error: Skipping special file '%s'\n", entry->path);
+            worker->stats.errors++;
+            break;
+    }
+    return WALK_CONTINUE;
+}
+
+static void copy_leave(const WalkEntry *directory, const WalkTotals *totals, void *arg) {
+    (void)totals;
+    CopyTree *tree = arg;
+    CopyWorker *worker = &tree->workers[directory->worker];
+    const char *destination = tree_destination(tree, directory, worker);
+    if (destination != NULL && directory->stat != NULL) {
+        chmod(destination, directory->stat->st_mode & 07777);
+    }
+}
+
+// True if path is directory or lies below it
+static int is_within(const char *path, const char *directory) {
+    size_t length = strlen(directory);
+    return strncmp(path, directory, length) == 0 &&
+           (path[length] == '\0' || path[length] == '/' || strcmp(directory, "/") == 0);
+}
+
+static int copy_tree(const char *source, const char *destination, const struct stat *st,
+                     const CopyOptions *options, CopyWorker *workers) {
+    // A copy inside its own source would keep finding itself
+    char real_source[PATH_MAX], real_parent[PATH_MAX], parent[PATH_MAX];
+    snprintf(parent, sizeof(parent), "%s", destination);
+    char *slash = strrchr(parent, '/');
+    if (slash == NULL) {
+        strcpy(parent, ".");
+    } else if (slash == parent) {
+        parent[1] = '\0';
+    } else {
+        *slash = '\0';
+    }
+    if (realpath(source, real_source) != NULL && realpath(parent, real_parent) != NULL &&
+        is_within(real_parent, real_source)) {
+        fprintf(options->output, "Error: Cannot copy directory '%s' into itself\n", source);
+        workers[0].stats.errors++;
+        return -1;
+    }
+
+    if (make_directory(destination, st, &workers[0]) != 0) return -1;
+
+    size_t source_length = strlen(source);
+    while (source_length > 1 && source[source_length - 1] == '/') source_length--;
+    CopyTree tree = { options, strcmp(source, "/") == 0 ? 0 : source_length, destination, workers };
+
+    WalkOptions walk;
+    init_walk_options(&walk);
+    walk.threads = options->threads;
+    walk.flags = WALK_STAT;
+    walk.visit = copy_visit;
+    walk.leave = copy_leave;
+    walk.arg = &tree;
+    WalkStats walk_stats;
+    if (walk_tree(source, &walk, &walk_stats) != 0) {
+        fprintf(options->output, "Error: Cannot open directory '%s'\n", source);
+        workers[0].stats.errors++;
+        return -1;
+    }
+    workers[0].stats.errors += walk_stats.errors;
+    return 0;
+}
+
+int copy_path(const char *source, const char *destination, const CopyOptions *options, CopyStats *stats) {
+    double start = now_seconds();
+    CopyWorker *workers = calloc(WALK_MAX_THREADS, sizeof(CopyWorker));
+    if (workers == NULL) {
+        fprintf(options->output, "Memory allocation failed!\n");
+        return -1;
+    }
+    for (int i = 0; i < WALK_MAX_THREADS; i++) {
+        workers[i].output = options->output;
+    }
+
+    struct stat st, target;
+    char joined[PATH_MAX];
+    if (lstat(source, &st) != 0) {
+        fprintf(options->output, "Error: Cannot open source file '%s'\n", source);
+        workers[0].stats.errors++;
+        goto done;
+    }
+    size_t destination_length = strlen(destination);
+    while (destination_length > 1 && destination[destination_length - 1] == '/') destination_length--;
+    if (destination_length >= sizeof(joined)) {
+        fprintf(options->output, "Error: Path too long: '%s'\n", destination);
+        workers[0].stats.errors++;
+        goto done;
+    }
+
+    // Copying to a directory puts the copy inside it, under the same name
+    if (stat(destination, &target) == 0 && S_ISDIR(target.st_mode)) {
+        size_t length = strlen(source);
+        while (length > 1 && source[length - 1] == '/') length--;
+        const char *name = source + length;
+        while (name > source && name[-1] != '/') name--;
+        int written = snprintf(joined, sizeof(joined), "%.*s%s%.*s", (int)destination_length, destination,
+                               destination[destination_length - 1] == '/' ? "" : "/",
+                               (int)(source + length - name), name);
+        if (written < 0 || written >= (int)sizeof(joined)) {
+            fprintf(options->output, "Error: Path too long: '%s'\n", destination);
+            workers[0].stats.errors++;
+            goto done;
+        }
+    } else {
+        snprintf(joined, sizeof(joined), "%.*s", (int)destination_length, destination);
+    }
+    destination = joined;
+
+    if (S_ISDIR(st.st_mode)) {
+        copy_tree(source, destination, &st, options, workers);
+    } else if (S_ISLNK(st.st_mode)) {
+        copy_link(source, destination, &workers[0]);
+    } else if (S_ISREG(st.st_mode)) {
+        copy_regular(source, destination, &st, options, &workers[0]);
+    } else {
+        fprintf(options->output, "Error: Cannot copy special file '%s'\n", source);
+        workers[0].stats.errors++;
+    }
+
+done:;
+    CopyStats total;
+    memset(&total, 0, sizeof(total));
+    for (int i = 0; i < WALK_MAX_THREADS; i++) {
+        const CopyStats *part = &workers[i].stats;
+        total.files += part->files;
+        total.directories += part->directories;
+        total.links += part->links;
+        total.bytes += part->bytes;
+        total.hole_bytes += part->hole_bytes;
+        total.errors += part->errors;
+        total.syscalls += workers[i].scratch.syscalls;
+        for (int m = 0; m < COPY_METHODS; m++) {
+            total.by_method[m] += part->by_method[m];
+        }
+        free_copy_scratch(&workers[i].scratch);
+    }
+    free(workers);
+    total.seconds = now_seconds() - start;
+    if (stats != NULL) *stats = total;
+    return total.errors == 0 ? 0 : -1;
+}
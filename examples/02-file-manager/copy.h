@@ -0,0 +1,80 @@
+#ifndef COPY_H
+#define COPY_H
+
+// File and directory copying for cp.
+//
+// Each file is first cloned with FICLONE, which shares the data blocks on
+// filesystems with reflinks (Btrfs, XFS) and copies nothing. Otherwise its
+// data moves inside the kernel with copy_file_range. Where that is not
+// possible, io_uring keeps several reads and writes in flight at once,
+// which hides the latency of network filesystems; then come sendfile,
+// splice through a pipe, and as a last resort a large page-aligned
+// buffer in user space. Each method falls back to the next
+// when the kernel or the filesystems involved do not support it. Holes in
+// sparse files are found with SEEK_DATA / SEEK_HOLE and left as holes.
+//
+// Directories are copied recursively with the parallel walker, several
+// files at a time.
+
+#include <stdio.h>
+#include <sys/types.h>
+#include "uring.h"
+
+typedef enum {
+    COPY_REFLINK,
+    COPY_FILE_RANGE,
+    COPY_URING,
+    COPY_SENDFILE,
+    COPY_SPLICE,
+    COPY_BUFFER,
+    COPY_METHODS
+} CopyMethod;
+
+#define COPY_AUTO COPY_METHODS      // CopyOptions.method: best available
+#define COPY_BUFFER_SIZE (1 << 20)
+
+typedef struct {
+    int threads;                // for directories; <= 0: one per online CPU
+    int method;                 // COPY_AUTO, or use only this method (for benchmarks)
+    FILE *output;               // where errors are printed; stdout by default
+} CopyOptions;
+
+typedef struct {
+    unsigned long long files;
+    unsigned long long directories;
+    unsigned long long links;               // symbolic links recreated
+    unsigned long long bytes;               // file sizes, holes included
+    unsigned long long hole_bytes;          // skipped as holes
+    unsigned long long errors;
+    unsigned long long syscalls;            // made to move data
+    unsigned long long by_method[COPY_METHODS];    // files copied by each method
+    double seconds;
+} CopyStats;
+
+// What one thread reuses from file to file. The buffer and the ring are
+// created the first time they are needed.
+typedef struct {
+    void *buffer;               // COPY_BUFFER_SIZE, page aligned
+    Uring *ring;
+    void *ring_buffer;          // the pieces io_uring reads into and writes from
+    int ring_failed;
+    unsigned long long syscalls;
+} CopyScratch;
+
+void init_copy_options(CopyOptions *options);
+const char* copy_method_name(CopyMethod method);
+void init_copy_scratch(CopyScratch *scratch);
+void free_copy_scratch(CopyScratch *scratch);
+
+// Copies the contents of in (size bytes) to out, which must be empty.
+// *used receives the last method that moved data. Returns 0, or -1 with
+// errno set.
+int copy_file_data(int in, int out, off_t size, int method, CopyScratch *scratch,
+                   CopyMethod *used, unsigned long long *hole_bytes);
+
+// Copies a file, symbolic link or directory tree. As with cp -r, copying
+// to an existing directory puts the copy inside it. Errors are printed to
+// options->output as they occur; returns 0 if everything was copied, -1 otherwise.
+int copy_path(const char *source, const char *destination, const CopyOptions *options, CopyStats *stats);
+
+#endif
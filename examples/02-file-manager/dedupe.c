@@ -0,0 +1,668 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <time.h>
+#include <dirent.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include <sys/ioctl.h>
+#include <linux/fs.h>
+#include "dedupe.h"
+#include "walker.h"
+
+#define PRIME1 0x9E3779B185EBCA87ull
+#define PRIME2 0xC2B2AE3D27D4EB4Full
+#define PRIME3 0x165667B19E3779F9ull
+#define PRIME4 0x85EBCA77C2B2AE63ull
+#define PRIME5 0x27D4EB2F165667C5ull
+
+#define DEDUPE_MAX_THREADS 64
+#define REFLINK_STEP (16 << 20)         // most FIDEDUPERANGE is asked to share at once
+
+static uint64_t rotate_left(uint64_t value, int bits) {
+    return (value << bits) | (value >> (64 - bits));
+}
+
+static uint64_t read64(const unsigned char *p) {
+    uint64_t value;
+    memcpy(&value, p, sizeof(value));
+    return value;
+}
+
+static uint32_t read32(const unsigned char *p) {
+    uint32_t value;
+    memcpy(&value, p, sizeof(value));
+    return value;
+}
+
+static uint64_t hash_round(uint64_t lane, uint64_t input) {
+    lane += input * PRIME2;
+    return rotate_left(lane, 31) * PRIME1;
+}
+
+static uint64_t merge_lane(uint64_t hash, uint64_t lane) {
+    hash ^= hash_round(0, lane);
+    return hash * PRIME1 + PRIME4;
+}
+
+static uint64_t avalanche(uint64_t hash) {
+    hash ^= hash >> 33;
+    hash *= PRIME2;
+    hash ^= hash >> 29;
+    hash *= PRIME3;
+    return hash ^ (hash >> 32);
+}
+
+void init_content_hash(ContentHash *hash) {
+    hash->lanes[0] = PRIME1 + PRIME2;
+    hash->lanes[1] = PRIME2;
+    hash->lanes[2] = 0;
+    hash->lanes[3] = -PRIME1;
+    hash->length = 0;
+    hash->tail_length = 0;
+}
+
+void update_content_hash(ContentHash *hash, const void *data, size_t length) {
+    const unsigned char *p = data;
+    hash->length += length;
+    for (; length >= 32; p += 32, length -= 32) {
+        for (int lane = 0; lane < 4; lane++) {
+            hash->lanes[lane] = hash_round(hash->lanes[lane], read64(p + lane * 8));
+        }
+    }
+    memcpy(hash->tail, p, length);
+    hash->tail_length = length;
+}
+
+void finish_content_hash(const ContentHash *hash, uint64_t result[2]) {
+    const uint64_t *lanes = hash->lanes;
+    uint64_t h;
+    if (hash->length >= 32) {
+        h = rotate_left(lanes[0], 1) + rotate_left(lanes[1], 7) + rotate_left(lanes[2], 12) +
+            rotate_left(lanes[3], 18);
+        for (int lane = 0; lane < 4; lane++) {
+            h = merge_lane(h, lanes[lane]);
+        }
+    } else {
+        h = PRIME5;
+    }
+    h += hash->length;
+
+    const unsigned char *p = hash->tail;
+    size_t length = hash->tail_length;
+    for (; length >= 8; p += 8, length -= 8) {
+        h ^= hash_round(0, read64(p));
+        h = rotate_left(h, 27) * PRIME1 + PRIME4;
+    }
+    if (length >= 4) {
+        h ^= (uint64_t)read32(p) * PRIME1;
+        h = rotate_left(h, 23) * PRIME2 + PRIME3;
+        p += 4;
+        length -= 4;
+    }
+    for (; length > 0; p++, length--) {
+        h ^= *p * PRIME5;
+        h = rotate_left(h, 11) * PRIME1;
+    }
+    result[0] = avalanche(h);
+    // A second word from the lanes mixed the other way round
+    uint64_t g = rotate_left(lanes[3], 5) ^ (rotate_left(lanes[2], 23) * PRIME3) ^
+                 (rotate_left(lanes[1], 41) * PRIME4) ^ (lanes[0] * PRIME5) ^ h;
+    result[1] = avalanche(g + hash->length * PRIME2);
+}
+
+void init_dedupe_options(DedupeOptions *options) {
+    options->threads = 0;
+    options->mode = DEDUPE_REPORT;
+    options->min_size = 1;
+}
+
+static double now_seconds() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+typedef struct {
+    char *path;
+    unsigned long long size;
+    unsigned long long blocks;      // 512-byte blocks allocated
+    dev_t dev;
+    ino_t ino;
+    nlink_t nlink;
+    uint64_t head[2];
+    uint64_t full[2];
+    int failed;
+} FileRecord;
+
+typedef struct {
+    FileRecord *records;
+    size_t count;
+    size_t capacity;
+    int failed;                     // out of memory
+} FileList;
+
+typedef struct {
+    FileRecord **members;           // in name order
+    int count;
+    unsigned long long wasted;
+} DuplicateSet;
+
+typedef struct DedupeRun DedupeRun;
+
+typedef struct {
+    pthread_t thread;
+    DedupeRun *run;
+    unsigned char *buffer;          // two DEDUPE_CHUNK halves, page aligned
+    unsigned long long bytes_read;
+    unsigned long long errors;
+    unsigned long long linked;
+    unsigned long long reclaimed;
+} DedupeWorker;
+
+typedef void (*DedupeWork)(DedupeRun *run, DedupeWorker *worker, size_t item);
+
+struct DedupeRun {
+    const DedupeOptions *options;
+    FileRecord **items;             // the files of the current round
+    DuplicateSet *sets;             // or, when linking, the sets
+    size_t count;
+    size_t next;                    // next item, taken atomically
+    DedupeWork work;
+    int threads;
+    int no_reflinks;                // the filesystem said it cannot share blocks
+    DedupeWorker workers[DEDUPE_MAX_THREADS];
+};
+
+typedef struct {
+    const DedupeOptions *options;
+    FileList lists[WALK_MAX_THREADS];
+} Gather;
+
+static int gather_visit(const WalkEntry *entry, void *arg) {
+    Gather *gather = arg;
+    FileList *list = &gather->lists[entry->worker];
+    if (entry->type != DT_REG || entry->stat->st_size <= 0 ||
+        (unsigned long long)entry->stat->st_size < gather->options->min_size || list->failed) {
+        return WALK_CONTINUE;
+    }
+    if (list->count == list->capacity) {
+        size_t capacity = list->capacity ? list->capacity * 2 : 1024;
+        FileRecord *records = realloc(list->records, capacity * sizeof(FileRecord));
+        if (records == NULL) {
+            list->failed = 1;
+            return WALK_CONTINUE;
+        }
+        list->records = records;
+        list->capacity = capacity;
+    }
+    FileRecord *record = &list->records[list->count];
+    memset(record, 0, sizeof(*record));
+    record->path = strdup(entry->path);
+    if (record->path == NULL) {
+        list->failed = 1;
+        return WALK_CONTINUE;
+    }
+    record->size = (unsigned long long)entry->stat->st_size;
+    record->blocks = (unsigned long long)entry->stat->st_blocks;
+    record->dev = entry->stat->st_dev;
+    record->ino = entry->stat->st_ino;
+    record->nlink = entry->stat->st_nlink;
+    list->count++;
+    return WALK_CONTINUE;
+}
+
+static void* pool_thread(void *arg) {
+    DedupeWorker *worker = arg;
+    DedupeRun *run = worker->run;
+    for (;;) {
+        size_t item = __atomic_fetch_add(&run->next, 1, __ATOMIC_RELAXED);
+        if (item >= run->count) break;
+        run->work(run, worker, item);
+    }
+    return NULL;
+}
+
+// Runs work on every item, the calling thread taking part as worker 0
+static void run_pool(DedupeRun *run, size_t count, DedupeWork work) {
+    run->count = count;
+    run->next = 0;
+    run->work = work;
+    int started[DEDUPE_MAX_THREADS] = { 0 };
+    for (int t = 1; t < run->threads && (size_t)t < count; t++) {
+        started[t] = pthread_create(&run->workers[t].thread, NULL, pool_thread, &run->workers[t]) == 0;
+    }
+    pool_thread(&run->workers[0]);
+    for (int t = 1; t < run->threads; t++) {
+        if (started[t]) pthread_join(run->workers[t].thread, NULL);
+    }
+}
+
+static unsigned char* worker_buffer(DedupeWorker *worker) {
+    if (worker->buffer == NULL) {
+        long page = sysconf(_SC_PAGESIZE);
+        void *buffer;
+        if (posix_memalign(&buffer, page > 0 ? (size_t)page : 4096, 2 * DEDUPE_CHUNK) != 0) return NULL;
+        worker->buffer = buffer;
+    }
+    return worker->buffer;
+}
+
+// Opens a file for hashing, refusing it if it changed size since the walk
+static int open_record(DedupeWorker *worker, const FileRecord *record) {
+    int fd = open(record->path, O_RDONLY);
+    struct stat st;
+    if (fd >= 0 && (fstat(fd, &st) != 0 || (unsigned long long)st.st_size != record->size)) {
+        close(fd);
+        fd = -1;
+    }
+    if (fd < 0) worker->errors++;
+    return fd;
+}
+
+// Reads until length bytes or the end of the file
+static ssize_t read_full(int fd, unsigned char *buffer, size_t length) {
+    size_t done = 0;
+    while (done < length) {
+        ssize_t got = read(fd, buffer + done, length - done);
+        if (got < 0 && errno == EINTR) continue;
+        if (got < 0) return -1;
+        if (got == 0) break;
+        done += (size_t)got;
+    }
+    return (ssize_t)done;
+}
+
+static void hash_head(DedupeRun *run, DedupeWorker *worker, size_t item) {
+    FileRecord *record = run->items[item];
+    unsigned char *buffer = worker_buffer(worker);
+    int fd = buffer != NULL ? open_record(worker, record) : -1;
+    if (fd < 0) {
+        record->failed = 1;
+        return;
+    }
+    size_t length = record->size < DEDUPE_HEAD ? (size_t)record->size : DEDUPE_HEAD;
+    ssize_t got = pread(fd, buffer, length, 0);
+    close(fd);
+    if (got != (ssize_t)length) {
+        worker->errors++;
+        record->failed = 1;
+        return;
+    }
+    worker->bytes_read += length;
+    ContentHash hash;
+    init_content_hash(&hash);
+    update_content_hash(&hash, buffer, length);
+    finish_content_hash(&hash, record->head);
+    if (record->size <= DEDUPE_HEAD) {
+        memcpy(record->full, record->head, sizeof(record->full));
+    }
+}
+
+static void hash_whole(DedupeRun *run, DedupeWorker *worker, size_t item) {
+    FileRecord *record = run->items[item];
+    unsigned char *buffer = worker_buffer(worker);
+    int fd = buffer != NULL ? open_record(worker, record) : -1;
+    if (fd < 0) {
+        record->failed = 1;
+        return;
+    }
+    posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+    ContentHash hash;
+    init_content_hash(&hash);
+    unsigned long long done = 0;
+    while (done < record->size) {
+        // Whole chunks, so every update but the last is a multiple of 32
+        ssize_t got = read_full(fd, buffer, DEDUPE_CHUNK);
+        if (got <= 0) break;
+        update_content_hash(&hash, buffer, (size_t)got);
+        done += (unsigned long long)got;
+        if (got < DEDUPE_CHUNK) break;
+    }
+    posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+    close(fd);
+    worker->bytes_read += done;
+    if (done != record->size) {
+        worker->errors++;
+        record->failed = 1;
+        return;
+    }
+    finish_content_hash(&hash, record->full);
+}
+
+// 1 if the two files hold the same bytes, 0 if not, -1 if unreadable
+static int same_contents(DedupeWorker *worker, const FileRecord *a, const FileRecord *b) {
+    unsigned char *buffer = worker_buffer(worker);
+    if (buffer == NULL) return -1;
+    int fa = open_record(worker, a);
+    int fb = fa >= 0 ? open_record(worker, b) : -1;
+    int result = -1;
+    if (fb < 0) goto done;
+    posix_fadvise(fa, 0, 0, POSIX_FADV_SEQUENTIAL);
+    posix_fadvise(fb, 0, 0, POSIX_FADV_SEQUENTIAL);
+    result = 1;
+    for (unsigned long long offset = 0; offset < a->size && result == 1; offset += DEDUPE_CHUNK) {
+        size_t length = a->size - offset < DEDUPE_CHUNK ? (size_t)(a->size - offset) : DEDUPE_CHUNK;
+        if (pread(fa, buffer, length, (off_t)offset) != (ssize_t)length ||
+            pread(fb, buffer + DEDUPE_CHUNK, length, (off_t)offset) != (ssize_t)length) {
+            worker->errors++;
+            result = -1;
+        } else if (memcmp(buffer, buffer + DEDUPE_CHUNK, length) != 0) {
+            result = 0;
+        }
+        worker->bytes_read += 2 * length;
+    }
+    posix_fadvise(fa, 0, 0, POSIX_FADV_DONTNEED);
+    posix_fadvise(fb, 0, 0, POSIX_FADV_DONTNEED);
+
+done:
+    if (fa >= 0) close(fa);
+    if (fb >= 0) close(fb);
+    return result;
+}
+
+// Replaces other with a hard link to first, through a temporary name so
+// other is never missing
+static int hardlink_duplicate(DedupeWorker *worker, const FileRecord *first, const FileRecord *other) {
+    if (first->dev != other->dev) {
+        printf("Error: '%s' is on another filesystem than '%s'\n", other->path, first->path);
+        worker->errors++;
+        return -1;
+    }
+    int same = same_contents(worker, first, other);
+    if (same != 1) {
+        if (same == 0) printf("Error: '%s' changed since it was hashed; left alone\n", other->path);
+        return -1;
+    }
+    size_t length = strlen(other->path);
+    char *temporary = malloc(length + 16);
+    if (temporary == NULL) {
+        printf("Memory allocation failed!\n");
+        return -1;
+    }
+    snprintf(temporary, length + 16, "%s.fm_dedupe", other->path);
+    int result = -1;
+    if (link(first->path, temporary) != 0) {
+        printf("Error: Cannot link '%s' to '%s': %s\n", temporary, first->path, strerror(errno));
+        worker->errors++;
+    } else if (rename(temporary, other->path) != 0) {
+        printf("Error: Cannot replace '%s': %s\n", other->path, strerror(errno));
+        unlink(temporary);
+        worker->errors++;
+    } else {
+        result = 0;
+    }
+    free(temporary);
+    return result;
+}
+
+// Asks the kernel to compare other with first and share first's blocks
+static int reflink_duplicate(DedupeRun *run, DedupeWorker *worker, const FileRecord *first,
+                             const FileRecord *other) {
+    if (__atomic_load_n(&run->no_reflinks, __ATOMIC_RELAXED)) return -1;
+    int source = open_record(worker, first);
+    int destination = source >= 0 ? open_record(worker, other) : -1;
+    struct {
+        struct file_dedupe_range range;
+        struct file_dedupe_range_info info;
+    } request;
+    int result = -1;
+    if (destination < 0) goto done;
+
+    for (unsigned long long offset = 0; offset < first->size;) {
+        memset(&request, 0, sizeof(request));
+        request.range.src_offset = offset;
+        request.range.src_length = first->size - offset < REFLINK_STEP ? first->size - offset : REFLINK_STEP;
+        request.range.dest_count = 1;
+        request.info.dest_fd = destination;
+        request.info.dest_offset = offset;
+        if (ioctl(source, FIDEDUPERANGE, &request) != 0 || request.info.status < 0) {
+            int error = request.info.status < 0 ? -request.info.status : errno;
+            if (error == EOPNOTSUPP || error == EINVAL || error == ENOTTY || error == EXDEV) {
+                if (!__atomic_exchange_n(&run->no_reflinks, 1, __ATOMIC_RELAXED)) {
+                    printf("Error: The filesystem of '%s' cannot share blocks; try --hardlink\n", other->path);
+                }
+            } else {
+                printf("Error: Cannot share blocks with '%s': %s\n", other->path, strerror(error));
+                worker->errors++;
+            }
+            goto done;
+        }
+        if (request.info.status == FILE_DEDUPE_RANGE_DIFFERS || request.info.bytes_deduped == 0) {
+            printf("Error: '%s' changed since it was hashed; left alone\n", other->path);
+            goto done;
+        }
+        offset += request.info.bytes_deduped;
+    }
+    result = 0;
+
+done:
+    if (source >= 0) close(source);
+    if (destination >= 0) close(destination);
+    return result;
+}
+
+static void link_set(DedupeRun *run, DedupeWorker *worker, size_t item) {
+    DuplicateSet *set = &run->sets[item];
+    const FileRecord *first = set->members[0];
+    for (int i = 1; i < set->count; i++) {
+        const FileRecord *other = set->members[i];
+        int result = run->options->mode == DEDUPE_HARDLINK ? hardlink_duplicate(worker, first, other) :
+                     reflink_duplicate(run, worker, first, other);
+        if (result == 0) {
+            worker->linked++;
+            // A hard link frees the blocks only if nothing else links them
+            if (run->options->mode == DEDUPE_REFLINK || other->nlink == 1) {
+                worker->reclaimed += other->blocks * 512;
+            }
+        }
+    }
+}
+
+static int compare_inodes(const void *a, const void *b) {
+    const FileRecord *x = a, *y = b;
+    if (x->dev != y->dev) return x->dev < y->dev ? -1 : 1;
+    if (x->ino != y->ino) return x->ino < y->ino ? -1 : 1;
+    return strcmp(x->path, y->path);
+}
+
+// Largest first, then by head hash, then by full hash
+static int compare_candidates(const void *a, const void *b) {
+    const FileRecord *x = *(FileRecord *const *)a, *y = *(FileRecord *const *)b;
+    if (x->size != y->size) return x->size > y->size ? -1 : 1;
+    int heads = memcmp(x->head, y->head, sizeof(x->head));
+    if (heads != 0) return heads;
+    int fulls = memcmp(x->full, y->full, sizeof(x->full));
+    if (fulls != 0) return fulls;
+    return strcmp(x->path, y->path);
+}
+
+static int compare_paths(const void *a, const void *b) {
+    return strcmp((*(FileRecord *const *)a)->path, (*(FileRecord *const *)b)->path);
+}
+
+static int compare_sets(const void *a, const void *b) {
+    const DuplicateSet *x = a, *y = b;
+    if (x->wasted != y->wasted) return x->wasted > y->wasted ? -1 : 1;
+    return strcmp(x->members[0]->path, y->members[0]->path);
+}
+
+// round 0: same size; 1: and same head hash; 2: and same full hash
+static int same_group(const FileRecord *x, const FileRecord *y, int round) {
+    return x->size == y->size &&
+           (round < 1 || memcmp(x->head, y->head, sizeof(x->head)) == 0) &&
+           (round < 2 || memcmp(x->full, y->full, sizeof(x->full)) == 0);
+}
+
+// Sorts items and keeps those sharing a group with another, in place;
+// returns how many are left
+static size_t keep_groups(FileRecord **items, size_t count, int round) {
+    size_t kept = 0, start = 0;
+    size_t usable = 0;
+    for (size_t i = 0; i < count; i++) {
+        if (!items[i]->failed) items[usable++] = items[i];
+    }
+    qsort(items, usable, sizeof(FileRecord *), compare_candidates);
+    while (start < usable) {
+        size_t end = start + 1;
+        while (end < usable && same_group(items[start], items[end], round)) end++;
+        if (end - start >= 2) {
+            memmove(items + kept, items + start, (end - start) * sizeof(FileRecord *));
+            kept += end - start;
+        }
+        start = end;
+    }
+    return kept;
+}
+
+int find_duplicates(const char *path, const DedupeOptions *options, DedupeVisit visit, void *arg,
+                    DedupeStats *stats) {
+    double start = now_seconds();
+    DedupeStats total;
+    memset(&total, 0, sizeof(total));
+
+    Gather gather;
+    memset(&gather, 0, sizeof(gather));
+    gather.options = options;
+    WalkOptions walk_options;
+    init_walk_options(&walk_options);
+    walk_options.flags = WALK_STAT;
+    walk_options.visit = gather_visit;
+    walk_options.arg = &gather;
+    WalkStats walk_stats;
+
+    FileRecord *records = NULL;
+    FileRecord **items = NULL;
+    DuplicateSet *sets = NULL;
+    DedupeRun *run = NULL;
+    const char **paths = NULL;
+    size_t count = 0, filled = 0, set_count = 0;
+    int result = -1;
+    if (walk_tree(path, &walk_options, &walk_stats) != 0) goto done;
+    total.errors = walk_stats.errors;
+
+    int out_of_memory = 0;
+    for (int t = 0; t < WALK_MAX_THREADS; t++) {
+        count += gather.lists[t].count;
+        out_of_memory |= gather.lists[t].failed;
+    }
+    records = malloc((count > 0 ? count : 1) * sizeof(FileRecord));
+    items = malloc((count > 0 ? count : 1) * sizeof(FileRecord *));
+    run = calloc(1, sizeof(DedupeRun));
+    if (out_of_memory || records == NULL || items == NULL || run == NULL) {
+        printf("Memory allocation failed!\n");
+        goto done;
+    }
+    for (int t = 0; t < WALK_MAX_THREADS; t++) {
+        memcpy(records + filled, gather.lists[t].records, gather.lists[t].count * sizeof(FileRecord));
+        filled += gather.lists[t].count;
+        free(gather.lists[t].records);
+        gather.lists[t].records = NULL;
+    }
+
+    // One path per inode, the first in name order
+    qsort(records, filled, sizeof(FileRecord), compare_inodes);
+    size_t files = 0;
+    for (size_t i = 0; i < filled; i++) {
+        if (files > 0 && records[i].dev == items[files - 1]->dev && records[i].ino == items[files - 1]->ino) {
+            continue;
+        }
+        items[files++] = &records[i];
+    }
+    total.files = files;
+
+    run->options = options;
+    run->items = items;
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    run->threads = options->threads > 0 ? options->threads :
+                   cpus > DEDUPE_MIN_THREADS ? (int)cpus : DEDUPE_MIN_THREADS;
+    if (run->threads > DEDUPE_MAX_THREADS) run->threads = DEDUPE_MAX_THREADS;
+    for (int t = 0; t < run->threads; t++) {
+        run->workers[t].run = run;
+    }
+    total.threads = run->threads;
+
+    size_t candidates = keep_groups(items, files, 0);
+    total.same_size = candidates;
+    run_pool(run, candidates, hash_head);
+    candidates = keep_groups(items, candidates, 1);
+    total.same_head = candidates;
+
+    // Files no longer than the head already have their full hash; the
+    // rest, largest first, are read whole
+    size_t whole = 0;
+    while (whole < candidates && items[whole]->size > DEDUPE_HEAD) whole++;
+    run_pool(run, whole, hash_whole);
+    candidates = keep_groups(items, candidates, 2);
+
+    sets = malloc((candidates / 2 + 1) * sizeof(DuplicateSet));
+    if (sets == NULL) {
+        printf("Memory allocation failed!\n");
+        goto done;
+    }
+    for (size_t i = 0; i < candidates;) {
+        size_t end = i + 1;
+        while (end < candidates && same_group(items[i], items[end], 2)) end++;
+        DuplicateSet *set = &sets[set_count++];
+        set->members = items + i;
+        set->count = (int)(end - i);
+        set->wasted = items[i]->size * (end - i - 1);
+        qsort(set->members, end - i, sizeof(FileRecord *), compare_paths);
+        total.duplicates += end - i - 1;
+        total.wasted += set->wasted;
+        i = end;
+    }
+    qsort(sets, set_count, sizeof(DuplicateSet), compare_sets);
+    total.sets = set_count;
+
+    paths = malloc((candidates + 1) * sizeof(char *));
+    if (paths == NULL) {
+        printf("Memory allocation failed!\n");
+        goto done;
+    }
+    for (size_t s = 0; s < set_count && visit != NULL; s++) {
+        for (int i = 0; i < sets[s].count; i++) {
+            paths[i] = sets[s].members[i]->path;
+        }
+        visit(paths, sets[s].count, sets[s].members[0]->size, arg);
+    }
+
+    if (options->mode != DEDUPE_REPORT) {
+        run->sets = sets;
+        run_pool(run, set_count, link_set);
+    }
+    result = 0;
+
+done:
+    if (run != NULL) {
+        for (int t = 0; t < DEDUPE_MAX_THREADS; t++) {
+            DedupeWorker *worker = &run->workers[t];
+            total.bytes_read += worker->bytes_read;
+            total.errors += worker->errors;
+            total.linked += worker->linked;
+            total.reclaimed += worker->reclaimed;
+            free(worker->buffer);
+        }
+        free(run);
+    }
+    for (int t = 0; t < WALK_MAX_THREADS; t++) {
+        for (size_t i = 0; i < gather.lists[t].count && gather.lists[t].records != NULL; i++) {
+            free(gather.lists[t].records[i].path);
+        }
+        free(gather.lists[t].records);
+    }
+    for (size_t i = 0; i < filled; i++) {
+        free(records[i].path);
+    }
+    free(records);
+    free(paths);
+    free(items);
+    free(sets);
+    total.seconds = now_seconds() - start;
+    if (stats != NULL) *stats = total;
+    return result;
+}
@@ -0,0 +1,80 @@
+#ifndef DEDUPE_H
+#define DEDUPE_H
+
+// Duplicate file detection for dedupe.
+//
+// The regular files under a directory are gathered with the parallel
+// walker and narrowed in three rounds: by size, by a hash of their first
+// DEDUPE_HEAD bytes, and by a hash of their whole contents. Only files
+// still sharing a group with another go on to the next round, so most
+// files are never opened and most of those opened are read only in part.
+// Each round runs on a pool of threads that take files from a shared
+// counter and read them DEDUPE_CHUNK bytes at a time, telling the kernel
+// to read ahead and then to drop the pages, so a large scan does not push
+// everything else out of the page cache. Hard links to one inode count as
+// one file.
+//
+// Files are told apart by a 128-bit hash, which is enough to report them.
+// Before anything is changed, contents are compared in full: a hard link
+// replaces a duplicate only after a byte-for-byte comparison, and a
+// reflink goes through FIDEDUPERANGE, where the kernel compares the data
+// and shares the blocks only if they match.
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define DEDUPE_HEAD 4096
+#define DEDUPE_CHUNK (1 << 20)
+#define DEDUPE_MIN_THREADS 4        // reads in flight even on a machine with fewer CPUs
+
+typedef enum {
+    DEDUPE_REPORT,
+    DEDUPE_HARDLINK,                // replace duplicates with hard links to the first file
+    DEDUPE_REFLINK                  // share the first file's blocks, keeping separate files
+} DedupeMode;
+
+typedef struct {
+    int threads;                    // <= 0: one per online CPU, at least DEDUPE_MIN_THREADS
+    DedupeMode mode;
+    unsigned long long min_size;    // smaller files are ignored; empty ones always are
+} DedupeOptions;
+
+typedef struct {
+    unsigned long long files;           // regular files considered, one per inode
+    unsigned long long same_size;       // files sharing their size with another
+    unsigned long long same_head;       // ... and the hash of their first DEDUPE_HEAD bytes
+    unsigned long long bytes_read;
+    unsigned long long sets;
+    unsigned long long duplicates;      // files in sets other than the first of each
+    unsigned long long wasted;          // bytes held by those duplicates
+    unsigned long long linked;          // duplicates replaced or sharing blocks
+    unsigned long long reclaimed;       // bytes freed by that
+    unsigned long long errors;          // files that could not be read or linked
+    int threads;
+    double seconds;
+} DedupeStats;
+
+typedef struct {
+    uint64_t lanes[4];
+    uint64_t length;
+    unsigned char tail[32];
+    size_t tail_length;
+} ContentHash;
+
+// Streaming hash. Every update but the last must be a multiple of 32
+// bytes long. The first word of the result is XXH64 with seed 0.
+void init_content_hash(ContentHash *hash);
+void update_content_hash(ContentHash *hash, const void *data, size_t length);
+void finish_content_hash(const ContentHash *hash, uint64_t result[2]);
+
+// Called for each set of identical files, largest waste first; paths are
+// in name order and the first is the one the others are linked to
+typedef void (*DedupeVisit)(const char *const *paths, int count, unsigned long long size, void *arg);
+
+void init_dedupe_options(DedupeOptions *options);
+
+// Returns 0, or -1 if path is not a readable directory
+int find_duplicates(const char *path, const DedupeOptions *options, DedupeVisit visit, void *arg,
+                    DedupeStats *stats);
+
+#endif
@@ -6,28 +6,46 @@
 #include <sys/types.h>
 #include <dirent.h>
 #include <unistd.h>
+#include <errno.h>
+#include <limits.h>
 #include <time.h>
-#include <pwd.h>
-#include <grp.h>
+#include "walker.h"
+#include "copy.h"
+#include "listing.h"
+#include "index.h"
+#include "viewer.h"
+#include "search.h"
+#include "pattern.h"
+#include "dedupe.h"
+#include "batch.h"
 
 #define MAX_PATH 1024
 #define MAX_FILENAME 256
 #define MAX_COMMAND 512
+#define OUTPUT_BUFFER (64 * 1024)
 
 void show_help() {
     printf("\nFile Manager Commands:\n");
     printf("=====================\n");
-    printf("ls [dir]           - List directory contents\n");
+    printf("ls [dir] [--sort name|size|mtime] [--sync] [--stats] - List directory contents\n");
     printf("cd <dir>           - Change directory\n");
     printf("pwd                - Print working directory\n");
     printf("mkdir <dir>        - Create directory\n");
     printf("rmdir <dir>        - Remove directory\n");
-    printf("cp <src> <dest>    - Copy file/directory\n");
+    printf("cp <src> <dest>    - Copy file/directory (recursive)\n");
     printf("mv <src> <dest>    - Move/rename file/directory\n");
     printf("rm <file>          - Delete file\n");
     printf("cat <file>         - Display file contents\n");
-    printf("find <pattern>     - Search for files\n");
+    printf("head [N] <file>    - Show the first N lines (default 10)\n");
+    printf("tail [N] <file>    - Show the last N lines (default 10)\n");
+    printf("view <file>        - Page through a file\n");
+    printf("find [--regex] <pattern> [dir] [--sorted] [--walk] - Search for files recursively\n");
+    printf("grep <pattern> [path] - Search file contents recursively\n");
     printf("tree [dir]         - Display directory tree\n");
+    printf("du [dir] [--sorted] [--walk] - Show disk usage of each subdirectory\n");
+    printf("largest [N] [dir] [--walk] - Show the N largest files (default 10)\n");
+    printf("index build|refresh|watch|stop|status [dir] - Manage the metadata index\n");
+    printf("dedupe [dir] [--hardlink|--reflink] [--min-size N] - Find duplicate files\n");
     printf("info <file>        - Show file information\n");
     printf("chmod <mode> <file> - Change file permissions\n");
     printf("help               - Show this help\n");
@@ -35,70 +53,6 @@ void show_help() {
     printf("\n");
 }
 
-void list_directory(const char *path) {
-    DIR *dir;
-    struct dirent *entry;
-    struct stat file_stat;
-    char full_path[MAX_PATH];
-    
-    if (path == NULL) {
-        path = ".";
-    }
-    
-    dir = opendir(path);
-    if (dir == NULL) {
-        printf("Error: Cannot open directory '%s'\n", path);
-        return;
-    }
-    
-    printf("\nContents of %s:\n", path);
-    printf("%-15s %-10s %-15s %-20s %s\n", "Permissions", "Size", "Owner", "Modified", "Name");
-    printf("%-15s %-10s %-15s %-20s %s\n", "-----------", "----", "-----", "--------", "----");
-    
-    while ((entry = readdir(dir)) != NULL) {
-        if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) {
-            continue;
-        }
-        
-        snprintf(full_path, sizeof(full_path), "%s/%s", path, entry->d_name);
-        
-        if (stat(full_path, &file_stat) == 0) {
-            char permissions[16];
-            char time_str[32];
-            struct passwd *pwd = getpwuid(file_stat.st_uid);
-            
-            // Format permissions
-            snprintf(permissions, sizeof(permissions), "%c%c%c%c%c%c%c%c%c%c",
-                S_ISDIR(file_stat.st_mode) ? 'd' : '-',
-                file_stat.st_mode & S_IRUSR ? 'r' : '-',
-                file_stat.st_mode & S_IWUSR ? 'w' : '-',
-                file_stat.st_mode & S_IXUSR ? 'x' : '-',
-                file_stat.st_mode & S_IRGRP ? 'r' : '-',
-                file_stat.st_mode & S_IWGRP ? 'w' : '-',
-                file_stat.st_mode & S_IXGRP ? 'x' : '-',
-                file_stat.st_mode & S_IROTH ? 'r' : '-',
-                file_stat.st_mode & S_IWOTH ? 'w' : '-',
-                file_stat.st_mode & S_IXOTH ? 'x' : '-'
-            );
-            
-            // Format time
-            struct tm *tm_info = localtime(&file_stat.st_mtime);
-            strftime(time_str, sizeof(time_str), "%Y-%m-%d %H:%M:%S", tm_info);
-            
-            printf("%-15s %-10ld %-15s %-20s %s\n",
-                permissions,
-                file_stat.st_size,
-                pwd ? pwd->pw_name : "unknown",
-                time_str,
-                entry->d_name
-            );
-        }
-    }
-    
-    closedir(dir);
-    printf("\n");
-}
-
 void change_directory(const char *path) {
     if (chdir(path) == 0) {
         char current_path[MAX_PATH];
@@ -119,99 +73,252 @@ void print_working_directory() {
     }
 }
 
-void create_directory(const char *path) {
+void create_directory(const char *path, FILE *out) {
     if (mkdir(path, 0755) == 0) {
-        printf("Directory '%s' created successfully\n", path);
+        fprintf(out, "Directory '%s' created successfully\n", path);
     } else {
-        printf("Error: Cannot create directory '%s'\n", path);
+        fprintf(out, "Error: Cannot create directory '%s'\n", path);
     }
 }
 
-void remove_directory(const char *path) {
+void remove_directory(const char *path, FILE *out) {
     if (rmdir(path) == 0) {
-        printf("Directory '%s' removed successfully\n", path);
+        fprintf(out, "Directory '%s' removed successfully\n", path);
     } else {
-        printf("Error: Cannot remove directory '%s'\n", path);
+        fprintf(out, "Error: Cannot remove directory '%s'\n", path);
     }
 }
 
-void copy_file(const char *src, const char *dest) {
-    FILE *source = fopen(src, "rb");
-    if (source == NULL) {
-        printf("Error: Cannot open source file '%s'\n", src);
-        return;
+static void format_size(unsigned long long bytes, char *text, size_t size) {
+    static const char units[] = "BKMGTPE";
+    double value = (double)bytes;
+    int unit = 0;
+    while (value >= 1024 && units[unit + 1] != '\0') {
+        value /= 1024;
+        unit++;
     }
-    
-    FILE *destination = fopen(dest, "wb");
-    if (destination == NULL) {
-        printf("Error: Cannot create destination file '%s'\n", dest);
-        fclose(source);
+    if (unit == 0) {
+        snprintf(text, size, "%lluB", bytes);
+    } else {
+        snprintf(text, size, value < 10 ? "%.1f%c" : "%.0f%c", value, units[unit]);
+    }
+}
+
+void copy_file(const char *src, const char *dest, FILE *out) {
+    CopyOptions options;
+    init_copy_options(&options);
+    options.output = out;
+    CopyStats stats;
+    copy_path(src, dest, &options, &stats);
+    if (stats.files + stats.directories + stats.links == 0) {
         return;
     }
-    
-    char buffer[4096];
-    size_t bytes_read;
-    
-    while ((bytes_read = fread(buffer, 1, sizeof(buffer), source)) > 0) {
-        fwrite(buffer, 1, bytes_read, destination);
+
+    char size[16], rate[16];
+    format_size(stats.bytes, size, sizeof(size));
+    format_size(stats.seconds > 0 ? (unsigned long long)(stats.bytes / stats.seconds) : 0, rate, sizeof(rate));
+    fprintf(out, "Copied '%s' to '%s': %llu files, %s in %.3f s (%s/s)\n", src, dest, stats.files, size,
+           stats.seconds, rate);
+    if (stats.directories + stats.links > 0) {
+        fprintf(out, "  %llu directories, %llu symbolic links\n", stats.directories, stats.links);
+    }
+    for (int m = 0; m < COPY_METHODS; m++) {
+        if (stats.by_method[m] > 0) {
+            fprintf(out, "  %llu files by %s\n", stats.by_method[m], copy_method_name((CopyMethod)m));
+        }
+    }
+    fprintf(out, "  %llu system calls moved the data\n", stats.syscalls);
+    if (stats.hole_bytes > 0) {
+        format_size(stats.hole_bytes, size, sizeof(size));
+        fprintf(out, "  %s of holes preserved\n", size);
+    }
+    if (stats.errors > 0) {
+        fprintf(out, "  %llu errors\n", stats.errors);
     }
-    
-    fclose(source);
-    fclose(destination);
-    printf("File copied from '%s' to '%s'\n", src, dest);
 }
 
-void move_file(const char *src, const char *dest) {
+void move_file(const char *src, const char *dest, FILE *out) {
     if (rename(src, dest) == 0) {
-        printf("File moved from '%s' to '%s'\n", src, dest);
+        fprintf(out, "File moved from '%s' to '%s'\n", src, dest);
     } else {
-        printf("Error: Cannot move file from '%s' to '%s'\n", src, dest);
+        fprintf(out, "Error: Cannot move file from '%s' to '%s'\n", src, dest);
     }
 }
 
-void delete_file(const char *path) {
+void delete_file(const char *path, FILE *out) {
     if (unlink(path) == 0) {
-        printf("File '%s' deleted successfully\n", path);
+        fprintf(out, "File '%s' deleted successfully\n", path);
     } else {
-        printf("Error: Cannot delete file '%s'\n", path);
+        fprintf(out, "Error: Cannot delete file '%s'\n", path);
     }
 }
 
 void display_file(const char *path) {
-    FILE *file = fopen(path, "r");
-    if (file == NULL) {
-        printf("Error: Cannot open file '%s'\n", path);
-        return;
+    cat_file(path);
+}
+
+// Takes [N] <file> from the rest of a head or tail command
+static const char* line_count_arguments(long *lines) {
+    char *first = strtok(NULL, " \t\n");
+    char *second = strtok(NULL, " \t\n");
+    *lines = 10;
+    if (second == NULL) return first;
+    char *end;
+    *lines = strtol(first, &end, 10);
+    if (*end != '\0' || *lines < 0) {
+        printf("Error: Invalid line count '%s'\n", first);
+        return NULL;
     }
-    
-    char buffer[1024];
-    while (fgets(buffer, sizeof(buffer), file) != NULL) {
-        printf("%s", buffer);
+    return second;
+}
+
+// Walks path, or replays it from the index covering it unless walk is
+// set. Returns 1 if the index answered, 0 if the disk was walked, -1 if
+// path could not be read.
+static int walk_or_index(const char *path, const WalkOptions *options, WalkStats *stats, int walk) {
+    Index index;
+    char relative[4096];
+    if (!walk && open_index_for(path, &index, relative, sizeof(relative)) == 0) {
+        char built[32];
+        time_t when = (time_t)index.built;
+        strftime(built, sizeof(built), "%Y-%m-%d %H:%M:%S", localtime(&when));
+        printf("(from the index of %s, updated %s)\n", index.root, built);
+        fflush(stdout);
+        int result = index_walk(&index, relative, path, options, stats);
+        close_index(&index);
+        if (result == 0) {
+            return 1;
+        }
     }
-    
-    fclose(file);
+    return walk_tree(path, options, stats) == 0 ? 0 : -1;
 }
 
-void find_files(const char *pattern) {
-    // Simple implementation - searches in current directory only
-    DIR *dir;
-    struct dirent *entry;
-    
-    dir = opendir(".");
-    if (dir == NULL) {
-        printf("Error: Cannot open current directory\n");
+// Matches are collected per walker thread and written a buffer at a time,
+// so lines from different threads never interleave
+typedef struct {
+    char *buffer;
+    size_t length;
+    unsigned long long matches;
+    unsigned long long pruned;
+} FindOutput;
+
+typedef struct {
+    Pattern pattern;
+    size_t relative_offset;     // where the path below the searched directory starts
+    FindOutput outputs[WALK_MAX_THREADS];
+} FindSearch;
+
+static void flush_output(FindOutput *output) {
+    fwrite(output->buffer, 1, output->length, stdout);
+    output->length = 0;
+}
+
+static int find_visit(const WalkEntry *entry, void *arg) {
+    FindSearch *search = arg;
+    FindOutput *output = &search->outputs[entry->worker];
+    const char *relative = entry->path + search->relative_offset;
+    int result = WALK_CONTINUE;
+    if (entry->type == DT_DIR && !pattern_may_match_below(&search->pattern, relative)) {
+        output->pruned++;
+        result = WALK_SKIP;
+    }
+    if (!pattern_matches(&search->pattern, search->pattern.match_path ? relative : entry->name)) {
+        return result;
+    }
+
+    size_t length = strlen(entry->path);
+    output->matches++;
+    if (output->buffer == NULL) {
+        output->buffer = malloc(OUTPUT_BUFFER);
+        if (output->buffer == NULL) {
+            printf("%s\n", entry->path);
+            return result;
+        }
+    }
+    if (output->length + length + 1 > OUTPUT_BUFFER) {
+        flush_output(output);
+    }
+    if (length + 1 > OUTPUT_BUFFER) {
+        printf("%s\n", entry->path);
+    } else {
+        memcpy(output->buffer + output->length, entry->path, length);
+        output->buffer[output->length + length] = '\n';
+        output->length += length + 1;
+    }
+    return result;
+}
+
+static const char *pattern_kinds[] = { "pattern", "glob", "regex" };
+
+// Matches a plain pattern anywhere in the name, a glob against the whole
+// name (or the path below dir if it has a '/'), a regex as grep -E would
+void find_files(const char *pattern, const char *path, int sorted, int walk, int regex) {
+    FindSearch search;
+    memset(&search, 0, sizeof(search));
+    PatternKind kind = regex ? PATTERN_REGEX : guess_pattern_kind(pattern);
+    if (compile_pattern(&search.pattern, pattern, kind) != 0) {
         return;
     }
-    
-    printf("Searching for pattern: %s\n", pattern);
-    
-    while ((entry = readdir(dir)) != NULL) {
-        if (strstr(entry->d_name, pattern) != NULL) {
-            printf("%s\n", entry->d_name);
+    // Entries are reported as path joined to what is below it, the way
+    // walk_tree joins them
+    size_t path_length = strlen(path);
+    while (path_length > 1 && path[path_length - 1] == '/') path_length--;
+    search.relative_offset = strcmp(path, "/") == 0 ? 1 : path_length + 1;
+
+    WalkOptions options;
+    init_walk_options(&options);
+    options.flags = sorted ? WALK_SORTED : 0;
+    options.visit = find_visit;
+    options.arg = &search;
+
+    printf("Searching for %s: %s\n", pattern_kinds[kind], pattern);
+    fflush(stdout);
+
+    WalkStats stats;
+    if (walk_or_index(path, &options, &stats, walk) < 0) {
+        printf("Error: Cannot open directory '%s'\n", path);
+        free_pattern(&search.pattern);
+        return;
+    }
+
+    unsigned long long matches = 0, pruned = 0;
+    for (int i = 0; i < WALK_MAX_THREADS; i++) {
+        if (search.outputs[i].buffer != NULL) {
+            flush_output(&search.outputs[i]);
+            free(search.outputs[i].buffer);
         }
+        matches += search.outputs[i].matches;
+        pruned += search.outputs[i].pruned;
+    }
+    printf("%llu matches among %llu entries\n", matches, stats.entries);
+    if (pruned > 0) {
+        printf("(%llu directories skipped as unable to match)\n", pruned);
+    }
+    if (stats.errors > 0) {
+        printf("(%llu directories could not be read)\n", stats.errors);
+    }
+    free_pattern(&search.pattern);
+}
+
+void grep_files(const char *pattern, const char *path) {
+    GrepOptions options;
+    init_grep_options(&options);
+    GrepStats stats;
+    if (grep_path(pattern, path, &options, &stats) != 0) {
+        return;
+    }
+
+    char size[16], rate[16];
+    format_size(stats.bytes, size, sizeof(size));
+    format_size(stats.seconds > 0 ? (unsigned long long)(stats.bytes / stats.seconds) : 0, rate, sizeof(rate));
+    printf("%llu matching lines in %llu of %llu files, %s in %.3f s (%s/s)\n", stats.lines,
+           stats.matched_files, stats.files, size, stats.seconds, rate);
+    if (stats.binary_files > 0) {
+        printf("(%llu binary files skipped)\n", stats.binary_files);
+    }
+    if (stats.errors > 0) {
+        printf("(%llu files or directories could not be read)\n", stats.errors);
     }
-    
-    closedir(dir);
 }
 
 void show_file_info(const char *path) {
@@ -222,9 +329,6 @@ void show_file_info(const char *path) {
         return;
     }
     
-    struct passwd *pwd = getpwuid(file_stat.st_uid);
-    struct group *grp = getgrgid(file_stat.st_gid);
-    
     printf("\nFile Information: %s\n", path);
     printf("====================\n");
     printf("Type: %s\n", S_ISDIR(file_stat.st_mode) ? "Directory" : 
@@ -242,8 +346,8 @@ void show_file_info(const char *path) {
         file_stat.st_mode & S_IWOTH ? 'w' : '-',
         file_stat.st_mode & S_IXOTH ? 'x' : '-'
     );
-    printf("Owner: %s\n", pwd ? pwd->pw_name : "unknown");
-    printf("Group: %s\n", grp ? grp->gr_name : "unknown");
+    printf("Owner: %s\n", user_name(file_stat.st_uid));
+    printf("Group: %s\n", group_name(file_stat.st_gid));
     
     struct tm *tm_info = localtime(&file_stat.st_mtime);
     char time_str[64];
@@ -252,7 +356,7 @@ void show_file_info(const char *path) {
     printf("\n");
 }
 
-void change_permissions(const char *mode_str, const char *path) {
+void change_permissions(const char *mode_str, const char *path, FILE *out) {
     mode_t mode = 0;
     
     // Parse octal mode
@@ -266,55 +370,326 @@ void change_permissions(const char *mode_str, const char *path) {
                (mode_str[2] - '0');
         
         if (chmod(path, mode) == 0) {
-            printf("Permissions changed for '%s' to %s\n", path, mode_str);
+            fprintf(out, "Permissions changed for '%s' to %s\n", path, mode_str);
         } else {
-            printf("Error: Cannot change permissions for '%s'\n", path);
+            fprintf(out, "Error: Cannot change permissions for '%s'\n", path);
         }
     } else {
-        printf("Error: Invalid permission mode '%s'. Use 3-digit octal (e.g., 755)\n", mode_str);
+        fprintf(out, "Error: Invalid permission mode '%s'. Use 3-digit octal (e.g., 755)\n", mode_str);
+    }
+}
+
+static int tree_visit(const WalkEntry *entry, void *arg) {
+    (void)arg;
+    for (int i = 0; i < entry->depth; i++) {
+        printf("│   ");
     }
+    printf(entry->type == DT_DIR ? "├── %s/\n" : "├── %s\n", entry->name);
+    return WALK_CONTINUE;
 }
 
-void show_tree(const char *path, int depth, int max_depth) {
-    if (depth > max_depth) {
+void show_tree(const char *path, int max_depth) {
+    WalkOptions options;
+    init_walk_options(&options);
+    options.flags = WALK_SORTED;
+    options.max_depth = max_depth;
+    options.visit = tree_visit;
+
+    if (walk_or_index(path, &options, NULL, 0) < 0) {
+        printf("Error: Cannot open directory '%s'\n", path);
+    }
+}
+
+// Reports the starting directory and its immediate subdirectories
+static void du_leave(const WalkEntry *directory, const WalkTotals *totals, void *arg) {
+    (void)arg;
+    if (directory->depth > 0) {
         return;
     }
-    
-    DIR *dir;
-    struct dirent *entry;
-    char full_path[MAX_PATH];
-    
-    if (path == NULL) {
-        path = ".";
+    char size[16];
+    format_size(totals->bytes, size, sizeof(size));
+    printf("%-8s %s\n", size, directory->path);
+    if (directory->depth < 0) {
+        printf("%llu files, %llu directories\n", totals->files, totals->directories);
     }
-    
-    dir = opendir(path);
-    if (dir == NULL) {
+}
+
+void disk_usage(const char *path, int sorted, int walk) {
+    WalkOptions options;
+    init_walk_options(&options);
+    options.flags = WALK_STAT | (sorted ? WALK_SORTED : 0);
+    options.leave = du_leave;
+
+    WalkStats stats;
+    if (walk_or_index(path, &options, &stats, walk) < 0) {
+        printf("Error: Cannot open directory '%s'\n", path);
         return;
     }
-    
-    while ((entry = readdir(dir)) != NULL) {
-        if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) {
-            continue;
+    if (stats.errors > 0) {
+        printf("(%llu directories could not be read)\n", stats.errors);
+    }
+}
+
+// The largest files seen by each walker thread, smallest at the top
+typedef struct {
+    unsigned long long *sizes;
+    char **paths;
+    int count;
+} LargestHeap;
+
+typedef struct {
+    int limit;
+    LargestHeap heaps[WALK_MAX_THREADS];
+} LargestSearch;
+
+static void sift_down(LargestHeap *heap, int i) {
+    for (;;) {
+        int smallest = i, left = 2 * i + 1, right = left + 1;
+        if (left < heap->count && heap->sizes[left] < heap->sizes[smallest]) smallest = left;
+        if (right < heap->count && heap->sizes[right] < heap->sizes[smallest]) smallest = right;
+        if (smallest == i) return;
+        unsigned long long size = heap->sizes[i];
+        char *path = heap->paths[i];
+        heap->sizes[i] = heap->sizes[smallest];
+        heap->paths[i] = heap->paths[smallest];
+        heap->sizes[smallest] = size;
+        heap->paths[smallest] = path;
+        i = smallest;
+    }
+}
+
+// Keeps path if it is among the limit largest; takes ownership of path
+static void offer_largest(LargestHeap *heap, int limit, unsigned long long size, char *path) {
+    if (heap->count == limit) {
+        if (size <= heap->sizes[0]) {
+            free(path);
+            return;
         }
-        
-        // Print indentation
-        for (int i = 0; i < depth; i++) {
-            printf("│   ");
+        free(heap->paths[0]);
+        heap->sizes[0] = size;
+        heap->paths[0] = path;
+        sift_down(heap, 0);
+        return;
+    }
+    int i = heap->count++;
+    heap->sizes[i] = size;
+    heap->paths[i] = path;
+    while (i > 0 && heap->sizes[(i - 1) / 2] > heap->sizes[i]) {
+        int parent = (i - 1) / 2;
+        heap->sizes[i] = heap->sizes[parent];
+        heap->paths[i] = heap->paths[parent];
+        heap->sizes[parent] = size;
+        heap->paths[parent] = path;
+        i = parent;
+    }
+}
+
+static int largest_visit(const WalkEntry *entry, void *arg) {
+    LargestSearch *search = arg;
+    if (entry->type != DT_REG) {
+        return WALK_CONTINUE;
+    }
+    LargestHeap *heap = &search->heaps[entry->worker];
+    unsigned long long size = (unsigned long long)entry->stat->st_size;
+    if (heap->count == search->limit && size <= heap->sizes[0]) {
+        return WALK_CONTINUE;
+    }
+    if (heap->sizes == NULL) {
+        heap->sizes = malloc(search->limit * sizeof(unsigned long long));
+        heap->paths = malloc(search->limit * sizeof(char *));
+        if (heap->sizes == NULL || heap->paths == NULL) {
+            free(heap->sizes);
+            free(heap->paths);
+            heap->sizes = NULL;
+            heap->paths = NULL;
+            return WALK_CONTINUE;
         }
-        
-        // Print entry
-        struct stat entry_stat;
-        snprintf(full_path, sizeof(full_path), "%s/%s", path, entry->d_name);
-        if (stat(full_path, &entry_stat) == 0 && S_ISDIR(entry_stat.st_mode)) {
-            printf("├── %s/\n", entry->d_name);
-            show_tree(full_path, depth + 1, max_depth);
+    }
+    char *path = strdup(entry->path);
+    if (path != NULL) {
+        offer_largest(heap, search->limit, size, path);
+    }
+    return WALK_CONTINUE;
+}
+
+void largest_files(const char *path, int limit, int walk) {
+    LargestSearch *search = calloc(1, sizeof(LargestSearch));
+    if (search == NULL) {
+        printf("Memory allocation failed!\n");
+        return;
+    }
+    search->limit = limit;
+
+    WalkOptions options;
+    init_walk_options(&options);
+    options.flags = WALK_STAT;
+    options.visit = largest_visit;
+    options.arg = search;
+
+    WalkStats stats;
+    if (walk_or_index(path, &options, &stats, walk) < 0) {
+        printf("Error: Cannot open directory '%s'\n", path);
+    } else {
+        // Every thread's heap into the first, then largest first
+        LargestHeap *all = &search->heaps[0];
+        for (int i = 1; i < WALK_MAX_THREADS; i++) {
+            LargestHeap *heap = &search->heaps[i];
+            for (int j = 0; j < heap->count; j++) {
+                if (all->sizes == NULL) {
+                    *all = *heap;
+                    heap->sizes = NULL;
+                    heap->paths = NULL;
+                    heap->count = 0;
+                    break;
+                }
+                offer_largest(all, limit, heap->sizes[j], heap->paths[j]);
+            }
+            if (heap->sizes != NULL) heap->count = 0;
+        }
+        int count = all->count;
+        while (all->count > 1) {
+            int last = --all->count;
+            unsigned long long size = all->sizes[0];
+            char *largest = all->paths[0];
+            all->sizes[0] = all->sizes[last];
+            all->paths[0] = all->paths[last];
+            all->sizes[last] = size;
+            all->paths[last] = largest;
+            sift_down(all, 0);
+        }
+        for (int i = 0; i < count; i++) {
+            char size[16];
+            format_size(all->sizes[i], size, sizeof(size));
+            printf("%-8s %s\n", size, all->paths[i]);
+            free(all->paths[i]);
+        }
+        printf("%d largest of %llu entries\n", count, stats.entries);
+    }
+    for (int i = 0; i < WALK_MAX_THREADS; i++) {
+        free(search->heaps[i].sizes);
+        free(search->heaps[i].paths);
+    }
+    free(search);
+}
+
+static void print_duplicate_set(const char *const *paths, int count, unsigned long long size, void *arg) {
+    (void)arg;
+    char each[16], wasted[16];
+    format_size(size, each, sizeof(each));
+    format_size(size * (unsigned long long)(count - 1), wasted, sizeof(wasted));
+    printf("%d copies of %s (%s wasted)\n", count, each, wasted);
+    for (int i = 0; i < count; i++) {
+        printf("  %s\n", paths[i]);
+    }
+}
+
+void dedupe_files(const char *path, DedupeMode mode, unsigned long long min_size) {
+    DedupeOptions options;
+    init_dedupe_options(&options);
+    options.mode = mode;
+    if (min_size > 0) {
+        options.min_size = min_size;
+    }
+    printf("Looking for duplicates in %s\n", path);
+    fflush(stdout);
+
+    DedupeStats stats;
+    if (find_duplicates(path, &options, print_duplicate_set, NULL, &stats) != 0) {
+        printf("Error: Cannot open directory '%s'\n", path);
+        return;
+    }
+    char wasted[16], read[16], rate[16];
+    format_size(stats.wasted, wasted, sizeof(wasted));
+    format_size(stats.bytes_read, read, sizeof(read));
+    format_size(stats.seconds > 0 ? (unsigned long long)(stats.bytes_read / stats.seconds) : 0, rate, sizeof(rate));
+    printf("%llu sets, %llu duplicate files holding %s\n", stats.sets, stats.duplicates, wasted);
+    printf("%llu files, %llu sharing a size, %llu sharing their first %d bytes; read %s in %.3f s (%s/s, %d threads)\n",
+           stats.files, stats.same_size, stats.same_head, DEDUPE_HEAD, read, stats.seconds, rate,
+           stats.threads);
+    if (mode != DEDUPE_REPORT) {
+        char reclaimed[16];
+        format_size(stats.reclaimed, reclaimed, sizeof(reclaimed));
+        printf("%s %llu duplicates, reclaiming %s\n", mode == DEDUPE_HARDLINK ? "Linked" : "Shared blocks of",
+               stats.linked, reclaimed);
+    }
+    if (stats.errors > 0) {
+        printf("(%llu files or directories could not be read or linked)\n", stats.errors);
+    }
+}
+
+static void print_index_stats(const char *action, const IndexStats *stats) {
+    char size[16];
+    format_size(stats->file_size, size, sizeof(size));
+    printf("%s %llu entries in %.3f s: %llu of %llu directories read, %llu stat calls, %s index\n",
+           action, stats->entries, stats->seconds, stats->rescanned, stats->directories,
+           stats->stat_calls, size);
+}
+
+void index_command(const char *action, const char *path) {
+    IndexStats stats;
+    if (strcmp(action, "build") == 0) {
+        if (build_index(path, &stats) == 0) {
+            print_index_stats("Indexed", &stats);
+        }
+    } else if (strcmp(action, "refresh") == 0) {
+        if (refresh_index(path, &stats) == 0) {
+            print_index_stats("Refreshed", &stats);
+        }
+    } else if (strcmp(action, "watch") == 0) {
+        unsigned long long updates, directories;
+        if (start_index_watch(path) == 0) {
+            const char *root = index_watch_status(&updates, &directories);
+            printf("Watching %llu directories under %s\n", directories, root);
+        }
+    } else if (strcmp(action, "stop") == 0) {
+        unsigned long long updates, directories;
+        const char *root = index_watch_status(&updates, &directories);
+        if (root == NULL) {
+            printf("Error: Not watching anything\n");
+            return;
+        }
+        printf("Stopped watching %s after %llu updates\n", root, updates);
+        stop_index_watch();
+    } else if (strcmp(action, "status") == 0) {
+        Index index;
+        char relative[4096];
+        if (open_index_for(path, &index, relative, sizeof(relative)) != 0) {
+            printf("No index covers '%s'\n", path);
         } else {
-            printf("├── %s\n", entry->d_name);
+            char size[16], built[32];
+            time_t when = (time_t)index.built;
+            format_size(index.size, size, sizeof(size));
+            strftime(built, sizeof(built), "%Y-%m-%d %H:%M:%S", localtime(&when));
+            printf("Index of %s: %llu entries, %s, updated %s\n", index.root, index.count, size, built);
+            close_index(&index);
         }
+        unsigned long long updates, directories;
+        const char *root = index_watch_status(&updates, &directories);
+        if (root != NULL) {
+            printf("Watching %llu directories under %s, %llu updates so far\n", directories, root, updates);
+        }
+    } else {
+        printf("Error: Unknown index command '%s'\n", action);
     }
-    
-    closedir(dir);
+}
+
+// Takes an optional directory, --sorted and --walk from the rest of the
+// command
+static const char* walk_arguments(int *sorted, int *walk) {
+    const char *path = NULL;
+    char *token;
+    *sorted = 0;
+    *walk = 0;
+    while ((token = strtok(NULL, " \t\n")) != NULL) {
+        if (strcmp(token, "--sorted") == 0) {
+            *sorted = 1;
+        } else if (strcmp(token, "--walk") == 0) {
+            *walk = 1;
+        } else if (path == NULL) {
+            path = token;
+        }
+    }
+    return path != NULL ? path : ".";
 }
 
 void parse_command(const char *command) {
@@ -330,8 +705,25 @@ void parse_command(const char *command) {
         show_help();
     }
     else if (strcmp(token, "ls") == 0) {
-        token = strtok(NULL, " \t\n");
-        list_directory(token);
+        const char *path = NULL;
+        ListOptions options;
+        init_list_options(&options);
+        while ((token = strtok(NULL, " \t\n")) != NULL) {
+            if (strcmp(token, "--sync") == 0) {
+                options.sync = 1;
+            } else if (strcmp(token, "--stats") == 0) {
+                options.show_stats = 1;
+            } else if (strcmp(token, "--sort") == 0) {
+                token = strtok(NULL, " \t\n");
+                if (token == NULL || parse_list_sort(token, &options.sort) != 0) {
+                    printf("Error: --sort takes name, size or mtime\n");
+                    return;
+                }
+            } else if (path == NULL) {
+                path = token;
+            }
+        }
+        list_directory(path, &options);
     }
     else if (strcmp(token, "cd") == 0) {
         token = strtok(NULL, " \t\n");
@@ -347,7 +739,7 @@ void parse_command(const char *command) {
     else if (strcmp(token, "mkdir") == 0) {
         token = strtok(NULL, " \t\n");
         if (token != NULL) {
-            create_directory(token);
+            create_directory(token, stdout);
         } else {
             printf("Error: Directory name required\n");
         }
@@ -355,7 +747,7 @@ void parse_command(const char *command) {
     else if (strcmp(token, "rmdir") == 0) {
         token = strtok(NULL, " \t\n");
         if (token != NULL) {
-            remove_directory(token);
+            remove_directory(token, stdout);
         } else {
             printf("Error: Directory name required\n");
         }
@@ -364,7 +756,7 @@ void parse_command(const char *command) {
         char *src = strtok(NULL, " \t\n");
         char *dest = strtok(NULL, " \t\n");
         if (src != NULL && dest != NULL) {
-            copy_file(src, dest);
+            copy_file(src, dest, stdout);
         } else {
             printf("Error: Source and destination required\n");
         }
@@ -373,7 +765,7 @@ void parse_command(const char *command) {
         char *src = strtok(NULL, " \t\n");
         char *dest = strtok(NULL, " \t\n");
         if (src != NULL && dest != NULL) {
-            move_file(src, dest);
+            move_file(src, dest, stdout);
         } else {
             printf("Error: Source and destination required\n");
         }
@@ -381,7 +773,7 @@ void parse_command(const char *command) {
     else if (strcmp(token, "rm") == 0) {
         token = strtok(NULL, " \t\n");
         if (token != NULL) {
-            delete_file(token);
+            delete_file(token, stdout);
         } else {
             printf("Error: File name required\n");
         }
@@ -394,10 +786,47 @@ void parse_command(const char *command) {
             printf("Error: File name required\n");
         }
     }
-    else if (strcmp(token, "find") == 0) {
+    else if (strcmp(token, "head") == 0 || strcmp(token, "tail") == 0) {
+        int head = strcmp(token, "head") == 0;
+        long lines;
+        const char *path = line_count_arguments(&lines);
+        if (path != NULL) {
+            if (head) {
+                head_file(path, lines);
+            } else {
+                tail_file(path, lines);
+            }
+        } else if (lines >= 0) {
+            printf("Error: File name required\n");
+        }
+    }
+    else if (strcmp(token, "view") == 0) {
         token = strtok(NULL, " \t\n");
         if (token != NULL) {
-            find_files(token);
+            view_file(token, stdin);
+        } else {
+            printf("Error: File name required\n");
+        }
+    }
+    else if (strcmp(token, "find") == 0) {
+        char *pattern = strtok(NULL, " \t\n");
+        int regex = pattern != NULL && strcmp(pattern, "--regex") == 0;
+        if (regex) {
+            pattern = strtok(NULL, " \t\n");
+        }
+        if (pattern != NULL) {
+            int sorted, walk;
+            const char *path = walk_arguments(&sorted, &walk);
+            find_files(pattern, path, sorted, walk, regex);
+        } else {
+            printf("Error: Search pattern required\n");
+        }
+    }
+    else if (strcmp(token, "grep") == 0) {
+        char *pattern = strtok(NULL, " \t\n");
+        char *path = strtok(NULL, " \t\n");
+        if (pattern != NULL) {
+            grep_files(pattern, path != NULL ? path : ".");
         } else {
             printf("Error: Search pattern required\n");
         }
@@ -405,7 +834,60 @@ void parse_command(const char *command) {
     else if (strcmp(token, "tree") == 0) {
         token = strtok(NULL, " \t\n");
         printf("Directory tree:\n");
-        show_tree(token, 0, 3);  // Limit depth to 3 levels
+        show_tree(token != NULL ? token : ".", 3);  // Limit depth to 3 levels
+    }
+    else if (strcmp(token, "du") == 0) {
+        int sorted, walk;
+        const char *path = walk_arguments(&sorted, &walk);
+        disk_usage(path, sorted, walk);
+    }
+    else if (strcmp(token, "largest") == 0) {
+        const char *path = NULL;
+        int limit = 10, walk = 0;
+        while ((token = strtok(NULL, " \t\n")) != NULL) {
+            char *end;
+            long value = strtol(token, &end, 10);
+            if (strcmp(token, "--walk") == 0) {
+                walk = 1;
+            } else if (*end == '\0' && value > 0 && value <= 100000) {
+                limit = (int)value;
+            } else if (path == NULL) {
+                path = token;
+            }
+        }
+        largest_files(path != NULL ? path : ".", limit, walk);
+    }
+    else if (strcmp(token, "dedupe") == 0) {
+        const char *path = NULL;
+        DedupeMode mode = DEDUPE_REPORT;
+        unsigned long long min_size = 0;
+        while ((token = strtok(NULL, " \t\n")) != NULL) {
+            if (strcmp(token, "--hardlink") == 0) {
+                mode = DEDUPE_HARDLINK;
+            } else if (strcmp(token, "--reflink") == 0) {
+                mode = DEDUPE_REFLINK;
+            } else if (strcmp(token, "--min-size") == 0) {
+                char *value = strtok(NULL, " \t\n");
+                char *end = NULL;
+                if (value != NULL) min_size = strtoull(value, &end, 10);
+                if (value == NULL || *end != '\0') {
+                    printf("Error: --min-size needs a number of bytes\n");
+                    return;
+                }
+            } else if (path == NULL) {
+                path = token;
+            }
+        }
+        dedupe_files(path != NULL ? path : ".", mode, min_size);
+    }
+    else if (strcmp(token, "index") == 0) {
+        char *action = strtok(NULL, " \t\n");
+        char *path = strtok(NULL, " \t\n");
+        if (action != NULL) {
+            index_command(action, path != NULL ? path : ".");
+        } else {
+            printf("Error: index build|refresh|watch|stop|status [dir]\n");
+        }
     }
     else if (strcmp(token, "info") == 0) {
         token = strtok(NULL, " \t\n");
@@ -419,7 +901,7 @@ void parse_command(const char *command) {
         char *mode = strtok(NULL, " \t\n");
         char *file = strtok(NULL, " \t\n");
         if (mode != NULL && file != NULL) {
-            change_permissions(mode, file);
+            change_permissions(mode, file, stdout);
         } else {
             printf("Error: Mode and file name required\n");
         }
@@ -430,21 +912,127 @@ void parse_command(const char *command) {
     }
 }
 
+// Script commands
+
+// Splits a command into words with strtok_r, which unlike parse_command's
+// strtok is safe on the batch threads. Returns the number of words, of
+// which the first max are stored.
+static int split_words(char *command, char *words[], int max) {
+    char *save;
+    int count = 0;
+    for (char *word = strtok_r(command, " \t\n", &save); word != NULL; word = strtok_r(NULL, " \t\n", &save)) {
+        if (count < max) words[count] = word;
+        count++;
+    }
+    return count;
+}
+
+// The commands a script may run concurrently, and the paths they read and
+// write; anything else runs alone
+static int plan_script_command(char *command, BatchAccess accesses[BATCH_MAX_ACCESSES], void *arg) {
+    (void)arg;
+    char *words[3];
+    int count = split_words(command, words, 3);
+    if (count == 2 && (strcmp(words[0], "mkdir") == 0 || strcmp(words[0], "rmdir") == 0 ||
+                       strcmp(words[0], "rm") == 0)) {
+        accesses[0].path = words[1];
+        accesses[0].write = 1;
+        return 1;
+    }
+    if (count == 3 && strcmp(words[0], "chmod") == 0) {
+        accesses[0].path = words[2];
+        accesses[0].write = 1;
+        return 1;
+    }
+    if (count == 3 && (strcmp(words[0], "cp") == 0 || strcmp(words[0], "mv") == 0)) {
+        accesses[0].path = words[1];
+        accesses[0].write = words[0][0] == 'm';
+        accesses[1].path = words[2];
+        accesses[1].write = 1;
+        return 2;
+    }
+    return -1;
+}
+
+static int run_script_command(const char *command, FILE *out, void *arg) {
+    (void)arg;
+    char copy[MAX_COMMAND];
+    if (strlen(command) >= sizeof(copy)) {
+        fprintf(out, "Error: Command too long\n");
+        return 0;
+    }
+    strcpy(copy, command);
+    char *words[3];
+    int count = split_words(copy, words, 3);
+    if (count == 1 && (strcmp(words[0], "quit") == 0 || strcmp(words[0], "exit") == 0)) {
+        return 1;
+    }
+
+    if (count == 2 && strcmp(words[0], "mkdir") == 0) {
+        create_directory(words[1], out);
+    } else if (count == 2 && strcmp(words[0], "rmdir") == 0) {
+        remove_directory(words[1], out);
+    } else if (count == 2 && strcmp(words[0], "rm") == 0) {
+        delete_file(words[1], out);
+    } else if (count == 3 && strcmp(words[0], "chmod") == 0) {
+        change_permissions(words[1], words[2], out);
+    } else if (count == 3 && strcmp(words[0], "cp") == 0) {
+        copy_file(words[1], words[2], out);
+    } else if (count == 3 && strcmp(words[0], "mv") == 0) {
+        move_file(words[1], words[2], out);
+    } else {
+        parse_command(command);     // a barrier, so on this thread alone and out is stdout
+    }
+    return 0;
+}
+
+int run_script(const char *path, int threads) {
+    BatchOptions options;
+    init_batch_options(&options);
+    options.threads = threads;
+    options.plan = plan_script_command;
+    options.run = run_script_command;
+    return run_batch(path, &options, NULL);
+}
+
 int main(int argc, char *argv[]) {
     char command[MAX_COMMAND];
     char initial_dir[MAX_PATH];
+    const char *directory = NULL;
+    char script[PATH_MAX] = "";
+    int threads = 0;
+
+    for (int i = 1; i < argc; i++) {
+        if ((strcmp(argv[i], "-c") == 0 || strcmp(argv[i], "--script") == 0) && i + 1 < argc) {
+            // Found from where file_manager was started, not the directory it moves to
+            i++;
+            if (strcmp(argv[i], "-") == 0 || realpath(argv[i], script) == NULL) {
+                snprintf(script, sizeof(script), "%s", argv[i]);
+            }
+        } else if (strcmp(argv[i], "-j") == 0 && i + 1 < argc) {
+            threads = atoi(argv[++i]);
+        } else if (directory == NULL) {
+            directory = argv[i];
+        }
+    }
     
     // Set initial directory
-    if (argc > 1) {
-        if (chdir(argv[1]) == 0) {
-            strcpy(initial_dir, argv[1]);
+    if (directory != NULL) {
+        if (chdir(directory) == 0) {
+            snprintf(initial_dir, sizeof(initial_dir), "%s", directory);
         } else {
-            printf("Error: Cannot access directory '%s', using current directory\n", argv[1]);
+            printf("Error: Cannot access directory '%s', using current directory\n", directory);
             getcwd(initial_dir, sizeof(initial_dir));
         }
     } else {
         getcwd(initial_dir, sizeof(initial_dir));
     }
+
+    if (script[0] != '\0') {
+        int result = run_script(script, threads);
+        stop_index_watch();
+        return result == 0 ? 0 : 1;
+    }
     
     printf("File Manager\n");
     printf("============\n");
@@ -470,6 +1058,7 @@ int main(int argc, char *argv[]) {
         }
     }
     
+    stop_index_watch();
     printf("Goodbye!\n");
     return 0;
 }
@@ -0,0 +1,1226 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <time.h>
+#include <dirent.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sys/inotify.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "index.h"
+#include "walker.h"
+
+#define INDEX_MAGIC "FMINDEX1"
+#define INDEX_TEMP INDEX_FILE ".tmp."     // + six characters from mkstemp
+#define POOL_BLOCK (1 << 20)
+#define WATCH_QUIET_MS 200          // events are gathered until this long passes without any
+#define WATCH_MAX_DELAY_MS 2000     // ... or this long since the first
+#define WATCH_MASK (IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | IN_MODIFY | \
+                    IN_CLOSE_WRITE | IN_ATTRIB | IN_ONLYDIR | IN_DONT_FOLLOW)
+
+typedef struct {
+    char magic[8];
+    uint64_t count;
+    int64_t built;
+    uint64_t paths_offset;
+    uint64_t paths_size;
+    uint64_t restarts_offset;
+    uint64_t sizes_offset;
+    uint64_t blocks_offset;
+    uint64_t inodes_offset;
+    uint64_t mtimes_offset;
+    uint64_t modes_offset;
+    uint64_t nlinks_offset;
+} IndexHeader;
+
+static double now_seconds() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static int is_index_file(const char *name) {
+    return strcmp(name, INDEX_FILE) == 0 ||
+           (strncmp(name, INDEX_TEMP, strlen(INDEX_TEMP)) == 0 && strlen(name) == strlen(INDEX_TEMP) + 6);
+}
+
+// Builds and refreshes, the watch's among them, run one at a time, so a
+// refresh never starts from an index another is about to replace
+static pthread_mutex_t writer_lock = PTHREAD_MUTEX_INITIALIZER;
+
+// Byte order with '/' below everything else, so "a/b" and all of "a/b/..."
+// sort before "a/b-c" and "a/b.txt"
+static int path_compare(const char *a, const char *b) {
+    const unsigned char *x = (const unsigned char *)a, *y = (const unsigned char *)b;
+    while (*x != '\0' && *x == *y) {
+        x++;
+        y++;
+    }
+    int cx = *x == '/' ? 1 : *x < '/' && *x != '\0' ? *x + 1 : *x;
+    int cy = *y == '/' ? 1 : *y < '/' && *y != '\0' ? *y + 1 : *y;
+    return cx - cy;
+}
+
+static long long mtime_of(const struct stat *st) {
+    return (long long)st->st_mtim.tv_sec * 1000000000LL + st->st_mtim.tv_nsec;
+}
+
+// Path storage that never moves what it has handed out
+
+typedef struct PoolBlock {
+    struct PoolBlock *next;
+    size_t used;
+    size_t capacity;
+    char data[];
+} PoolBlock;
+
+static const char* pool_copy(PoolBlock **pool, const char *text, size_t length) {
+    PoolBlock *block = *pool;
+    if (block == NULL || block->used + length + 1 > block->capacity) {
+        size_t capacity = length + 1 > POOL_BLOCK ? length + 1 : POOL_BLOCK;
+        block = malloc(sizeof(PoolBlock) + capacity);
+        if (block == NULL) return NULL;
+        block->next = *pool;
+        block->used = 0;
+        block->capacity = capacity;
+        *pool = block;
+    }
+    char *copy = block->data + block->used;
+    memcpy(copy, text, length);
+    copy[length] = '\0';
+    block->used += length + 1;
+    return copy;
+}
+
+static void free_pool(PoolBlock *pool) {
+    while (pool != NULL) {
+        PoolBlock *next = pool->next;
+        free(pool);
+        pool = next;
+    }
+}
+
+// Records on their way into an index
+
+typedef struct {
+    const char *path;
+    uint64_t size;
+    uint64_t blocks;
+    uint64_t inode;
+    int64_t mtime;
+    uint32_t mode;
+    uint32_t nlink;
+} IndexRecord;
+
+typedef struct {
+    IndexRecord *records;
+    size_t count;
+    size_t capacity;
+    PoolBlock *pool;
+    int failed;
+} RecordList;
+
+static IndexRecord* push_record(RecordList *list) {
+    if (list->count == list->capacity) {
+        size_t capacity = list->capacity ? list->capacity * 2 : 1024;
+        IndexRecord *grown = realloc(list->records, capacity * sizeof(IndexRecord));
+        if (grown == NULL) {
+            list->failed = 1;
+            return NULL;
+        }
+        list->records = grown;
+        list->capacity = capacity;
+    }
+    return &list->records[list->count++];
+}
+
+// path is copied unless it is already pooled
+static void add_record(RecordList *list, const char *path, int pooled, const struct stat *st) {
+    if (!pooled && (path = pool_copy(&list->pool, path, strlen(path))) == NULL) {
+        list->failed = 1;
+        return;
+    }
+    IndexRecord *record = push_record(list);
+    if (record == NULL) return;
+    record->path = path;
+    record->size = (uint64_t)st->st_size;
+    record->blocks = (uint64_t)st->st_blocks;
+    record->inode = (uint64_t)st->st_ino;
+    record->mtime = mtime_of(st);
+    record->mode = (uint32_t)st->st_mode;
+    record->nlink = (uint32_t)st->st_nlink;
+}
+
+static void free_record_list(RecordList *list) {
+    free(list->records);
+    free_pool(list->pool);
+}
+
+// Writing
+
+static void put_varint(FILE *file, uint64_t value, uint64_t *offset) {
+    do {
+        unsigned char byte = value & 0x7f;
+        value >>= 7;
+        if (value != 0) byte |= 0x80;
+        fputc(byte, file);
+        (*offset)++;
+    } while (value != 0);
+}
+
+static void pad(FILE *file, uint64_t *offset) {
+    while (*offset % 8 != 0) {
+        fputc(0, file);
+        (*offset)++;
+    }
+}
+
+#define PUT_COLUMN(field, width, header_offset)                         \
+    do {                                                                \
+        header_offset = offset;                                         \
+        for (size_t i = 0; i < count; i++) {                            \
+            fwrite(&records[i]->field, width, 1, file);                 \
+        }                                                               \
+        offset += (uint64_t)count * width;                              \
+        pad(file, &offset);                                             \
+    } while (0)
+
+// Writes records, already in index order, next to the index and renames
+// the result over it, so readers see either the old index or the new one
+static int write_index(const char *root, IndexRecord **records, size_t count, IndexStats *stats) {
+    char temp[4200], path[4200];
+    snprintf(temp, sizeof(temp), "%s/%sXXXXXX", root, INDEX_TEMP);
+    snprintf(path, sizeof(path), "%s/%s", root, INDEX_FILE);
+    size_t restart_count = (count + INDEX_RESTART - 1) / INDEX_RESTART;
+    uint64_t *restarts = malloc((restart_count ? restart_count : 1) * sizeof(uint64_t));
+    int fd = mkstemp(temp);
+    FILE *file = fd >= 0 && fchmod(fd, 0644) == 0 ? fdopen(fd, "wb") : NULL;
+    if (restarts == NULL || file == NULL) {
+        printf(file == NULL ? "Error: Cannot write '%s'\n" : "Memory allocation failed!\n", path);
+        free(restarts);
+        if (file != NULL) {
+            fclose(file);
+        } else if (fd >= 0) {
+            close(fd);
+        }
+        if (fd >= 0) unlink(temp);
+        return -1;
+    }
+
+    IndexHeader header;
+    memset(&header, 0, sizeof(header));
+    fwrite(&header, sizeof(header), 1, file);
+    uint64_t offset = sizeof(header);
+
+    header.paths_offset = offset;
+    const char *previous = "";
+    for (size_t i = 0; i < count; i++) {
+        const char *current = records[i]->path;
+        size_t shared = 0;
+        if (i % INDEX_RESTART == 0) {
+            restarts[i / INDEX_RESTART] = offset - header.paths_offset;
+        } else {
+            while (previous[shared] != '\0' && previous[shared] == current[shared]) shared++;
+        }
+        size_t length = strlen(current);
+        put_varint(file, shared, &offset);
+        put_varint(file, length - shared, &offset);
+        fwrite(current + shared, 1, length - shared, file);
+        offset += length - shared;
+        previous = current;
+    }
+    header.paths_size = offset - header.paths_offset;
+    pad(file, &offset);
+
+    header.restarts_offset = offset;
+    fwrite(restarts, sizeof(uint64_t), restart_count, file);
+    offset += restart_count * sizeof(uint64_t);
+    PUT_COLUMN(size, 8, header.sizes_offset);
+    PUT_COLUMN(blocks, 8, header.blocks_offset);
+    PUT_COLUMN(inode, 8, header.inodes_offset);
+    PUT_COLUMN(mtime, 8, header.mtimes_offset);
+    PUT_COLUMN(mode, 4, header.modes_offset);
+    PUT_COLUMN(nlink, 4, header.nlinks_offset);
+    free(restarts);
+
+    memcpy(header.magic, INDEX_MAGIC, 8);
+    header.count = count;
+    header.built = (int64_t)time(NULL);
+    int failed = fseek(file, 0, SEEK_SET) != 0 || fwrite(&header, sizeof(header), 1, file) != 1;
+    failed |= fflush(file) != 0 || ferror(file);
+    failed |= fclose(file) != 0;
+    if (failed || rename(temp, path) != 0) {
+        printf("Error: Cannot write '%s'\n", path);
+        unlink(temp);
+        return -1;
+    }
+    stats->entries = count;
+    stats->file_size = offset;
+    return 0;
+}
+
+// Reading
+
+static int section_fits(const Index *index, uint64_t offset, uint64_t count, size_t width) {
+    return offset % 8 == 0 && offset <= index->size && count <= (index->size - offset) / width;
+}
+
+int open_index(const char *root, Index *index) {
+    memset(index, 0, sizeof(*index));
+    if (realpath(root, index->root) == NULL) return -1;
+    char path[4200];
+    snprintf(path, sizeof(path), "%s/%s", strcmp(index->root, "/") == 0 ? "" : index->root, INDEX_FILE);
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return -1;
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(IndexHeader)) {
+        close(fd);
+        return -1;
+    }
+    index->size = (size_t)st.st_size;
+    index->data = mmap(NULL, index->size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (index->data == MAP_FAILED) {
+        index->data = NULL;
+        return -1;
+    }
+
+    const IndexHeader *header = index->data;
+    uint64_t count = header->count;
+    uint64_t restart_count = (count + INDEX_RESTART - 1) / INDEX_RESTART;
+    if (memcmp(header->magic, INDEX_MAGIC, 8) != 0 || count == 0 ||
+        header->paths_offset > index->size || header->paths_size > index->size - header->paths_offset ||
+        !section_fits(index, header->restarts_offset, restart_count, 8) ||
+        !section_fits(index, header->sizes_offset, count, 8) ||
+        !section_fits(index, header->blocks_offset, count, 8) ||
+        !section_fits(index, header->inodes_offset, count, 8) ||
+        !section_fits(index, header->mtimes_offset, count, 8) ||
+        !section_fits(index, header->modes_offset, count, 4) ||
+        !section_fits(index, header->nlinks_offset, count, 4)) {
+        close_index(index);
+        return -1;
+    }
+    const unsigned char *base = index->data;
+    index->count = count;
+    index->built = header->built;
+    index->paths = base + header->paths_offset;
+    index->paths_size = header->paths_size;
+    index->restarts = (const uint64_t *)(base + header->restarts_offset);
+    index->sizes = (const uint64_t *)(base + header->sizes_offset);
+    index->blocks = (const uint64_t *)(base + header->blocks_offset);
+    index->inodes = (const uint64_t *)(base + header->inodes_offset);
+    index->mtimes = (const int64_t *)(base + header->mtimes_offset);
+    index->modes = (const uint32_t *)(base + header->modes_offset);
+    index->nlinks = (const uint32_t *)(base + header->nlinks_offset);
+    return 0;
+}
+
+int open_index_for(const char *path, Index *index, char *relative, size_t size) {
+    char resolved[4096];
+    if (realpath(path, resolved) == NULL) return -1;
+    size_t length = strlen(resolved);
+    for (;;) {
+        char saved = resolved[length];
+        resolved[length] = '\0';
+        int found = open_index(length > 0 ? resolved : "/", index) == 0;
+        resolved[length] = saved;
+        if (found) {
+            const char *rest = resolved + length;
+            while (*rest == '/') rest++;
+            snprintf(relative, size, "%s", rest);
+            return 0;
+        }
+        if (length == 0) return -1;
+        do {
+            length--;
+        } while (length > 0 && resolved[length] != '/');
+    }
+}
+
+void close_index(Index *index) {
+    if (index->data != NULL) munmap(index->data, index->size);
+    index->data = NULL;
+}
+
+// Entries are decoded in order from the nearest restart point
+typedef struct {
+    const Index *index;
+    uint64_t position;          // entry the next call decodes
+    size_t offset;
+    char path[4096];
+    size_t length;
+} Cursor;
+
+static void seek_restart(Cursor *cursor, const Index *index, uint64_t restart) {
+    cursor->index = index;
+    cursor->position = restart * INDEX_RESTART;
+    cursor->offset = (size_t)index->restarts[restart];
+    cursor->length = 0;
+    cursor->path[0] = '\0';
+}
+
+static int get_varint(const Index *index, size_t *offset, uint64_t *value) {
+    *value = 0;
+    for (int shift = 0; shift < 64; shift += 7) {
+        if (*offset >= index->paths_size) return -1;
+        unsigned char byte = index->paths[(*offset)++];
+        *value |= (uint64_t)(byte & 0x7f) << shift;
+        if (!(byte & 0x80)) return 0;
+    }
+    return -1;
+}
+
+// Decodes entry position - 1 into path; 0 at the end or on damage
+static int next_entry(Cursor *cursor) {
+    const Index *index = cursor->index;
+    uint64_t shared, suffix;
+    if (cursor->position >= index->count || cursor->offset > index->paths_size ||
+        get_varint(index, &cursor->offset, &shared) != 0 || get_varint(index, &cursor->offset, &suffix) != 0 ||
+        shared > cursor->length || suffix >= sizeof(cursor->path) - shared ||
+        suffix > index->paths_size - cursor->offset) {
+        return 0;
+    }
+    memcpy(cursor->path + shared, index->paths + cursor->offset, (size_t)suffix);
+    cursor->length = (size_t)(shared + suffix);
+    cursor->path[cursor->length] = '\0';
+    cursor->offset += (size_t)suffix;
+    cursor->position++;
+    return 1;
+}
+
+// Leaves the cursor on target and returns 1 if it is in the index
+static int seek_entry(Cursor *cursor, const Index *index, const char *target) {
+    uint64_t low = 0, high = (index->count + INDEX_RESTART - 1) / INDEX_RESTART;
+    // Last restart point at or before target
+    while (high - low > 1) {
+        uint64_t middle = low + (high - low) / 2;
+        seek_restart(cursor, index, middle);
+        if (next_entry(cursor) && path_compare(cursor->path, target) <= 0) {
+            low = middle;
+        } else {
+            high = middle;
+        }
+    }
+    seek_restart(cursor, index, low);
+    while (next_entry(cursor)) {
+        int order = path_compare(cursor->path, target);
+        if (order >= 0) return order == 0;
+    }
+    return 0;
+}
+
+static void fill_entry(IndexEntry *entry, const Index *index, uint64_t i) {
+    entry->size = index->sizes[i];
+    entry->blocks = index->blocks[i];
+    entry->inode = index->inodes[i];
+    entry->mtime = index->mtimes[i];
+    entry->mode = index->modes[i];
+    entry->nlink = index->nlinks[i];
+}
+
+int index_subtree(const Index *index, const char *relative, IndexVisit visit, void *arg) {
+    Cursor cursor;
+    if (!seek_entry(&cursor, index, relative)) return -1;
+
+    IndexEntry entry;
+    entry.path = cursor.path;
+    const char *slash = strrchr(cursor.path, '/');
+    entry.name = slash != NULL ? slash + 1 : cursor.path;
+    entry.depth = -1;
+    fill_entry(&entry, index, cursor.position - 1);
+    if (visit(&entry, arg) == WALK_SKIP || !S_ISDIR(entry.mode)) return 0;
+
+    size_t base = strlen(relative);
+    size_t skipping = 0;        // length of a skipped directory's path, or 0
+    while (next_entry(&cursor)) {
+        const char *path = cursor.path;
+        if (base > 0 && (strncmp(path, relative, base) != 0 || path[base] != '/')) break;
+        if (skipping > 0) {
+            if (cursor.length > skipping && path[skipping] == '/') continue;
+            skipping = 0;
+        }
+        int depth = 0;
+        const char *name = path + (base > 0 ? base + 1 : 0);
+        for (const char *p = name; *p != '\0'; p++) {
+            if (*p == '/') {
+                depth++;
+                name = p + 1;
+            }
+        }
+        entry.path = path;
+        entry.name = name;
+        entry.depth = depth;
+        fill_entry(&entry, index, cursor.position - 1);
+        if (visit(&entry, arg) == WALK_SKIP && S_ISDIR(entry.mode)) {
+            skipping = cursor.length;
+        }
+    }
+    return 0;
+}
+
+// Replaying the index as a walk
+
+typedef struct {
+    char *path;                 // as reported, joined to the base
+    const char *name;
+    int depth;
+    struct stat stat;
+    WalkTotals totals;
+} ReplayDir;
+
+typedef struct {
+    const char *base;
+    size_t skip;                // characters of index paths standing for base
+    const WalkOptions *options;
+    WalkStats *stats;
+    ReplayDir *dirs;            // the directories being replayed, outermost first
+    size_t depth;
+    size_t capacity;
+    uint64_t *links;            // inodes + 1 of hard-linked files counted so far
+    size_t link_count;
+    size_t link_capacity;
+    char *path;
+    size_t path_capacity;
+    int failed;
+} Replay;
+
+// True the first time an inode is seen
+static int first_link(Replay *replay, uint64_t inode) {
+    if ((replay->link_count + 1) * 4 > replay->link_capacity * 3) {
+        size_t capacity = replay->link_capacity ? replay->link_capacity * 2 : 1024;
+        uint64_t *links = calloc(capacity, sizeof(uint64_t));
+        if (links == NULL) return 1;
+        for (size_t i = 0; i < replay->link_capacity; i++) {
+            uint64_t key = replay->links[i];
+            if (key == 0) continue;
+            size_t slot = (size_t)(key * 0x9e3779b97f4a7c15ULL) & (capacity - 1);
+            while (links[slot] != 0) slot = (slot + 1) & (capacity - 1);
+            links[slot] = key;
+        }
+        free(replay->links);
+        replay->links = links;
+        replay->link_capacity = capacity;
+    }
+    uint64_t key = inode + 1;
+    size_t slot = (size_t)(key * 0x9e3779b97f4a7c15ULL) & (replay->link_capacity - 1);
+    while (replay->links[slot] != 0) {
+        if (replay->links[slot] == key) return 0;
+        slot = (slot + 1) & (replay->link_capacity - 1);
+    }
+    replay->links[slot] = key;
+    replay->link_count++;
+    return 1;
+}
+
+static unsigned char type_of(mode_t mode) {
+    if (S_ISREG(mode)) return DT_REG;
+    if (S_ISDIR(mode)) return DT_DIR;
+    if (S_ISLNK(mode)) return DT_LNK;
+    if (S_ISCHR(mode)) return DT_CHR;
+    if (S_ISBLK(mode)) return DT_BLK;
+    if (S_ISFIFO(mode)) return DT_FIFO;
+    return DT_SOCK;
+}
+
+static void fake_stat(struct stat *st, const IndexEntry *entry) {
+    memset(st, 0, sizeof(*st));
+    st->st_size = (off_t)entry->size;
+    st->st_blocks = (blkcnt_t)entry->blocks;
+    st->st_ino = (ino_t)entry->inode;
+    st->st_mtim.tv_sec = (time_t)(entry->mtime / 1000000000LL);
+    st->st_mtim.tv_nsec = (long)(entry->mtime % 1000000000LL);
+    st->st_mode = (mode_t)entry->mode;
+    st->st_nlink = (nlink_t)entry->nlink;
+}
+
+// Directories deeper than depth are finished: leave them and add their
+// totals to their parents
+static void finish_dirs(Replay *replay, int depth) {
+    while (replay->depth > 0 && replay->dirs[replay->depth - 1].depth >= depth) {
+        ReplayDir *dir = &replay->dirs[--replay->depth];
+        if (replay->options->leave != NULL) {
+            WalkEntry entry = { dir->path, dir->name, dir->depth, DT_DIR, &dir->stat, 0 };
+            replay->options->leave(&entry, &dir->totals, replay->options->arg);
+        }
+        if (replay->depth > 0) {
+            WalkTotals *parent = &replay->dirs[replay->depth - 1].totals;
+            parent->bytes += dir->totals.bytes;
+            parent->files += dir->totals.files;
+            parent->directories += dir->totals.directories;
+        }
+        free(dir->path);
+    }
+}
+
+static int replay_visit(const IndexEntry *entry, void *arg) {
+    Replay *replay = arg;
+    finish_dirs(replay, entry->depth);
+
+    // base joined with what follows the subtree's own path
+    const char *rest = entry->path + replay->skip;
+    if (*rest == '/') rest++;
+    size_t base_length = strlen(replay->base), rest_length = strlen(rest);
+    size_t needed = base_length + rest_length + 2;
+    if (needed > replay->path_capacity) {
+        char *grown = realloc(replay->path, needed * 2);
+        if (grown == NULL) {
+            replay->failed = 1;
+            return WALK_SKIP;
+        }
+        replay->path = grown;
+        replay->path_capacity = needed * 2;
+    }
+    memcpy(replay->path, replay->base, base_length);
+    if (rest_length > 0 && (base_length == 0 || replay->base[base_length - 1] != '/')) {
+        replay->path[base_length++] = '/';
+    }
+    memcpy(replay->path + base_length, rest, rest_length + 1);
+    const char *name = entry->depth < 0 ? replay->base : replay->path + base_length + rest_length - strlen(entry->name);
+
+    struct stat st;
+    fake_stat(&st, entry);
+    unsigned char type = type_of(st.st_mode);
+    int result = WALK_CONTINUE;
+    if (entry->depth >= 0) {
+        replay->stats->entries++;
+        if (replay->options->visit != NULL) {
+            WalkEntry visited = { replay->path, name, entry->depth, type, &st, 0 };
+            result = replay->options->visit(&visited, replay->options->arg);
+        }
+    }
+
+    WalkTotals own = { 0, type == DT_DIR ? 0 : 1, type == DT_DIR ? 1 : 0 };
+    if (type == DT_DIR || entry->nlink < 2 || first_link(replay, entry->inode)) {
+        own.bytes = entry->blocks * 512;
+    }
+    int descend = type == DT_DIR && result != WALK_SKIP &&
+                  (replay->options->max_depth < 0 || entry->depth < replay->options->max_depth);
+    if (!descend) {
+        if (replay->depth > 0) {
+            WalkTotals *parent = &replay->dirs[replay->depth - 1].totals;
+            parent->bytes += own.bytes;
+            parent->files += own.files;
+            parent->directories += own.directories;
+        }
+        return WALK_SKIP;
+    }
+
+    if (replay->depth == replay->capacity) {
+        size_t capacity = replay->capacity ? replay->capacity * 2 : 32;
+        ReplayDir *grown = realloc(replay->dirs, capacity * sizeof(ReplayDir));
+        if (grown == NULL) {
+            replay->failed = 1;
+            return WALK_SKIP;
+        }
+        replay->dirs = grown;
+        replay->capacity = capacity;
+    }
+    ReplayDir *dir = &replay->dirs[replay->depth];
+    if ((dir->path = strdup(replay->path)) == NULL) {
+        replay->failed = 1;
+        return WALK_SKIP;
+    }
+    dir->name = dir->path + (name - replay->path);
+    if (entry->depth < 0) dir->name = replay->base;
+    dir->depth = entry->depth;
+    dir->stat = st;
+    dir->totals = own;
+    replay->depth++;
+    replay->stats->directories++;
+    return WALK_CONTINUE;
+}
+
+int index_walk(const Index *index, const char *relative, const char *base,
+               const WalkOptions *options, WalkStats *stats) {
+    WalkStats own_stats;
+    if (stats == NULL) stats = &own_stats;
+    memset(stats, 0, sizeof(*stats));
+    stats->threads = 1;
+
+    Cursor cursor;
+    if (!seek_entry(&cursor, index, relative) || !S_ISDIR(index->modes[cursor.position - 1])) {
+        return -1;
+    }
+    Replay replay;
+    memset(&replay, 0, sizeof(replay));
+    replay.base = base;
+    replay.skip = strlen(relative);
+    replay.options = options;
+    replay.stats = stats;
+    index_subtree(index, relative, replay_visit, &replay);
+    finish_dirs(&replay, -1);
+    if (replay.failed) printf("Memory allocation failed!\n");
+    free(replay.dirs);
+    free(replay.links);
+    free(replay.path);
+    return 0;
+}
+
+// Building: the parallel walker reads the tree, the records are sorted
+
+typedef struct {
+    size_t prefix;              // length of the root and separator in walker paths
+    RecordList lists[WALK_MAX_THREADS];
+} BuildWalk;
+
+static int build_visit(const WalkEntry *entry, void *arg) {
+    BuildWalk *build = arg;
+    if (entry->depth == 0 && is_index_file(entry->name)) return WALK_CONTINUE;
+    add_record(&build->lists[entry->worker], entry->path + build->prefix, 0, entry->stat);
+    return WALK_CONTINUE;
+}
+
+static int compare_records(const void *a, const void *b) {
+    return path_compare((*(IndexRecord *const *)a)->path, (*(IndexRecord *const *)b)->path);
+}
+
+int build_index(const char *root, IndexStats *stats) {
+    double start = now_seconds();
+    memset(stats, 0, sizeof(*stats));
+    BuildWalk *build = calloc(1, sizeof(BuildWalk));
+    if (build == NULL) {
+        printf("Memory allocation failed!\n");
+        return -1;
+    }
+    pthread_mutex_lock(&writer_lock);
+    size_t length = strlen(root);
+    build->prefix = length + (length > 0 && root[length - 1] == '/' ? 0 : 1);
+
+    int result = -1;
+    IndexRecord **sorted = NULL;
+    RecordList top;
+    memset(&top, 0, sizeof(top));
+    struct stat st;
+    if (stat(root, &st) != 0 || !S_ISDIR(st.st_mode)) {
+        printf("Error: Cannot open directory '%s'\n", root);
+        goto done;
+    }
+    add_record(&top, "", 0, &st);
+
+    WalkOptions options;
+    init_walk_options(&options);
+    options.flags = WALK_STAT;
+    options.visit = build_visit;
+    options.arg = build;
+    WalkStats walk_stats;
+    if (walk_tree(root, &options, &walk_stats) != 0) {
+        printf("Error: Cannot open directory '%s'\n", root);
+        goto done;
+    }
+
+    size_t count = top.count;
+    int failed = top.failed;
+    for (int i = 0; i < WALK_MAX_THREADS; i++) {
+        count += build->lists[i].count;
+        failed |= build->lists[i].failed;
+    }
+    sorted = malloc(count * sizeof(IndexRecord *));
+    if (failed || sorted == NULL) {
+        printf("Memory allocation failed!\n");
+        goto done;
+    }
+    size_t n = 0;
+    sorted[n++] = &top.records[0];
+    for (int i = 0; i < WALK_MAX_THREADS; i++) {
+        for (size_t j = 0; j < build->lists[i].count; j++) {
+            IndexRecord *record = &build->lists[i].records[j];
+            if (S_ISDIR(record->mode)) stats->directories++;
+            sorted[n++] = record;
+        }
+    }
+    qsort(sorted, n, sizeof(IndexRecord *), compare_records);
+    stats->directories++;
+    stats->rescanned = stats->directories;
+    stats->stat_calls = walk_stats.stat_calls + 1;
+    result = write_index(root, sorted, n, stats);
+
+done:
+    for (int i = 0; i < WALK_MAX_THREADS; i++) {
+        free_record_list(&build->lists[i]);
+    }
+    free_record_list(&top);
+    free(build);
+    free(sorted);
+    pthread_mutex_unlock(&writer_lock);
+    stats->seconds = now_seconds() - start;
+    return result;
+}
+
+// Refreshing: the old index, decoded, is followed directory by directory
+
+typedef struct {
+    IndexRecord *old;           // the previous index, in index order
+    size_t *ends;               // for each directory: one past the end of its subtree
+    size_t old_count;
+    char *const *forced;        // directories re-read whatever their mtime, sorted
+    size_t forced_count;
+    int force_all;
+    RecordList list;
+    IndexStats *stats;
+} Refresh;
+
+static int decode_index(const Index *index, Refresh *refresh, PoolBlock **pool) {
+    refresh->old = malloc(index->count * sizeof(IndexRecord));
+    refresh->ends = malloc(index->count * sizeof(size_t));
+    size_t *stack = malloc(index->count * sizeof(size_t));
+    if (refresh->old == NULL || refresh->ends == NULL || stack == NULL) {
+        free(stack);
+        return -1;
+    }
+    size_t depth = 0;
+    Cursor cursor;
+    seek_restart(&cursor, index, 0);
+    size_t i = 0;
+    while (next_entry(&cursor)) {
+        IndexRecord *record = &refresh->old[i];
+        if ((record->path = pool_copy(pool, cursor.path, cursor.length)) == NULL) {
+            free(stack);
+            return -1;
+        }
+        record->size = index->sizes[i];
+        record->blocks = index->blocks[i];
+        record->inode = index->inodes[i];
+        record->mtime = index->mtimes[i];
+        record->mode = index->modes[i];
+        record->nlink = index->nlinks[i];
+
+        // Close the directories this entry is not inside of
+        while (depth > 0) {
+            const char *top = refresh->old[stack[depth - 1]].path;
+            size_t length = strlen(top);
+            if (length == 0 || (strncmp(record->path, top, length) == 0 && record->path[length] == '/')) break;
+            refresh->ends[stack[--depth]] = i;
+        }
+        refresh->ends[i] = i + 1;
+        if (S_ISDIR(record->mode)) stack[depth++] = i;
+        i++;
+    }
+    while (depth > 0) refresh->ends[stack[--depth]] = i;
+    refresh->old_count = i;
+    free(stack);
+    return 0;
+}
+
+static long find_old(const Refresh *refresh, const char *path) {
+    size_t low = 0, high = refresh->old_count;
+    while (low < high) {
+        size_t middle = low + (high - low) / 2;
+        int order = path_compare(refresh->old[middle].path, path);
+        if (order == 0) return (long)middle;
+        if (order < 0) low = middle + 1;
+        else high = middle;
+    }
+    return -1;
+}
+
+static int compare_strings(const void *a, const void *b) {
+    return strcmp(*(char *const *)a, *(char *const *)b);
+}
+
+static int is_forced(const Refresh *refresh, const char *path) {
+    return refresh->force_all ||
+           (refresh->forced_count > 0 &&
+            bsearch(&path, refresh->forced, refresh->forced_count, sizeof(char *), compare_strings) != NULL);
+}
+
+static void refresh_directory(Refresh *refresh, int fd, const char *path, const struct stat *st, long old);
+
+// old is the child's position in the old index, -1 if it has none, -2 if
+// that has still to be looked up
+static void refresh_child(Refresh *refresh, int parent, const char *parent_path, const char *name, long old) {
+    struct stat st;
+    refresh->stats->stat_calls++;
+    if (fstatat(parent, name, &st, AT_SYMLINK_NOFOLLOW) != 0) return;     // gone
+
+    size_t parent_length = strlen(parent_path), name_length = strlen(name);
+    char path[4096];
+    if (parent_length + name_length + 2 > sizeof(path)) return;
+    size_t length = 0;
+    if (parent_length > 0) {
+        memcpy(path, parent_path, parent_length);
+        path[parent_length] = '/';
+        length = parent_length + 1;
+    }
+    memcpy(path + length, name, name_length + 1);
+    const char *pooled = pool_copy(&refresh->list.pool, path, length + name_length);
+    if (pooled == NULL) {
+        refresh->list.failed = 1;
+        return;
+    }
+    if (!S_ISDIR(st.st_mode)) {
+        add_record(&refresh->list, pooled, 1, &st);
+        return;
+    }
+    if (old == -2) old = find_old(refresh, pooled);
+    int fd = openat(parent, name, O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+    if (fd < 0) {
+        add_record(&refresh->list, pooled, 1, &st);
+        return;
+    }
+    refresh_directory(refresh, fd, pooled, &st, old);
+    close(fd);
+}
+
+static void refresh_directory(Refresh *refresh, int fd, const char *path, const struct stat *st, long old) {
+    add_record(&refresh->list, path, 1, st);
+    refresh->stats->directories++;
+
+    if (old >= 0 && S_ISDIR(refresh->old[old].mode) && refresh->old[old].mtime == mtime_of(st) &&
+        !is_forced(refresh, path)) {
+        // Same names as last time: files are taken from the old index and
+        // only subdirectories are looked at again
+        size_t j = (size_t)old + 1;
+        while (j < refresh->ends[old] && !refresh->list.failed) {
+            const IndexRecord *child = &refresh->old[j];
+            if (S_ISDIR(child->mode)) {
+                const char *name = strrchr(child->path, '/');
+                refresh_child(refresh, fd, path, name != NULL ? name + 1 : child->path, (long)j);
+                j = refresh->ends[j];
+            } else {
+                IndexRecord *record = push_record(&refresh->list);
+                if (record != NULL) *record = *child;
+                j++;
+            }
+        }
+        return;
+    }
+
+    refresh->stats->rescanned++;
+    int handle = dup(fd);
+    DIR *dir = handle >= 0 ? fdopendir(handle) : NULL;
+    if (dir == NULL) {
+        if (handle >= 0) close(handle);
+        return;
+    }
+    char **names = NULL;
+    size_t count = 0, capacity = 0;
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != NULL) {
+        const char *name = entry->d_name;
+        if (strcmp(name, ".") == 0 || strcmp(name, "..") == 0) continue;
+        if (path[0] == '\0' && is_index_file(name)) continue;
+        if (count == capacity) {
+            capacity = capacity ? capacity * 2 : 64;
+            char **grown = realloc(names, capacity * sizeof(char *));
+            if (grown == NULL) break;
+            names = grown;
+        }
+        if ((names[count] = strdup(name)) == NULL) break;
+        count++;
+    }
+    closedir(dir);
+    if (entry != NULL) refresh->list.failed = 1;
+
+    // Names hold no '/', so name order is index order
+    qsort(names, count, sizeof(char *), compare_strings);
+    for (size_t i = 0; i < count; i++) {
+        if (!refresh->list.failed) refresh_child(refresh, fd, path, names[i], -2);
+        free(names[i]);
+    }
+    free(names);
+}
+
+static int update_index(const char *root, char *const *forced, size_t forced_count, int force_all,
+                        IndexStats *stats) {
+    double start = now_seconds();
+    memset(stats, 0, sizeof(*stats));
+    pthread_mutex_lock(&writer_lock);
+    Index index;
+    if (open_index(root, &index) != 0) {
+        pthread_mutex_unlock(&writer_lock);
+        printf("Error: No index of '%s'; use 'index build' first\n", root);
+        return -1;
+    }
+
+    int result = -1;
+    PoolBlock *old_pool = NULL;
+    IndexRecord **ordered = NULL;
+    Refresh refresh;
+    memset(&refresh, 0, sizeof(refresh));
+    refresh.forced = forced;
+    refresh.forced_count = forced_count;
+    refresh.force_all = force_all;
+    refresh.stats = stats;
+    if (decode_index(&index, &refresh, &old_pool) != 0) {
+        printf("Memory allocation failed!\n");
+        goto done;
+    }
+
+    int fd = open(root, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) != 0) {
+        printf("Error: Cannot open directory '%s'\n", root);
+        if (fd >= 0) close(fd);
+        goto done;
+    }
+    stats->stat_calls++;
+    refresh_directory(&refresh, fd, "", &st, find_old(&refresh, ""));
+    close(fd);
+
+    ordered = malloc((refresh.list.count ? refresh.list.count : 1) * sizeof(IndexRecord *));
+    if (refresh.list.failed || ordered == NULL) {
+        printf("Memory allocation failed!\n");
+        goto done;
+    }
+    for (size_t i = 0; i < refresh.list.count; i++) {
+        ordered[i] = &refresh.list.records[i];
+    }
+    result = write_index(index.root, ordered, refresh.list.count, stats);
+
+done:
+    free(ordered);
+    free(refresh.old);
+    free(refresh.ends);
+    free_record_list(&refresh.list);
+    free_pool(old_pool);
+    close_index(&index);
+    pthread_mutex_unlock(&writer_lock);
+    stats->seconds = now_seconds() - start;
+    return result;
+}
+
+int refresh_index(const char *root, IndexStats *stats) {
+    return update_index(root, NULL, 0, 0, stats);
+}
+
+// Watching
+
+typedef struct {
+    char root[4096];
+    int inotify;
+    int stop[2];                // a byte on this pipe ends the thread
+    pthread_t thread;
+    char **paths;               // directory of each watch descriptor
+    size_t paths_capacity;
+    pthread_mutex_t lock;       // guards the counters
+    unsigned long long updates;
+    unsigned long long directories;
+    int full;                   // ran out of inotify watches
+} IndexWatch;
+
+static IndexWatch *current_watch;
+
+static int watch_visit(const IndexEntry *entry, void *arg) {
+    IndexWatch *watch = arg;
+    if (!S_ISDIR(entry->mode)) return WALK_CONTINUE;
+    char path[8200];
+    snprintf(path, sizeof(path), "%s/%s", strcmp(watch->root, "/") == 0 ? "" : watch->root, entry->path);
+    int wd = inotify_add_watch(watch->inotify, path, WATCH_MASK);
+    if (wd < 0) {
+        if (errno == ENOSPC) watch->full = 1;
+        return WALK_CONTINUE;
+    }
+    if ((size_t)wd >= watch->paths_capacity) {
+        size_t capacity = watch->paths_capacity ? watch->paths_capacity : 1024;
+        while (capacity <= (size_t)wd) capacity *= 2;
+        char **grown = realloc(watch->paths, capacity * sizeof(char *));
+        if (grown == NULL) return WALK_CONTINUE;
+        memset(grown + watch->paths_capacity, 0, (capacity - watch->paths_capacity) * sizeof(char *));
+        watch->paths = grown;
+        watch->paths_capacity = capacity;
+    }
+    if (watch->paths[wd] == NULL || strcmp(watch->paths[wd], entry->path) != 0) {
+        char *copy = strdup(entry->path);
+        if (copy == NULL) return WALK_CONTINUE;
+        pthread_mutex_lock(&watch->lock);
+        if (watch->paths[wd] == NULL) watch->directories++;
+        pthread_mutex_unlock(&watch->lock);
+        free(watch->paths[wd]);
+        watch->paths[wd] = copy;
+    }
+    return WALK_CONTINUE;
+}
+
+// Watches every directory of the index under path
+static void add_watches(IndexWatch *watch, const char *path) {
+    Index index;
+    if (open_index(watch->root, &index) != 0) return;
+    index_subtree(&index, path, watch_visit, watch);
+    close_index(&index);
+}
+
+static void apply_changes(IndexWatch *watch, char **dirty, size_t count, int overflow) {
+    qsort(dirty, count, sizeof(char *), compare_strings);
+    size_t unique = 0;
+    for (size_t i = 0; i < count; i++) {
+        if (unique > 0 && strcmp(dirty[unique - 1], dirty[i]) == 0) {
+            free(dirty[i]);
+        } else {
+            dirty[unique++] = dirty[i];
+        }
+    }
+    IndexStats stats;
+    if (update_index(watch->root, dirty, unique, overflow, &stats) == 0) {
+        pthread_mutex_lock(&watch->lock);
+        watch->updates++;
+        pthread_mutex_unlock(&watch->lock);
+        // New directories in what changed need watches of their own
+        if (overflow) {
+            add_watches(watch, "");
+        } else {
+            for (size_t i = 0; i < unique; i++) add_watches(watch, dirty[i]);
+        }
+    }
+    for (size_t i = 0; i < unique; i++) free(dirty[i]);
+}
+
+static void* watch_thread(void *arg) {
+    IndexWatch *watch = arg;
+    char buffer[64 * 1024] __attribute__((aligned(__alignof__(struct inotify_event))));
+    char **dirty = NULL;
+    size_t count = 0, capacity = 0;
+    int overflow = 0;
+    double first = 0, last = 0;
+
+    for (;;) {
+        int timeout = -1;
+        if (count > 0 || overflow) {
+            double now = now_seconds();
+            double quiet = last + WATCH_QUIET_MS / 1000.0, deadline = first + WATCH_MAX_DELAY_MS / 1000.0;
+            double due = quiet < deadline ? quiet : deadline;
+            timeout = due > now ? (int)((due - now) * 1000) + 1 : 0;
+        }
+        struct pollfd fds[2] = { { watch->inotify, POLLIN, 0 }, { watch->stop[0], POLLIN, 0 } };
+        int ready = poll(fds, 2, timeout);
+        if (ready < 0 && errno == EINTR) continue;
+        if (ready < 0 || (fds[1].revents & (POLLIN | POLLHUP))) break;
+        if (ready == 0) {
+            apply_changes(watch, dirty, count, overflow);
+            count = 0;
+            overflow = 0;
+            continue;
+        }
+
+        ssize_t length = read(watch->inotify, buffer, sizeof(buffer));
+        if (length <= 0) continue;
+        if (count == 0 && !overflow) first = now_seconds();
+        for (char *p = buffer; p < buffer + length;) {
+            struct inotify_event *event = (struct inotify_event *)p;
+            p += sizeof(struct inotify_event) + event->len;
+            if (event->mask & IN_Q_OVERFLOW) {
+                overflow = 1;
+                continue;
+            }
+            if (event->wd < 0 || (size_t)event->wd >= watch->paths_capacity || watch->paths[event->wd] == NULL) {
+                continue;
+            }
+            const char *path = watch->paths[event->wd];
+            if (event->mask & IN_IGNORED) {
+                pthread_mutex_lock(&watch->lock);
+                watch->directories--;
+                pthread_mutex_unlock(&watch->lock);
+                free(watch->paths[event->wd]);
+                watch->paths[event->wd] = NULL;
+                continue;
+            }
+            if (event->len > 0 && path[0] == '\0' && is_index_file(event->name)) continue;
+
+            if (count == capacity) {
+                capacity = capacity ? capacity * 2 : 64;
+                char **grown = realloc(dirty, capacity * sizeof(char *));
+                if (grown == NULL) {
+                    overflow = 1;
+                    continue;
+                }
+                dirty = grown;
+            }
+            if ((dirty[count] = strdup(path)) == NULL) {
+                overflow = 1;
+                continue;
+            }
+            count++;
+        }
+        last = now_seconds();
+    }
+
+    if (count > 0 || overflow) apply_changes(watch, dirty, count, overflow);
+    free(dirty);
+    return NULL;
+}
+
+int start_index_watch(const char *root) {
+    if (current_watch != NULL) {
+        printf("Error: Already watching '%s'; use 'index stop' first\n", current_watch->root);
+        return -1;
+    }
+    Index index;
+    if (open_index(root, &index) != 0) {
+        printf("Error: No index of '%s'; use 'index build' first\n", root);
+        return -1;
+    }
+    IndexWatch *watch = calloc(1, sizeof(IndexWatch));
+    if (watch == NULL) {
+        printf("Memory allocation failed!\n");
+        close_index(&index);
+        return -1;
+    }
+    memcpy(watch->root, index.root, sizeof(watch->root));
+    pthread_mutex_init(&watch->lock, NULL);
+    watch->stop[0] = watch->stop[1] = -1;
+    watch->inotify = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    int result = -1;
+    if (watch->inotify < 0) {
+        printf("Error: Cannot watch for changes: %s\n", strerror(errno));
+    } else if (index_subtree(&index, "", watch_visit, watch) != 0 || watch->full) {
+        printf("Error: Too many directories to watch; raise fs.inotify.max_user_watches\n");
+    } else if (pipe2(watch->stop, O_CLOEXEC) != 0 ||
+               pthread_create(&watch->thread, NULL, watch_thread, watch) != 0) {
+        printf("Error: Cannot start watching\n");
+    } else {
+        result = 0;
+    }
+    close_index(&index);
+    if (result == 0) {
+        current_watch = watch;
+        return 0;
+    }
+
+    if (watch->inotify >= 0) close(watch->inotify);
+    if (watch->stop[0] >= 0) close(watch->stop[0]);
+    if (watch->stop[1] >= 0) close(watch->stop[1]);
+    for (size_t i = 0; i < watch->paths_capacity; i++) free(watch->paths[i]);
+    free(watch->paths);
+    pthread_mutex_destroy(&watch->lock);
+    free(watch);
+    return -1;
+}
+
+void stop_index_watch() {
+    IndexWatch *watch = current_watch;
+    if (watch == NULL) return;
+    // The thread must be gone before its state is freed. Should the byte
+    // not go through, closing the write end wakes it with POLLHUP instead;
+    // cancelling could leave the index writer lock held.
+    ssize_t written;
+    do {
+        written = write(watch->stop[1], "x", 1);
+    } while (written != 1 && (errno == EINTR || errno == EAGAIN));
+    if (written != 1) {
+        close(watch->stop[1]);
+        watch->stop[1] = -1;
+    }
+    pthread_join(watch->thread, NULL);
+    close(watch->inotify);
+    close(watch->stop[0]);
+    if (watch->stop[1] >= 0) close(watch->stop[1]);
+    for (size_t i = 0; i < watch->paths_capacity; i++) free(watch->paths[i]);
+    free(watch->paths);
+    pthread_mutex_destroy(&watch->lock);
+    free(watch);
+    current_watch = NULL;
+}
+
+const char* index_watch_status(unsigned long long *updates, unsigned long long *directories) {
+    IndexWatch *watch = current_watch;
+    if (watch == NULL) return NULL;
+    pthread_mutex_lock(&watch->lock);
+    *updates = watch->updates;
+    *directories = watch->directories;
+    pthread_mutex_unlock(&watch->lock);
+    return watch->root;
+}
@@ -0,0 +1,103 @@
+#ifndef INDEX_H
+#define INDEX_H
+
+// A persistent metadata index, so find, du and largest can answer without
+// walking the disk.
+//
+// The index of a directory lives in a file named INDEX_FILE inside it and
+// covers everything below. Paths relative to that directory are stored in
+// sorted order with each one sharing a prefix with the previous one and
+// only the rest written out, and a full path every INDEX_RESTART entries
+// for binary search. Sorting treats '/' as lower than any other byte, so
+// every subtree is one contiguous run. Size, allocated size, mtime, mode,
+// inode and link count are stored a column each. Queries map the file and
+// read only the part of it they need.
+//
+// A refresh reuses what the index says about every directory whose mtime
+// has not changed and re-reads only the others; a changed file in an
+// unchanged directory is not noticed until the next build. A watch keeps
+// the index current as changes happen, using inotify. Builds and
+// refreshes, the watch's included, take turns, and each writes a temporary
+// file of its own before renaming it over the index.
+
+#include <stdint.h>
+#include <stddef.h>
+#include "walker.h"
+
+#define INDEX_FILE ".fm_index"
+#define INDEX_RESTART 16
+
+typedef struct {
+    char root[4096];            // the indexed directory, resolved
+    void *data;
+    size_t size;
+    unsigned long long count;
+    long long built;            // time of the last build or refresh
+    const unsigned char *paths; // prefix-compressed, in index order
+    size_t paths_size;
+    const uint64_t *restarts;   // offset into paths of every INDEX_RESTART-th entry
+    const uint64_t *sizes;
+    const uint64_t *blocks;     // 512-byte blocks allocated
+    const uint64_t *inodes;
+    const int64_t *mtimes;      // nanoseconds
+    const uint32_t *modes;
+    const uint32_t *nlinks;
+} Index;
+
+typedef struct {
+    const char *path;           // relative to the index root; "" for the root itself
+    const char *name;           // last component of path
+    int depth;                  // -1 for the subtree's top, 0 for its entries, ...
+    unsigned long long size;
+    unsigned long long blocks;
+    unsigned long long inode;
+    long long mtime;            // nanoseconds
+    unsigned mode;
+    unsigned nlink;
+} IndexEntry;
+
+typedef struct {
+    unsigned long long entries;
+    unsigned long long directories;
+    unsigned long long rescanned;   // directories read from disk
+    unsigned long long stat_calls;
+    unsigned long long file_size;   // bytes in INDEX_FILE
+    double seconds;
+} IndexStats;
+
+// Walks root and writes its index. Returns 0, or -1 after printing why.
+int build_index(const char *root, IndexStats *stats);
+// Brings root's existing index up to date
+int refresh_index(const char *root, IndexStats *stats);
+
+// Opens the index of root itself. Returns 0, or -1 if there is none.
+int open_index(const char *root, Index *index);
+// Opens the index of path or of its nearest indexed ancestor and stores
+// path relative to that index's root in relative
+int open_index_for(const char *path, Index *index, char *relative, size_t size);
+void close_index(Index *index);
+
+// Visits relative itself, then its subtree in index order. Returns 0, or
+// -1 if relative is not in the index. Returning WALK_SKIP from a
+// directory's visit skips its subtree, as with walk_tree.
+typedef int (*IndexVisit)(const IndexEntry *entry, void *arg);
+int index_subtree(const Index *index, const char *relative, IndexVisit visit, void *arg);
+
+// Stands in for walk_tree: reports relative's subtree as walk_tree would
+// report base, the same directory as the caller named it, with paths
+// joined to base and WalkEntry.stat filled from the index whatever the
+// flags. Entries come in name order on the calling thread, as with
+// WALK_SORTED, and leave gets the same totals. Returns -1 if relative is
+// not a directory in the index.
+int index_walk(const Index *index, const char *relative, const char *base,
+               const WalkOptions *options, WalkStats *stats);
+
+// A background thread that applies inotify events to root's index. One
+// watch at a time; returns -1 after printing why if it cannot start.
+int start_index_watch(const char *root);
+void stop_index_watch();
+// Resolved root of the running watch, or NULL; updates and watched
+// directories so far
+const char* index_watch_status(unsigned long long *updates, unsigned long long *directories);
+
+#endif
@@ -0,0 +1,460 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <stdint.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <time.h>
+#include <pwd.h>
+#include <grp.h>
+#include <sys/stat.h>
+#include "listing.h"
+#include "uring.h"
+
+#define LIST_OUTPUT_BUFFER (1 << 20)
+#define STAT_CHUNK 4096             // entries stat'ed per round
+#define METADATA_BATCH 256          // statx requests in flight
+#define MAX_ROW 512                 // longest formatted row but the name
+
+void init_list_options(ListOptions *options) {
+    options->sync = 0;
+    options->show_stats = 0;
+    options->sort = SORT_NONE;
+}
+
+int parse_list_sort(const char *name, ListSort *sort) {
+    if (strcmp(name, "name") == 0) {
+        *sort = SORT_NAME;
+    } else if (strcmp(name, "size") == 0) {
+        *sort = SORT_SIZE;
+    } else if (strcmp(name, "mtime") == 0) {
+        *sort = SORT_MTIME;
+    } else {
+        return -1;
+    }
+    return 0;
+}
+
+// Id to name caches, open addressing with linear probing
+
+typedef struct {
+    unsigned id;
+    char *name;                 // NULL marks a free slot
+} NameSlot;
+
+typedef struct {
+    NameSlot *slots;
+    size_t capacity;            // a power of two
+    size_t count;
+} NameCache;
+
+static NameCache user_names, group_names;
+
+static NameSlot* find_slot(NameSlot *slots, size_t capacity, unsigned id) {
+    size_t i = (id * 2654435761u) & (capacity - 1);
+    while (slots[i].name != NULL && slots[i].id != id) {
+        i = (i + 1) & (capacity - 1);
+    }
+    return &slots[i];
+}
+
+static const char* cached_name(NameCache *cache, unsigned id, int group) {
+    if (cache->capacity > 0) {
+        NameSlot *slot = find_slot(cache->slots, cache->capacity, id);
+        if (slot->name != NULL) return slot->name;
+    }
+
+    const char *found = NULL;
+    if (group) {
+        struct group *entry = getgrgid((gid_t)id);
+        if (entry != NULL) found = entry->gr_name;
+    } else {
+        struct passwd *entry = getpwuid((uid_t)id);
+        if (entry != NULL) found = entry->pw_name;
+    }
+    char *name = strdup(found != NULL ? found : "unknown");
+    if (name == NULL) return "unknown";
+
+    // Kept at most half full
+    if (2 * (cache->count + 1) > cache->capacity) {
+        size_t capacity = cache->capacity ? cache->capacity * 2 : 64;
+        NameSlot *slots = calloc(capacity, sizeof(NameSlot));
+        if (slots == NULL) {
+            free(name);
+            return "unknown";
+        }
+        for (size_t i = 0; i < cache->capacity; i++) {
+            if (cache->slots[i].name != NULL) {
+                *find_slot(slots, capacity, cache->slots[i].id) = cache->slots[i];
+            }
+        }
+        free(cache->slots);
+        cache->slots = slots;
+        cache->capacity = capacity;
+    }
+    NameSlot *slot = find_slot(cache->slots, cache->capacity, id);
+    slot->id = id;
+    slot->name = name;
+    cache->count++;
+    return name;
+}
+
+const char* user_name(uid_t uid) {
+    return cached_name(&user_names, (unsigned)uid, 0);
+}
+
+const char* group_name(gid_t gid) {
+    return cached_name(&group_names, (unsigned)gid, 1);
+}
+
+// Times on a day seen before reuse its date; the clock time is worked
+// out from the seconds since midnight. Days are kept in a small table
+// indexed by local day number. Days with a daylight saving change are not
+// cached, since their clock does not run evenly.
+#define DAY_SLOTS 256
+
+typedef struct {
+    time_t start;
+    time_t end;                 // start + 86400; empty while both are 0
+    char date[12];              // "YYYY-MM-DD "
+} Day;
+
+typedef struct {
+    Day days[DAY_SLOTS];
+    long offset;                // UTC offset of the last day added
+} DayCache;
+
+static void two_digits(char *out, int value) {
+    out[0] = (char)('0' + value / 10);
+    out[1] = (char)('0' + value % 10);
+}
+
+static size_t day_slot(time_t t, long offset) {
+    long long day = ((long long)t + offset) / 86400;
+    return (size_t)(day & (DAY_SLOTS - 1));
+}
+
+static int is_midnight(time_t t, long offset) {
+    struct tm tm_info;
+    return localtime_r(&t, &tm_info) != NULL && tm_info.tm_hour == 0 && tm_info.tm_min == 0 &&
+           tm_info.tm_sec == 0 && tm_info.tm_gmtoff == offset;
+}
+
+// Writes "YYYY-MM-DD HH:MM:SS" (19 characters) to out
+static void format_time(DayCache *cache, time_t t, char *out) {
+    const Day *day = &cache->days[day_slot(t, cache->offset)];
+    if (t >= day->start && t < day->end) {
+        int seconds = (int)(t - day->start);
+        memcpy(out, day->date, 11);
+        two_digits(out + 11, seconds / 3600);
+        out[13] = ':';
+        two_digits(out + 14, seconds / 60 % 60);
+        out[16] = ':';
+        two_digits(out + 17, seconds % 60);
+        return;
+    }
+
+    struct tm tm_info;
+    char text[32];
+    if (localtime_r(&t, &tm_info) == NULL ||
+        strftime(text, sizeof(text), "%Y-%m-%d %H:%M:%S", &tm_info) != 19) {
+        memset(out, '?', 19);
+        return;
+    }
+    memcpy(out, text, 19);
+
+    time_t start = t - (tm_info.tm_hour * 3600 + tm_info.tm_min * 60 + tm_info.tm_sec);
+    long offset = tm_info.tm_gmtoff;
+    if (is_midnight(start, offset) && is_midnight(start + 86400, offset)) {
+        Day *slot = &cache->days[day_slot(t, offset)];
+        slot->start = start;
+        slot->end = start + 86400;
+        memcpy(slot->date, text, 11);
+        cache->offset = offset;
+    }
+}
+
+// Entry records
+
+typedef struct {
+    off_t size;
+    time_t mtime;
+    uint32_t name;              // offset into the name pool
+    mode_t mode;
+    uid_t uid;
+} ListEntry;
+
+typedef struct {
+    ListEntry *entries;
+    size_t count;
+    size_t capacity;
+    char *names;
+    size_t names_length;
+    size_t names_capacity;
+} Listing;
+
+static int add_name(Listing *listing, const char *name, uint32_t *offset) {
+    size_t length = strlen(name) + 1;
+    if (listing->names_length + length > listing->names_capacity) {
+        size_t capacity = listing->names_capacity ? listing->names_capacity * 2 : 16384;
+        while (capacity < listing->names_length + length) capacity *= 2;
+        if (capacity > UINT32_MAX) return -1;
+        char *grown = realloc(listing->names, capacity);
+        if (grown == NULL) return -1;
+        listing->names = grown;
+        listing->names_capacity = capacity;
+    }
+    *offset = (uint32_t)listing->names_length;
+    memcpy(listing->names + listing->names_length, name, length);
+    listing->names_length += length;
+    return 0;
+}
+
+typedef struct {
+    ListSort sort;
+    const char *names;
+} SortContext;
+
+static int compare_records(const void *a, const void *b, void *arg) {
+    const SortContext *context = arg;
+    const ListEntry *x = a, *y = b;
+    if (context->sort == SORT_SIZE && x->size != y->size) return x->size < y->size ? 1 : -1;
+    if (context->sort == SORT_MTIME && x->mtime != y->mtime) return x->mtime < y->mtime ? 1 : -1;
+    return strcmp(context->names + x->name, context->names + y->name);
+}
+
+// Shared by every ls; created the first time io_uring is used
+static Uring *metadata_ring;
+
+static double now_seconds() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Stats names as a few io_uring batches when the kernel allows it and
+// with one stat call each otherwise. Returns the system calls made;
+// *batched says which way it went.
+static long stat_entries(int directory, char **names, size_t count, struct stat *results,
+                         int *errors, int sync, int *batched) {
+    *batched = 0;
+    if (!sync && metadata_ring == NULL && uring_supported()) {
+        metadata_ring = create_uring(METADATA_BATCH);
+    }
+    if (!sync && metadata_ring != NULL) {
+        long calls = uring_stat_names(metadata_ring, directory, names, count, results, errors);
+        if (calls >= 0) {
+            *batched = 1;
+            return calls;
+        }
+        free_uring(metadata_ring);      // unusable; stay synchronous from now on
+        metadata_ring = NULL;
+    }
+    for (size_t i = 0; i < count; i++) {
+        errors[i] = fstatat(directory, names[i], &results[i], 0) == 0 ? 0 : errno;
+    }
+    return (long)count;
+}
+
+// Output
+
+typedef struct {
+    char *buffer;
+    size_t length;
+} ListOutput;
+
+static void flush_list_output(ListOutput *output) {
+    size_t done = 0;
+    while (done < output->length) {
+        ssize_t written = write(STDOUT_FILENO, output->buffer + done, output->length - done);
+        if (written < 0) {
+            if (errno == EINTR) continue;
+            break;
+        }
+        done += (size_t)written;
+    }
+    output->length = 0;
+}
+
+// Appends text and pads it with spaces to width, then one more space
+static char* put_column(char *out, const char *text, size_t length, size_t width) {
+    memcpy(out, text, length);
+    out += length;
+    while (length++ < width) *out++ = ' ';
+    *out++ = ' ';
+    return out;
+}
+
+static size_t format_number(char *out, long long value) {
+    char digits[24];
+    size_t length = 0;
+    unsigned long long magnitude = value < 0 ? 0ULL - (unsigned long long)value : (unsigned long long)value;
+    do {
+        digits[length++] = (char)('0' + magnitude % 10);
+        magnitude /= 10;
+    } while (magnitude > 0);
+    size_t written = 0;
+    if (value < 0) out[written++] = '-';
+    while (length > 0) out[written++] = digits[--length];
+    return written;
+}
+
+// Same columns as "%-15s %-10ld %-15s %-20s %s\n"
+static void format_row(ListOutput *output, DayCache *day, const ListEntry *entry, const char *name) {
+    size_t name_length = strlen(name);
+    if (output->length + MAX_ROW + name_length > LIST_OUTPUT_BUFFER) {
+        flush_list_output(output);
+    }
+    char *out = output->buffer + output->length;
+    mode_t mode = entry->mode;
+    char permissions[10] = {
+        S_ISDIR(mode) ? 'd' : '-',
+        mode & S_IRUSR ? 'r' : '-', mode & S_IWUSR ? 'w' : '-', mode & S_IXUSR ? 'x' : '-',
+        mode & S_IRGRP ? 'r' : '-', mode & S_IWGRP ? 'w' : '-', mode & S_IXGRP ? 'x' : '-',
+        mode & S_IROTH ? 'r' : '-', mode & S_IWOTH ? 'w' : '-', mode & S_IXOTH ? 'x' : '-'
+    };
+    out = put_column(out, permissions, 10, 15);
+
+    char number[24];
+    out = put_column(out, number, format_number(number, (long long)entry->size), 10);
+
+    const char *owner = user_name(entry->uid);
+    size_t owner_length = strlen(owner);
+    if (owner_length > MAX_ROW / 2) owner_length = MAX_ROW / 2;
+    out = put_column(out, owner, owner_length, 15);
+
+    char time_text[32];
+    format_time(day, entry->mtime, time_text);
+    out = put_column(out, time_text, 19, 20);
+
+    memcpy(out, name, name_length);
+    out += name_length;
+    *out++ = '\n';
+    output->length = (size_t)(out - output->buffer);
+}
+
+static void put_text(ListOutput *output, const char *text) {
+    size_t length = strlen(text);
+    if (output->length + length > LIST_OUTPUT_BUFFER) flush_list_output(output);
+    memcpy(output->buffer + output->length, text, length);
+    output->length += length;
+}
+
+void list_directory(const char *path, const ListOptions *options) {
+    Listing listing;
+    memset(&listing, 0, sizeof(listing));
+    ListOutput output = { NULL, 0 };
+    char **chunk_names = NULL;
+    struct stat *stats = NULL;
+    int *errors = NULL;
+    uint32_t *offsets = NULL;
+    DayCache *day = NULL;
+    size_t name_count = 0, offsets_capacity = 0;
+
+    if (path == NULL) {
+        path = ".";
+    }
+    DIR *dir = opendir(path);
+    if (dir == NULL) {
+        printf("Error: Cannot open directory '%s'\n", path);
+        return;
+    }
+
+    // Names first, so their metadata can be requested all at once
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != NULL) {
+        if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) {
+            continue;
+        }
+        if (name_count == offsets_capacity) {
+            offsets_capacity = offsets_capacity ? offsets_capacity * 2 : 1024;
+            uint32_t *grown = realloc(offsets, offsets_capacity * sizeof(uint32_t));
+            if (grown == NULL) goto failed;
+            offsets = grown;
+        }
+        if (add_name(&listing, entry->d_name, &offsets[name_count]) != 0) goto failed;
+        name_count++;
+    }
+
+    listing.entries = malloc((name_count ? name_count : 1) * sizeof(ListEntry));
+    chunk_names = malloc(STAT_CHUNK * sizeof(char *));
+    stats = malloc(STAT_CHUNK * sizeof(struct stat));
+    errors = malloc(STAT_CHUNK * sizeof(int));
+    output.buffer = malloc(LIST_OUTPUT_BUFFER);
+    day = calloc(1, sizeof(DayCache));
+    if (listing.entries == NULL || chunk_names == NULL || stats == NULL || errors == NULL ||
+        output.buffer == NULL || day == NULL) {
+        goto failed;
+    }
+
+    // Metadata a chunk at a time, kept only as far as the listing needs it
+    double start = now_seconds();
+    long calls = 0;
+    int batched = 0;
+    for (size_t first = 0; first < name_count; first += STAT_CHUNK) {
+        size_t count = name_count - first < STAT_CHUNK ? name_count - first : STAT_CHUNK;
+        for (size_t i = 0; i < count; i++) {
+            chunk_names[i] = listing.names + offsets[first + i];
+        }
+        calls += stat_entries(dirfd(dir), chunk_names, count, stats, errors, options->sync, &batched);
+        for (size_t i = 0; i < count; i++) {
+            if (errors[i] != 0) continue;
+            ListEntry *record = &listing.entries[listing.count++];
+            record->size = stats[i].st_size;
+            record->mtime = stats[i].st_mtime;
+            record->name = offsets[first + i];
+            record->mode = stats[i].st_mode;
+            record->uid = stats[i].st_uid;
+        }
+    }
+    double stat_time = now_seconds() - start;
+
+    start = now_seconds();
+    if (options->sort != SORT_NONE && listing.count > 1) {
+        SortContext context = { options->sort, listing.names };
+        qsort_r(listing.entries, listing.count, sizeof(ListEntry), compare_records, &context);
+    }
+
+    char header[160];
+    snprintf(header, sizeof(header), ":\n%-15s %-10s %-15s %-20s %s\n%-15s %-10s %-15s %-20s %s\n",
+             "Permissions", "Size", "Owner", "Modified", "Name",
+             "-----------", "----", "-----", "--------", "----");
+    fflush(stdout);
+    put_text(&output, "\nContents of ");
+    put_text(&output, path);
+    put_text(&output, header);
+    for (size_t i = 0; i < listing.count; i++) {
+        format_row(&output, day, &listing.entries[i], listing.names + listing.entries[i].name);
+    }
+    flush_list_output(&output);
+    double format_time_taken = now_seconds() - start;
+
+    if (options->show_stats) {
+        if (batched) {
+            printf("\n%zu entries: %ld io_uring submissions instead of %zu stat calls (%ld saved), %.2f ms\n",
+                   name_count, calls, name_count, (long)name_count - calls, stat_time * 1000);
+        } else {
+            printf("\n%zu entries: %ld stat calls, %.2f ms\n", name_count, calls, stat_time * 1000);
+        }
+        printf("%zu rows formatted in %.2f ms (%.0f rows/s)\n", listing.count, format_time_taken * 1000,
+               format_time_taken > 0 ? listing.count / format_time_taken : 0);
+    }
+    printf("\n");
+    goto done;
+
+failed:
+    printf("Memory allocation failed!\n");
+done:
+    free(listing.entries);
+    free(listing.names);
+    free(offsets);
+    free(chunk_names);
+    free(stats);
+    free(errors);
+    free(output.buffer);
+    free(day);
+    closedir(dir);
+}
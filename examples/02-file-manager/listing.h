@@ -0,0 +1,39 @@
+#ifndef LISTING_H
+#define LISTING_H
+
+// Directory listings for ls.
+//
+// Entries are gathered into an array of small fixed-size records with
+// their names packed into one pool, sorted there if asked, and formatted
+// by hand into a large buffer that is written out with one call per
+// megabyte. Owner and group names are looked up once per id for the whole
+// session, and a modification time on a day already seen is formatted
+// without calling localtime again.
+
+#include <sys/types.h>
+
+typedef enum {
+    SORT_NONE,                  // directory order
+    SORT_NAME,
+    SORT_SIZE,                  // largest first
+    SORT_MTIME                  // newest first
+} ListSort;
+
+typedef struct {
+    int sync;                   // plain stat calls even where io_uring works
+    int show_stats;             // report system calls and time spent
+    ListSort sort;
+} ListOptions;
+
+void init_list_options(ListOptions *options);
+
+// Returns -1 if name is not name, size or mtime
+int parse_list_sort(const char *name, ListSort *sort);
+
+// Cached for the session; "unknown" if the id has no name
+const char* user_name(uid_t uid);
+const char* group_name(gid_t gid);
+
+void list_directory(const char *path, const ListOptions *options);
+
+#endif
@@ -0,0 +1,643 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include "pattern.h"
+
+#define NFA_MAX_STATES 2048
+#define DFA_HASH_SIZE (PATTERN_MAX_STATES * 2)
+
+// NFA node types
+#define NFA_SET     0           // consume a byte in set, go to out
+#define NFA_SPLIT   1           // go to out and to out1
+#define NFA_JUMP    2           // go to out
+#define NFA_MATCH   3
+
+typedef struct {
+    int type;
+    int out;
+    int out1;
+    uint32_t set[8];
+} NfaState;
+
+typedef struct {
+    NfaState *states;           // NFA_MAX_STATES, and one spare once they run out
+    int count;
+    const char *at;             // parse position
+    const char *error;
+} Nfa;
+
+// A piece of NFA under construction. end is an NFA_JUMP whose out is
+// still open, so joining fragments never needs a list of loose ends.
+typedef struct {
+    int start;
+    int end;
+} Fragment;
+
+static void set_add(uint32_t *set, int c) {
+    set[c >> 5] |= 1u << (c & 31);
+}
+
+static int set_has(const uint32_t *set, int c) {
+    return (set[c >> 5] >> (c & 31)) & 1;
+}
+
+static void set_fill(uint32_t *set) {
+    memset(set, 0xff, 8 * sizeof(uint32_t));
+}
+
+static int new_state(Nfa *nfa, int type) {
+    int index = nfa->count;
+    if (index == NFA_MAX_STATES) {
+        // Keep going on the spare state; the caller checks error at the end
+        nfa->error = "pattern too long";
+    } else {
+        nfa->count++;
+    }
+    NfaState *state = &nfa->states[index];
+    memset(state, 0, sizeof(*state));
+    state->type = type;
+    state->out = -1;
+    state->out1 = -1;
+    return index;
+}
+
+static Fragment empty_fragment(Nfa *nfa) {
+    int jump = new_state(nfa, NFA_JUMP);
+    return (Fragment){ jump, jump };
+}
+
+static Fragment set_fragment(Nfa *nfa, const uint32_t *set) {
+    int start = new_state(nfa, NFA_SET);
+    int end = new_state(nfa, NFA_JUMP);
+    memcpy(nfa->states[start].set, set, sizeof(nfa->states[start].set));
+    nfa->states[start].out = end;
+    return (Fragment){ start, end };
+}
+
+static Fragment byte_fragment(Nfa *nfa, int c) {
+    uint32_t set[8] = { 0 };
+    set_add(set, c);
+    return set_fragment(nfa, set);
+}
+
+static Fragment concat(Nfa *nfa, Fragment a, Fragment b) {
+    nfa->states[a.end].out = b.start;
+    return (Fragment){ a.start, b.end };
+}
+
+static Fragment alternate(Nfa *nfa, Fragment a, Fragment b) {
+    int split = new_state(nfa, NFA_SPLIT);
+    int end = new_state(nfa, NFA_JUMP);
+    nfa->states[split].out = a.start;
+    nfa->states[split].out1 = b.start;
+    nfa->states[a.end].out = end;
+    nfa->states[b.end].out = end;
+    return (Fragment){ split, end };
+}
+
+// op is '*', '+' or '?'
+static Fragment repeat(Nfa *nfa, Fragment a, char op) {
+    int split = new_state(nfa, NFA_SPLIT);
+    int end = new_state(nfa, NFA_JUMP);
+    nfa->states[split].out = a.start;
+    nfa->states[split].out1 = end;
+    nfa->states[a.end].out = op == '?' ? end : split;
+    return (Fragment){ op == '+' ? a.start : split, end };
+}
+
+// Any run of bytes, '/' included
+static Fragment any_run(Nfa *nfa) {
+    uint32_t set[8];
+    set_fill(set);
+    return repeat(nfa, set_fragment(nfa, set), '*');
+}
+
+// A copy of the fragment whose states are first .. last - 1, made before
+// its end is joined to anything
+static Fragment copy_fragment(Nfa *nfa, Fragment a, int first, int last) {
+    int delta = nfa->count - first;
+    for (int i = first; i < last && nfa->error == NULL; i++) {
+        int copy = new_state(nfa, NFA_JUMP);
+        nfa->states[copy] = nfa->states[i];
+        if (nfa->states[copy].out >= first) nfa->states[copy].out += delta;
+        if (nfa->states[copy].out1 >= first) nfa->states[copy].out1 += delta;
+    }
+    return (Fragment){ a.start + delta, a.end + delta };
+}
+
+// Adds \d, \w, \s or their negations to set; false for other escapes
+static int escape_class(int c, uint32_t *set) {
+    int lower = tolower(c);
+    if (lower != 'd' && lower != 'w' && lower != 's') return 0;
+    for (int b = 0; b < 256; b++) {
+        int member = lower == 'd' ? isdigit(b) != 0 :
+                     lower == 'w' ? isalnum(b) || b == '_' :
+                     b == ' ' || (b >= '\t' && b <= '\r');
+        if (member != (c != lower)) set_add(set, b);
+    }
+    return 1;
+}
+
+static int class_byte(Nfa *nfa) {
+    if (nfa->at[0] == '\\' && nfa->at[1] != '\0') nfa->at++;
+    return (unsigned char)*nfa->at++;
+}
+
+// [...] with nfa->at just past the '['. Ranges, leading ^ (or ! in a
+// glob) to negate, a leading ] taken literally and backslash escapes.
+static int parse_class(Nfa *nfa, uint32_t *set, int glob) {
+    int negate = 0;
+    memset(set, 0, 8 * sizeof(uint32_t));
+    if (*nfa->at == '^' || (glob && *nfa->at == '!')) {
+        negate = 1;
+        nfa->at++;
+    }
+    int first = 1;
+    while (first || *nfa->at != ']') {
+        if (*nfa->at == '\0') {
+            nfa->error = "missing ]";
+            return -1;
+        }
+        first = 0;
+        if (!glob && nfa->at[0] == '\\' && nfa->at[1] != '\0' && escape_class(nfa->at[1], set)) {
+            nfa->at += 2;
+            continue;
+        }
+        int low = class_byte(nfa);
+        int high = low;
+        if (nfa->at[0] == '-' && nfa->at[1] != ']' && nfa->at[1] != '\0') {
+            nfa->at++;
+            high = class_byte(nfa);
+            if (high < low) {
+                nfa->error = "range out of order";
+                return -1;
+            }
+        }
+        for (int c = low; c <= high; c++) {
+            set_add(set, c);
+        }
+    }
+    nfa->at++;
+    if (negate) {
+        for (int i = 0; i < 8; i++) {
+            set[i] = ~set[i];
+        }
+    }
+    return 0;
+}
+
+static Fragment parse_alternation(Nfa *nfa, int depth);
+
+static Fragment parse_atom(Nfa *nfa, int depth) {
+    uint32_t set[8] = { 0 };
+    char c = *nfa->at;
+    if (c == '(') {
+        nfa->at++;
+        Fragment inner = parse_alternation(nfa, depth + 1);
+        if (*nfa->at != ')') {
+            if (nfa->error == NULL) nfa->error = "missing )";
+            return inner;
+        }
+        nfa->at++;
+        return inner;
+    }
+    if (c == '*' || c == '+' || c == '?') {
+        nfa->error = "nothing to repeat";
+        return empty_fragment(nfa);
+    }
+    if (c == '[') {
+        nfa->at++;
+        parse_class(nfa, set, 0);
+    } else if (c == '.') {
+        set_fill(set);
+        nfa->at++;
+    } else if (c == '\\') {
+        nfa->at++;
+        if (*nfa->at == '\0') {
+            nfa->error = "trailing backslash";
+            return empty_fragment(nfa);
+        }
+        if (!escape_class(*nfa->at, set)) set_add(set, (unsigned char)*nfa->at);
+        nfa->at++;
+    } else {
+        set_add(set, (unsigned char)c);
+        nfa->at++;
+    }
+    return set_fragment(nfa, set);
+}
+
+// a{m}, a{m,} or a{m,n}, built from copies of a made before any is joined
+static Fragment parse_interval(Nfa *nfa, Fragment a, int first) {
+    char *end;
+    long min = strtol(nfa->at + 1, &end, 10);
+    long max = min;
+    if (*end == ',') {
+        end++;
+        max = isdigit((unsigned char)*end) ? strtol(end, &end, 10) : -1;
+    }
+    if (*end != '}') {
+        nfa->error = "bad {m,n}";
+        return a;
+    }
+    if (min > PATTERN_MAX_REPEAT || max > PATTERN_MAX_REPEAT || (max >= 0 && max < min)) {
+        nfa->error = "bad repetition count";
+        return a;
+    }
+    nfa->at = end + 1;
+
+    int total = max < 0 ? (int)min + 1 : (int)max;
+    if (total == 0) return empty_fragment(nfa);
+    Fragment copies[PATTERN_MAX_REPEAT + 1];
+    int last = nfa->count;
+    for (int i = 0; i + 1 < total; i++) {
+        copies[i] = copy_fragment(nfa, a, first, last);
+    }
+    copies[total - 1] = a;
+    if (nfa->error != NULL) return a;
+
+    Fragment result = empty_fragment(nfa);
+    for (int i = 0; i < min; i++) {
+        result = concat(nfa, result, copies[i]);
+    }
+    if (max < 0) {
+        return concat(nfa, result, repeat(nfa, copies[min], '*'));
+    }
+    for (int i = min; i < max; i++) {
+        result = concat(nfa, result, repeat(nfa, copies[i], '?'));
+    }
+    return result;
+}
+
+static Fragment parse_piece(Nfa *nfa, int depth) {
+    int first = nfa->count;
+    Fragment fragment = parse_atom(nfa, depth);
+    while (nfa->error == NULL) {
+        char op = *nfa->at;
+        if (op == '*' || op == '+' || op == '?') {
+            nfa->at++;
+            fragment = repeat(nfa, fragment, op);
+        } else if (op == '{' && isdigit((unsigned char)nfa->at[1])) {
+            fragment = parse_interval(nfa, fragment, first);
+        } else {
+            break;
+        }
+    }
+    return fragment;
+}
+
+// At the top level a branch stops before a '$' that ends it
+static Fragment parse_branch(Nfa *nfa, int depth) {
+    Fragment result = empty_fragment(nfa);
+    while (nfa->error == NULL && *nfa->at != '\0' && *nfa->at != '|') {
+        char c = *nfa->at;
+        if (c == ')') {
+            if (depth == 0) nfa->error = "unmatched )";
+            break;
+        }
+        if (c == '$' && depth == 0 && (nfa->at[1] == '\0' || nfa->at[1] == '|')) break;
+        if (c == '^' || c == '$') {
+            nfa->error = "^ and $ only at the ends of the pattern";
+            break;
+        }
+        result = concat(nfa, result, parse_piece(nfa, depth));
+    }
+    return result;
+}
+
+static Fragment parse_alternation(Nfa *nfa, int depth) {
+    Fragment result = parse_branch(nfa, depth);
+    while (nfa->error == NULL && *nfa->at == '|') {
+        nfa->at++;
+        result = alternate(nfa, result, parse_branch(nfa, depth));
+    }
+    return result;
+}
+
+// The regex is searched for anywhere in the name, so each top level
+// branch gets a leading and trailing any_run unless anchored there
+static Fragment parse_regex(Nfa *nfa) {
+    Fragment result = { -1, -1 };
+    do {
+        if (result.start >= 0) nfa->at++;
+        int anchored_start = *nfa->at == '^';
+        if (anchored_start) nfa->at++;
+        Fragment branch = parse_branch(nfa, 0);
+        int anchored_end = *nfa->at == '$';
+        if (anchored_end) nfa->at++;
+        if (!anchored_start) branch = concat(nfa, any_run(nfa), branch);
+        if (!anchored_end) branch = concat(nfa, branch, any_run(nfa));
+        result = result.start < 0 ? branch : alternate(nfa, result, branch);
+    } while (nfa->error == NULL && *nfa->at == '|');
+    return result;
+}
+
+// Globs never match '/' except with a literal '/' or a "**" component
+static Fragment parse_glob(Nfa *nfa) {
+    const char *text = nfa->at;
+    uint32_t not_slash[8], slash[8] = { 0 }, set[8];
+    set_fill(not_slash);
+    not_slash['/' >> 5] &= ~(1u << ('/' & 31));
+    set_add(slash, '/');
+
+    Fragment result = empty_fragment(nfa);
+    while (nfa->error == NULL && *nfa->at != '\0') {
+        const char *at = nfa->at;
+        Fragment piece;
+        if (*at == '*') {
+            while (*nfa->at == '*') nfa->at++;
+            int component = nfa->at - at >= 2 && (at == text || at[-1] == '/');
+            if (component && *nfa->at == '/') {
+                // Any number of whole directories: ([^/]*/)*
+                nfa->at++;
+                Fragment directory = concat(nfa, repeat(nfa, set_fragment(nfa, not_slash), '*'),
+                                            set_fragment(nfa, slash));
+                piece = repeat(nfa, directory, '*');
+            } else if (component && *nfa->at == '\0') {
+                piece = any_run(nfa);
+            } else {
+                piece = repeat(nfa, set_fragment(nfa, not_slash), '*');
+            }
+        } else if (*at == '?') {
+            nfa->at++;
+            piece = set_fragment(nfa, not_slash);
+        } else if (*at == '[') {
+            nfa->at++;
+            if (parse_class(nfa, set, 1) == 0) {
+                set['/' >> 5] &= ~(1u << ('/' & 31));
+                piece = set_fragment(nfa, set);
+            } else {
+                // No closing ']': the '[' is an ordinary character
+                nfa->error = NULL;
+                nfa->at = at + 1;
+                piece = byte_fragment(nfa, '[');
+            }
+        } else {
+            if (at[0] == '\\' && at[1] != '\0') nfa->at++;
+            piece = byte_fragment(nfa, (unsigned char)*nfa->at++);
+        }
+        result = concat(nfa, result, piece);
+    }
+    return result;
+}
+
+// Splits the bytes into classes that every NFA_SET treats alike; returns
+// the number of classes
+static int byte_classes(const Nfa *nfa, unsigned char *byte_class) {
+    int classes = 1;
+    memset(byte_class, 0, 256);
+    for (int s = 0; s < nfa->count; s++) {
+        if (nfa->states[s].type != NFA_SET) continue;
+        int remap[256][2];
+        memset(remap, -1, sizeof(remap));
+        int count = 0;
+        for (int b = 0; b < 256; b++) {
+            int *slot = &remap[byte_class[b]][set_has(nfa->states[s].set, b)];
+            if (*slot < 0) *slot = count++;
+            byte_class[b] = (unsigned char)*slot;
+        }
+        classes = count;
+    }
+    return classes;
+}
+
+typedef struct {
+    const Nfa *nfa;
+    int words;                  // uint64_t per state set
+    uint64_t *sets;             // PATTERN_MAX_STATES + 1 sets; the last is scratch
+    uint64_t *visited;
+    int *stack;
+    int *table;                 // DFA_HASH_SIZE slots of state numbers, -1 if free
+    int count;
+} Subsets;
+
+// Adds the SET and MATCH states reachable from state without input
+static void add_closure(Subsets *subsets, uint64_t *set, int state) {
+    int depth = 0;
+    subsets->stack[depth++] = state;
+    while (depth > 0) {
+        int s = subsets->stack[--depth];
+        if (s < 0 || (subsets->visited[s >> 6] >> (s & 63)) & 1) continue;
+        subsets->visited[s >> 6] |= 1ull << (s & 63);
+        const NfaState *node = &subsets->nfa->states[s];
+        if (node->type == NFA_SET || node->type == NFA_MATCH) {
+            set[s >> 6] |= 1ull << (s & 63);
+        } else {
+            subsets->stack[depth++] = node->out;
+            if (node->type == NFA_SPLIT) subsets->stack[depth++] = node->out1;
+        }
+    }
+}
+
+// State number of the set in the scratch slot, adding it if new; -1 if
+// there are already PATTERN_MAX_STATES
+static int find_subset(Subsets *subsets) {
+    size_t bytes = subsets->words * sizeof(uint64_t);
+    uint64_t *candidate = subsets->sets + (size_t)PATTERN_MAX_STATES * subsets->words;
+    uint64_t hash = 1469598103934665603ull;
+    for (int i = 0; i < subsets->words; i++) {
+        hash = (hash ^ candidate[i]) * 1099511628211ull;
+    }
+    size_t slot = (hash ^ (hash >> 29)) % DFA_HASH_SIZE;
+    while (subsets->table[slot] >= 0) {
+        int state = subsets->table[slot];
+        if (memcmp(subsets->sets + (size_t)state * subsets->words, candidate, bytes) == 0) return state;
+        slot = (slot + 1) % DFA_HASH_SIZE;
+    }
+    if (subsets->count == PATTERN_MAX_STATES) return -1;
+    int state = subsets->count++;
+    memcpy(subsets->sets + (size_t)state * subsets->words, candidate, bytes);
+    subsets->table[slot] = state;
+    return state;
+}
+
+// Marks states that cannot reach an accepting one, and accepting states
+// whose every continuation accepts
+static void mark_states(Pattern *pattern, const uint16_t *next, int classes) {
+    unsigned char *flags = pattern->flags;
+    for (int s = 0; s < pattern->states; s++) {
+        flags[s] |= PATTERN_DEAD;
+        if (flags[s] & PATTERN_ACCEPT) flags[s] = PATTERN_ACCEPT | PATTERN_ALWAYS;
+    }
+    int changed = 1;
+    while (changed) {
+        changed = 0;
+        // States are numbered breadth first, so going backwards settles
+        // most of them in one pass
+        for (int s = pattern->states - 1; s >= 0; s--) {
+            for (int c = 0; c < classes; c++) {
+                unsigned char target = flags[next[s * classes + c]];
+                if ((flags[s] & PATTERN_DEAD) && !(target & PATTERN_DEAD)) {
+                    flags[s] &= ~PATTERN_DEAD;
+                    changed = 1;
+                }
+                if ((flags[s] & PATTERN_ALWAYS) && !(target & PATTERN_ALWAYS)) {
+                    flags[s] &= ~PATTERN_ALWAYS;
+                    changed = 1;
+                }
+            }
+        }
+    }
+}
+
+static int build_dfa(Pattern *pattern, const Nfa *nfa, int start, int match) {
+    unsigned char byte_class[256];
+    int classes = byte_classes(nfa, byte_class);
+    int representative[256];
+    for (int b = 255; b >= 0; b--) {
+        representative[byte_class[b]] = b;
+    }
+
+    Subsets subsets;
+    memset(&subsets, 0, sizeof(subsets));
+    subsets.nfa = nfa;
+    subsets.words = (nfa->count + 63) / 64;
+    subsets.sets = calloc((size_t)(PATTERN_MAX_STATES + 1) * subsets.words, sizeof(uint64_t));
+    subsets.visited = malloc(subsets.words * sizeof(uint64_t));
+    subsets.stack = malloc((2 * nfa->count + 1) * sizeof(int));
+    subsets.table = malloc(DFA_HASH_SIZE * sizeof(int));
+    uint16_t *next = malloc((size_t)PATTERN_MAX_STATES * classes * sizeof(uint16_t));
+    int result = -1;
+    if (subsets.sets == NULL || subsets.visited == NULL || subsets.stack == NULL ||
+        subsets.table == NULL || next == NULL) {
+        printf("Memory allocation failed!\n");
+        goto done;
+    }
+    memset(subsets.table, -1, DFA_HASH_SIZE * sizeof(int));
+
+    size_t bytes = subsets.words * sizeof(uint64_t);
+    uint64_t *candidate = subsets.sets + (size_t)PATTERN_MAX_STATES * subsets.words;
+    memset(subsets.visited, 0, bytes);
+    add_closure(&subsets, candidate, start);
+    find_subset(&subsets);
+
+    for (int d = 0; d < subsets.count; d++) {
+        for (int c = 0; c < classes; c++) {
+            const uint64_t *set = subsets.sets + (size_t)d * subsets.words;
+            memset(candidate, 0, bytes);
+            memset(subsets.visited, 0, bytes);
+            for (int w = 0; w < subsets.words; w++) {
+                for (uint64_t bits = set[w]; bits != 0; bits &= bits - 1) {
+                    int s = w * 64 + __builtin_ctzll(bits);
+                    if (nfa->states[s].type == NFA_SET && set_has(nfa->states[s].set, representative[c])) {
+                        add_closure(&subsets, candidate, nfa->states[s].out);
+                    }
+                }
+            }
+            int target = find_subset(&subsets);
+            if (target < 0) {
+                printf("Error: Pattern needs more than %d states\n", PATTERN_MAX_STATES);
+                goto done;
+            }
+            next[d * classes + c] = (uint16_t)target;
+        }
+    }
+
+    pattern->states = subsets.count;
+    pattern->flags = calloc(subsets.count, 1);
+    pattern->next = malloc((size_t)subsets.count * 256 * sizeof(uint16_t));
+    if (pattern->flags == NULL || pattern->next == NULL) {
+        printf("Memory allocation failed!\n");
+        free_pattern(pattern);
+        goto done;
+    }
+    for (int d = 0; d < subsets.count; d++) {
+        const uint64_t *set = subsets.sets + (size_t)d * subsets.words;
+        if ((set[match >> 6] >> (match & 63)) & 1) pattern->flags[d] = PATTERN_ACCEPT;
+        for (int b = 0; b < 256; b++) {
+            pattern->next[d * 256 + b] = next[d * classes + byte_class[b]];
+        }
+    }
+    mark_states(pattern, next, classes);
+    result = 0;
+
+done:
+    free(subsets.sets);
+    free(subsets.visited);
+    free(subsets.stack);
+    free(subsets.table);
+    free(next);
+    return result;
+}
+
+PatternKind guess_pattern_kind(const char *text) {
+    return strpbrk(text, "*?[") != NULL ? PATTERN_GLOB : PATTERN_SUBSTRING;
+}
+
+int compile_pattern(Pattern *pattern, const char *text, PatternKind kind) {
+    memset(pattern, 0, sizeof(*pattern));
+    if (*text == '\0') {
+        printf("Error: Empty pattern\n");
+        return -1;
+    }
+    pattern->kind = kind;
+    if (kind == PATTERN_SUBSTRING) {
+        pattern->literal = strdup(text);
+        if (pattern->literal == NULL) {
+            printf("Memory allocation failed!\n");
+            return -1;
+        }
+        return 0;
+    }
+    Nfa nfa;
+    memset(&nfa, 0, sizeof(nfa));
+    nfa.states = malloc((NFA_MAX_STATES + 1) * sizeof(NfaState));
+    if (nfa.states == NULL) {
+        printf("Memory allocation failed!\n");
+        return -1;
+    }
+    nfa.at = text;
+
+    Fragment fragment = kind == PATTERN_REGEX ? parse_regex(&nfa) : parse_glob(&nfa);
+    int match = new_state(&nfa, NFA_MATCH);
+    nfa.states[fragment.end].out = match;
+    int result = -1;
+    if (nfa.error != NULL) {
+        printf("Error: Invalid pattern '%s': %s\n", text, nfa.error);
+    } else {
+        pattern->match_path = kind == PATTERN_GLOB && strchr(text, '/') != NULL;
+        result = build_dfa(pattern, &nfa, fragment.start, match);
+    }
+    free(nfa.states);
+    return result;
+}
+
+void free_pattern(Pattern *pattern) {
+    free(pattern->literal);
+    free(pattern->next);
+    free(pattern->flags);
+    pattern->literal = NULL;
+    pattern->next = NULL;
+    pattern->flags = NULL;
+    pattern->states = 0;
+}
+
+// State after text, or the first state reached that settles the answer
+static unsigned run_pattern(const Pattern *pattern, const char *text) {
+    const unsigned char *c = (const unsigned char *)text;
+    unsigned state = 0;
+    while (*c != '\0' && !(pattern->flags[state] & (PATTERN_DEAD | PATTERN_ALWAYS))) {
+        state = pattern->next[state * 256 + *c++];
+    }
+    return state;
+}
+
+int pattern_matches(const Pattern *pattern, const char *text) {
+    if (pattern->literal != NULL) return strstr(text, pattern->literal) != NULL;
+    const unsigned char *c = (const unsigned char *)text;
+    unsigned state = 0;
+    while (*c != '\0') {
+        state = pattern->next[state * 256 + *c++];
+    }
+    return pattern->flags[state] & PATTERN_ACCEPT;
+}
+
+int pattern_may_match_below(const Pattern *pattern, const char *directory) {
+    if (!pattern->match_path) return 1;
+    unsigned state = run_pattern(pattern, directory);
+    if (pattern->flags[state] & (PATTERN_DEAD | PATTERN_ALWAYS)) {
+        return !(pattern->flags[state] & PATTERN_DEAD);
+    }
+    return !(pattern->flags[pattern->next[state * 256 + '/']] & PATTERN_DEAD);
+}
@@ -0,0 +1,60 @@
+#ifndef PATTERN_H
+#define PATTERN_H
+
+// Name patterns for find, compiled once into a DFA.
+//
+// A pattern is a plain substring of the name, as find has always taken
+// it, a glob (*, ?, [...]) or an extended regular expression. Globs and
+// regexes are parsed into a Thompson NFA, which subset construction turns
+// into a DFA over byte classes: bytes the pattern never tells apart share
+// a column. The finished table has a row of 256 entries per state, so
+// matching a name costs one lookup per byte and allocates nothing. A
+// substring stays with strstr, whose vector loops are faster on names
+// than walking a table a byte at a time.
+//
+// A glob containing '/' is matched against the path below the directory
+// searched rather than the name, with a "**" component standing for any
+// number of directories. Such a pattern can also say that no path below a
+// directory will ever match, so find does not read that directory at all.
+
+#include <stdint.h>
+
+#define PATTERN_MAX_STATES 4096         // DFA states; larger patterns are refused
+#define PATTERN_MAX_REPEAT 255          // largest count in a regex {m,n}
+
+// State flags
+#define PATTERN_ACCEPT  0x1
+#define PATTERN_DEAD    0x2             // no continuation matches
+#define PATTERN_ALWAYS  0x4             // every continuation matches
+
+typedef enum {
+    PATTERN_SUBSTRING,
+    PATTERN_GLOB,
+    PATTERN_REGEX
+} PatternKind;
+
+typedef struct {
+    PatternKind kind;
+    int match_path;             // matched against the relative path, not the name
+    char *literal;              // PATTERN_SUBSTRING; no DFA is built
+    int states;                 // state 0 is the start
+    uint16_t *next;             // states rows of 256
+    unsigned char *flags;       // per state
+} Pattern;
+
+// PATTERN_GLOB if text has *, ? or [ in it, else PATTERN_SUBSTRING
+PatternKind guess_pattern_kind(const char *text);
+
+// Returns 0, or -1 after printing why text cannot be compiled
+int compile_pattern(Pattern *pattern, const char *text, PatternKind kind);
+void free_pattern(Pattern *pattern);
+
+// text is the name, or the path relative to the directory searched when
+// pattern->match_path is set
+int pattern_matches(const Pattern *pattern, const char *text);
+
+// False only if no path below the directory (given relative to the
+// directory searched) can match; always true unless match_path is set
+int pattern_may_match_below(const Pattern *pattern, const char *directory);
+
+#endif
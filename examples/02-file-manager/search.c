@@ -0,0 +1,337 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <time.h>
+#include <dirent.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "search.h"
+#include "walker.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define HAVE_X86_SIMD 1
+#endif
+
+#define READ_LIMIT (1 << 20)            // larger files are mapped
+#define GREP_OUTPUT_BUFFER (64 * 1024)
+
+int init_matcher(Matcher *matcher, const char *pattern) {
+    size_t length = strlen(pattern);
+    if (length == 0) return -1;
+    matcher->pattern = (const unsigned char *)pattern;
+    matcher->length = length;
+    for (int c = 0; c < 256; c++) {
+        matcher->skip[c] = length;
+    }
+    for (size_t i = 0; i + 1 < length; i++) {
+        matcher->skip[matcher->pattern[i]] = length - 1 - i;
+    }
+#ifdef HAVE_X86_SIMD
+    __builtin_cpu_init();
+    matcher->use_avx2 = __builtin_cpu_supports("avx2");
+#else
+    matcher->use_avx2 = 0;
+#endif
+    return 0;
+}
+
+static const char* horspool_find(const Matcher *matcher, const char *data, size_t length) {
+    size_t n = matcher->length;
+    const unsigned char *text = (const unsigned char *)data;
+    const unsigned char last = matcher->pattern[n - 1];
+    size_t i = 0;
+    while (i + n <= length) {
+        unsigned char c = text[i + n - 1];
+        if (c == last && memcmp(text + i, matcher->pattern, n - 1) == 0) {
+            return data + i;
+        }
+        i += matcher->skip[c];
+    }
+    return NULL;
+}
+
+#ifdef HAVE_X86_SIMD
+// A block's candidates are the positions whose first and last pattern
+// bytes both match; each set bit of mask is one
+static const char* check_candidates(const Matcher *matcher, const char *block, unsigned mask) {
+    while (mask != 0) {
+        int bit = __builtin_ctz(mask);
+        if (memcmp(block + bit + 1, matcher->pattern + 1, matcher->length - 2) == 0) {
+            return block + bit;
+        }
+        mask &= mask - 1;
+    }
+    return NULL;
+}
+
+static const char* sse2_find(const Matcher *matcher, const char *data, size_t length, size_t *searched) {
+    size_t n = matcher->length;
+    const __m128i first = _mm_set1_epi8((char)matcher->pattern[0]);
+    const __m128i last = _mm_set1_epi8((char)matcher->pattern[n - 1]);
+    size_t i = 0;
+    for (; i + n - 1 + 16 <= length; i += 16) {
+        __m128i start = _mm_loadu_si128((const __m128i *)(data + i));
+        __m128i end = _mm_loadu_si128((const __m128i *)(data + i + n - 1));
+        unsigned mask = (unsigned)_mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(start, first),
+                                                                  _mm_cmpeq_epi8(end, last)));
+        if (mask != 0) {
+            const char *found = check_candidates(matcher, data + i, mask);
+            if (found != NULL) return found;
+        }
+    }
+    *searched = i;
+    return NULL;
+}
+
+__attribute__((target("avx2")))
+static const char* avx2_find(const Matcher *matcher, const char *data, size_t length, size_t *searched) {
+    size_t n = matcher->length;
+    const __m256i first = _mm256_set1_epi8((char)matcher->pattern[0]);
+    const __m256i last = _mm256_set1_epi8((char)matcher->pattern[n - 1]);
+    size_t i = 0;
+    for (; i + n - 1 + 32 <= length; i += 32) {
+        __m256i start = _mm256_loadu_si256((const __m256i *)(data + i));
+        __m256i end = _mm256_loadu_si256((const __m256i *)(data + i + n - 1));
+        unsigned mask = (unsigned)_mm256_movemask_epi8(_mm256_and_si256(_mm256_cmpeq_epi8(start, first),
+                                                                        _mm256_cmpeq_epi8(end, last)));
+        if (mask != 0) {
+            const char *found = check_candidates(matcher, data + i, mask);
+            if (found != NULL) return found;
+        }
+    }
+    *searched = i;
+    return NULL;
+}
+#endif
+
+const char* find_match(const Matcher *matcher, const char *data, size_t length) {
+    if (matcher->length == 1) {
+        return memchr(data, matcher->pattern[0], length);
+    }
+    if (length < matcher->length) return NULL;
+    size_t searched = 0;
+#ifdef HAVE_X86_SIMD
+    const char *found = matcher->use_avx2 ? avx2_find(matcher, data, length, &searched)
+                                          : sse2_find(matcher, data, length, &searched);
+    if (found != NULL) return found;
+#endif
+    // Positions the vector loop could not reach without reading past the end
+    return horspool_find(matcher, data + searched, length - searched);
+}
+
+int looks_binary(const char *data, size_t length) {
+    return memchr(data, '\0', length < BINARY_SAMPLE ? length : BINARY_SAMPLE) != NULL;
+}
+
+void init_grep_options(GrepOptions *options) {
+    options->threads = 0;
+    options->line_numbers = 1;
+}
+
+// Tree search
+
+typedef struct {
+    GrepStats stats;
+    char *buffer;               // whole small files
+    char *output;
+    size_t output_length;
+} GrepWorker;
+
+typedef struct {
+    Matcher matcher;
+    const GrepOptions *options;
+    GrepWorker *workers;
+} GrepSearch;
+
+static double now_seconds() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void flush_grep_output(GrepWorker *worker) {
+    fwrite(worker->output, 1, worker->output_length, stdout);
+    worker->output_length = 0;
+}
+
+// Lines are kept whole in the buffer, so output from different threads
+// never interleaves within a line
+static void emit(GrepWorker *worker, const char *path, unsigned long long line_number,
+                 int line_numbers, const char *line, size_t length) {
+    char prefix[64];
+    int prefix_length = line_numbers ? snprintf(prefix, sizeof(prefix), ":%llu:", line_number)
+                                     : snprintf(prefix, sizeof(prefix), ":");
+    size_t path_length = strlen(path);
+    size_t total = path_length + (size_t)prefix_length + length + 1;
+    if (worker->output == NULL && (worker->output = malloc(GREP_OUTPUT_BUFFER)) == NULL) {
+        printf("%s%s%.*s\n", path, prefix, (int)length, line);
+        return;
+    }
+    if (worker->output_length + total > GREP_OUTPUT_BUFFER) {
+        flush_grep_output(worker);
+    }
+    if (total > GREP_OUTPUT_BUFFER) {
+        printf("%s%s%.*s\n", path, prefix, (int)length, line);
+        return;
+    }
+    char *out = worker->output + worker->output_length;
+    memcpy(out, path, path_length);
+    memcpy(out + path_length, prefix, (size_t)prefix_length);
+    memcpy(out + path_length + prefix_length, line, length);
+    out[total - 1] = '\n';
+    worker->output_length += total;
+}
+
+static unsigned long long count_lines(const char *data, size_t length) {
+    unsigned long long count = 0;
+    const char *end = data + length;
+    while ((data = memchr(data, '\n', (size_t)(end - data))) != NULL) {
+        count++;
+        data++;
+    }
+    return count;
+}
+
+static void search_data(GrepSearch *search, GrepWorker *worker, const char *path,
+                        const char *data, size_t length) {
+    worker->stats.files++;
+    worker->stats.bytes += length;
+    if (looks_binary(data, length)) {
+        worker->stats.binary_files++;
+        return;
+    }
+
+    // Lines are only counted between matches, so files without any cost
+    // nothing beyond the search itself
+    unsigned long long line_number = 1;
+    size_t counted = 0, position = 0;
+    int matched = 0;
+    const char *found;
+    while (position < length &&
+           (found = find_match(&search->matcher, data + position, length - position)) != NULL) {
+        size_t offset = (size_t)(found - data);
+        const char *line_start = memrchr(data + position, '\n', offset - position);
+        size_t start = line_start != NULL ? (size_t)(line_start - data) + 1 : position;
+        const char *line_end = memchr(found, '\n', length - offset);
+        size_t end = line_end != NULL ? (size_t)(line_end - data) : length;
+
+        if (search->options->line_numbers) {
+            line_number += count_lines(data + counted, start - counted);
+            counted = start;
+        }
+        emit(worker, path, line_number, search->options->line_numbers, data + start, end - start);
+        worker->stats.lines++;
+        matched = 1;
+        position = end + 1;
+    }
+    if (matched) worker->stats.matched_files++;
+}
+
+static void search_file(GrepSearch *search, GrepWorker *worker, const char *path) {
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) != 0 || !S_ISREG(st.st_mode)) {
+        if (fd < 0) worker->stats.errors++;
+        if (fd >= 0) close(fd);
+        return;
+    }
+    size_t size = (size_t)st.st_size;
+
+    if (size <= READ_LIMIT) {
+        if (worker->buffer == NULL && (worker->buffer = malloc(READ_LIMIT)) == NULL) {
+            worker->stats.errors++;
+            close(fd);
+            return;
+        }
+        size_t got = 0;
+        while (got < size) {
+            ssize_t n = read(fd, worker->buffer + got, size - got);
+            if (n < 0 && errno == EINTR) continue;
+            if (n <= 0) break;
+            got += (size_t)n;
+        }
+        search_data(search, worker, path, worker->buffer, got);
+    } else {
+        void *data = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (data == MAP_FAILED) {
+            worker->stats.errors++;
+        } else {
+            madvise(data, size, MADV_SEQUENTIAL);
+            search_data(search, worker, path, data, size);
+            munmap(data, size);
+        }
+    }
+    close(fd);
+}
+
+static int grep_visit(const WalkEntry *entry, void *arg) {
+    GrepSearch *search = arg;
+    if (entry->type == DT_REG) {
+        search_file(search, &search->workers[entry->worker], entry->path);
+    }
+    return WALK_CONTINUE;
+}
+
+int grep_path(const char *pattern, const char *path, const GrepOptions *options, GrepStats *stats) {
+    double start = now_seconds();
+    int result = -1;
+    GrepSearch search;
+    if (init_matcher(&search.matcher, pattern) != 0) {
+        printf("Error: Search pattern required\n");
+        return -1;
+    }
+    search.options = options;
+    search.workers = calloc(WALK_MAX_THREADS, sizeof(GrepWorker));
+    if (search.workers == NULL) {
+        printf("Memory allocation failed!\n");
+        return -1;
+    }
+
+    struct stat st;
+    if (stat(path, &st) != 0) {
+        printf("Error: Cannot open '%s'\n", path);
+        goto done;
+    }
+    fflush(stdout);
+    if (S_ISDIR(st.st_mode)) {
+        WalkOptions walk;
+        init_walk_options(&walk);
+        walk.threads = options->threads;
+        walk.visit = grep_visit;
+        walk.arg = &search;
+        WalkStats walk_stats;
+        if (walk_tree(path, &walk, &walk_stats) != 0) {
+            printf("Error: Cannot open directory '%s'\n", path);
+            goto done;
+        }
+        search.workers[0].stats.errors += walk_stats.errors;
+    } else {
+        search_file(&search, &search.workers[0], path);
+    }
+    result = 0;
+
+done:;
+    GrepStats total;
+    memset(&total, 0, sizeof(total));
+    for (int i = 0; i < WALK_MAX_THREADS; i++) {
+        GrepWorker *worker = &search.workers[i];
+        if (worker->output != NULL) flush_grep_output(worker);
+        total.files += worker->stats.files;
+        total.matched_files += worker->stats.matched_files;
+        total.lines += worker->stats.lines;
+        total.bytes += worker->stats.bytes;
+        total.binary_files += worker->stats.binary_files;
+        total.errors += worker->stats.errors;
+        free(worker->buffer);
+        free(worker->output);
+    }
+    free(search.workers);
+    total.seconds = now_seconds() - start;
+    if (stats != NULL) *stats = total;
+    return result;
+}
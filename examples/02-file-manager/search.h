@@ -0,0 +1,55 @@
+#ifndef SEARCH_H
+#define SEARCH_H
+
+// Content search for grep.
+//
+// A literal pattern is found with a SIMD filter: 16 or 32 positions at a
+// time are tested for the pattern's first and last bytes together, and
+// only positions passing both are compared in full. AVX2 is used when the
+// CPU has it, SSE2 otherwise; other processors and short tails use
+// Boyer-Moore-Horspool. Files are read whole when small and mapped when
+// large, searched on the walker's threads, and skipped as binary if their
+// first block contains a NUL byte.
+
+#include <stddef.h>
+
+#define BINARY_SAMPLE 8192
+
+typedef struct {
+    const unsigned char *pattern;
+    size_t length;
+    size_t skip[256];           // Horspool shift for each byte
+    int use_avx2;
+} Matcher;
+
+// Returns -1 for an empty pattern. The pattern is not copied.
+int init_matcher(Matcher *matcher, const char *pattern);
+
+// First occurrence of the pattern in data, or NULL
+const char* find_match(const Matcher *matcher, const char *data, size_t length);
+
+// True if a NUL byte appears in the first BINARY_SAMPLE bytes
+int looks_binary(const char *data, size_t length);
+
+typedef struct {
+    int threads;                // <= 0: one per online CPU
+    int line_numbers;
+} GrepOptions;
+
+typedef struct {
+    unsigned long long files;           // searched
+    unsigned long long matched_files;
+    unsigned long long lines;           // matching lines printed
+    unsigned long long bytes;           // searched
+    unsigned long long binary_files;    // skipped
+    unsigned long long errors;
+    double seconds;
+} GrepStats;
+
+void init_grep_options(GrepOptions *options);
+
+// Prints path:line:text for every line of every file under path (or of
+// path itself) containing pattern. Returns -1 if path cannot be searched.
+int grep_path(const char *pattern, const char *path, const GrepOptions *options, GrepStats *stats);
+
+#endif
@@ -0,0 +1,180 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include "batch.h"
+
+// Runs scripts of stand-in commands through the batch runner: "w PATH N"
+// writes PATH, "r PATH N" reads it, "b N" is a barrier and "q N" ends the
+// script, N being the command's number. Each records when it started and
+// finished, so the test can see which commands waited for which, that
+// unrelated ones ran at once, and that output came out in script order.
+
+#define COMMANDS 16
+
+static int failures;
+
+static void check(int condition, const char *description) {
+    if (!condition) {
+        printf("FAIL: %s\n", description);
+        failures++;
+    }
+}
+
+static pthread_mutex_t clock_lock = PTHREAD_MUTEX_INITIALIZER;
+static int ticks, running, most_running;
+static int started[COMMANDS], ended[COMMANDS];
+
+static int plan_test_command(char *command, BatchAccess accesses[BATCH_MAX_ACCESSES], void *arg) {
+    (void)arg;
+    char *save;
+    char *op = strtok_r(command, " ", &save);
+    char *path = strtok_r(NULL, " ", &save);
+    if (op == NULL || path == NULL || (strcmp(op, "w") != 0 && strcmp(op, "r") != 0)) return -1;
+    accesses[0].path = path;
+    accesses[0].write = op[0] == 'w';
+    return 1;
+}
+
+static int run_test_command(const char *command, FILE *out, void *arg) {
+    (void)arg;
+    int number = atoi(strrchr(command, ' ') + 1);
+    pthread_mutex_lock(&clock_lock);
+    started[number] = ++ticks;
+    if (++running > most_running) most_running = running;
+    pthread_mutex_unlock(&clock_lock);
+
+    struct timespec pause = { 0, 3 * 1000 * 1000 };
+    nanosleep(&pause, NULL);
+    fprintf(out, "%s\n", command);
+
+    pthread_mutex_lock(&clock_lock);
+    ended[number] = ++ticks;
+    running--;
+    pthread_mutex_unlock(&clock_lock);
+    return command[0] == 'q';
+}
+
+static void write_text(const char *path, const char *text) {
+    FILE *file = fopen(path, "w");
+    fputs(text, file);
+    fclose(file);
+}
+
+// Runs the script with stdout going to a file, whose contents come back in output
+static int run_captured(const char *script, const char *capture, BatchStats *stats, char *output, size_t size) {
+    BatchOptions options;
+    init_batch_options(&options);
+    options.threads = 8;
+    options.plan = plan_test_command;
+    options.run = run_test_command;
+
+    fflush(stdout);
+    int saved = dup(STDOUT_FILENO);
+    int fd = open(capture, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    dup2(fd, STDOUT_FILENO);
+    close(fd);
+    int result = run_batch(script, &options, stats);
+    fflush(stdout);
+    dup2(saved, STDOUT_FILENO);
+    close(saved);
+
+    FILE *file = fopen(capture, "r");
+    size_t got = fread(output, 1, size - 1, file);
+    output[got] = '\0';
+    fclose(file);
+    return result;
+}
+
+static void test_dependencies(const char *root) {
+    char path[4200], capture[4200], output[4096];
+    snprintf(path, sizeof(path), "%s/real", root);
+    mkdir(path, 0755);
+    snprintf(path, sizeof(path), "%s/link", root);
+    symlink("real", path);
+    snprintf(path, sizeof(path), "%s/script", root);
+    snprintf(capture, sizeof(capture), "%s/output", root);
+    write_text(path,
+               "# paths are relative to the directory the test moved to\n"
+               "w a 0\n"
+               "w b 1\n"
+               "w a/x 2\n"
+               "\n"
+               "r b 3\n"
+               "  r b 4\n"
+               "w b/y 5\n"
+               "w ab 6\n"
+               "w ./a/../a//x 7\n"
+               "w link/z 8\n"
+               "w real/z 9\n"
+               "b 10\n"
+               "w a 11\n"
+               "q 12\n"
+               "w a 13\n");
+
+    BatchStats stats;
+    check(run_captured(path, capture, &stats, output, sizeof(output)) == 0, "script runs");
+    check(strcmp(output, "w a 0\nw b 1\nw a/x 2\nr b 3\nr b 4\nw b/y 5\nw ab 6\nw ./a/../a//x 7\n"
+                         "w link/z 8\nw real/z 9\nb 10\nw a 11\nq 12\n") == 0, "output in script order");
+    check(stats.commands == 13 && stats.concurrent == 11 && stats.barriers == 2, "commands counted, quit stops");
+    check(started[13] == 0, "nothing runs after quit");
+
+    check(started[2] > ended[0], "write below a write waits");
+    check(started[3] > ended[1] && started[4] > ended[1], "reads wait for the write before");
+    check(started[5] > ended[1] && started[5] > ended[3] && started[5] > ended[4], "write below reads waits");
+    check(started[7] > ended[2], "paths compared once cleaned up");
+    check(started[9] > ended[8], "symbolic links resolved");
+    check(stats.waits == 9, "no needless waits: reads together, ab apart from a");
+    check(most_running > 1, "independent commands run at once");
+    int before_barrier = 1;
+    for (int c = 0; c < 10; c++) {
+        if (ended[c] > started[10]) before_barrier = 0;
+    }
+    check(before_barrier && started[11] > ended[10], "barriers run alone");
+}
+
+static void test_missing() {
+    BatchOptions options;
+    init_batch_options(&options);
+    options.plan = plan_test_command;
+    options.run = run_test_command;
+    check(run_batch("/nonexistent/script", &options, NULL) == -1, "missing script refused");
+}
+
+static void remove_scratch(const char *root) {
+    const char *names[] = { "link", "real", "script", "output" };
+    char path[4200];
+    for (int i = 0; i < 4; i++) {
+        snprintf(path, sizeof(path), "%s/%s", root, names[i]);
+        if (unlink(path) != 0) rmdir(path);
+    }
+    rmdir(root);
+}
+
+int main() {
+    printf("Testing script mode\n");
+    printf("===================\n");
+
+    char root[] = "/tmp/test_batch_XXXXXX";
+    if (mkdtemp(root) == NULL || chdir(root) != 0) {
+        printf("FAIL: cannot create scratch directory\n");
+        return 1;
+    }
+
+    test_dependencies(root);
+    test_missing();
+
+    remove_scratch(root);
+
+    if (failures > 0) {
+        printf("\n%d test(s) failed\n", failures);
+        return 1;
+    }
+    printf("\nAll tests completed successfully!\n");
+    return 0;
+}
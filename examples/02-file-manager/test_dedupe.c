@@ -0,0 +1,193 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "dedupe.h"
+
+// Checks the content hash against known XXH64 values and in pieces, then
+// runs dedupe over a scratch tree holding files that differ only past
+// their first 4 KB, in their first bytes or in size, small and empty
+// duplicates and a hard link, and replaces duplicates with hard links.
+
+static int failures;
+
+static void check(int condition, const char *description) {
+    if (!condition) {
+        printf("FAIL: %s\n", description);
+        failures++;
+    }
+}
+
+static void hash_text(const char *text, size_t length, size_t piece, uint64_t result[2]) {
+    ContentHash hash;
+    init_content_hash(&hash);
+    for (size_t done = 0; done < length; done += piece) {
+        update_content_hash(&hash, text + done, length - done < piece ? length - done : piece);
+    }
+    finish_content_hash(&hash, result);
+}
+
+static void test_hash() {
+    uint64_t result[2], pieces[2];
+    hash_text("", 0, 1, result);
+    check(result[0] == 0xef46db3751d8e999ull, "XXH64 of nothing");
+    hash_text("abc", 3, 3, result);
+    check(result[0] == 0x44bc2cf5ad770999ull, "XXH64 of abc");
+    const char *text = "Nobody inspects the spammish repetition";
+    hash_text(text, strlen(text), 64, result);
+    check(result[0] == 0xfbcea83c8a378bf1ull, "XXH64 past 32 bytes");
+
+    char data[1000];
+    for (int i = 0; i < 1000; i++) data[i] = (char)(i * 7);
+    hash_text(data, sizeof(data), sizeof(data), result);
+    hash_text(data, sizeof(data), 96, pieces);
+    check(memcmp(result, pieces, sizeof(result)) == 0, "hash in pieces");
+    data[999]++;
+    hash_text(data, sizeof(data), sizeof(data), pieces);
+    check(result[0] != pieces[0] && result[1] != pieces[1], "last byte changes both words");
+}
+
+static void write_file(const char *root, const char *name, size_t size, int seed, long flip) {
+    char path[4200];
+    snprintf(path, sizeof(path), "%s/%s", root, name);
+    FILE *file = fopen(path, "wb");
+    for (size_t i = 0; i < size; i++) {
+        int c = (int)((i * 31 + (size_t)seed) & 0xff);
+        fputc((long)i == flip ? c ^ 1 : c, file);
+    }
+    fclose(file);
+}
+
+typedef struct {
+    int sets;
+    char lines[8][512];         // each set's paths, joined, without the root
+} Found;
+
+static void collect_set(const char *const *paths, int count, unsigned long long size, void *arg) {
+    Found *found = arg;
+    (void)size;
+    if (found->sets == 8) return;
+    char *line = found->lines[found->sets++];
+    line[0] = '\0';
+    for (int i = 0; i < count; i++) {
+        const char *name = strrchr(paths[i], '/');
+        const char *below = strstr(paths[i], "/tree/");
+        strncat(line, below != NULL ? below + 6 : name + 1, 500 - strlen(line));
+        strcat(line, " ");
+    }
+}
+
+static ino_t inode_of(const char *root, const char *name) {
+    char path[4200];
+    struct stat st;
+    snprintf(path, sizeof(path), "%s/%s", root, name);
+    return stat(path, &st) == 0 ? st.st_ino : 0;
+}
+
+static void test_dedupe(const char *root) {
+    char tree[4096], path[4200];
+    snprintf(tree, sizeof(tree), "%s/tree", root);
+    mkdir(tree, 0755);
+    snprintf(path, sizeof(path), "%s/sub", tree);
+    mkdir(path, 0755);
+    write_file(tree, "big", 100000, 1, -1);
+    write_file(tree, "sub/big_copy", 100000, 1, -1);
+    write_file(tree, "sub/big_copy2", 100000, 1, -1);
+    write_file(tree, "big_late", 100000, 1, 90000);    // same head, different end
+    write_file(tree, "big_early", 100000, 1, 10);      // different head
+    write_file(tree, "big_longer", 100001, 1, -1);
+    write_file(tree, "small", 100, 2, -1);
+    write_file(tree, "sub/small_copy", 100, 2, -1);
+    write_file(tree, "empty", 0, 0, -1);
+    write_file(tree, "sub/empty", 0, 0, -1);
+    char target[4200];
+    snprintf(path, sizeof(path), "%s/big_link", tree);
+    snprintf(target, sizeof(target), "%s/big", tree);
+    link(target, path);
+
+    DedupeOptions options;
+    init_dedupe_options(&options);
+    DedupeStats stats;
+    Found found;
+    memset(&found, 0, sizeof(found));
+    check(find_duplicates(tree, &options, collect_set, &found, &stats) == 0, "dedupe runs");
+    check(found.sets == 2 && strcmp(found.lines[0], "big sub/big_copy sub/big_copy2 ") == 0 &&
+          strcmp(found.lines[1], "small sub/small_copy ") == 0, "duplicate sets, largest waste first");
+    check(stats.files == 8, "one file per inode, empty files ignored");
+    check(stats.same_size == 7 && stats.same_head == 6, "narrowed by size, then head");
+    check(stats.duplicates == 3 && stats.wasted == 200100, "waste counted");
+    check(stats.bytes_read < 7 * 4096 + 4 * 100000, "tail of big_early never read");
+
+    options.min_size = 1000;
+    memset(&found, 0, sizeof(found));
+    find_duplicates(tree, &options, collect_set, &found, &stats);
+    check(found.sets == 1, "small files left out");
+
+    // Shared blocks, where the filesystem has them, leave separate files
+    // with the same contents
+    options.min_size = 1;
+    options.mode = DEDUPE_REFLINK;
+    find_duplicates(tree, &options, NULL, NULL, &stats);
+    check(stats.linked == 3 || stats.linked == 0, "reflinks shared or refused");
+    options.mode = DEDUPE_REPORT;
+    find_duplicates(tree, &options, NULL, NULL, &stats);
+    check(stats.sets == 2 && inode_of(tree, "sub/big_copy") != inode_of(tree, "big"), "reflinked files kept");
+
+    options.mode = DEDUPE_HARDLINK;
+    find_duplicates(tree, &options, NULL, NULL, &stats);
+    check(stats.linked == 3 && stats.errors == 0, "duplicates linked");
+    check(inode_of(tree, "sub/big_copy") == inode_of(tree, "big") &&
+          inode_of(tree, "sub/big_copy2") == inode_of(tree, "big") &&
+          inode_of(tree, "sub/small_copy") == inode_of(tree, "small") &&
+          inode_of(tree, "big_late") != inode_of(tree, "big"), "links point at the first file");
+    check(stats.reclaimed >= 200000, "space reclaimed");
+
+    options.mode = DEDUPE_REPORT;
+    find_duplicates(tree, &options, NULL, NULL, &stats);
+    check(stats.sets == 0, "nothing left to deduplicate");
+
+    check(find_duplicates("/nonexistent/dedupe", &options, NULL, NULL, &stats) == -1, "missing directory");
+}
+
+static void remove_tree(const char *path) {
+    DIR *dir = opendir(path);
+    if (dir == NULL) {
+        unlink(path);
+        return;
+    }
+    struct dirent *entry;
+    char child[4200];
+    while ((entry = readdir(dir)) != NULL) {
+        if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) continue;
+        snprintf(child, sizeof(child), "%s/%s", path, entry->d_name);
+        remove_tree(child);
+    }
+    closedir(dir);
+    rmdir(path);
+}
+
+int main() {
+    printf("Testing duplicate detection\n");
+    printf("===========================\n");
+
+    char root[] = "/tmp/test_dedupe_XXXXXX";
+    if (mkdtemp(root) == NULL) {
+        printf("FAIL: cannot create scratch directory\n");
+        return 1;
+    }
+
+    test_hash();
+    test_dedupe(root);
+
+    remove_tree(root);
+
+    if (failures > 0) {
+        printf("\n%d test(s) failed\n", failures);
+        return 1;
+    }
+    printf("\nAll tests completed successfully!\n");
+    return 0;
+}
@@ -0,0 +1,318 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <time.h>
+#include <sys/stat.h>
+#include "index.h"
+#include "walker.h"
+
+// Builds an index of a scratch tree and checks that replaying it reports
+// what walking the disk does, that subtrees are found by prefix without
+// taking in neighbours like "a-b" or "a.txt", and that a refresh and a
+// watch bring the index back in line with the disk after changes.
+
+#define DIRS 40
+#define FILES_PER_DIR 5
+
+static int failures;
+
+static void check(int condition, const char *description) {
+    if (!condition) {
+        printf("FAIL: %s\n", description);
+        failures++;
+    }
+}
+
+typedef struct {
+    pthread_mutex_t lock;
+    char **lines;               // "path size"
+    size_t count;
+    size_t capacity;
+    WalkTotals root_totals;
+} Collected;
+
+static int collect_visit(const WalkEntry *entry, void *arg) {
+    Collected *collected = arg;
+    if (strstr(entry->path, INDEX_FILE) != NULL) return WALK_CONTINUE;
+    char line[4200];
+    snprintf(line, sizeof(line), "%s %lld", entry->path,
+             entry->type == DT_DIR ? 0LL : (long long)entry->stat->st_size);
+    pthread_mutex_lock(&collected->lock);
+    if (collected->count == collected->capacity) {
+        collected->capacity = collected->capacity ? collected->capacity * 2 : 256;
+        collected->lines = realloc(collected->lines, collected->capacity * sizeof(char *));
+    }
+    collected->lines[collected->count++] = strdup(line);
+    pthread_mutex_unlock(&collected->lock);
+    return WALK_CONTINUE;
+}
+
+static void collect_leave(const WalkEntry *directory, const WalkTotals *totals, void *arg) {
+    Collected *collected = arg;
+    if (directory->depth < 0) collected->root_totals = *totals;
+}
+
+static int compare_lines(const void *a, const void *b) {
+    return strcmp(*(char *const *)a, *(char *const *)b);
+}
+
+static void collect(Collected *collected, const char *path, const Index *index, const char *relative) {
+    memset(collected, 0, sizeof(*collected));
+    pthread_mutex_init(&collected->lock, NULL);
+    WalkOptions options;
+    init_walk_options(&options);
+    options.flags = WALK_STAT;
+    options.visit = collect_visit;
+    options.leave = collect_leave;
+    options.arg = collected;
+    if (index != NULL) {
+        index_walk(index, relative, path, &options, NULL);
+    } else {
+        walk_tree(path, &options, NULL);
+    }
+    qsort(collected->lines, collected->count, sizeof(char *), compare_lines);
+}
+
+static void free_collected(Collected *collected) {
+    for (size_t i = 0; i < collected->count; i++) free(collected->lines[i]);
+    free(collected->lines);
+    pthread_mutex_destroy(&collected->lock);
+}
+
+static int same_lines(const Collected *a, const Collected *b) {
+    if (a->count != b->count) return 0;
+    for (size_t i = 0; i < a->count; i++) {
+        if (strcmp(a->lines[i], b->lines[i]) != 0) return 0;
+    }
+    return 1;
+}
+
+// The index of root agrees with the disk under path (root or below it)
+static int index_matches_disk(const char *path) {
+    Index index;
+    char relative[4096];
+    if (open_index_for(path, &index, relative, sizeof(relative)) != 0) return 0;
+    Collected from_index, from_disk;
+    collect(&from_index, path, &index, relative);
+    collect(&from_disk, path, NULL, NULL);
+    int same = same_lines(&from_index, &from_disk);
+    free_collected(&from_index);
+    free_collected(&from_disk);
+    close_index(&index);
+    return same;
+}
+
+static void write_file(const char *path, size_t size) {
+    FILE *file = fopen(path, "wb");
+    for (size_t i = 0; i < size; i++) fputc('x', file);
+    fclose(file);
+}
+
+static void make_tree(const char *root) {
+    char path[4200];
+    for (int d = 0; d < DIRS; d++) {
+        snprintf(path, sizeof(path), "%s/dir%02d", root, d);
+        mkdir(path, 0755);
+        snprintf(path, sizeof(path), "%s/dir%02d/sub", root, d);
+        mkdir(path, 0755);
+        for (int f = 0; f < FILES_PER_DIR; f++) {
+            snprintf(path, sizeof(path), "%s/dir%02d/%sfile%d", root, d, f % 2 ? "sub/" : "", f);
+            write_file(path, (size_t)(d * 100 + f));
+        }
+    }
+    // Names that sort between "a" and "a/..." in plain byte order
+    snprintf(path, sizeof(path), "%s/a", root);
+    mkdir(path, 0755);
+    snprintf(path, sizeof(path), "%s/a/inside", root);
+    write_file(path, 7);
+    snprintf(path, sizeof(path), "%s/a-b", root);
+    write_file(path, 8);
+    snprintf(path, sizeof(path), "%s/a.txt", root);
+    write_file(path, 9);
+    snprintf(path, sizeof(path), "%s/dir00/hard", root);
+    char target[4200];
+    snprintf(target, sizeof(target), "%s/dir00/file0", root);
+    link(target, path);
+}
+
+static void test_build(const char *root) {
+    IndexStats stats;
+    check(build_index(root, &stats) == 0, "index built");
+    check(stats.entries == 1 + DIRS * (2 + FILES_PER_DIR) + 5, "every entry indexed");
+    check(index_matches_disk(root), "index agrees with a walk");
+
+    char path[4200];
+    snprintf(path, sizeof(path), "%s/dir07/sub", root);
+    check(index_matches_disk(path), "subdirectory agrees with a walk");
+    snprintf(path, sizeof(path), "%s/a", root);
+    check(index_matches_disk(path), "subtree holds only its own entries");
+
+    Index index;
+    char relative[4096];
+    check(open_index_for(path, &index, relative, sizeof(relative)) == 0 && strcmp(relative, "a") == 0,
+          "nearest index found from below");
+    Collected from_index, from_disk;
+    collect(&from_index, root, &index, "");
+    collect(&from_disk, root, NULL, NULL);
+    char index_path[4200];
+    snprintf(index_path, sizeof(index_path), "%s/%s", root, INDEX_FILE);
+    struct stat st;
+    stat(index_path, &st);
+    check(from_index.root_totals.bytes + st.st_blocks * 512 == from_disk.root_totals.bytes &&
+          from_index.root_totals.directories == from_disk.root_totals.directories &&
+          from_index.root_totals.files + 1 == from_disk.root_totals.files, "du totals, index file aside");
+    free_collected(&from_index);
+    free_collected(&from_disk);
+    check(index_walk(&index, "a.txt", root, NULL, NULL) == -1, "a file is not a subtree");
+    check(index_walk(&index, "missing", root, NULL, NULL) == -1, "missing path refused");
+    close_index(&index);
+}
+
+static void test_refresh(const char *root) {
+    char path[4200];
+    snprintf(path, sizeof(path), "%s/dir03/new_file", root);
+    write_file(path, 1234);
+    snprintf(path, sizeof(path), "%s/dir05/sub/file1", root);
+    unlink(path);
+    snprintf(path, sizeof(path), "%s/dir09/fresh", root);
+    mkdir(path, 0755);
+    snprintf(path, sizeof(path), "%s/dir09/fresh/deep", root);
+    mkdir(path, 0755);
+    snprintf(path, sizeof(path), "%s/dir09/fresh/deep/leaf", root);
+    write_file(path, 55);
+
+    IndexStats stats;
+    check(refresh_index(root, &stats) == 0, "index refreshed");
+    check(index_matches_disk(root), "refreshed index agrees with a walk");
+    // The root, the three changed directories and the two new ones
+    check(stats.rescanned <= 6 && stats.rescanned < stats.directories, "only changed directories read");
+}
+
+static int indexed_size(const char *root, const char *relative, long long *size) {
+    Index index;
+    if (open_index(root, &index) != 0) return 0;
+    Collected found;
+    memset(&found, 0, sizeof(found));
+    pthread_mutex_init(&found.lock, NULL);
+    WalkOptions options;
+    init_walk_options(&options);
+    options.visit = collect_visit;
+    options.arg = &found;
+    char parent[4096];
+    snprintf(parent, sizeof(parent), "%s", relative);
+    char *slash = strrchr(parent, '/');
+    *slash = '\0';
+    int present = 0;
+    if (index_walk(&index, parent, "", &options, NULL) == 0) {
+        char expected[4200];
+        snprintf(expected, sizeof(expected), "%s ", strrchr(relative, '/'));
+        for (size_t i = 0; i < found.count; i++) {
+            const char *match = strstr(found.lines[i], expected);
+            if (match != NULL) {
+                *size = atoll(match + strlen(expected));
+                present = 1;
+            }
+        }
+    }
+    free_collected(&found);
+    close_index(&index);
+    return present;
+}
+
+static void test_watch(const char *root) {
+    check(start_index_watch(root) == 0, "watch started");
+    check(start_index_watch(root) == -1, "one watch at a time");
+
+    char path[4200];
+    snprintf(path, sizeof(path), "%s/dir11/sub/watched", root);
+    write_file(path, 77);
+    snprintf(path, sizeof(path), "%s/dir12/file0", root);
+    write_file(path, 4321);         // same directory mtime, new size
+
+    long long created = -1, modified = -1;
+    unsigned long long updates = 0, directories = 0;
+    for (int tries = 0; tries < 60; tries++) {
+        struct timespec pause = { 0, 100 * 1000 * 1000 };
+        nanosleep(&pause, NULL);
+        if (indexed_size(root, "dir11/sub/watched", &created) && created == 77 &&
+            indexed_size(root, "dir12/file0", &modified) && modified == 4321 &&
+            index_watch_status(&updates, &directories) != NULL && updates > 0) {
+            break;
+        }
+    }
+    check(created == 77, "new file seen by the watch");
+    check(modified == 4321, "changed file seen by the watch");
+    check(index_watch_status(&updates, &directories) != NULL && updates > 0 &&
+          directories == 1 + DIRS * 2 + 3, "watch status");
+
+    // Refreshes from here race the watch's own for the index
+    int refreshed = 1;
+    for (int i = 0; i < 20; i++) {
+        snprintf(path, sizeof(path), "%s/dir13/churn", root);
+        write_file(path, (size_t)i);
+        IndexStats stats;
+        refreshed &= refresh_index(root, &stats) == 0;
+        struct timespec pause = { 0, 20 * 1000 * 1000 };
+        nanosleep(&pause, NULL);
+    }
+    check(refreshed, "refreshes alongside the watch succeed");
+    stop_index_watch();
+    check(index_watch_status(&updates, &directories) == NULL, "watch stopped");
+
+    DIR *dir = opendir(root);
+    struct dirent *entry;
+    int leftover = 0;
+    while ((entry = readdir(dir)) != NULL) {
+        if (strncmp(entry->d_name, INDEX_FILE ".tmp", strlen(INDEX_FILE ".tmp")) == 0) leftover = 1;
+    }
+    closedir(dir);
+    check(!leftover, "no temporary index files left behind");
+    check(index_matches_disk(root), "index agrees with a walk after racing the watch");
+}
+
+static void remove_tree(const char *path) {
+    DIR *dir = opendir(path);
+    if (dir == NULL) {
+        unlink(path);
+        return;
+    }
+    struct dirent *entry;
+    char child[4200];
+    while ((entry = readdir(dir)) != NULL) {
+        if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) continue;
+        snprintf(child, sizeof(child), "%s/%s", path, entry->d_name);
+        remove_tree(child);
+    }
+    closedir(dir);
+    rmdir(path);
+}
+
+int main() {
+    printf("Testing the metadata index\n");
+    printf("==========================\n");
+
+    char root[] = "/tmp/test_index_XXXXXX";
+    if (mkdtemp(root) == NULL) {
+        printf("FAIL: cannot create scratch directory\n");
+        return 1;
+    }
+    make_tree(root);
+
+    test_build(root);
+    test_refresh(root);
+    test_watch(root);
+
+    remove_tree(root);
+
+    if (failures > 0) {
+        printf("\n%d test(s) failed\n", failures);
+        return 1;
+    }
+    printf("\nAll tests completed successfully!\n");
+    return 0;
+}
@@ -0,0 +1,163 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <time.h>
+#include <pwd.h>
+#include <sys/stat.h>
+#include "listing.h"
+
+// Checks ls rows against the printf format they replace, the three sort
+// orders, and that the name caches agree with the password database.
+
+static int failures;
+
+static void check(int condition, const char *description) {
+    if (!condition) {
+        printf("FAIL: %s\n", description);
+        failures++;
+    }
+}
+
+static char output_path[] = "/tmp/test_listing_out_XXXXXX";
+
+static char* run_ls(const char *path, ListSort sort, int sync) {
+    fflush(stdout);
+    int saved = dup(STDOUT_FILENO);
+    int fd = open(output_path, O_WRONLY | O_TRUNC);
+    dup2(fd, STDOUT_FILENO);
+    close(fd);
+    ListOptions options;
+    init_list_options(&options);
+    options.sort = sort;
+    options.sync = sync;
+    list_directory(path, &options);
+    fflush(stdout);
+    dup2(saved, STDOUT_FILENO);
+    close(saved);
+
+    FILE *file = fopen(output_path, "rb");
+    char *data = calloc(1, 1 << 16);
+    fread(data, 1, (1 << 16) - 1, file);
+    fclose(file);
+    return data;
+}
+
+static void make_file(const char *root, const char *name, size_t size, time_t mtime) {
+    char path[4200];
+    snprintf(path, sizeof(path), "%s/%s", root, name);
+    FILE *file = fopen(path, "wb");
+    for (size_t i = 0; i < size; i++) fputc('x', file);
+    fclose(file);
+    struct timespec times[2] = { { mtime, 0 }, { mtime, 0 } };
+    utimensat(AT_FDCWD, path, times, 0);
+}
+
+// Position of a name's row in the output, or -1
+static long row_of(const char *output, const char *name) {
+    char needle[64];
+    snprintf(needle, sizeof(needle), " %s\n", name);
+    const char *found = strstr(output, needle);
+    return found != NULL ? (long)(found - output) : -1;
+}
+
+static void expected_row(const char *root, const char *name, char *row, size_t size) {
+    char path[4200], time_str[32];
+    snprintf(path, sizeof(path), "%s/%s", root, name);
+    struct stat st;
+    stat(path, &st);
+    struct tm *tm_info = localtime(&st.st_mtime);
+    strftime(time_str, sizeof(time_str), "%Y-%m-%d %H:%M:%S", tm_info);
+    struct passwd *pwd = getpwuid(st.st_uid);
+    snprintf(row, size, "%-15s %-10ld %-15s %-20s %s\n",
+             "-rw-r--r--", (long)st.st_size, pwd ? pwd->pw_name : "unknown", time_str, name);
+}
+
+static void test_format(const char *root) {
+    // Two on one day, so the second comes from the day cache
+    time_t base = time(NULL) - 86400 * 3;
+    make_file(root, "small.txt", 10, base);
+    make_file(root, "large.txt", 3000, base + 3723);
+    make_file(root, "medium.txt", 500, base - 86400 * 400);
+
+    char expected[3][8192];
+    const char *names[] = { "small.txt", "large.txt", "medium.txt" };
+    for (int i = 0; i < 3; i++) {
+        expected_row(root, names[i], expected[i], sizeof(expected[i]));
+    }
+
+    char *output = run_ls(root, SORT_NONE, 1);
+    check(strstr(output, expected[0]) != NULL && strstr(output, expected[1]) != NULL &&
+          strstr(output, expected[2]) != NULL, "rows match the printf format");
+    check(strstr(output, "Permissions     Size       Owner") != NULL, "header printed");
+    free(output);
+
+    output = run_ls(root, SORT_NAME, 0);
+    check(row_of(output, "large.txt") < row_of(output, "medium.txt") &&
+          row_of(output, "medium.txt") < row_of(output, "small.txt"), "sorted by name");
+    check(strstr(output, expected[1]) != NULL, "row through io_uring matches too");
+    free(output);
+
+    output = run_ls(root, SORT_SIZE, 0);
+    check(row_of(output, "large.txt") < row_of(output, "medium.txt") &&
+          row_of(output, "medium.txt") < row_of(output, "small.txt"), "sorted by size, largest first");
+    free(output);
+
+    output = run_ls(root, SORT_MTIME, 0);
+    check(row_of(output, "large.txt") < row_of(output, "small.txt") &&
+          row_of(output, "small.txt") < row_of(output, "medium.txt"), "sorted by mtime, newest first");
+    free(output);
+
+    char path[4200];
+    for (int i = 0; i < 3; i++) {
+        snprintf(path, sizeof(path), "%s/%s", root, names[i]);
+        unlink(path);
+    }
+}
+
+static void test_names() {
+    struct passwd *pwd = getpwuid(getuid());
+    const char *name = user_name(getuid());
+    check(pwd != NULL && strcmp(name, pwd->pw_name) == 0, "user name resolved");
+    check(user_name(getuid()) == name, "user name cached");
+    check(strcmp(user_name((uid_t)4000000001u), "unknown") == 0, "unknown user");
+
+    // Enough ids to grow the table a few times
+    int all_found = 1;
+    for (unsigned id = 4000000100u; id < 4000000400u; id++) {
+        if (strcmp(group_name((gid_t)id), "unknown") != 0) all_found = 0;
+    }
+    check(all_found && strcmp(group_name(0), "root") == 0, "group names after growth");
+
+    ListSort sort;
+    check(parse_list_sort("size", &sort) == 0 && sort == SORT_SIZE, "sort key parsed");
+    check(parse_list_sort("owner", &sort) == -1, "unknown sort key refused");
+}
+
+int main() {
+    printf("Testing directory listings\n");
+    printf("==========================\n");
+
+    char root[] = "/tmp/test_listing_XXXXXX";
+    if (mkdtemp(root) == NULL) {
+        printf("FAIL: cannot create scratch directory\n");
+        return 1;
+    }
+    close(mkstemp(output_path));
+    umask(022);
+
+    test_format(root);
+    test_names();
+
+    rmdir(root);
+    unlink(output_path);
+
+    if (failures > 0) {
+        printf("\n%d test(s) failed\n", failures);
+        return 1;
+    }
+    printf("\nAll tests completed successfully!\n");
+    return 0;
+}
@@ -0,0 +1,140 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "pattern.h"
+
+// Checks substring, glob and regex patterns against names and paths,
+// which directories a path glob lets find skip, and that malformed or
+// oversized patterns are refused.
+
+static int failures;
+
+static void check(int condition, const char *description) {
+    if (!condition) {
+        printf("FAIL: %s\n", description);
+        failures++;
+    }
+}
+
+// Every name in matching[] matches text, none in others[] does
+static void check_matches(const char *text, PatternKind kind, const char **matching, const char **others) {
+    Pattern pattern;
+    char description[256];
+    if (compile_pattern(&pattern, text, kind) != 0) {
+        snprintf(description, sizeof(description), "'%s' compiles", text);
+        check(0, description);
+        return;
+    }
+    for (int i = 0; matching[i] != NULL; i++) {
+        snprintf(description, sizeof(description), "'%s' matches '%s'", text, matching[i]);
+        check(pattern_matches(&pattern, matching[i]), description);
+    }
+    for (int i = 0; others[i] != NULL; i++) {
+        snprintf(description, sizeof(description), "'%s' does not match '%s'", text, others[i]);
+        check(!pattern_matches(&pattern, others[i]), description);
+    }
+    free_pattern(&pattern);
+}
+
+#define NAMES(...) (const char *[]){ __VA_ARGS__, NULL }
+
+static void test_substring() {
+    check(guess_pattern_kind("report") == PATTERN_SUBSTRING, "plain text is a substring");
+    check(guess_pattern_kind("*.log") == PATTERN_GLOB && guess_pattern_kind("file[0-9]") == PATTERN_GLOB,
+          "wildcards make a glob");
+    check_matches("42", PATTERN_SUBSTRING, NAMES("42", "file42.txt", "4242"), NAMES("file4.txt", "4", ""));
+    check_matches("a.c", PATTERN_SUBSTRING, NAMES("a.c", "data.csv"), NAMES("abc", "a_c"));
+}
+
+static void test_glob() {
+    check_matches("*.log", PATTERN_GLOB, NAMES("a.log", ".log", "x.y.log"), NAMES("a.log.1", "a.LOG", "log"));
+    check_matches("file?.txt", PATTERN_GLOB, NAMES("file1.txt", "filex.txt"), NAMES("file.txt", "file12.txt"));
+    check_matches("[a-c]*[!0-9]", PATTERN_GLOB, NAMES("apple", "c_x"), NAMES("dog", "b1", "a"));
+    check_matches("\\*[]x]", PATTERN_GLOB, NAMES("*]", "*x"), NAMES("a]", "*y"));
+    check_matches("[abc", PATTERN_GLOB, NAMES("[abc"), NAMES("a", "abc"));
+
+    check_matches("**/cache/*", PATTERN_GLOB, NAMES("cache/x", "a/b/cache/x"),
+                  NAMES("cache", "a/cache/x/y", "acache/x", "a/xcache/y"));
+    check_matches("src/*.c", PATTERN_GLOB, NAMES("src/a.c"), NAMES("src/sub/a.c", "a.c", "lib/src/a.c"));
+    check_matches("src/**", PATTERN_GLOB, NAMES("src/a", "src/a/b/c"), NAMES("src", "lib/a"));
+    check_matches("a/**/b", PATTERN_GLOB, NAMES("a/b", "a/x/b", "a/x/y/b"), NAMES("a/xb", "b", "a/b/c"));
+    check_matches("a**b", PATTERN_GLOB, NAMES("ab", "axxb"), NAMES("a/b"));
+
+    Pattern pattern;
+    compile_pattern(&pattern, "*.log", PATTERN_GLOB);
+    check(!pattern.match_path && pattern_may_match_below(&pattern, "anything"), "name globs never prune");
+    free_pattern(&pattern);
+}
+
+static void test_pruning() {
+    Pattern pattern;
+    check(compile_pattern(&pattern, "src/*/*.c", PATTERN_GLOB) == 0 && pattern.match_path, "path glob");
+    check(pattern_may_match_below(&pattern, "src"), "descends into src");
+    check(pattern_may_match_below(&pattern, "src/lib"), "descends into src/lib");
+    check(!pattern_may_match_below(&pattern, "docs"), "skips docs");
+    check(!pattern_may_match_below(&pattern, "src/lib/deeper"), "skips below the last directory");
+    check(!pattern_may_match_below(&pattern, "srcs"), "skips a longer name");
+    free_pattern(&pattern);
+
+    compile_pattern(&pattern, "**/cache/*", PATTERN_GLOB);
+    check(pattern_may_match_below(&pattern, "a/b/c"), "** descends everywhere");
+    free_pattern(&pattern);
+
+    compile_pattern(&pattern, "build/**", PATTERN_GLOB);
+    check(pattern_may_match_below(&pattern, "build/x/y") && !pattern_may_match_below(&pattern, "test"),
+          "trailing ** descends only below its directory");
+    free_pattern(&pattern);
+}
+
+static void test_regex() {
+    check_matches("^core\\.[0-9]+$", PATTERN_REGEX, NAMES("core.1", "core.12345"),
+                  NAMES("core.", "xcore.1", "core.1a", "core_1"));
+    check_matches("log", PATTERN_REGEX, NAMES("log", "catalog.txt"), NAMES("lo", "LOG"));
+    check_matches("a|^b$", PATTERN_REGEX, NAMES("xa", "b"), NAMES("xb", "bc"));
+    check_matches("\\d{4}-\\d{2}", PATTERN_REGEX, NAMES("report-2024-05.txt"), NAMES("report-24-05.txt"));
+    check_matches("^(ab){2,3}$", PATTERN_REGEX, NAMES("abab", "ababab"), NAMES("ab", "abababab", "aba"));
+    check_matches("^x{2,}y?$", PATTERN_REGEX, NAMES("xx", "xxxxy"), NAMES("x", "xyy"));
+    check_matches("^colou?r\\.(png|jpe?g)$", PATTERN_REGEX, NAMES("color.png", "colour.jpeg", "color.jpg"),
+                  NAMES("colr.png", "color.gif"));
+    check_matches("^[^.]+$", PATTERN_REGEX, NAMES("Makefile", "README"), NAMES("a.c", ".hidden"));
+    check_matches("^\\w+\\s\\S$", PATTERN_REGEX, NAMES("name x"), NAMES("name  x", "na-me x"));
+    check_matches("a{0}b", PATTERN_REGEX, NAMES("b", "ab"), NAMES("a"));
+    check_matches("x{", PATTERN_REGEX, NAMES("x{"), NAMES("x"));
+}
+
+static void test_errors() {
+    const char *invalid[] = { "(a", "a)", "*a", "a|+", "[z-a]", "[abc", "a{3", "x{300}", "x{3,2}",
+                              "a^b", "(a$)", "\\" };
+    Pattern pattern;
+    for (size_t i = 0; i < sizeof(invalid) / sizeof(invalid[0]); i++) {
+        char description[64];
+        snprintf(description, sizeof(description), "'%s' refused", invalid[i]);
+        check(compile_pattern(&pattern, invalid[i], PATTERN_REGEX) == -1, description);
+    }
+    check(compile_pattern(&pattern, "", PATTERN_SUBSTRING) == -1, "empty pattern refused");
+    // The n-th byte from the end: a DFA needs 2^(n+1) states for this
+    check(compile_pattern(&pattern, "(a|b)*a(a|b){12}$", PATTERN_REGEX) == -1, "too many states refused");
+    check(compile_pattern(&pattern, "(a|b)*a(a|b){8}$", PATTERN_REGEX) == 0 &&
+          pattern_matches(&pattern, "babbbbbbbb") && !pattern_matches(&pattern, "bbbbbbbbbb"),
+          "large DFA still built");
+    free_pattern(&pattern);
+}
+
+int main() {
+    printf("Testing name patterns\n");
+    printf("=====================\n");
+
+    test_substring();
+    test_glob();
+    test_pruning();
+    test_regex();
+    test_errors();
+
+    if (failures > 0) {
+        printf("\n%d test(s) failed\n", failures);
+        return 1;
+    }
+    printf("\nAll tests completed successfully!\n");
+    return 0;
+}
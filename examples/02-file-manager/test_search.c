@@ -0,0 +1,173 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "search.h"
+
+// Checks the matcher against memmem on random text over a small alphabet,
+// for every pattern length and alignment the vector loops handle
+// differently, and grep output on a scratch tree.
+
+static int failures;
+
+static void check(int condition, const char *description) {
+    if (!condition) {
+        printf("FAIL: %s\n", description);
+        failures++;
+    }
+}
+
+static void test_matcher() {
+    size_t size = 4096;
+    char *text = malloc(size);
+    unsigned int state = 99;
+    for (size_t i = 0; i < size; i++) {
+        state = state * 1103515245u + 12345u;
+        text[i] = "abc"[(state >> 16) % 3];
+    }
+
+    int all_match = 1;
+    char pattern[48];
+    for (int simd = 0; simd < 2; simd++) {
+        for (size_t length = 1; length < sizeof(pattern); length++) {
+            for (size_t from = 0; from + length < size; from += 997) {
+                // Half the patterns occur, half are unlikely to
+                memcpy(pattern, text + from, length);
+                pattern[length] = '\0';
+                if (from % 2) pattern[length - 1] = 'd';
+                Matcher matcher;
+                init_matcher(&matcher, pattern);
+                if (simd == 0) matcher.use_avx2 = 0;
+                for (size_t start = 0; start < 40; start += 7) {
+                    for (size_t end = size; end > size - 70; end -= 23) {
+                        const char *expected = memmem(text + start, end - start, pattern, length);
+                        if (find_match(&matcher, text + start, end - start) != expected) all_match = 0;
+                    }
+                }
+            }
+        }
+    }
+    check(all_match, "matcher agrees with memmem");
+
+    Matcher matcher;
+    check(init_matcher(&matcher, "") == -1, "empty pattern refused");
+    init_matcher(&matcher, "needle");
+    check(find_match(&matcher, "needl", 5) == NULL, "text shorter than the pattern");
+    check(looks_binary("text\0more", 9), "NUL means binary");
+    check(!looks_binary("plain text\n", 11), "text is not binary");
+    free(text);
+}
+
+static char output_path[] = "/tmp/test_search_out_XXXXXX";
+
+static char* run_grep(const char *pattern, const char *path, GrepStats *stats) {
+    fflush(stdout);
+    int saved = dup(STDOUT_FILENO);
+    int fd = open(output_path, O_WRONLY | O_TRUNC);
+    dup2(fd, STDOUT_FILENO);
+    close(fd);
+    GrepOptions options;
+    init_grep_options(&options);
+    options.threads = 4;
+    grep_path(pattern, path, &options, stats);
+    fflush(stdout);
+    dup2(saved, STDOUT_FILENO);
+    close(saved);
+
+    FILE *file = fopen(output_path, "rb");
+    char *data = calloc(1, 1 << 16);
+    fread(data, 1, (1 << 16) - 1, file);
+    fclose(file);
+    return data;
+}
+
+static void write_text(const char *path, const char *text) {
+    FILE *file = fopen(path, "wb");
+    fputs(text, file);
+    fclose(file);
+}
+
+static void test_grep(const char *root) {
+    char path[4096];
+    snprintf(path, sizeof(path), "%s/a.txt", root);
+    write_text(path, "one\nfind me\nthree\nfour\nfind me too\n");
+    snprintf(path, sizeof(path), "%s/sub", root);
+    mkdir(path, 0755);
+    snprintf(path, sizeof(path), "%s/sub/last.txt", root);
+    write_text(path, "x\ny\nends with find me");
+    snprintf(path, sizeof(path), "%s/sub/data.bin", root);
+    FILE *file = fopen(path, "wb");
+    fwrite("find me\0\1\2", 1, 10, file);
+    fclose(file);
+
+    // Large enough to be mapped; the match is on the last line
+    snprintf(path, sizeof(path), "%s/big.log", root);
+    file = fopen(path, "wb");
+    for (int i = 0; i < 200000; i++) fprintf(file, "log line %d\n", i);
+    fprintf(file, "then find me here\n");
+    fclose(file);
+
+    GrepStats stats;
+    char *output = run_grep("find me", root, &stats);
+    char expected[4200];
+    snprintf(expected, sizeof(expected), "%s/a.txt:2:find me\n", root);
+    check(strstr(output, expected) != NULL, "match with line number");
+    snprintf(expected, sizeof(expected), "%s/a.txt:5:find me too\n", root);
+    check(strstr(output, expected) != NULL, "second match in a file");
+    snprintf(expected, sizeof(expected), "%s/sub/last.txt:3:ends with find me\n", root);
+    check(strstr(output, expected) != NULL, "match on a last line without newline");
+    snprintf(expected, sizeof(expected), "%s/big.log:200001:then find me here\n", root);
+    check(strstr(output, expected) != NULL, "match in a mapped file");
+    check(strstr(output, "data.bin") == NULL, "binary file skipped");
+    check(stats.lines == 4 && stats.matched_files == 3, "match counts");
+    check(stats.files == 4 && stats.binary_files == 1, "file counts");
+    free(output);
+
+    snprintf(path, sizeof(path), "%s/a.txt", root);
+    output = run_grep("three", path, &stats);
+    snprintf(expected, sizeof(expected), "%s:3:three\n", path);
+    check(strcmp(output, expected) == 0, "single file searched");
+    free(output);
+
+    output = run_grep("absent", root, &stats);
+    check(output[0] == '\0' && stats.lines == 0, "no matches, no output");
+    free(output);
+
+    unlink(path);
+    snprintf(path, sizeof(path), "%s/sub/last.txt", root);
+    unlink(path);
+    snprintf(path, sizeof(path), "%s/sub/data.bin", root);
+    unlink(path);
+    snprintf(path, sizeof(path), "%s/sub", root);
+    rmdir(path);
+    snprintf(path, sizeof(path), "%s/big.log", root);
+    unlink(path);
+}
+
+int main() {
+    printf("Testing content search\n");
+    printf("======================\n");
+
+    char root[] = "/tmp/test_search_XXXXXX";
+    if (mkdtemp(root) == NULL) {
+        printf("FAIL: cannot create scratch directory\n");
+        return 1;
+    }
+    close(mkstemp(output_path));
+
+    test_matcher();
+    test_grep(root);
+
+    rmdir(root);
+    unlink(output_path);
+
+    if (failures > 0) {
+        printf("\n%d test(s) failed\n", failures);
+        return 1;
+    }
+    printf("\nAll tests completed successfully!\n");
+    return 0;
+}
@@ -0,0 +1,106 @@
+#define _DEFAULT_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "uring.h"
+
+// Checks batched statx against plain fstatat, across several batches and
+// with names that do not exist. Skipped where io_uring is unavailable.
+
+#define ENTRIES 300
+#define RING_ENTRIES 32
+
+static int failures;
+
+static void check(int condition, const char *description) {
+    if (!condition) {
+        printf("FAIL: %s\n", description);
+        failures++;
+    }
+}
+
+int main() {
+    printf("Testing io_uring metadata batches\n");
+    printf("=================================\n");
+
+    if (!uring_supported()) {
+        printf("io_uring is not available here; skipped\n");
+        printf("\nAll tests completed successfully!\n");
+        return 0;
+    }
+
+    char root[] = "/tmp/test_uring_XXXXXX";
+    if (mkdtemp(root) == NULL) {
+        printf("FAIL: cannot create scratch directory\n");
+        return 1;
+    }
+    int directory = open(root, O_RDONLY | O_DIRECTORY);
+
+    char *names[ENTRIES];
+    for (int i = 0; i < ENTRIES; i++) {
+        names[i] = malloc(32);
+        snprintf(names[i], 32, "entry%03d", i);
+        if (i % 10 == 0) {
+            mkdirat(directory, names[i], 0750);
+        } else if (i % 7 != 0) {        // every seventh is left missing
+            int fd = openat(directory, names[i], O_WRONLY | O_CREAT, 0640);
+            for (int b = 0; b < i; b++) write(fd, "x", 1);
+            close(fd);
+        }
+    }
+    symlinkat("entry001", directory, "link");
+    strcpy(names[0], "link");           // stat follows links
+
+    struct stat *batched = calloc(ENTRIES, sizeof(struct stat));
+    int *errors = calloc(ENTRIES, sizeof(int));
+    Uring *ring = create_uring(RING_ENTRIES);
+    check(ring != NULL, "ring created");
+    long calls = uring_stat_names(ring, directory, names, ENTRIES, batched, errors);
+    check(calls > 0 && calls <= (ENTRIES + RING_ENTRIES - 1) / RING_ENTRIES + 2,
+          "one submission per batch");
+
+    int all_match = 1;
+    for (int i = 0; i < ENTRIES; i++) {
+        struct stat expected;
+        int error = fstatat(directory, names[i], &expected, 0) == 0 ? 0 : errno;
+        if (error != errors[i]) {
+            all_match = 0;
+        } else if (error == 0 && (expected.st_ino != batched[i].st_ino ||
+                                  expected.st_mode != batched[i].st_mode ||
+                                  expected.st_size != batched[i].st_size ||
+                                  expected.st_uid != batched[i].st_uid ||
+                                  expected.st_mtime != batched[i].st_mtime ||
+                                  expected.st_dev != batched[i].st_dev)) {
+            all_match = 0;
+        }
+    }
+    check(all_match, "batched statx matches fstatat");
+    check(errors[7] == ENOENT, "missing entry reports ENOENT");
+    check(errors[0] == 0 && S_ISREG(batched[0].st_mode), "links are followed");
+
+    // The ring is reusable
+    check(uring_stat_names(ring, directory, names + 1, 5, batched, errors) == 1, "ring reused");
+    free_uring(ring);
+
+    unlinkat(directory, "link", 0);
+    unlinkat(directory, "entry000", AT_REMOVEDIR);
+    for (int i = 1; i < ENTRIES; i++) {
+        unlinkat(directory, names[i], i % 10 == 0 ? AT_REMOVEDIR : 0);
+    }
+    for (int i = 0; i < ENTRIES; i++) free(names[i]);
+    close(directory);
+    rmdir(root);
+    free(batched);
+    free(errors);
+
+    if (failures > 0) {
+        printf("\n%d test(s) failed\n", failures);
+        return 1;
+    }
+    printf("\nAll tests completed successfully!\n");
+    return 0;
+}
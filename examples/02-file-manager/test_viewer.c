@@ -0,0 +1,196 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include "viewer.h"
+
+// Checks cat, head and tail output byte for byte, and the lazy line index
+// against a plain count, across many index strides.
+
+#define LINES 5000
+
+static int failures;
+
+static void check(int condition, const char *description) {
+    if (!condition) {
+        printf("FAIL: %s\n", description);
+        failures++;
+    }
+}
+
+static char output_path[] = "/tmp/test_viewer_out_XXXXXX";
+static int saved_stdout;
+
+// Standard output goes to a file while a command runs
+static void capture_start() {
+    fflush(stdout);
+    saved_stdout = dup(STDOUT_FILENO);
+    int fd = open(output_path, O_WRONLY | O_TRUNC);
+    dup2(fd, STDOUT_FILENO);
+    close(fd);
+}
+
+static char* capture_end(size_t *length) {
+    fflush(stdout);
+    dup2(saved_stdout, STDOUT_FILENO);
+    close(saved_stdout);
+    FILE *file = fopen(output_path, "rb");
+    fseek(file, 0, SEEK_END);
+    *length = (size_t)ftell(file);
+    rewind(file);
+    char *data = malloc(*length + 1);
+    *length = fread(data, 1, *length, file);
+    data[*length] = '\0';
+    fclose(file);
+    return data;
+}
+
+static void write_bytes(const char *path, const char *data, size_t length) {
+    FILE *file = fopen(path, "wb");
+    fwrite(data, 1, length, file);
+    fclose(file);
+}
+
+static int output_is(const char *expected, size_t expected_length, size_t length, const char *data) {
+    return length == expected_length && memcmp(data, expected, length) == 0;
+}
+
+static void test_lines(const char *path) {
+    // Line i is "line <i>" padded with i % 13 dashes
+    size_t capacity = LINES * 40, length = 0;
+    char *text = malloc(capacity);
+    size_t starts[LINES + 1];
+    for (int i = 0; i < LINES; i++) {
+        starts[i] = length;
+        length += (size_t)sprintf(text + length, "line %d%.*s\n", i, i % 13, "-------------");
+    }
+    starts[LINES] = length;
+    write_bytes(path, text, length);
+
+    size_t got_length;
+    char *got;
+    capture_start();
+    cat_file(path);
+    got = capture_end(&got_length);
+    check(output_is(text, length, got_length, got), "cat writes the whole file");
+    free(got);
+
+    capture_start();
+    head_file(path, 3);
+    got = capture_end(&got_length);
+    check(output_is(text, starts[3], got_length, got), "head 3");
+    free(got);
+
+    capture_start();
+    tail_file(path, 2);
+    got = capture_end(&got_length);
+    check(output_is(text + starts[LINES - 2], length - starts[LINES - 2], got_length, got), "tail 2");
+    free(got);
+
+    capture_start();
+    tail_file(path, LINES + 10);
+    got = capture_end(&got_length);
+    check(output_is(text, length, got_length, got), "tail past the start shows everything");
+    free(got);
+
+    MappedFile file;
+    check(map_file(&file, path) == 0, "file maps");
+    check(file.checkpoint_count == 1 && file.indexed_offset == 0, "nothing indexed on open");
+    int all_match = 1;
+    size_t probes[] = { 0, 1, 1023, 1024, 1025, 4999, 2048, 7, 3100 };
+    for (size_t i = 0; i < sizeof(probes) / sizeof(probes[0]); i++) {
+        if (line_offset(&file, probes[i]) != starts[probes[i]]) all_match = 0;
+    }
+    check(all_match, "line offsets match");
+    check(line_offset(&file, LINES) == length, "line past the end");
+    unmap_file(&file);
+
+    check(map_file(&file, path) == 0, "file maps again");
+    line_offset(&file, 10);
+    check(file.indexed_offset < length / 2, "index built only as far as needed");
+    unmap_file(&file);
+    free(text);
+}
+
+static void test_edges(const char *path) {
+    size_t got_length;
+    char *got;
+
+    // No final newline
+    write_bytes(path, "a\nb\nc", 5);
+    capture_start();
+    tail_file(path, 2);
+    got = capture_end(&got_length);
+    check(output_is("b\nc", 3, got_length, got), "tail without a final newline");
+    free(got);
+
+    // NUL bytes pass through unchanged
+    const char binary[] = { 'x', '\0', 'y', '\n', '\0', '\0', 'z' };
+    write_bytes(path, binary, sizeof(binary));
+    capture_start();
+    cat_file(path);
+    got = capture_end(&got_length);
+    check(output_is(binary, sizeof(binary), got_length, got), "cat keeps NUL bytes");
+    free(got);
+
+    write_bytes(path, "", 0);
+    capture_start();
+    cat_file(path);
+    head_file(path, 5);
+    tail_file(path, 5);
+    got = capture_end(&got_length);
+    check(got_length == 0, "empty file prints nothing");
+    free(got);
+
+    capture_start();
+    cat_file("/nonexistent/viewer/file");
+    got = capture_end(&got_length);
+    check(strstr(got, "Error: Cannot open file") != NULL, "missing file reported");
+    free(got);
+}
+
+static void test_view(const char *path) {
+    FILE *file = fopen(path, "wb");
+    for (int i = 1; i <= 3000; i++) fprintf(file, "row %d\n", i);
+    fclose(file);
+
+    const char commands[] = "\ng 2500\nb\nG\ng 4000\nq\n";
+    FILE *input = fmemopen((void *)commands, strlen(commands), "r");
+    size_t got_length;
+    capture_start();
+    view_file(path, input);
+    char *got = capture_end(&got_length);
+    fclose(input);
+    check(strstr(got, "row 1\n") != NULL, "view starts at the top");
+    check(strstr(got, "lines 2500-") != NULL && strstr(got, "row 2500\nrow 2501\n") != NULL, "g jumps to a line");
+    check(strstr(got, "\nrow 3000\n") != NULL, "G shows the end");
+    check(strstr(got, "has only 3000 lines") != NULL, "line past the end reported");
+    free(got);
+}
+
+int main() {
+    printf("Testing file viewer\n");
+    printf("===================\n");
+
+    int fd = mkstemp(output_path);
+    close(fd);
+    char path[] = "/tmp/test_viewer_XXXXXX";
+    fd = mkstemp(path);
+    close(fd);
+
+    test_lines(path);
+    test_edges(path);
+    test_view(path);
+
+    unlink(path);
+    unlink(output_path);
+
+    if (failures > 0) {
+        printf("\n%d test(s) failed\n", failures);
+        return 1;
+    }
+    printf("\nAll tests completed successfully!\n");
+    return 0;
+}
@@ -0,0 +1,315 @@
+#define _DEFAULT_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include "walker.h"
+
+// Builds a scratch tree and checks the walker against a plain recursive
+// readdir/lstat walk, with one and many threads, sorted and unsorted.
+
+#define FANOUT_DIRS 150
+#define FILES_PER_DIR 6
+
+static int failures;
+
+static void check(int condition, const char *description) {
+    if (!condition) {
+        printf("FAIL: %s\n", description);
+        failures++;
+    }
+}
+
+typedef struct {
+    pthread_mutex_t lock;
+    char **paths;
+    size_t count;
+    size_t capacity;
+    int leaves;
+    int root_left_last;
+    WalkTotals root_totals;
+    const char *skip;           // directory name not to descend into
+} Collected;
+
+static void add_path(Collected *collected, const char *path) {
+    if (collected->count == collected->capacity) {
+        collected->capacity = collected->capacity ? collected->capacity * 2 : 256;
+        collected->paths = realloc(collected->paths, collected->capacity * sizeof(char *));
+    }
+    collected->paths[collected->count++] = strdup(path);
+}
+
+static void free_paths(Collected *collected) {
+    for (size_t i = 0; i < collected->count; i++) free(collected->paths[i]);
+    free(collected->paths);
+}
+
+static int collect_visit(const WalkEntry *entry, void *arg) {
+    Collected *collected = arg;
+    pthread_mutex_lock(&collected->lock);
+    add_path(collected, entry->path);
+    pthread_mutex_unlock(&collected->lock);
+    if (collected->skip != NULL && entry->type == DT_DIR && strcmp(entry->name, collected->skip) == 0) {
+        return WALK_SKIP;
+    }
+    return WALK_CONTINUE;
+}
+
+static void collect_leave(const WalkEntry *directory, const WalkTotals *totals, void *arg) {
+    Collected *collected = arg;
+    pthread_mutex_lock(&collected->lock);
+    collected->leaves++;
+    if (directory->depth < 0) {
+        collected->root_totals = *totals;
+        collected->root_left_last = 1;
+    } else {
+        collected->root_left_last = 0;
+    }
+    pthread_mutex_unlock(&collected->lock);
+}
+
+static int compare_paths(const void *a, const void *b) {
+    return strcmp(*(char *const *)a, *(char *const *)b);
+}
+
+// Reference walk; bytes counts each inode once like du
+static void reference_walk(const char *path, Collected *collected, WalkTotals *totals,
+                           ino_t *seen, size_t *seen_count) {
+    DIR *dir = opendir(path);
+    if (dir == NULL) return;
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != NULL) {
+        if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) continue;
+        char child[4096];
+        snprintf(child, sizeof(child), "%s/%s", path, entry->d_name);
+        add_path(collected, child);
+
+        struct stat st;
+        lstat(child, &st);
+        int counted = 0;
+        for (size_t i = 0; i < *seen_count; i++) {
+            if (seen[i] == st.st_ino) counted = 1;
+        }
+        if (!counted) {
+            seen[(*seen_count)++] = st.st_ino;
+            totals->bytes += (unsigned long long)st.st_blocks * 512;
+        }
+        if (S_ISDIR(st.st_mode)) {
+            totals->directories++;
+            reference_walk(child, collected, totals, seen, seen_count);
+        } else {
+            totals->files++;
+        }
+    }
+    closedir(dir);
+}
+
+static void write_file(const char *path, size_t size) {
+    FILE *file = fopen(path, "wb");
+    if (file == NULL) return;
+    for (size_t i = 0; i < size; i++) fputc('a' + i % 26, file);
+    fclose(file);
+}
+
+static void build_tree(const char *root) {
+    char path[4096];
+    snprintf(path, sizeof(path), "%s/a/b/c", root);
+    for (char *p = strchr(path + strlen(root) + 1, '/'); ; p = strchr(p + 1, '/')) {
+        if (p != NULL) *p = '\0';
+        mkdir(path, 0755);
+        if (p == NULL) break;
+        *p = '/';
+    }
+    snprintf(path, sizeof(path), "%s/a/b/c/deep.txt", root);
+    write_file(path, 1000);
+    snprintf(path, sizeof(path), "%s/a.txt", root);
+    write_file(path, 10);
+    snprintf(path, sizeof(path), "%s/empty", root);
+    mkdir(path, 0755);
+    snprintf(path, sizeof(path), "%s/link", root);
+    symlink("a", path);
+    snprintf(path, sizeof(path), "%s/h1", root);
+    write_file(path, 65536);
+    char second[4096];
+    snprintf(second, sizeof(second), "%s/h2", root);
+    link(path, second);
+
+    for (int d = 0; d < FANOUT_DIRS; d++) {
+        snprintf(path, sizeof(path), "%s/many%03d", root, d);
+        mkdir(path, 0755);
+        snprintf(path, sizeof(path), "%s/many%03d/sub", root, d);
+        mkdir(path, 0755);
+        for (int f = 0; f < FILES_PER_DIR; f++) {
+            snprintf(path, sizeof(path), "%s/many%03d/%s%d", root, d, f % 2 ? "sub/" : "", f);
+            write_file(path, (size_t)(d * 37 + f * 5000) % 9000);
+        }
+    }
+}
+
+static void remove_tree(const char *path) {
+    DIR *dir = opendir(path);
+    if (dir != NULL) {
+        struct dirent *entry;
+        while ((entry = readdir(dir)) != NULL) {
+            if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) continue;
+            char child[4096];
+            snprintf(child, sizeof(child), "%s/%s", path, entry->d_name);
+            struct stat st;
+            if (lstat(child, &st) == 0 && S_ISDIR(st.st_mode)) {
+                remove_tree(child);
+            } else {
+                unlink(child);
+            }
+        }
+        closedir(dir);
+    }
+    rmdir(path);
+}
+
+static void init_collected(Collected *collected) {
+    memset(collected, 0, sizeof(*collected));
+    pthread_mutex_init(&collected->lock, NULL);
+}
+
+static void run_walk(const char *root, int threads, int flags, int max_depth, Collected *collected) {
+    WalkOptions options;
+    init_walk_options(&options);
+    options.threads = threads;
+    options.flags = flags;
+    options.max_depth = max_depth;
+    options.visit = collect_visit;
+    options.leave = collect_leave;
+    options.arg = collected;
+    check(walk_tree(root, &options, NULL) == 0, "walk succeeds");
+}
+
+static int same_paths(Collected *a, Collected *b, int sort) {
+    if (a->count != b->count) return 0;
+    if (sort) {
+        qsort(a->paths, a->count, sizeof(char *), compare_paths);
+        qsort(b->paths, b->count, sizeof(char *), compare_paths);
+    }
+    for (size_t i = 0; i < a->count; i++) {
+        if (strcmp(a->paths[i], b->paths[i]) != 0) return 0;
+    }
+    return 1;
+}
+
+static void test_against_reference(const char *root) {
+    Collected expected;
+    init_collected(&expected);
+    WalkTotals totals = { 0, 0, 1 };
+    ino_t seen[4096];
+    size_t seen_count = 0;
+    struct stat st;
+    stat(root, &st);
+    totals.bytes = (unsigned long long)st.st_blocks * 512;
+    reference_walk(root, &expected, &totals, seen, &seen_count);
+
+    int thread_counts[] = { 1, 8 };
+    for (int t = 0; t < 2; t++) {
+        Collected found;
+        init_collected(&found);
+        run_walk(root, thread_counts[t], WALK_STAT, -1, &found);
+        check(same_paths(&found, &expected, 1), "unsorted walk finds every entry once");
+        check(found.leaves == 3 + 1 + 1 + 2 * FANOUT_DIRS, "leave called once per directory");
+        check(found.root_left_last, "starting directory left last");
+        check(found.root_totals.bytes == totals.bytes, "bytes match, hard links once");
+        check(found.root_totals.files == totals.files, "file count");
+        check(found.root_totals.directories == totals.directories, "directory count");
+        free_paths(&found);
+    }
+    free_paths(&expected);
+
+    // Symbolic links are reported, not followed
+    Collected found;
+    init_collected(&found);
+    run_walk(root, 4, 0, -1, &found);
+    char link_child[4096];
+    snprintf(link_child, sizeof(link_child), "%s/link/b", root);
+    int saw_link = 0, followed = 0;
+    for (size_t i = 0; i < found.count; i++) {
+        if (strcmp(found.paths[i] + strlen(root), "/link") == 0) saw_link = 1;
+        if (strcmp(found.paths[i], link_child) == 0) followed = 1;
+    }
+    check(saw_link && !followed, "symbolic link reported, not followed");
+    free_paths(&found);
+}
+
+static void test_sorted(const char *root) {
+    Collected first, second;
+    init_collected(&first);
+    init_collected(&second);
+    run_walk(root, 1, WALK_SORTED, -1, &first);
+    run_walk(root, 8, WALK_SORTED | WALK_STAT, -1, &second);
+    check(same_paths(&first, &second, 0), "sorted walks agree across thread counts");
+    check(first.count > 3 && strcmp(first.paths[0] + strlen(root), "/a") == 0 &&
+          strcmp(first.paths[1] + strlen(root), "/a/b") == 0 &&
+          strcmp(first.paths[2] + strlen(root), "/a/b/c") == 0, "sorted walk is depth first by name");
+    free_paths(&first);
+    free_paths(&second);
+}
+
+static void test_limits(const char *root) {
+    Collected found;
+    init_collected(&found);
+    run_walk(root, 4, 0, 1, &found);
+    int too_deep = 0, saw_depth_one = 0;
+    for (size_t i = 0; i < found.count; i++) {
+        const char *relative = found.paths[i] + strlen(root) + 1;
+        int slashes = 0;
+        for (const char *p = relative; *p; p++) slashes += *p == '/';
+        if (slashes > 1) too_deep = 1;
+        if (slashes == 1) saw_depth_one = 1;
+    }
+    check(saw_depth_one && !too_deep, "max_depth limits entry depth");
+    free_paths(&found);
+
+    int flags[] = { 0, WALK_SORTED };
+    for (int f = 0; f < 2; f++) {
+        init_collected(&found);
+        found.skip = "a";
+        run_walk(root, 4, flags[f], -1, &found);
+        int below = 0, saw = 0;
+        for (size_t i = 0; i < found.count; i++) {
+            const char *relative = found.paths[i] + strlen(root);
+            if (strcmp(relative, "/a") == 0) saw = 1;
+            if (strncmp(relative, "/a/", 3) == 0) below = 1;
+        }
+        check(saw && !below, "WALK_SKIP prunes a directory");
+        free_paths(&found);
+    }
+
+    WalkOptions options;
+    init_walk_options(&options);
+    check(walk_tree("/nonexistent/walker/root", &options, NULL) == -1, "missing root reported");
+}
+
+int main() {
+    printf("Testing directory walker\n");
+    printf("========================\n");
+
+    char root[] = "/tmp/test_walker_XXXXXX";
+    if (mkdtemp(root) == NULL) {
+        printf("FAIL: cannot create scratch directory\n");
+        return 1;
+    }
+    build_tree(root);
+
+    test_against_reference(root);
+    test_sorted(root);
+    test_limits(root);
+
+    remove_tree(root);
+
+    if (failures > 0) {
+        printf("\n%d test(s) failed\n", failures);
+        return 1;
+    }
+    printf("\nAll tests completed successfully!\n");
+    return 0;
+}
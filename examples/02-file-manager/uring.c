@@ -0,0 +1,242 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/sysmacros.h>
+#include "uring.h"
+
+struct Uring {
+    int fd;
+    unsigned entries;
+    // Submission ring, shared with the kernel
+    void *sq_map;
+    size_t sq_map_size;
+    unsigned *sq_head;
+    unsigned *sq_tail;
+    unsigned sq_mask;
+    unsigned *sq_array;
+    struct io_uring_sqe *sqes;
+    size_t sqes_size;
+    unsigned sq_local_tail;     // entries handed out, not yet published
+    unsigned queued;            // published, not yet submitted
+    // Completion ring
+    void *cq_map;
+    size_t cq_map_size;
+    unsigned *cq_head;
+    unsigned *cq_tail;
+    unsigned cq_mask;
+    struct io_uring_cqe *cqes;
+    unsigned long long enter_calls;
+};
+
+static int sys_io_uring_setup(unsigned entries, struct io_uring_params *params) {
+    return (int)syscall(__NR_io_uring_setup, entries, params);
+}
+
+static int sys_io_uring_enter(int fd, unsigned submit, unsigned wait_for, unsigned flags) {
+    return (int)syscall(__NR_io_uring_enter, fd, submit, wait_for, flags, NULL, 0);
+}
+
+static int sys_io_uring_register(int fd, unsigned opcode, void *arg, unsigned count) {
+    return (int)syscall(__NR_io_uring_register, fd, opcode, arg, count);
+}
+
+Uring* create_uring(unsigned entries) {
+    Uring *ring = calloc(1, sizeof(Uring));
+    if (ring == NULL) {
+        errno = ENOMEM;
+        return NULL;
+    }
+    struct io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    ring->fd = sys_io_uring_setup(entries, &params);
+    if (ring->fd < 0) {
+        free(ring);
+        return NULL;
+    }
+    ring->entries = params.sq_entries;
+
+    // The rings are mapped separately, which every kernel version accepts
+    ring->sq_map_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    ring->cq_map_size = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    ring->sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+    ring->sq_map = mmap(NULL, ring->sq_map_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                        ring->fd, IORING_OFF_SQ_RING);
+    ring->cq_map = mmap(NULL, ring->cq_map_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                        ring->fd, IORING_OFF_CQ_RING);
+    ring->sqes = mmap(NULL, ring->sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                      ring->fd, IORING_OFF_SQES);
+    if (ring->sq_map == MAP_FAILED || ring->cq_map == MAP_FAILED || ring->sqes == MAP_FAILED) {
+        int error = errno;
+        free_uring(ring);
+        errno = error;
+        return NULL;
+    }
+
+    char *sq = ring->sq_map, *cq = ring->cq_map;
+    ring->sq_head = (unsigned *)(sq + params.sq_off.head);
+    ring->sq_tail = (unsigned *)(sq + params.sq_off.tail);
+    ring->sq_mask = *(unsigned *)(sq + params.sq_off.ring_mask);
+    ring->sq_array = (unsigned *)(sq + params.sq_off.array);
+    ring->sq_local_tail = *ring->sq_tail;
+    ring->cq_head = (unsigned *)(cq + params.cq_off.head);
+    ring->cq_tail = (unsigned *)(cq + params.cq_off.tail);
+    ring->cq_mask = *(unsigned *)(cq + params.cq_off.ring_mask);
+    ring->cqes = (struct io_uring_cqe *)(cq + params.cq_off.cqes);
+    return ring;
+}
+
+void free_uring(Uring *ring) {
+    if (ring == NULL) return;
+    if (ring->sqes != NULL && ring->sqes != MAP_FAILED) munmap(ring->sqes, ring->sqes_size);
+    if (ring->cq_map != NULL && ring->cq_map != MAP_FAILED) munmap(ring->cq_map, ring->cq_map_size);
+    if (ring->sq_map != NULL && ring->sq_map != MAP_FAILED) munmap(ring->sq_map, ring->sq_map_size);
+    close(ring->fd);
+    free(ring);
+}
+
+static int supported;
+static pthread_once_t probe_once = PTHREAD_ONCE_INIT;
+
+static void probe_uring() {
+    Uring *ring = create_uring(4);
+    if (ring == NULL) return;
+    size_t size = sizeof(struct io_uring_probe) + 256 * sizeof(struct io_uring_probe_op);
+    struct io_uring_probe *probe = calloc(1, size);
+    if (probe != NULL && sys_io_uring_register(ring->fd, IORING_REGISTER_PROBE, probe, 256) == 0) {
+        static const int needed[] = { IORING_OP_STATX, IORING_OP_READ, IORING_OP_WRITE };
+        supported = 1;
+        for (int i = 0; i < 3; i++) {
+            if (needed[i] > probe->last_op || !(probe->ops[needed[i]].flags & IO_URING_OP_SUPPORTED)) {
+                supported = 0;
+            }
+        }
+    }
+    free(probe);
+    free_uring(ring);
+}
+
+int uring_supported(void) {
+    pthread_once(&probe_once, probe_uring);
+    return supported;
+}
+
+struct io_uring_sqe* uring_get_sqe(Uring *ring) {
+    unsigned head = __atomic_load_n(ring->sq_head, __ATOMIC_ACQUIRE);
+    if (ring->sq_local_tail - head >= ring->entries) return NULL;
+    unsigned index = ring->sq_local_tail & ring->sq_mask;
+    struct io_uring_sqe *sqe = &ring->sqes[index];
+    memset(sqe, 0, sizeof(*sqe));
+    ring->sq_array[index] = index;
+    ring->sq_local_tail++;
+    ring->queued++;
+    return sqe;
+}
+
+int uring_submit(Uring *ring, unsigned wait_for) {
+    // The entries must be visible before the kernel sees the new tail
+    __atomic_store_n(ring->sq_tail, ring->sq_local_tail, __ATOMIC_RELEASE);
+    for (;;) {
+        ring->enter_calls++;
+        int submitted = sys_io_uring_enter(ring->fd, ring->queued, wait_for,
+                                           wait_for > 0 ? IORING_ENTER_GETEVENTS : 0);
+        if (submitted >= 0) {
+            ring->queued -= (unsigned)submitted;
+            // Whatever is still queued must be waited on separately
+            if (ring->queued == 0 || wait_for == 0) return submitted;
+            continue;
+        }
+        if (errno != EINTR) return -1;
+    }
+}
+
+struct io_uring_cqe* uring_peek(Uring *ring) {
+    unsigned head = *ring->cq_head;
+    if (head == __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE)) return NULL;
+    return &ring->cqes[head & ring->cq_mask];
+}
+
+void uring_seen(Uring *ring) {
+    __atomic_store_n(ring->cq_head, *ring->cq_head + 1, __ATOMIC_RELEASE);
+}
+
+unsigned long long uring_enter_calls(const Uring *ring) {
+    return ring->enter_calls;
+}
+
+static void statx_to_stat(const struct statx *sx, struct stat *st) {
+    memset(st, 0, sizeof(*st));
+    st->st_dev = makedev(sx->stx_dev_major, sx->stx_dev_minor);
+    st->st_ino = sx->stx_ino;
+    st->st_mode = sx->stx_mode;
+    st->st_nlink = sx->stx_nlink;
+    st->st_uid = sx->stx_uid;
+    st->st_gid = sx->stx_gid;
+    st->st_rdev = makedev(sx->stx_rdev_major, sx->stx_rdev_minor);
+    st->st_size = (off_t)sx->stx_size;
+    st->st_blksize = sx->stx_blksize;
+    st->st_blocks = (blkcnt_t)sx->stx_blocks;
+    st->st_atim.tv_sec = sx->stx_atime.tv_sec;
+    st->st_atim.tv_nsec = sx->stx_atime.tv_nsec;
+    st->st_mtim.tv_sec = sx->stx_mtime.tv_sec;
+    st->st_mtim.tv_nsec = sx->stx_mtime.tv_nsec;
+    st->st_ctim.tv_sec = sx->stx_ctime.tv_sec;
+    st->st_ctim.tv_nsec = sx->stx_ctime.tv_nsec;
+}
+
+long uring_stat_names(Uring *ring, int directory, char *const *names, size_t count,
+                      struct stat *results, int *errors) {
+    struct statx *buffers = malloc(ring->entries * sizeof(struct statx));
+    if (buffers == NULL) {
+        errno = ENOMEM;
+        return -1;
+    }
+    unsigned long long calls = ring->enter_calls;
+    long result = -1;
+
+    // A batch fills the ring and is submitted and waited on with one call
+    for (size_t first = 0; first < count;) {
+        unsigned batch = 0;
+        struct io_uring_sqe *sqe;
+        while (first + batch < count && (sqe = uring_get_sqe(ring)) != NULL) {
+            sqe->opcode = IORING_OP_STATX;
+            sqe->fd = directory;
+            sqe->addr = (unsigned long)names[first + batch];
+            sqe->len = STATX_BASIC_STATS;
+            sqe->off = (unsigned long)&buffers[batch];
+            sqe->statx_flags = 0;           // follow links, like stat
+            sqe->user_data = batch;
+            batch++;
+        }
+        if (uring_submit(ring, batch) < 0) goto done;
+
+        for (unsigned done = 0; done < batch;) {
+            struct io_uring_cqe *cqe = uring_peek(ring);
+            if (cqe == NULL) {
+                if (uring_submit(ring, 1) < 0) {
+                    buffers = NULL;     // the kernel may still write to them
+                    goto done;
+                }
+                continue;
+            }
+            size_t index = first + cqe->user_data;
+            errors[index] = cqe->res < 0 ? -cqe->res : 0;
+            if (cqe->res >= 0) statx_to_stat(&buffers[cqe->user_data], &results[index]);
+            uring_seen(ring);
+            done++;
+        }
+        first += batch;
+    }
+    result = (long)(ring->enter_calls - calls);
+
+done:
+    free(buffers);
+    return result;
+}
@@ -0,0 +1,46 @@
+#ifndef URING_H
+#define URING_H
+
+// A small io_uring wrapper over the raw system calls, so there is no
+// dependency on liburing. Requests are queued in the shared submission
+// ring and handed to the kernel many at a time with one io_uring_enter,
+// which matters most where each request waits on the network.
+//
+// io_uring may be missing (kernels before 5.6), disabled or blocked by a
+// seccomp filter; uring_supported() says whether it can be used and
+// callers keep a synchronous path for when it cannot.
+
+#include <stddef.h>
+#include <sys/stat.h>
+#include <linux/io_uring.h>
+
+typedef struct Uring Uring;
+
+// True if rings can be created and support statx, read and write
+int uring_supported(void);
+
+// Returns NULL with errno set if io_uring is unavailable
+Uring* create_uring(unsigned entries);
+void free_uring(Uring *ring);
+
+// Next free submission entry, zeroed, or NULL if entries are all queued
+struct io_uring_sqe* uring_get_sqe(Uring *ring);
+
+// Submits queued entries and waits until at least wait_for completions
+// are available. Returns the number submitted, or -1 with errno set.
+int uring_submit(Uring *ring, unsigned wait_for);
+
+// Oldest unconsumed completion or NULL; uring_seen releases it
+struct io_uring_cqe* uring_peek(Uring *ring);
+void uring_seen(Uring *ring);
+
+// io_uring_enter calls made so far
+unsigned long long uring_enter_calls(const Uring *ring);
+
+// stat() of count names relative to directory, with up to a ring's worth
+// of statx requests in flight at a time. errors[i] is 0 or an errno.
+// Returns the io_uring_enter calls made, or -1 if the ring failed.
+long uring_stat_names(Uring *ring, int directory, char *const *names, size_t count,
+                      struct stat *results, int *errors);
+
+#endif
@@ -0,0 +1,313 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "viewer.h"
+
+#define STREAM_BUFFER (1 << 20)
+#define SPLICE_CHUNK (1 << 30)
+#define DEFAULT_PAGE_LINES 22
+
+static int write_all(const char *data, size_t length) {
+    while (length > 0) {
+        ssize_t written = write(STDOUT_FILENO, data, length);
+        if (written < 0) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        data += written;
+        length -= (size_t)written;
+    }
+    return 0;
+}
+
+int map_file(MappedFile *file, const char *path) {
+    memset(file, 0, sizeof(*file));
+    file->fd = open(path, O_RDONLY | O_CLOEXEC);
+    struct stat st;
+    if (file->fd < 0 || fstat(file->fd, &st) != 0) {
+        printf("Error: Cannot open file '%s'\n", path);
+        if (file->fd >= 0) close(file->fd);
+        return -1;
+    }
+    if (!S_ISREG(st.st_mode)) {
+        printf("Error: '%s' is not a regular file\n", path);
+        close(file->fd);
+        return -1;
+    }
+    file->size = (size_t)st.st_size;
+    if (file->size > 0) {
+        void *data = mmap(NULL, file->size, PROT_READ, MAP_PRIVATE, file->fd, 0);
+        if (data == MAP_FAILED) {
+            printf("Error: Cannot map file '%s': %s\n", path, strerror(errno));
+            close(file->fd);
+            return -1;
+        }
+        file->data = data;
+    }
+
+    file->checkpoints = malloc(64 * sizeof(size_t));
+    if (file->checkpoints == NULL) {
+        printf("Memory allocation failed!\n");
+        unmap_file(file);
+        return -1;
+    }
+    file->checkpoints[0] = 0;
+    file->checkpoint_count = 1;
+    file->checkpoint_capacity = 64;
+    return 0;
+}
+
+void unmap_file(MappedFile *file) {
+    if (file->data != NULL) munmap((void *)file->data, file->size);
+    if (file->fd >= 0) close(file->fd);
+    free(file->checkpoints);
+    memset(file, 0, sizeof(*file));
+    file->fd = -1;
+}
+
+static size_t next_line(const MappedFile *file, size_t offset) {
+    const char *newline = memchr(file->data + offset, '\n', file->size - offset);
+    return newline != NULL ? (size_t)(newline - file->data) + 1 : file->size;
+}
+
+// Start of the line before the one starting at offset
+static size_t previous_line(const MappedFile *file, size_t offset) {
+    if (offset == 0) return 0;
+    const char *newline = offset > 1 ? memrchr(file->data, '\n', offset - 1) : NULL;
+    return newline != NULL ? (size_t)(newline - file->data) + 1 : 0;
+}
+
+// Start of the last count lines; a final newline does not begin a line
+static size_t last_lines(const MappedFile *file, size_t count) {
+    size_t end = file->size;
+    if (end > 0 && file->data[end - 1] == '\n') end--;
+    for (size_t found = 0; found < count; found++) {
+        const char *newline = end > 0 ? memrchr(file->data, '\n', end) : NULL;
+        if (newline == NULL) return 0;
+        end = (size_t)(newline - file->data);
+    }
+    return end + 1;
+}
+
+static int index_complete(const MappedFile *file) {
+    return file->indexed_offset >= file->size;
+}
+
+static size_t total_lines(const MappedFile *file) {
+    return file->indexed_lines + (file->size > 0 && file->data[file->size - 1] != '\n');
+}
+
+size_t line_offset(MappedFile *file, size_t line) {
+    size_t checkpoint = line / LINE_INDEX_STRIDE;
+    while (file->checkpoint_count <= checkpoint && !index_complete(file)) {
+        file->indexed_offset = next_line(file, file->indexed_offset);
+        if (file->indexed_offset > 0 && file->data[file->indexed_offset - 1] == '\n') {
+            file->indexed_lines++;
+        }
+        if (file->indexed_lines % LINE_INDEX_STRIDE == 0 && file->indexed_offset < file->size &&
+            file->indexed_lines / LINE_INDEX_STRIDE == file->checkpoint_count) {
+            if (file->checkpoint_count == file->checkpoint_capacity) {
+                size_t capacity = file->checkpoint_capacity * 2;
+                size_t *grown = realloc(file->checkpoints, capacity * sizeof(size_t));
+                if (grown == NULL) break;
+                file->checkpoints = grown;
+                file->checkpoint_capacity = capacity;
+            }
+            file->checkpoints[file->checkpoint_count++] = file->indexed_offset;
+        }
+    }
+    if (checkpoint >= file->checkpoint_count) return file->size;
+
+    size_t offset = file->checkpoints[checkpoint];
+    for (size_t skip = line % LINE_INDEX_STRIDE; skip > 0 && offset < file->size; skip--) {
+        offset = next_line(file, offset);
+    }
+    return offset;
+}
+
+// Plain reads, for files that cannot be mapped such as those in /proc
+static void stream_file(int fd, const char *path) {
+    char *buffer = malloc(STREAM_BUFFER);
+    if (buffer == NULL) {
+        printf("Memory allocation failed!\n");
+        return;
+    }
+    ssize_t got;
+    while ((got = read(fd, buffer, STREAM_BUFFER)) != 0) {
+        if (got < 0) {
+            if (errno == EINTR) continue;
+            printf("Error: Cannot read file '%s'\n", path);
+            break;
+        }
+        if (write_all(buffer, (size_t)got) != 0) break;
+    }
+    free(buffer);
+}
+
+void cat_file(const char *path) {
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    struct stat file_stat, out_stat;
+    if (fd < 0 || fstat(fd, &file_stat) != 0) {
+        printf("Error: Cannot open file '%s'\n", path);
+        if (fd >= 0) close(fd);
+        return;
+    }
+    fflush(stdout);
+
+    // Into a pipe the data can move without being copied at all
+    if (S_ISREG(file_stat.st_mode) && fstat(STDOUT_FILENO, &out_stat) == 0 && S_ISFIFO(out_stat.st_mode)) {
+        loff_t offset = 0;
+        while (offset < file_stat.st_size) {
+            size_t length = file_stat.st_size - offset < SPLICE_CHUNK ?
+                            (size_t)(file_stat.st_size - offset) : SPLICE_CHUNK;
+            ssize_t moved = splice(fd, &offset, STDOUT_FILENO, NULL, length, SPLICE_F_MORE);
+            if (moved < 0 && errno == EINTR) continue;
+            if (moved <= 0) break;
+        }
+        if (offset >= file_stat.st_size) {
+            close(fd);
+            return;
+        }
+        lseek(fd, offset, SEEK_SET);        // the rest goes the ordinary way
+        if (offset > 0) {
+            stream_file(fd, path);
+            close(fd);
+            return;
+        }
+    }
+
+    void *data = MAP_FAILED;
+    if (S_ISREG(file_stat.st_mode) && file_stat.st_size > 0) {
+        data = mmap(NULL, (size_t)file_stat.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    }
+    if (data == MAP_FAILED) {
+        stream_file(fd, path);
+    } else {
+        madvise(data, (size_t)file_stat.st_size, MADV_SEQUENTIAL);
+        write_all(data, (size_t)file_stat.st_size);
+        munmap(data, (size_t)file_stat.st_size);
+    }
+    close(fd);
+}
+
+void head_file(const char *path, long lines) {
+    MappedFile file;
+    if (map_file(&file, path) != 0) return;
+    size_t end = 0;
+    for (long i = 0; i < lines && end < file.size; i++) {
+        end = next_line(&file, end);
+    }
+    fflush(stdout);
+    write_all(file.data, end);
+    unmap_file(&file);
+}
+
+void tail_file(const char *path, long lines) {
+    MappedFile file;
+    if (map_file(&file, path) != 0) return;
+    if (lines > 0 && file.size > 0) {
+        size_t start = last_lines(&file, (size_t)lines);
+        fflush(stdout);
+        write_all(file.data + start, file.size - start);
+    }
+    unmap_file(&file);
+}
+
+static int page_lines() {
+    struct winsize size;
+    if (ioctl(STDOUT_FILENO, TIOCGWINSZ, &size) == 0 && size.ws_row > 3) {
+        return size.ws_row - 2;
+    }
+    return DEFAULT_PAGE_LINES;
+}
+
+// Writes up to count lines from offset; returns the offset after them
+static size_t show_page(const MappedFile *file, size_t offset, int count, int *shown) {
+    size_t end = offset;
+    *shown = 0;
+    while (*shown < count && end < file->size) {
+        end = next_line(file, end);
+        (*shown)++;
+    }
+    fflush(stdout);
+    write_all(file->data + offset, end - offset);
+    if (end > offset && file->data[end - 1] != '\n') write_all("\n", 1);
+    return end;
+}
+
+void view_file(const char *path, FILE *input) {
+    MappedFile file;
+    if (map_file(&file, path) != 0) return;
+    if (file.size == 0) {
+        printf("(empty file)\n");
+        unmap_file(&file);
+        return;
+    }
+    madvise((void *)file.data, file.size, MADV_RANDOM);
+
+    int lines = page_lines();
+    size_t top = 0;
+    long top_line = 0;          // -1 when not known
+    char command[64];
+    for (;;) {
+        int shown;
+        size_t bottom = show_page(&file, top, lines, &shown);
+        int percent = (int)(bottom * 100.0 / file.size);
+        if (top_line >= 0) {
+            printf("-- %s lines %ld-%ld (%d%%) -- Enter: next, b: back, g N: line N, G: end, q: quit ",
+                   path, top_line + 1, top_line + shown, percent);
+        } else {
+            printf("-- %s (%d%%) -- Enter: next, b: back, g N: line N, G: end, q: quit ", path, percent);
+        }
+        fflush(stdout);
+        if (fgets(command, sizeof(command), input) == NULL) {
+            printf("\n");
+            break;
+        }
+        command[strcspn(command, "\n")] = 0;
+
+        if (strcmp(command, "q") == 0) {
+            break;
+        } else if (command[0] == '\0' || strcmp(command, "n") == 0) {
+            if (bottom < file.size) {
+                top = bottom;
+                if (top_line >= 0) top_line += shown;
+            }
+        } else if (strcmp(command, "b") == 0) {
+            for (int i = 0; i < lines && top > 0; i++) {
+                top = previous_line(&file, top);
+                if (top_line > 0) top_line--;
+            }
+            if (top == 0) top_line = 0;
+        } else if (command[0] == 'g' && (command[1] == ' ' || command[1] == '\0')) {
+            long line = atol(command + 1);
+            if (line < 1) {
+                printf("Error: Line number required\n");
+                continue;
+            }
+            size_t offset = line_offset(&file, (size_t)line - 1);
+            if (offset >= file.size) {
+                line_offset(&file, (size_t)-1);     // counts the rest
+                printf("Error: '%s' has only %zu lines\n", path, total_lines(&file));
+                continue;
+            }
+            top = offset;
+            top_line = line - 1;
+        } else if (strcmp(command, "G") == 0) {
+            top = last_lines(&file, (size_t)lines);
+            // Line numbers are known only once the index has reached the end
+            top_line = index_complete(&file) ? (long)total_lines(&file) - lines : -1;
+            if (top == 0) top_line = 0;
+        } else {
+            printf("Unknown command: %s\n", command);
+        }
+    }
+    unmap_file(&file);
+}
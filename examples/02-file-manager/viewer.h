@@ -0,0 +1,45 @@
+#ifndef VIEWER_H
+#define VIEWER_H
+
+// cat, head, tail and view over memory-mapped files.
+//
+// Nothing is read up front: the mapping is paged in only where the output
+// comes from, so opening a multi-gigabyte log costs the same as opening a
+// small one. Output goes to standard output with large write calls, bytes
+// as they are, NULs included. tail searches backward from the end of the
+// mapping. view finds lines by number through an index of every
+// LINE_INDEX_STRIDE-th line start, extended only as far as the furthest
+// line asked for.
+
+#include <stdio.h>
+#include <stddef.h>
+
+#define LINE_INDEX_STRIDE 1024
+
+typedef struct {
+    int fd;
+    const char *data;
+    size_t size;
+    size_t *checkpoints;            // start of lines 0, STRIDE, 2 * STRIDE, ...
+    size_t checkpoint_count;
+    size_t checkpoint_capacity;
+    size_t indexed_lines;           // newlines counted so far
+    size_t indexed_offset;          // counted up to here
+} MappedFile;
+
+// Prints an error and returns -1 if the file cannot be mapped
+int map_file(MappedFile *file, const char *path);
+void unmap_file(MappedFile *file);
+
+// Offset of the start of line (counting from 0), or file->size if the
+// file has fewer lines
+size_t line_offset(MappedFile *file, size_t line);
+
+void cat_file(const char *path);
+void head_file(const char *path, long lines);
+void tail_file(const char *path, long lines);
+
+// Pages through the file, reading commands from input
+void view_file(const char *path, FILE *input);
+
+#endif
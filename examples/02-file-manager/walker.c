@@ -0,0 +1,624 @@
+#define _DEFAULT_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <pthread.h>
+#include "walker.h"
+
+#define DEQUE_MIN_CAPACITY 64
+#define LINKS_MIN_CAPACITY 64
+
+// WALK_SORTED keeps every entry until the walk ends
+typedef struct {
+    size_t name_offset;         // into the directory's name arena, which moves as it grows
+    const char *name;           // set once the directory has been read
+    int index;                  // position when read; its stat in WalkDir.stats
+    unsigned char type;
+    struct WalkDir *child;      // directory to descend into, else NULL
+} WalkRecord;
+
+typedef struct WalkDir {
+    struct WalkDir *parent;
+    struct WalkDir *next_done;  // chains directories finished together
+    char *path;
+    const char *name;           // last component of path
+    int depth;                  // of the directory itself; the starting directory is -1
+    int has_stat;
+    struct stat stat;
+    int outstanding;            // its own read plus unfinished subdirectories (walk lock)
+    WalkTotals totals;          // (walk lock)
+    WalkRecord *records;        // WALK_SORTED
+    struct stat *stats;         // WALK_SORTED and WALK_STAT, parallel to records
+    int record_count;
+    int record_capacity;
+    char *names;
+    size_t names_length;
+    size_t names_capacity;
+} WalkDir;
+
+// Directories waiting to be read: the owner pushes and pops at the tail,
+// thieves take from the head
+typedef struct {
+    pthread_mutex_t lock;
+    WalkDir **tasks;            // ring buffer
+    size_t head;
+    size_t count;
+    size_t capacity;
+} Deque;
+
+typedef struct Walk Walk;
+
+typedef struct {
+    Walk *walk;
+    int id;
+    Deque deque;
+    WalkStats stats;
+    char *path;                 // entry paths are built here
+    size_t path_capacity;
+    unsigned int random_state;  // picks the first victim to steal from
+} Worker;
+
+typedef struct {
+    dev_t device;
+    ino_t inode;
+} LinkKey;
+
+struct Walk {
+    const WalkOptions *options;
+    int root_fd;
+    size_t relative_offset;     // where the part below the starting directory begins in a path
+    Worker *workers;
+    int worker_count;
+
+    pthread_mutex_t lock;       // everything below, plus WalkDir outstanding and totals
+    pthread_cond_t work;
+    long pending;               // directories queued or being read
+    unsigned long generation;   // bumped whenever directories are queued
+    int idle;
+
+    pthread_mutex_t links_lock; // files with several links, counted once
+    LinkKey *links;
+    size_t link_count;
+    size_t link_capacity;
+};
+
+void init_walk_options(WalkOptions *options) {
+    options->threads = 0;
+    options->max_depth = -1;
+    options->flags = 0;
+    options->visit = NULL;
+    options->leave = NULL;
+    options->arg = NULL;
+}
+
+int walk_thread_count(const WalkOptions *options) {
+    int threads = options->threads;
+    if (threads <= 0) {
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        threads = cpus > 0 ? (int)cpus : 1;
+    }
+    return threads > WALK_MAX_THREADS ? WALK_MAX_THREADS : threads;
+}
+
+// Deques
+
+static int push_task(Deque *deque, WalkDir *dir) {
+    pthread_mutex_lock(&deque->lock);
+    if (deque->count == deque->capacity) {
+        size_t capacity = deque->capacity ? deque->capacity * 2 : DEQUE_MIN_CAPACITY;
+        WalkDir **tasks = malloc(capacity * sizeof(WalkDir *));
+        if (tasks == NULL) {
+            pthread_mutex_unlock(&deque->lock);
+            return -1;
+        }
+        for (size_t i = 0; i < deque->count; i++) {
+            tasks[i] = deque->tasks[(deque->head + i) % deque->capacity];
+        }
+        free(deque->tasks);
+        deque->tasks = tasks;
+        deque->head = 0;
+        deque->capacity = capacity;
+    }
+    deque->tasks[(deque->head + deque->count) % deque->capacity] = dir;
+    deque->count++;
+    pthread_mutex_unlock(&deque->lock);
+    return 0;
+}
+
+static WalkDir* pop_newest(Deque *deque) {
+    WalkDir *dir = NULL;
+    pthread_mutex_lock(&deque->lock);
+    if (deque->count > 0) {
+        deque->count--;
+        dir = deque->tasks[(deque->head + deque->count) % deque->capacity];
+    }
+    pthread_mutex_unlock(&deque->lock);
+    return dir;
+}
+
+static WalkDir* take_oldest(Deque *deque) {
+    WalkDir *dir = NULL;
+    pthread_mutex_lock(&deque->lock);
+    if (deque->count > 0) {
+        dir = deque->tasks[deque->head];
+        deque->head = (deque->head + 1) % deque->capacity;
+        deque->count--;
+    }
+    pthread_mutex_unlock(&deque->lock);
+    return dir;
+}
+
+static WalkDir* steal(Walk *walk, Worker *self) {
+    self->random_state = self->random_state * 1103515245u + 12345u;
+    int first = (int)((self->random_state >> 8) % (unsigned int)walk->worker_count);
+    for (int i = 0; i < walk->worker_count; i++) {
+        Worker *victim = &walk->workers[(first + i) % walk->worker_count];
+        if (victim == self) continue;
+        WalkDir *dir = take_oldest(&victim->deque);
+        if (dir != NULL) return dir;
+    }
+    return NULL;
+}
+
+// Next directory to read, or NULL once every directory has been read
+static WalkDir* take_task(Walk *walk, Worker *self) {
+    for (;;) {
+        WalkDir *dir = pop_newest(&self->deque);
+        if (dir != NULL) return dir;
+
+        pthread_mutex_lock(&walk->lock);
+        unsigned long generation = walk->generation;
+        pthread_mutex_unlock(&walk->lock);
+
+        dir = steal(walk, self);
+        if (dir != NULL) return dir;
+
+        // Directories are queued under the walk lock, so an unchanged
+        // generation means there was nothing to steal
+        pthread_mutex_lock(&walk->lock);
+        if (walk->pending == 0) {
+            pthread_mutex_unlock(&walk->lock);
+            return NULL;
+        }
+        if (walk->generation == generation) {
+            walk->idle++;
+            pthread_cond_wait(&walk->work, &walk->lock);
+            walk->idle--;
+        }
+        pthread_mutex_unlock(&walk->lock);
+    }
+}
+
+// Hard links
+
+static size_t link_slot(const LinkKey *links, size_t capacity, dev_t device, ino_t inode) {
+    size_t mask = capacity - 1;
+    size_t slot = (size_t)(((unsigned long long)inode * 0x9E3779B97F4A7C15ULL) ^ device) & mask;
+    while (links[slot].inode != 0 && (links[slot].inode != inode || links[slot].device != device)) {
+        slot = (slot + 1) & mask;
+    }
+    return slot;
+}
+
+// True the first time a file is seen
+static int first_link(Walk *walk, const struct stat *st) {
+    int first = 1;
+    pthread_mutex_lock(&walk->links_lock);
+    if ((walk->link_count + 1) * 4 > walk->link_capacity * 3) {
+        size_t capacity = walk->link_capacity ? walk->link_capacity * 2 : LINKS_MIN_CAPACITY;
+        LinkKey *links = calloc(capacity, sizeof(LinkKey));
+        if (links == NULL) {
+            pthread_mutex_unlock(&walk->links_lock);
+            return 1;
+        }
+        for (size_t i = 0; i < walk->link_capacity; i++) {
+            if (walk->links[i].inode != 0) {
+                links[link_slot(links, capacity, walk->links[i].device, walk->links[i].inode)] = walk->links[i];
+            }
+        }
+        free(walk->links);
+        walk->links = links;
+        walk->link_capacity = capacity;
+    }
+    size_t slot = link_slot(walk->links, walk->link_capacity, st->st_dev, st->st_ino);
+    if (walk->links[slot].inode != 0) {
+        first = 0;
+    } else {
+        walk->links[slot].device = st->st_dev;
+        walk->links[slot].inode = st->st_ino;
+        walk->link_count++;
+    }
+    pthread_mutex_unlock(&walk->links_lock);
+    return first;
+}
+
+// Directories
+
+static unsigned char type_of(mode_t mode) {
+    if (S_ISREG(mode)) return DT_REG;
+    if (S_ISDIR(mode)) return DT_DIR;
+    if (S_ISLNK(mode)) return DT_LNK;
+    if (S_ISCHR(mode)) return DT_CHR;
+    if (S_ISBLK(mode)) return DT_BLK;
+    if (S_ISFIFO(mode)) return DT_FIFO;
+    return DT_SOCK;
+}
+
+// Joins a directory path and a name into the worker's path buffer
+static const char* join_path(Worker *self, const char *directory, const char *name) {
+    size_t directory_length = strlen(directory);
+    size_t name_length = strlen(name);
+    size_t needed = directory_length + name_length + 2;
+    if (needed > self->path_capacity) {
+        size_t capacity = self->path_capacity ? self->path_capacity : 256;
+        while (capacity < needed) capacity *= 2;
+        char *path = realloc(self->path, capacity);
+        if (path == NULL) return NULL;
+        self->path = path;
+        self->path_capacity = capacity;
+    }
+    memcpy(self->path, directory, directory_length);
+    // "/" already ends in a separator
+    if (directory_length == 0 || directory[directory_length - 1] != '/') {
+        self->path[directory_length++] = '/';
+    }
+    memcpy(self->path + directory_length, name, name_length + 1);
+    return self->path;
+}
+
+static WalkDir* create_dir(WalkDir *parent, const char *path, size_t name_offset, int depth) {
+    WalkDir *dir = calloc(1, sizeof(WalkDir));
+    if (dir == NULL) return NULL;
+    dir->path = strdup(path);
+    if (dir->path == NULL) {
+        free(dir);
+        return NULL;
+    }
+    dir->parent = parent;
+    dir->name = dir->path + name_offset;
+    dir->depth = depth;
+    dir->outstanding = 1;
+    dir->totals.directories = 1;
+    return dir;
+}
+
+static void free_dir(WalkDir *dir) {
+    for (int i = 0; i < dir->record_count; i++) {
+        if (dir->records[i].child != NULL) free_dir(dir->records[i].child);
+    }
+    free(dir->records);
+    free(dir->stats);
+    free(dir->names);
+    free(dir->path);
+    free(dir);
+}
+
+static int add_record(WalkDir *dir, const char *name, unsigned char type, const struct stat *st) {
+    size_t length = strlen(name) + 1;
+    if (dir->record_count == dir->record_capacity) {
+        int capacity = dir->record_capacity ? dir->record_capacity * 2 : 16;
+        WalkRecord *records = realloc(dir->records, capacity * sizeof(WalkRecord));
+        if (records == NULL) return -1;
+        dir->records = records;
+        if (st != NULL || dir->stats != NULL) {
+            struct stat *stats = realloc(dir->stats, capacity * sizeof(struct stat));
+            if (stats == NULL) return -1;
+            dir->stats = stats;
+        }
+        dir->record_capacity = capacity;
+    }
+    if (dir->names_length + length > dir->names_capacity) {
+        size_t capacity = dir->names_capacity ? dir->names_capacity * 2 : 512;
+        while (capacity < dir->names_length + length) capacity *= 2;
+        char *names = realloc(dir->names, capacity);
+        if (names == NULL) return -1;
+        dir->names = names;
+        dir->names_capacity = capacity;
+    }
+    memcpy(dir->names + dir->names_length, name, length);
+
+    WalkRecord *record = &dir->records[dir->record_count];
+    record->name_offset = dir->names_length;
+    record->index = dir->record_count;
+    record->type = type;
+    record->child = NULL;
+    if (st != NULL) dir->stats[dir->record_count] = *st;
+    dir->names_length += length;
+    dir->record_count++;
+    return 0;
+}
+
+static int compare_records(const void *a, const void *b) {
+    return strcmp(((const WalkRecord *)a)->name, ((const WalkRecord *)b)->name);
+}
+
+static void add_totals(WalkTotals *to, const WalkTotals *from) {
+    to->bytes += from->bytes;
+    to->files += from->files;
+    to->directories += from->directories;
+}
+
+static void leave_directory(Walk *walk, Worker *self, const WalkDir *dir) {
+    const WalkOptions *options = walk->options;
+    if (options->leave == NULL) return;
+    WalkEntry entry = { dir->path, dir->name, dir->depth, DT_DIR, dir->has_stat ? &dir->stat : NULL, self->id };
+    options->leave(&entry, &dir->totals, options->arg);
+}
+
+// Reads one directory, reports or records its entries, and queues the
+// subdirectories to descend into
+static void read_directory(Walk *walk, Worker *self, WalkDir *dir) {
+    const WalkOptions *options = walk->options;
+    int sorted = options->flags & WALK_SORTED;
+    int want_stat = options->flags & WALK_STAT;
+    int descend_depth = options->max_depth < 0 || dir->depth + 2 <= options->max_depth;
+    WalkTotals local = { 0, 0, 0 };
+    WalkDir **children = NULL;
+    size_t child_count = 0, child_capacity = 0;
+
+    int fd = dir->parent == NULL ? dup(walk->root_fd)
+                                 : openat(walk->root_fd, dir->path + walk->relative_offset,
+                                          O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+    DIR *handle = fd >= 0 ? fdopendir(fd) : NULL;
+    if (handle == NULL) {
+        if (fd >= 0) close(fd);
+        self->stats.errors++;
+        goto publish;
+    }
+    self->stats.directories++;
+
+    struct dirent *entry;
+    while ((entry = readdir(handle)) != NULL) {
+        const char *name = entry->d_name;
+        if (name[0] == '.' && (name[1] == '\0' || (name[1] == '.' && name[2] == '\0'))) continue;
+
+        unsigned char type = entry->d_type;
+        struct stat st;
+        if (want_stat || type == DT_UNKNOWN) {
+            self->stats.stat_calls++;
+            if (fstatat(fd, name, &st, AT_SYMLINK_NOFOLLOW) != 0) continue;     // removed since readdir
+            type = type_of(st.st_mode);
+        }
+        self->stats.entries++;
+
+        WalkTotals own = { 0, type == DT_DIR ? 0 : 1, type == DT_DIR ? 1 : 0 };
+        if (want_stat && (type == DT_DIR || st.st_nlink < 2 || first_link(walk, &st))) {
+            own.bytes = (unsigned long long)st.st_blocks * 512;
+        }
+
+        int descend = type == DT_DIR && descend_depth;
+        if (sorted) {
+            if (add_record(dir, name, type, want_stat ? &st : NULL) != 0) {
+                printf("Memory allocation failed!\n");
+                break;
+            }
+        } else if (options->visit != NULL) {
+            const char *path = join_path(self, dir->path, name);
+            if (path == NULL) {
+                printf("Memory allocation failed!\n");
+                break;
+            }
+            WalkEntry visited = { path, path + strlen(path) - strlen(name), dir->depth + 1, type,
+                                  want_stat ? &st : NULL, self->id };
+            if (options->visit(&visited, options->arg) == WALK_SKIP) descend = 0;
+        }
+
+        WalkDir *child = NULL;
+        if (descend && child_count == child_capacity) {
+            size_t capacity = child_capacity ? child_capacity * 2 : 16;
+            WalkDir **grown = realloc(children, capacity * sizeof(WalkDir *));
+            if (grown != NULL) {
+                children = grown;
+                child_capacity = capacity;
+            }
+        }
+        if (descend && child_count < child_capacity) {
+            const char *path = join_path(self, dir->path, name);
+            child = path ? create_dir(dir, path, strlen(path) - strlen(name), dir->depth + 1) : NULL;
+        }
+        if (child != NULL) {
+            child->totals.bytes = own.bytes;
+            if (want_stat) {
+                child->has_stat = 1;
+                child->stat = st;
+            }
+            children[child_count++] = child;
+            if (sorted) dir->records[dir->record_count - 1].child = child;
+        } else {
+            if (descend) printf("Memory allocation failed!\n");
+            add_totals(&local, &own);
+        }
+    }
+    closedir(handle);
+
+    if (sorted) {
+        for (int i = 0; i < dir->record_count; i++) {
+            dir->records[i].name = dir->names + dir->records[i].name_offset;
+        }
+        if (dir->record_count > 1) {
+            qsort(dir->records, dir->record_count, sizeof(WalkRecord), compare_records);
+        }
+    }
+
+publish:;
+    // Counts change and children are queued in one step, so a thief that
+    // finishes a child at once cannot see this directory as done
+    WalkDir *done = NULL, **last_done = &done;
+    pthread_mutex_lock(&walk->lock);
+    for (size_t i = child_count; i-- > 0;) {
+        if (push_task(&self->deque, children[i]) != 0) {
+            printf("Memory allocation failed!\n");
+            add_totals(&local, &children[i]->totals);
+            if (sorted) {
+                for (int r = 0; r < dir->record_count; r++) {
+                    if (dir->records[r].child == children[i]) dir->records[r].child = NULL;
+                }
+            }
+            free_dir(children[i]);
+            children[i] = children[--child_count];
+        }
+    }
+    add_totals(&dir->totals, &local);
+    dir->outstanding += (int)child_count - 1;
+    walk->pending += (long)child_count - 1;
+    if (child_count > 0) {
+        walk->generation++;
+        if (walk->idle > 0) pthread_cond_broadcast(&walk->work);
+    }
+    if (walk->pending == 0) pthread_cond_broadcast(&walk->work);
+
+    // Finished directories pass their totals up
+    for (WalkDir *d = dir; d != NULL && d->outstanding == 0; d = d->parent) {
+        *last_done = d;
+        last_done = &d->next_done;
+        if (d->parent != NULL) {
+            add_totals(&d->parent->totals, &d->totals);
+            d->parent->outstanding--;
+        }
+    }
+    pthread_mutex_unlock(&walk->lock);
+    free(children);
+
+    // Without WALK_SORTED a finished directory is reported and forgotten
+    if (!sorted) {
+        while (done != NULL) {
+            WalkDir *next = done->next_done;
+            leave_directory(walk, self, done);
+            free_dir(done);
+            done = next;
+        }
+    }
+}
+
+static void* walk_worker(void *arg) {
+    Worker *self = arg;
+    WalkDir *dir;
+    while ((dir = take_task(self->walk, self)) != NULL) {
+        read_directory(self->walk, self, dir);
+    }
+    return NULL;
+}
+
+// WALK_SORTED: reports the recorded tree in order once it is complete
+static void replay(Walk *walk, Worker *self, WalkDir *dir) {
+    const WalkOptions *options = walk->options;
+    for (int i = 0; i < dir->record_count; i++) {
+        const WalkRecord *record = &dir->records[i];
+        int result = WALK_CONTINUE;
+        if (options->visit != NULL) {
+            const char *path = join_path(self, dir->path, record->name);
+            if (path == NULL) {
+                printf("Memory allocation failed!\n");
+                return;
+            }
+            const struct stat *st = dir->stats ? &dir->stats[record->index] : NULL;
+            WalkEntry entry = { path, path + strlen(path) - strlen(record->name), dir->depth + 1, record->type,
+                                st, 0 };
+            result = options->visit(&entry, options->arg);
+        }
+        if (record->child != NULL && result == WALK_CONTINUE) {
+            replay(walk, self, record->child);
+        }
+    }
+    leave_directory(walk, self, dir);
+}
+
+int walk_tree(const char *root, const WalkOptions *options, WalkStats *stats) {
+    Walk walk;
+    memset(&walk, 0, sizeof(walk));
+    walk.options = options;
+    walk.root_fd = open(root, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (walk.root_fd < 0) return -1;
+
+    // Paths below "a/b/" read "a/b/c", below "/" read "/c"
+    size_t root_length = strlen(root);
+    while (root_length > 1 && root[root_length - 1] == '/') root_length--;
+    char *root_path = strndup(root, root_length);
+    WalkDir *top = root_path ? create_dir(NULL, root_path, 0, -1) : NULL;
+    free(root_path);
+    if (top == NULL) {
+        printf("Memory allocation failed!\n");
+        close(walk.root_fd);
+        return -1;
+    }
+    walk.relative_offset = strcmp(top->path, "/") == 0 ? 1 : root_length + 1;
+
+    int threads = walk_thread_count(options);
+    walk.workers = calloc(threads, sizeof(Worker));
+    pthread_t *handles = malloc(threads * sizeof(pthread_t));
+    if (walk.workers == NULL || handles == NULL) {
+        printf("Memory allocation failed!\n");
+        free(walk.workers);
+        free(handles);
+        free_dir(top);
+        close(walk.root_fd);
+        return -1;
+    }
+    walk.worker_count = threads;
+    pthread_mutex_init(&walk.lock, NULL);
+    pthread_mutex_init(&walk.links_lock, NULL);
+    pthread_cond_init(&walk.work, NULL);
+    for (int i = 0; i < threads; i++) {
+        walk.workers[i].walk = &walk;
+        walk.workers[i].id = i;
+        walk.workers[i].random_state = 2166136261u + i;
+        pthread_mutex_init(&walk.workers[i].deque.lock, NULL);
+    }
+
+    if (options->flags & WALK_STAT) {
+        walk.workers[0].stats.stat_calls++;
+        if (fstat(walk.root_fd, &top->stat) == 0) {
+            top->has_stat = 1;
+            top->totals.bytes = (unsigned long long)top->stat.st_blocks * 512;
+        }
+    }
+    walk.pending = 1;
+    int started = push_task(&walk.workers[0].deque, top) == 0 ? 0 : -1;
+    if (started == 0) {
+        while (started < threads && pthread_create(&handles[started], NULL, walk_worker, &walk.workers[started]) == 0) {
+            started++;
+        }
+        if (started == 0) {
+            // No threads available: walk on this thread
+            walk_worker(&walk.workers[0]);
+        }
+        for (int i = 0; i < started; i++) {
+            pthread_join(handles[i], NULL);
+        }
+        if (options->flags & WALK_SORTED) {
+            replay(&walk, &walk.workers[0], top);
+            free_dir(top);
+        }
+    } else {
+        printf("Memory allocation failed!\n");
+        free_dir(top);
+    }
+
+    if (stats != NULL) {
+        memset(stats, 0, sizeof(*stats));
+        stats->threads = started > 0 ? started : 1;
+    }
+    for (int i = 0; i < threads; i++) {
+        Worker *worker = &walk.workers[i];
+        if (stats != NULL) {
+            stats->directories += worker->stats.directories;
+            stats->entries += worker->stats.entries;
+            stats->stat_calls += worker->stats.stat_calls;
+            stats->errors += worker->stats.errors;
+        }
+        pthread_mutex_destroy(&worker->deque.lock);
+        free(worker->deque.tasks);
+        free(worker->path);
+    }
+    pthread_mutex_destroy(&walk.lock);
+    pthread_mutex_destroy(&walk.links_lock);
+    pthread_cond_destroy(&walk.work);
+    free(walk.links);
+    free(walk.workers);
+    free(handles);
+    close(walk.root_fd);
+    return 0;
+}
@@ -0,0 +1,76 @@
+#ifndef WALKER_H
+#define WALKER_H
+
+// Parallel recursive directory traversal shared by find, tree and du.
+//
+// Each worker thread owns a deque of directories still to be read. It
+// takes the newest directory from its own deque (depth first, so the
+// directories it just saw are still warm) and, when that runs dry, steals
+// the oldest directory from another worker (breadth first, so a thief
+// gets a large subtree). Directories are opened with openat() relative to
+// the starting directory, entries are examined with fstatat() relative to
+// the directory being read, and d_type from readdir() means an entry is
+// only stat'ed when the caller needs its metadata or the filesystem does
+// not report a type. Symbolic links are reported, never followed.
+
+#include <sys/stat.h>
+
+#define WALK_MAX_THREADS 64
+
+// Flags
+#define WALK_STAT       0x1     // stat every entry; fills WalkEntry.stat and WalkTotals.bytes
+#define WALK_SORTED     0x2     // visit in name order, depth first, on the calling thread
+
+// Visitor results
+#define WALK_CONTINUE   0
+#define WALK_SKIP       1       // for a directory: do not descend into it
+
+typedef struct {
+    const char *path;           // starting directory joined with the entry's relative path
+    const char *name;           // last component of path
+    int depth;                  // 0 for entries of the starting directory (which is -1)
+    unsigned char type;         // DT_REG, DT_DIR, DT_LNK, ...; never DT_UNKNOWN
+    const struct stat *stat;    // with WALK_STAT, else NULL
+    int worker;                 // calling thread, 0 .. threads - 1; always 0 with WALK_SORTED
+} WalkEntry;
+
+// Everything in a directory's subtree, the directory included
+typedef struct {
+    unsigned long long bytes;       // allocated size (st_blocks), each hard-linked file once
+    unsigned long long files;       // entries other than directories
+    unsigned long long directories;
+} WalkTotals;
+
+// Without WALK_SORTED both callbacks run on the worker threads, several at
+// a time; WalkEntry.worker indexes per-thread state.
+typedef int (*WalkVisit)(const WalkEntry *entry, void *arg);
+typedef void (*WalkLeave)(const WalkEntry *directory, const WalkTotals *totals, void *arg);
+
+typedef struct {
+    int threads;                // <= 0: one per online CPU, at most WALK_MAX_THREADS
+    int max_depth;              // deepest entry depth reported; < 0: unlimited
+    int flags;
+    WalkVisit visit;            // called for every entry; may be NULL
+    WalkLeave leave;            // called once a directory's whole subtree is done,
+                                // the starting directory last; may be NULL
+    void *arg;
+} WalkOptions;
+
+typedef struct {
+    unsigned long long directories;     // directories read
+    unsigned long long entries;         // entries reported
+    unsigned long long stat_calls;      // fstatat() calls
+    unsigned long long errors;          // directories that could not be read
+    int threads;                        // threads that took part
+} WalkStats;
+
+void init_walk_options(WalkOptions *options);
+// Resolves options->threads the way walk_tree will
+int walk_thread_count(const WalkOptions *options);
+
+// Returns 0, or -1 if root is not a readable directory. With WALK_SORTED
+// the tree's entries are kept in memory until the walk ends, and a
+// directory skipped by the visitor has already been read.
+int walk_tree(const char *root, const WalkOptions *options, WalkStats *stats);
+
+#endif